@@ -1642,6 +1642,10 @@ ST_FUNC void asm_gen_code(ASMOperand *operands, int nb_operands,
     static const uint8_t reg_saved[] = { 3, 6, 7 };
 #endif
 
+#if defined TCC_TARGET_X86_64 && !defined TCC_TARGET_PE
+    /* asm may push registers and refer to locals via %rbp */
+    gen_need_frame();
+#endif
     /* mark all used registers */
     memcpy(regs_allocated, clobber_regs, sizeof(regs_allocated));
     for(i = 0; i < nb_operands;i++) {
@@ -79,6 +79,17 @@ enum {
    at caller side (for interfacing with non-TCC compilers) */
 #define PROMOTE_RET
 
+/* define if gen_opi() implements TOK_UMULH and TOK_SMULH */
+#define HAVE_MULH
+
+/* __atomic_xxx() builtins of this size are expanded inline */
+#define TCC_TARGET_NATIVE_ATOMIC(size) ((size) <= 4)
+ST_FUNC int gen_atomic(int atok, int size, int memorder);
+
+/* __builtin_prefetch() emits prefetchnta/t2/t1/t0 */
+#define TCC_TARGET_PREFETCH
+ST_FUNC void gen_prefetch(int locality);
+
 /******************************************************/
 #else /* ! TARGET_DEFS_ONLY */
 /******************************************************/
@@ -378,6 +389,40 @@ static void gcall_or_jmp(int is_jmp)
 
 static const uint8_t fastcall_regs[3] = { TREG_EAX, TREG_EDX, TREG_ECX };
 static const uint8_t fastcallw_regs[2] = { TREG_ECX, TREG_EDX };
+static const uint8_t fastcall_rc[3] = { RC_EAX, RC_EDX, RC_ECX };
+
+/* With -O1, static functions with one to three int or pointer
+   parameters have a private entry point at 'sym + 4 * n' which takes
+   them in %eax, %edx and %ecx.  'sym' itself is a stub that loads them
+   from the stack, so that the address of the function (used by
+   function pointers, aliases, asm ...) still follows the ABI.  Returns
+   n, or 0 for normal functions.  Calls use the private entry only when
+   the body is compiled here (sym->a.hasbody): a static declaration may
+   also be an alias for code compiled elsewhere. */
+static int func_private_regs(Sym *sym)
+{
+    Sym *s = sym->type.ref;
+    int n = 0, bt;
+
+    if (!tcc_state->optimize
+#ifdef CONFIG_TCC_BCHECK
+        || tcc_state->do_bounds_check
+#endif
+        || !(sym->type.t & VT_STATIC)
+        || (sym->type.t & VT_BTYPE) != VT_FUNC
+        || sym->asm_label
+        || s->f.func_call != FUNC_CDECL
+        || s->f.func_type != FUNC_NEW
+        || (s->type.t & VT_BTYPE) == VT_STRUCT)
+        return 0;
+    while ((s = s->next) != NULL) {
+        bt = s->type.t & VT_BTYPE;
+        if (++n > 3 || (bt != VT_INT && bt != VT_PTR && bt != VT_SHORT
+                        && bt != VT_BYTE && bt != VT_BOOL))
+            return 0;
+    }
+    return n;
+}
 
 /* Return the number of registers needed to return the struct, or 0 if
    returning via struct pointer. */
@@ -414,12 +459,30 @@ ST_FUNC void gfunc_call(int nb_args)
 {
     int size, align, r, args_size, i, func_call;
     Sym *func_sym;
+    SValue *sv;
     
 #ifdef CONFIG_TCC_BCHECK
     if (tcc_state->do_bounds_check)
         gbound_args(nb_args);
 #endif
 
+    sv = vtop - nb_args;
+    if ((sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == (VT_CONST | VT_SYM)
+        && sv->type.ref == sv->sym->type.ref && sv->sym->a.hasbody
+        && nb_args == func_private_regs(sv->sym) && nb_args) {
+        /* private entry: load the arguments, last one first */
+        for (i = nb_args; i > 0; i--) {
+            vrotb(nb_args - i + 1);
+            gv(fastcall_rc[i - 1]);
+        }
+        save_regs(nb_args);
+        vtop -= nb_args;
+        vtop->c.i += 4 * nb_args;
+        gcall_or_jmp(0);
+        vtop--;
+        return;
+    }
+
     args_size = 0;
     for(i = 0;i < nb_args; i++) {
         if ((vtop->type.t & VT_BTYPE) == VT_STRUCT) {
@@ -534,7 +597,15 @@ ST_FUNC void gfunc_prolog(Sym *func_sym)
     loc = 0;
     func_vc = 0;
 
-    if (func_call >= FUNC_FASTCALL1 && func_call <= FUNC_FASTCALL3) {
+    if ((fastcall_nb_regs = func_private_regs(func_sym)) != 0) {
+        /* the stub for callers that follow the ABI */
+        for (param_index = 0; param_index < fastcall_nb_regs; param_index++) {
+            o(0x448b + (fastcall_regs[param_index] << 11)); /* mov n(%esp),r */
+            g(0x24);
+            g(4 + 4 * param_index);
+        }
+        fastcall_regs_ptr = fastcall_regs;
+    } else if (func_call >= FUNC_FASTCALL1 && func_call <= FUNC_FASTCALL3) {
         fastcall_nb_regs = func_call - FUNC_FASTCALL1 + 1;
         fastcall_regs_ptr = fastcall_regs;
     } else if (func_call == FUNC_FASTCALLW) {
@@ -801,6 +872,8 @@ ST_FUNC void gen_opi(int op)
     case '%':
     case TOK_UMOD:
     case TOK_UMULL:
+    case TOK_UMULH:
+    case TOK_SMULH:
         /* first operand must be in eax */
         /* XXX: need better constraint for second operand */
         gv2(RC_EAX, RC_ECX);
@@ -815,6 +888,10 @@ ST_FUNC void gen_opi(int op)
             o(0xe0 + fr);
             vtop->r2 = TREG_EDX;
             r = TREG_EAX;
+        } else if (op == TOK_UMULH || op == TOK_SMULH) {
+            o(0xf7); /* mul/imul fr */
+            o((op == TOK_UMULH ? 0xe0 : 0xe8) + fr);
+            r = TREG_EDX;
         } else {
             if (op == TOK_UDIV || op == TOK_UMOD) {
                 o(0xf7d231); /* xor %edx, %edx, div fr, %eax */
@@ -1139,6 +1216,138 @@ ST_FUNC void gen_vla_alloc(CType *type, int align) {
     }
 }
 
+/* 'size' bytes form of instruction 'op' (the opcode of the byte form,
+   op + 1 being the wider one) with register 'r' and memory at '(b)' */
+static void gen_atomic_insn(int op, int size, int r, int b)
+{
+    if (size == 2)
+        g(0x66);
+    if (op > 0xff)
+        g(op >> 8);
+    g(op + (size != 1));
+    g(r << 3 | b);
+}
+
+/* inline expansion of __atomic_xxx().  The value stack holds the
+   pointer to the atomic object and the other arguments of the builtin
+   without the memory orders.  Returns the register with the result.
+   Locked instructions are full barriers, so 'memorder' only matters
+   for stores.  %ebx is not allocated by tcc and is saved around its
+   use as a scratch register. */
+ST_FUNC int gen_atomic(int atok, int size, int memorder)
+{
+    int r = TREG_ECX, op = 0, t;
+
+    switch (atok) {
+    case TOK___atomic_load:
+        r = gv(RC_INT);
+        gen_atomic_insn(0x8a, size, r, r); /* mov (r),r */
+        vpop();
+        break;
+    case TOK___atomic_compare_exchange:
+        /* eax: expected value, ebx: its address, ecx: desired */
+        vswap();
+        gv(RC_EAX);
+        vrott(3);
+        gv2(RC_EDX, RC_ECX);
+        vrotb(3); /* again if a bounds check call spilled it */
+        gv(RC_EAX);
+        vrott(3);
+        o(0xc38953); /* push %ebx; mov %eax,%ebx */
+        gen_atomic_insn(0x8a, size, TREG_EAX, TREG_EBX);
+        g(0xf0);
+        gen_atomic_insn(0x0fb0, size, TREG_ECX, TREG_EDX); /* lock cmpxchg */
+        g(0x74); /* je, else store the current value */
+        g(2 + (size == 2));
+        gen_atomic_insn(0x88, size, TREG_EAX, TREG_EBX);
+        g(0x5b); /* pop %ebx */
+        o(0xc0940f); /* sete %al */
+        o(0xc0b60f); /* movzbl %al,%eax */
+        vtop -= 3;
+        return TREG_EAX;
+    default:
+        gv2(RC_EDX, RC_ECX);
+        vtop -= 2;
+        switch (atok) {
+        case TOK___atomic_store:
+            if (memorder == 5)
+                gen_atomic_insn(0x86, size, r, TREG_EDX); /* xchg */
+            else
+                gen_atomic_insn(0x88, size, r, TREG_EDX); /* mov */
+            return VT_CONST;
+        case TOK___atomic_exchange:
+            gen_atomic_insn(0x86, size, r, TREG_EDX);
+            break;
+        case TOK___atomic_fetch_sub:
+        case TOK___atomic_sub_fetch:
+            o(0xd9f7); /* neg %ecx */
+            /* fall through */
+        case TOK___atomic_fetch_add:
+        case TOK___atomic_add_fetch:
+            t = atok == TOK___atomic_add_fetch || atok == TOK___atomic_sub_fetch;
+            get_reg(RC_EAX);
+            if (t)
+                o(0xc889); /* mov %ecx,%eax */
+            g(0xf0);
+            gen_atomic_insn(0x0fc0, size, r, TREG_EDX); /* lock xadd */
+            if (t)
+                o(0xc101); /* add %eax,%ecx */
+            break;
+        default:
+            /* cmpxchg loop for the other operations */
+            switch (atok) {
+            case TOK___atomic_fetch_or:
+            case TOK___atomic_or_fetch:
+                op = 0x09;
+                break;
+            case TOK___atomic_fetch_xor:
+            case TOK___atomic_xor_fetch:
+                op = 0x31;
+                break;
+            default:
+                op = 0x21;
+                break;
+            }
+            get_reg(RC_EAX);
+            g(0x53); /* push %ebx */
+            gen_atomic_insn(0x8a, size, TREG_EAX, TREG_EDX);
+            t = ind;
+            o(0xc389); /* mov %eax,%ebx */
+            g(op);
+            g(0xcb); /* op %ecx,%ebx */
+            if (atok == TOK___atomic_fetch_nand
+                || atok == TOK___atomic_nand_fetch)
+                o(0xd3f7); /* not %ebx */
+            g(0xf0);
+            gen_atomic_insn(0x0fb0, size, TREG_EBX, TREG_EDX);
+            g(0x75); /* jne */
+            g(t - ind - 1);
+            if (atok >= TOK___atomic_add_fetch)
+                o(0xd989); /* mov %ebx,%ecx */
+            else
+                r = TREG_EAX;
+            g(0x5b); /* pop %ebx */
+            break;
+        }
+        break;
+    }
+    if (size < 4) {
+        o(0xb60f + ((size == 2) << 8)); /* movz[bw]l r,r */
+        g(0xc0 + r * 9);
+    }
+    return r;
+}
+
+/* prefetch the address on vtop into the cache levels for 'locality'
+   (0: prefetchnta ... 3: prefetcht0) */
+ST_FUNC void gen_prefetch(int locality)
+{
+    int r = gv(RC_INT);
+    o(0x180f);
+    gen_modrm((4 - locality) & 3, r, NULL, 0);
+    vpop();
+}
+
 /* end of X86 code generator */
 /*************************************************************/
 #endif
@@ -329,5 +329,8 @@
     __BUILTIN_EXTERN(popcount, unsigned)
     __BUILTIN_EXTERN(parity, unsigned)
     #undef __BUILTIN_EXTERN
+    unsigned short __builtin_bswap16(unsigned short);
+    unsigned int __builtin_bswap32(unsigned int);
+    unsigned long long __builtin_bswap64(unsigned long long);
 
     #endif /* ndef __TCC_PP__ */
@@ -16,6 +16,7 @@
  * __builtin_popcount
  * __builtin_parity
  * for int, long and long long
+ * __builtin_bswap16, __builtin_bswap32, __builtin_bswap64
  */
 
 static const unsigned char table_1_32[] = {
@@ -132,6 +133,20 @@ int BUILTIN(parityl) (unsigned long x) __attribute__((alias(BUILTINN(parity))));
 int BUILTIN(parityl) (unsigned long x) __attribute__((alias(BUILTINN(parityll))));
 #endif
 
+/* Returns x with the order of the bytes reversed. */
+unsigned short BUILTIN(bswap16) (unsigned short x) { return x << 8 | x >> 8; }
+unsigned int BUILTIN(bswap32) (unsigned int x)
+{
+    x = (x & 0x00ff00ff) << 8 | (x >> 8 & 0x00ff00ff);
+    return x << 16 | x >> 16;
+}
+unsigned long long BUILTIN(bswap64) (unsigned long long x)
+{
+    x = (x & 0x00ff00ff00ff00ffull) << 8 | (x >> 8 & 0x00ff00ff00ff00ffull);
+    x = (x & 0x0000ffff0000ffffull) << 16 | (x >> 16 & 0x0000ffff0000ffffull);
+    return x << 32 | x >> 32;
+}
+
 #ifndef __TINYC__
 #if defined(__GNUC__) && (__GNUC__ >= 6)
 /* gcc overrides alias from __builtin_ffs... to ffs.. so use assembly code */
@@ -161,4 +176,7 @@ int __builtin_popcountll(unsigned long long x) __attribute__((alias("__tcc_built
 int __builtin_parity(unsigned int x) __attribute__((alias("__tcc_builtin_parity")));
 int __builtin_parityl(unsigned long x) __attribute__((alias("__tcc_builtin_parityl")));
 int __builtin_parityll(unsigned long long x) __attribute__((alias("__tcc_builtin_parityll")));
+unsigned short __builtin_bswap16(unsigned short x) __attribute__((alias("__tcc_builtin_bswap16")));
+unsigned int __builtin_bswap32(unsigned int x) __attribute__((alias("__tcc_builtin_bswap32")));
+unsigned long long __builtin_bswap64(unsigned long long x) __attribute__((alias("__tcc_builtin_bswap64")));
 #endif
@@ -25,6 +25,7 @@
 #if !defined ONE_SOURCE || ONE_SOURCE
 #include "tccpp.c"
 #include "tccgen.c"
+#include "tccir.c"
 #include "tccdbg.c"
 #include "tccasm.c"
 #include "tccelf.c"
@@ -1001,6 +1002,37 @@ static int tcc_glob_so(TCCState *s1, const char *pattern, char *buf, int size)
 }
 #endif
 
+/* map the binary input file so that the loaders can read it in place,
+   without copies or system calls.  Returns the previous mapping. */
+static MappedFile tcc_map_file(TCCState *s1, int fd)
+{
+    MappedFile prev = s1->map;
+    s1->map.data = NULL;
+    s1->map.fd = fd;
+#ifndef _WIN32
+    {
+        long size = lseek(fd, 0, SEEK_END);
+        void *p;
+        if (size > 0) {
+            p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+                s1->map.data = p, s1->map.size = size;
+        }
+        lseek(fd, 0, SEEK_SET);
+    }
+#endif
+    return prev;
+}
+
+static void tcc_unmap_file(TCCState *s1, MappedFile prev)
+{
+#ifndef _WIN32
+    if (s1->map.data)
+        munmap((void *)s1->map.data, s1->map.size);
+#endif
+    s1->map = prev;
+}
+
 ST_FUNC int tcc_add_file_internal(TCCState *s1, const char *filename, int flags)
 {
     int fd, ret = -1;
@@ -1028,9 +1060,14 @@ ST_FUNC int tcc_add_file_internal(TCCState *s1, const char *filename, int flags)
     if (flags & AFF_TYPE_BIN) {
         ElfW(Ehdr) ehdr;
         int obj_type;
+        MappedFile prev_map = tcc_map_file(s1, fd);
 
         obj_type = tcc_object_type(fd, &ehdr);
         lseek(fd, 0, SEEK_SET);
+#if CONFIG_TCC_INCREMENTAL
+        if (s1->incremental)
+            tcc_inc_add_file(s1, filename, fd, obj_type);
+#endif
 
         switch (obj_type) {
 
@@ -1110,10 +1147,15 @@ check_success:
             break;
 #endif
         }
+        tcc_unmap_file(s1, prev_map);
         close(fd);
     } else {
         /* update target deps */
         dynarray_add(&s1->target_deps, &s1->nb_target_deps, tcc_strdup(filename));
+#if CONFIG_TCC_INCREMENTAL
+        if (s1->incremental)
+            tcc_inc_add_file(s1, filename, fd, -1);
+#endif
         ret = tcc_compile(s1, flags, filename, fd);
     }
     s1->current_filename = NULL;
@@ -1347,6 +1389,19 @@ static void copy_linker_arg(char **pp, const char *s, int sep)
     pstrncpy(l + (*pp = tcc_realloc(p, q - s + l + 1)), s, q - s);
 }
 
+/* hash of the command line, so that -Wl,--incremental can see whether
+   the options changed since the last link */
+static unsigned hash_arg(unsigned h, const char *r)
+{
+    /* -v, -vv... do not change the output */
+    if (r[0] == '-' && r[1] == 'v' && r[1 + strspn(r + 1, "v")] == 0)
+        return h;
+    do
+        h = h * 31 + (unsigned char)*r;
+    while (*r++);
+    return h;
+}
+
 static void args_parser_add_file(TCCState *s, const char* filename, int filetype)
 {
     struct filespec *f = tcc_malloc(sizeof *f + strlen(filename));
@@ -1464,6 +1519,25 @@ static int tcc_set_linker(TCCState *s, const char *option)
         } else if (link_option(option, "single_module", &p)) {
             ignoring = 1;
 #endif
+        } else if (ret = link_option(option, "?gc-sections", &p), ret) {
+            s->gc_sections = ret > 0;
+        } else if (link_option(option, "threads=", &p)) {
+            s->nb_threads = strtoul(p, &end, 10);
+        } else if (link_option(option, "no-threads", &p)) {
+            s->nb_threads = 1;
+        } else if (ret = link_option(option, "?incremental", &p), ret) {
+            s->incremental = ret > 0;
+        } else if (ret = link_option(option, "?relax", &p), ret) {
+            s->no_relax = ret < 0;
+        } else if (link_option(option, "icf=", &p)) {
+            if (!strcmp(p, "all"))
+                s->icf = 1;
+            else if (!strcmp(p, "safe"))
+                s->icf = 2;
+            else if (!strcmp(p, "none"))
+                s->icf = 0;
+            else
+                goto err;
         } else if (ret = link_option(option, "?whole-archive", &p), ret) {
             if (ret > 0)
                 s->filetype |= AFF_WHOLE_ARCHIVE;
@@ -1669,6 +1743,11 @@ static const FlagDef options_f[] = {
     { offsetof(TCCState, ms_extensions), 0, "ms-extensions" },
     { offsetof(TCCState, dollars_in_identifiers), 0, "dollars-in-identifiers" },
     { offsetof(TCCState, test_coverage), 0, "test-coverage" },
+    { offsetof(TCCState, omit_frame_pointer), 0, "omit-frame-pointer" },
+    { offsetof(TCCState, inline_functions), 0, "inline-functions" },
+    { offsetof(TCCState, optimize_sibling_calls), 0, "optimize-sibling-calls" },
+    { offsetof(TCCState, function_sections), 0, "function-sections" },
+    { offsetof(TCCState, data_sections), 0, "data-sections" },
     { 0, 0, NULL }
 };
 
@@ -1676,6 +1755,9 @@ static const FlagDef options_m[] = {
     { offsetof(TCCState, ms_bitfields), 0, "ms-bitfields" },
 #ifdef TCC_TARGET_X86_64
     { offsetof(TCCState, nosse), FD_INVERT, "sse" },
+    { offsetof(TCCState, mpopcnt), 0, "popcnt" },
+    { offsetof(TCCState, mlzcnt), 0, "lzcnt" },
+    { offsetof(TCCState, mbmi), 0, "bmi" },
 #endif
     { 0, 0, NULL }
 };
@@ -1845,6 +1927,7 @@ PUB_FUNC int tcc_parse_args(TCCState *s, int *pargc, char ***pargv, int optind)
             continue;
         }
         optind++;
+        s->args_hash = hash_arg(s->args_hash, r);
         if (tool) {
             if (r[0] == '-' && r[1] == 'v' && r[2] == 0)
                 ++s->verbose;
@@ -2036,6 +2119,12 @@ dorun:
             break;
 #endif
         case TCC_OPTION_m:
+#ifdef TCC_TARGET_RISCV64
+            if (!strncmp(optarg, "arch=", 5)) {
+                s->mzbb = strstr(optarg, "zbb") != NULL;
+                break;
+            }
+#endif
             if (set_flag(s, options_m, optarg) < 0) {
                 if (x = atoi(optarg), x != 32 && x != 64)
                     goto unsupported_option;
@@ -30,6 +30,21 @@
 
 #define CHAR_IS_UNSIGNED
 
+/* define if gen_opl() implements TOK_UMULH and TOK_SMULH */
+#define HAVE_MULH
+
+/* __atomic_xxx() builtins of this size are expanded inline */
+#define TCC_TARGET_NATIVE_ATOMIC(size) ((size) >= 4)
+ST_FUNC int gen_atomic(int atok, int size, int memorder);
+
+/* __builtin_clz() and friends are expanded inline with Zbb */
+#define TCC_TARGET_BITOP(op) (tcc_state->mzbb)
+ST_FUNC int gen_bitop(int op, int size);
+
+/* thread-local variables, addressed from tp */
+#define TCC_TARGET_TLS
+ST_FUNC void gen_tls_addr(int model);
+
 #else
 #define USING_GLOBALS
 #include "tcc.h"
@@ -1126,6 +1141,12 @@ static void gen_opil(int op, int ll)
     case '*':
         ER(0x33 | ll, 0, d, a, b, 1); // mul d, a, b
         break;
+    case TOK_SMULH: /* 64 bit only */
+        ER(0x33, 1, d, a, b, 1); // mulh d, a, b
+        break;
+    case TOK_UMULH:
+        ER(0x33, 3, d, a, b, 1); // mulhu d, a, b
+        break;
     case '/':
         ER(0x33 | ll, 4, d, a, b, 1); // div d, a, b
         break;
@@ -1444,4 +1465,201 @@ ST_FUNC void gen_vla_alloc(CType *type, int align)
     }
 #endif
 }
+// bOP rs1, rs2, off  with a short 'off'
+static void gen_bcond(int func3, int rs1, int rs2, int off)
+{
+    o(0x63 | func3 << 12 | rs1 << 15 | rs2 << 20
+      | ((off >> 11) & 1) << 7 | ((off >> 1) & 15) << 8
+      | ((off >> 5) & 63) << 25 | ((off >> 12) & 1) << 31);
+}
+
+// Inline expansion of __atomic_xxx() with AMO and LR/SC instructions.
+// The value stack holds the pointer to the atomic object and the other
+// arguments without the memory orders.  Returns the result register.
+ST_FUNC int gen_atomic(int atok, int size, int memorder)
+{
+    int f3 = size == 8 ? 3 : 2, ll = size == 8 ? 0 : 8;
+    int aqrl, p, v, e, op;
+
+    // aq for acquire, rl for release, both for acq_rel and seq_cst
+    aqrl = memorder == 3 ? 1 : memorder >= 4 ? 3 : memorder ? 2 : 0;
+    switch (atok) {
+    case TOK___atomic_load:
+        p = ireg(gv(RC_INT));
+        if (memorder == 5)
+            o(0x0330000f); // fence rw,rw
+        EI(0x03, f3, p, p, 0); // l[wd] P, 0(P)
+        if (memorder)
+            o(0x0230000f); // fence r,rw
+        p = vtop->r;
+        vpop();
+        return p;
+    case TOK___atomic_compare_exchange:
+        vswap();
+        gv(RC_R(2));
+        vrott(3);
+        gv2(RC_R(0), RC_R(1));
+        vrotb(3); // again if a bounds check call spilled it
+        e = ireg(gv(RC_R(2)));
+        vrott(3);
+        p = ireg(TREG_R(0));
+        v = ireg(TREG_R(1));
+        EI(0x03, f3, 5, e, 0);                      // l[wd] t0, 0(E)
+        ER(0x2f, f3, 6, p, 0, 2 << 2 | (aqrl == 3 ? 3 : aqrl & 2));
+                                                    // lr t1, (P)
+        gen_bcond(1, 6, 5, 12);                     // bne t1, t0, 1f
+        ER(0x2f, f3, 7, p, v, 3 << 2 | (aqrl & 1)); // sc t2, V, (P)
+        gen_bcond(1, 7, 0, -12);                    // bnez t2, lr
+        ER(0x33, 0, 7, 6, 5, 0x20);                 // 1: sub t2, t1, t0
+        gen_bcond(0, 7, 0, 8);                      // beqz t2, 2f
+        ES(0x23, f3, e, 6, 0);                      // s[wd] t1, 0(E)
+        EI(0x13, 3, v, 7, 1);                       // 2: seqz V, t2
+        vtop -= 3;
+        return TREG_R(1);
+    }
+    gv2(RC_R(0), RC_R(1));
+    vtop -= 2;
+    p = ireg(TREG_R(0));
+    v = ireg(TREG_R(1));
+    switch (atok) {
+    case TOK___atomic_store:
+        if (memorder)
+            o(0x0310000f); // fence rw,w
+        ES(0x23, f3, p, v, 0); // s[wd] V, 0(P)
+        return VT_CONST;
+    case TOK___atomic_exchange:
+        ER(0x2f, f3, v, p, v, 1 << 2 | aqrl); // amoswap V, V, (P)
+        return TREG_R(1);
+    case TOK___atomic_fetch_nand:
+    case TOK___atomic_nand_fetch:
+        ER(0x2f, f3, 5, p, 0, 2 << 2 | (aqrl == 3 ? 3 : aqrl & 2));
+                                                    // lr t0, (P)
+        ER(0x33, 7, 6, 5, v, 0);                    // and t1, t0, V
+        EI(0x13, 4, 6, 6, -1);                      // not t1, t1
+        ER(0x2f, f3, 7, p, 6, 3 << 2 | (aqrl & 1)); // sc t2, t1, (P)
+        gen_bcond(1, 7, 0, -16);                    // bnez t2, lr
+        EI(0x13, 0, v, atok == TOK___atomic_fetch_nand ? 5 : 6, 0);
+                                                    // mv V, t0/t1
+        return TREG_R(1);
+    case TOK___atomic_fetch_sub:
+    case TOK___atomic_sub_fetch:
+        ER(0x33, 0, v, 0, v, 0x20); // neg V, V
+        /* fall through */
+    case TOK___atomic_fetch_add:
+    case TOK___atomic_add_fetch:
+        op = 0x00;
+        break;
+    case TOK___atomic_fetch_or:
+    case TOK___atomic_or_fetch:
+        op = 0x08;
+        break;
+    case TOK___atomic_fetch_xor:
+    case TOK___atomic_xor_fetch:
+        op = 0x04;
+        break;
+    default:
+        op = 0x0c;
+        break;
+    }
+    if (atok < TOK___atomic_add_fetch) {
+        ER(0x2f, f3, v, p, v, op << 2 | aqrl); // amo<op> V, V, (P)
+    } else {
+        ER(0x2f, f3, 5, p, v, op << 2 | aqrl); // amo<op> t0, V, (P)
+        if (op == 0x00)
+            ER(0x33 | ll, 0, v, 5, v, 0); // add[w] V, t0, V
+        else
+            ER(0x33, op == 0x08 ? 6 : op == 0x04 ? 4 : 7, v, 5, v, 0);
+                                          // or/xor/and V, t0, V
+    }
+    return TREG_R(1);
+}
+
+// Inline expansion of __builtin_'op'() with the Zbb instructions, 'op'
+// being the int form or TOK_builtin_bswap16.  The operand of 'size'
+// bytes is on vtop.  Returns the result register.
+ST_FUNC int gen_bitop(int op, int size)
+{
+    int w = size == 8 ? 0x13 : 0x1b, bits = size * 8, r, x;
+
+    r = gv(RC_INT);
+    x = ireg(r);
+    vpop();
+    switch (op) {
+    case TOK_builtin_bswap16:
+        EIu(0x13, 5, x, x, 0x6b8);                  // rev8 X, X
+        if (size < 8)                               // sra[il] X, X, 64-BITS
+            EI(0x13, 5, x, x, (size == 4) << 10 | (64 - bits));
+        break;
+    case TOK_builtin_ffs:
+        EIu(w, 1, x, x, 0x601);                     // ctz[w] X, X
+        EI(0x13, 0, x, x, 1);                       // addi X, X, 1
+        EI(0x13, 3, 5, x, bits + 1);                // sltiu t0, X, BITS+1
+        ER(0x33, 0, 5, 0, 5, 0x20);                 // neg t0, t0
+        ER(0x33, 7, x, x, 5, 0);                    // and X, X, t0
+        break;
+    case TOK_builtin_clrsb:
+        EI(w, 5, 5, x, 0x400 | (bits - 1));         // srai[w] t0, X, BITS-1
+        ER(0x33, 4, x, x, 5, 0);                    // xor X, X, t0
+        EIu(w, 1, x, x, 0x600);                     // clz[w] X, X
+        EI(0x13, 0, x, x, -1);                      // addi X, X, -1
+        break;
+    case TOK_builtin_clz:
+        EIu(w, 1, x, x, 0x600);                     // clz[w] X, X
+        break;
+    case TOK_builtin_ctz:
+        EIu(w, 1, x, x, 0x601);                     // ctz[w] X, X
+        break;
+    default:
+        EIu(w, 1, x, x, 0x602);                     // cpop[w] X, X
+        if (op == TOK_builtin_parity)
+            EI(0x13, 7, x, x, 1);                   // andi X, X, 1
+        break;
+    }
+    return r;
+}
+
+// Compute the address of the thread-local variable vtop->sym into a
+// register, with the access model from gen_tls().
+ST_FUNC void gen_tls_addr(int model)
+{
+    Sym *sym = vtop->sym, label = {0};
+    int r, rr;
+
+    if (model == TLS_LE) {
+        r = get_reg(RC_INT);
+        rr = ireg(r);
+        greloca(cur_text_section, sym, ind, R_RISCV_TPREL_HI20, 0);
+        o(0x37 | (rr << 7));            // lui RR, %tprel_hi(sym)
+        greloca(cur_text_section, sym, ind, R_RISCV_TPREL_ADD, 0);
+        ER(0x33, 0, rr, rr, 4, 0);      // add RR, RR, tp, %tprel_add(sym)
+        greloca(cur_text_section, sym, ind, R_RISCV_TPREL_LO12_I, 0);
+        EI(0x13, 0, rr, rr, 0);         // addi RR, RR, %tprel_lo(sym)
+    } else {
+        if (model == TLS_GD) {
+            save_regs(0);
+            r = TREG_R(0);
+        } else {
+            r = get_reg(RC_INT);
+        }
+        rr = ireg(r);
+        greloca(cur_text_section, sym, ind, model == TLS_GD
+                ? R_RISCV_TLS_GD_HI20 : R_RISCV_TLS_GOT_HI20, 0);
+        label.type.t = VT_VOID | VT_STATIC;
+        if (!nocode_wanted)
+            put_extern_sym(&label, cur_text_section, ind, 0);
+        o(0x17 | (rr << 7));            // auipc RR, %tls_[gd|ie]_pcrel_hi(sym)
+        greloca(cur_text_section, &label, ind, R_RISCV_PCREL_LO12_I, 0);
+        if (model == TLS_GD) {
+            EI(0x13, 0, rr, rr, 0);     // addi a0, a0, %pcrel_lo(label)
+            greloca(cur_text_section, external_helper_sym(TOK___tls_get_addr),
+                    ind, R_RISCV_CALL_PLT, 0);
+            o(0x17 | (1 << 7));         // auipc ra, 0 %call(__tls_get_addr)
+            EI(0x67, 0, 1, 1, 0);       // jalr ra, 0(ra)
+        } else {
+            EI(0x03, 3, rr, rr, 0);     // ld RR, %pcrel_lo(label)(RR)
+            ER(0x33, 0, rr, rr, 4, 0);  // add RR, RR, tp
+        }
+    }
+    vtop->r = r;
+}
 #endif
@@ -11,12 +11,22 @@
 
 #define R_NUM      R_RISCV_NUM
 
+/* dynamic relocations of TLS GOT entries */
+#define R_TPOFF    R_RISCV_TLS_TPREL64
+#define R_DTPMOD   R_RISCV_TLS_DTPMOD64
+#define R_DTPOFF   R_RISCV_TLS_DTPREL64
+/* __tls_get_addr() adds this to the offsets in the TLS GOT entries */
+#define TLS_DTV_OFFSET 0x800
+
 #define ELF_START_ADDR 0x00010000
 #define ELF_PAGE_SIZE 0x1000
 
 #define PCRELATIVE_DLLPLT 1
 #define RELOCATE_DLLPLT 1
 
+/* sections are shrunk where R_RISCV_RELAX allows (relax_sections()) */
+#define LINK_RELAX
+
 #else /* !TARGET_DEFS_ONLY */
 
 //#define DEBUG_RELOC
@@ -51,6 +61,16 @@ int code_reloc (int reloc_type)
     case R_RISCV_SUB64:
     case R_RISCV_32:
     case R_RISCV_64:
+    case R_RISCV_TLS_GOT_HI20:
+    case R_RISCV_TLS_GD_HI20:
+    case R_RISCV_TPREL_HI20:
+    case R_RISCV_TPREL_LO12_I:
+    case R_RISCV_TPREL_LO12_S:
+    case R_RISCV_TPREL_ADD:
+    case R_RISCV_TLS_DTPREL32:
+    case R_RISCV_TLS_DTPREL64:
+    case R_RISCV_GPREL_I:
+    case R_RISCV_GPREL_S:
         return 0;
 
     case R_RISCV_CALL_PLT:
@@ -77,6 +97,14 @@ int gotplt_entry_type (int reloc_type)
     case R_RISCV_ADD16:
     case R_RISCV_SUB8:
     case R_RISCV_SUB16:
+    case R_RISCV_TPREL_HI20:
+    case R_RISCV_TPREL_LO12_I:
+    case R_RISCV_TPREL_LO12_S:
+    case R_RISCV_TPREL_ADD:
+    case R_RISCV_TLS_DTPREL32:
+    case R_RISCV_TLS_DTPREL64:
+    case R_RISCV_GPREL_I:
+    case R_RISCV_GPREL_S:
         return NO_GOTPLT_ENTRY;
 
     case R_RISCV_BRANCH:
@@ -97,6 +125,11 @@ int gotplt_entry_type (int reloc_type)
 
     case R_RISCV_GOT_HI20:
         return ALWAYS_GOTPLT_ENTRY;
+
+    case R_RISCV_TLS_GOT_HI20:
+        return TLS_IE_ENTRY;
+    case R_RISCV_TLS_GD_HI20:
+        return TLS_GD_ENTRY;
     }
     return -1;
 }
@@ -169,6 +202,368 @@ ST_FUNC void relocate_plt(TCCState *s1)
     }
 }
 
+/* offset of 'val' from the thread pointer, which points to the start
+   of the TLS block of the executable */
+static addr_t tls_tpoff(TCCState *s1, addr_t val)
+{
+    addr_t size;
+    return val - get_tls_block(s1, &size, NULL);
+}
+
+/* offset of 'val' in the TLS block of its module, minus the bias */
+static addr_t tls_dtpoff(TCCState *s1, addr_t val)
+{
+    addr_t size;
+    return val - get_tls_block(s1, &size, NULL) - TLS_DTV_OFFSET;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Linker relaxation.  Where the assembler marked a sequence with
+   R_RISCV_RELAX, shrink
+       auipc ra,%hi(f); jalr ra,%lo(f)(ra)        ->  jal ra,f
+   when 'f' is in the same section and within reach, and
+       auipc a0,%pcrel_hi(x); addi a0,a0,%pcrel_lo(1b)  ->  addi a0,gp,%gprel(x)
+   (and the same for loads and stores) in executables when 'x' is within
+   2KB of __global_pointer$ in its section.  Then trim the nops before
+   each R_RISCV_ALIGN to what the alignment still needs, which is done
+   even with -Wl,--no-relax since the assembler put the most nops the
+   alignment could take.
+
+   This runs before the layout, when only distances within one section
+   are known.  Removing bytes only brings them closer, except that the
+   code of each file keeps the alignment it started with, which may
+   give back up to the section alignment. */
+
+/* 'size' bytes are removed at 'offset', or if size < 0, inserted at
+   'offset' + 1 */
+typedef struct RelaxDel {
+    addr_t offset;
+    long size, before; /* 'before': total removed by the previous ones */
+} RelaxDel;
+
+typedef struct RelaxHi {
+    addr_t offset; /* of the removed auipc */
+    int sym_index;
+    addr_t addend;
+} RelaxHi;
+
+typedef struct Relax {
+    RelaxDel *dels;
+    int nb_dels;
+    long total;
+    RelaxHi *his;
+    int nb_his;
+} Relax;
+
+static void relax_del(Relax *r, addr_t offset, long size)
+{
+    RelaxDel *d;
+    if ((r->nb_dels & (r->nb_dels - 1)) == 0)
+        r->dels = tcc_realloc(r->dels, (r->nb_dels ? 2 * r->nb_dels : 1)
+                                       * sizeof *d);
+    d = &r->dels[r->nb_dels++];
+    d->offset = offset, d->size = size, d->before = r->total;
+    r->total += size;
+}
+
+/* new offset of 'x' */
+static addr_t relax_map(Relax *r, addr_t x)
+{
+    int lo = 0, hi = r->nb_dels, m;
+    RelaxDel *d;
+    while (lo < hi) {
+        m = (lo + hi) >> 1;
+        if (r->dels[m].offset < x)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    if (lo == 0)
+        return x;
+    d = &r->dels[lo - 1];
+    if (d->size > 0 && x - d->offset < (addr_t)d->size)
+        return x - d->before - (x - d->offset);
+    return x - d->before - d->size;
+}
+
+static int relax_removed(Relax *r, addr_t x)
+{
+    return relax_map(r, x) == relax_map(r, x + 1);
+}
+
+static int relax_rel_cmp(const void *a, const void *b)
+{
+    const ElfW_Rel *x = *(const ElfW_Rel **)a, *y = *(const ElfW_Rel **)b;
+    if (x->r_offset != y->r_offset)
+        return x->r_offset < y->r_offset ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
+
+static int relax_hi_find(Relax *r, addr_t offset)
+{
+    int lo = 0, hi = r->nb_his, m;
+    while (lo < hi) {
+        m = (lo + hi) >> 1;
+        if (r->his[m].offset == offset)
+            return m;
+        if (r->his[m].offset < offset)
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    return -1;
+}
+
+/* the offsets where the code of each file starts in 's' */
+static int relax_parts(TCCState *s1, Section *s, addr_t **pparts)
+{
+    addr_t *parts, *pc = s1->code_pieces;
+    int i, n = 0;
+
+    parts = tcc_malloc((s1->nb_code_pieces + 1) * sizeof *parts);
+    for (i = 0; i < s1->nb_code_pieces; i++)
+        if (pc[2 * i] == s->sh_num && pc[2 * i + 1])
+            parts[n++] = pc[2 * i + 1];
+    *pparts = parts;
+    return n;
+}
+
+static int relax_addr_cmp(const void *a, const void *b)
+{
+    addr_t x = *(const addr_t *)a, y = *(const addr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* choose what to remove from section 's' */
+static void relax_scan(TCCState *s1, Section *s, Relax *r,
+                       ElfW_Rel **rels, int n, int rewrite,
+                       int gp_shndx, addr_t gp)
+{
+    ElfW_Rel *rel;
+    ElfW(Sym) *sym;
+    addr_t off, tgt, *parts, align, need, j;
+    long dist, margin = s->sh_addralign;
+    int i, k, nb_parts, type, relax, sym_index;
+    uint32_t insn;
+
+    nb_parts = relax_parts(s1, s, &parts);
+    qsort(parts, nb_parts, sizeof *parts, relax_addr_cmp);
+    for (i = k = 0; i <= n; i++) {
+        off = i < n ? rels[i]->r_offset : s->data_offset;
+        /* keep the parts aligned as they were */
+        for (; k < nb_parts && parts[k] <= off; k++) {
+            align = parts[k] & -parts[k];
+            if (align > margin)
+                align = margin;
+            need = r->total & (align - 1);
+            if (need)
+                relax_del(r, parts[k] - 1, -(long)need);
+        }
+        if (i == n)
+            break;
+        rel = rels[i];
+        type = ELFW(R_TYPE)(rel->r_info);
+        sym_index = ELFW(R_SYM)(rel->r_info);
+        sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
+        relax = rewrite && i + 1 < n && rels[i + 1]->r_offset == off
+            && ELFW(R_TYPE)(rels[i + 1]->r_info) == R_RISCV_RELAX;
+        switch (type) {
+        case R_RISCV_CALL:
+        case R_RISCV_CALL_PLT:
+            if (!relax || sym->st_shndx != s->sh_num
+                || ELFW(ST_TYPE)(sym->st_info) == STT_GNU_IFUNC
+                || off + 8 > s->data_offset)
+                break;
+            insn = read32le(s->data + off + 4);
+            if ((insn & 0x707f) != 0x67) /* jalr */
+                break;
+            tgt = sym->st_value + rel->r_addend;
+            dist = relax_map(r, tgt) - relax_map(r, off);
+            if (dist + margin >= (1 << 20) || dist - margin < -(1 << 20))
+                break;
+            write32le(s->data + off, 0x6f | (insn & 0xf80)); /* jal rd */
+            rel->r_info = ELFW(R_INFO)(sym_index, R_RISCV_JAL);
+            relax_del(r, off + 4, 4);
+            break;
+        case R_RISCV_PCREL_HI20:
+            if (!relax || !gp_shndx || sym->st_shndx != gp_shndx
+                || ELFW(ST_TYPE)(sym->st_info) == STT_TLS)
+                break;
+            insn = read32le(s->data + off);
+            if ((insn & 0x7f) != 0x17 || !(insn & 0xf80)) /* auipc rd */
+                break;
+            tgt = sym->st_value + rel->r_addend - gp;
+            if ((tgt + 0x800) >> 12)
+                break;
+            if ((r->nb_his & (r->nb_his - 1)) == 0)
+                r->his = tcc_realloc(r->his, (r->nb_his ? 2 * r->nb_his : 1)
+                                             * sizeof *r->his);
+            r->his[r->nb_his].offset = off;
+            r->his[r->nb_his].sym_index = sym_index;
+            r->his[r->nb_his++].addend = rel->r_addend;
+            relax_del(r, off, 4);
+            break;
+        case R_RISCV_ALIGN:
+            /* the assembler put 'addend' bytes of nops for the worst case */
+            for (align = 2; align <= rel->r_addend; align <<= 1)
+                ;
+            need = -relax_map(r, off) & (align - 1);
+            if (need > rel->r_addend || off + rel->r_addend > s->data_offset)
+                break;
+            for (j = 0; j + 4 <= need; j += 4)
+                write32le(s->data + off + j, 0x13); /* nop */
+            if (need & 2)
+                write16le(s->data + off + j, 0x1); /* c.nop */
+            if (rel->r_addend > need)
+                relax_del(r, off + need, rel->r_addend - need);
+            rel->r_addend = need;
+            if (s->sh_addralign < align)
+                s->sh_addralign = align;
+            break;
+        }
+    }
+    tcc_free(parts);
+}
+
+/* make the accesses through the removed auipc's use gp */
+static void relax_lo12(TCCState *s1, Section *s, Relax *r)
+{
+    ElfW_Rel *rel;
+    ElfW(Sym) *sym;
+    int type, h;
+
+    for_each_elem(s->reloc, 0, rel, ElfW_Rel) {
+        type = ELFW(R_TYPE)(rel->r_info);
+        if (type != R_RISCV_PCREL_LO12_I && type != R_RISCV_PCREL_LO12_S)
+            continue;
+        sym = &((ElfW(Sym) *)symtab_section->data)[ELFW(R_SYM)(rel->r_info)];
+        if (sym->st_shndx != s->sh_num
+            || (h = relax_hi_find(r, sym->st_value + rel->r_addend)) < 0)
+            continue;
+        write32le(s->data + rel->r_offset,
+                  (read32le(s->data + rel->r_offset) & ~0xf8000) | 3 << 15);
+        rel->r_info = ELFW(R_INFO)(r->his[h].sym_index,
+            type == R_RISCV_PCREL_LO12_I ? R_RISCV_GPREL_I : R_RISCV_GPREL_S);
+        rel->r_addend = r->his[h].addend;
+    }
+}
+
+/* remove the bytes from 's' and move what refers to them */
+static void relax_apply(TCCState *s1, Section *s, Relax *r)
+{
+    ElfW_Rel *rel, *q;
+    ElfW(Sym) *sym;
+    Section *sr;
+    unsigned char *data;
+    addr_t from, to, end;
+    int i;
+
+    /* section symbol + addend */
+    for (i = 1; i < s1->nb_sections; i++) {
+        sr = s1->sections[i];
+        if (sr->sh_type != SHT_RELX || sr->link != symtab_section)
+            continue;
+        for_each_elem(sr, 0, rel, ElfW_Rel) {
+            sym = &((ElfW(Sym) *)symtab_section->data)[ELFW(R_SYM)(rel->r_info)];
+            if (sym->st_shndx == s->sh_num
+                && ELFW(ST_TYPE)(sym->st_info) == STT_SECTION)
+                rel->r_addend = relax_map(r, sym->st_value + rel->r_addend)
+                    - relax_map(r, sym->st_value);
+        }
+    }
+    for (i = 0; i < s1->nb_code_pieces; i++)
+        if (s1->code_pieces[2 * i] == s->sh_num)
+            s1->code_pieces[2 * i + 1] =
+                relax_map(r, s1->code_pieces[2 * i + 1]);
+    for_each_elem(symtab_section, 1, sym, ElfW(Sym)) {
+        if (sym->st_shndx != s->sh_num)
+            continue;
+        end = relax_map(r, sym->st_value + sym->st_size);
+        sym->st_value = relax_map(r, sym->st_value);
+        sym->st_size = end - sym->st_value;
+    }
+    /* relocations of removed instructions go */
+    q = (ElfW_Rel *)s->reloc->data;
+    for_each_elem(s->reloc, 0, rel, ElfW_Rel) {
+        if (relax_removed(r, rel->r_offset))
+            continue;
+        *q = *rel;
+        q++->r_offset = relax_map(r, rel->r_offset);
+    }
+    s->reloc->data_offset = (unsigned char *)q - s->reloc->data;
+
+    data = tcc_mallocz(s->data_offset - r->total + 1);
+    for (from = to = i = 0; i <= r->nb_dels; i++) {
+        end = i < r->nb_dels ? r->dels[i].offset : s->data_offset;
+        if (i < r->nb_dels && r->dels[i].size < 0)
+            ++end;
+        memcpy(data + to, s->data + from, end - from);
+        to += end - from, from = end;
+        if (i == r->nb_dels)
+            break;
+        if (r->dels[i].size > 0)
+            from += r->dels[i].size;
+        else
+            to -= r->dels[i].size; /* zeros */
+    }
+    tcc_free(s->data);
+    s->data = data;
+    s->data_allocated = s->data_offset = to;
+}
+
+ST_FUNC void relax_sections(TCCState *s1)
+{
+    Section *s;
+    ElfW_Rel *rel, **rels;
+    ElfW(Sym) *sym;
+    Relax r;
+    int i, n, gp_index, gp_shndx = 0, rewrite;
+    addr_t gp = 0;
+
+    /* -Wl,--no-relax and --incremental keep the calls and accesses as
+       they are, but the nops before R_RISCV_ALIGN are always trimmed */
+    rewrite = !s1->no_relax && !s1->incremental;
+    gp_index = find_elf_sym(symtab_section, "__global_pointer$");
+    if (rewrite && gp_index && s1->output_type == TCC_OUTPUT_EXE) {
+        sym = &((ElfW(Sym) *)symtab_section->data)[gp_index];
+        if (sym->st_shndx != SHN_UNDEF && sym->st_shndx < SHN_LORESERVE)
+            gp_shndx = sym->st_shndx, gp = sym->st_value;
+    }
+    for (i = 1; i < s1->nb_sections; i++) {
+        s = s1->sections[i];
+        if (!(s->sh_flags & SHF_EXECINSTR) || s->sh_type != SHT_PROGBITS
+            || !s->reloc || i == gp_shndx)
+            continue;
+        n = 0;
+        for_each_elem(s->reloc, 0, rel, ElfW_Rel)
+            if ((rewrite && ELFW(R_TYPE)(rel->r_info) == R_RISCV_RELAX)
+                || ELFW(R_TYPE)(rel->r_info) == R_RISCV_ALIGN)
+                n = 1;
+        if (!n)
+            continue;
+        n = s->reloc->data_offset / sizeof *rel;
+        rels = tcc_malloc(n * sizeof *rels);
+        n = 0;
+        for_each_elem(s->reloc, 0, rel, ElfW_Rel)
+            rels[n++] = rel;
+        qsort(rels, n, sizeof *rels, relax_rel_cmp);
+        memset(&r, 0, sizeof r);
+        relax_scan(s1, s, &r, rels, n, rewrite, gp_shndx, gp);
+        tcc_free(rels);
+        if (r.nb_dels) {
+            relax_lo12(s1, s, &r);
+            relax_apply(s1, s, &r);
+#if CONFIG_TCC_INCREMENTAL
+            /* the objects are no longer as they will be loaded again */
+            if (s1->incremental)
+                tcc_inc_disable(s1);
+#endif
+        }
+        tcc_free(r.dels);
+        tcc_free(r.his);
+    }
+}
+
 void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr,
               addr_t addr, addr_t val)
 {
@@ -227,8 +622,17 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr,
         last_hi.addr = addr;
         last_hi.val = val;
         return;
+    case R_RISCV_TLS_GOT_HI20:
+        val = tls_got_entry(s1, TLS_IE_ENTRY, sym_index,
+                            tls_tpoff(s1, sym->st_value));
+        goto got_hi20;
+    case R_RISCV_TLS_GD_HI20:
+        val = tls_got_entry(s1, TLS_GD_ENTRY, sym_index,
+                            tls_dtpoff(s1, sym->st_value));
+        goto got_hi20;
     case R_RISCV_GOT_HI20:
         val = s1->got->sh_addr + get_sym_attr(s1, sym_index, 0)->got_offset;
+    got_hi20:
         off64 = (int64_t)(val - addr + 0x800) >> 12;
         if ((off64 + ((uint64_t)1 << 20)) >> 21)
           tcc_error_noabort("R_RISCV_GOT_HI20 relocation failed");
@@ -259,6 +663,23 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr,
                        | ((off32 & 0x01f) << 7));
         return;
 
+    case R_RISCV_GPREL_I:
+    case R_RISCV_GPREL_S:
+        /* made by relax_sections() */
+        off64 = val - get_sym_addr(s1, "__global_pointer$", 1, 0);
+        if ((off64 + 0x800) >> 12)
+          tcc_error_noabort("R_RISCV_GPREL relocation failed"
+                    " (val=%lx)", (long)val);
+        off32 = off64;
+        if (type == R_RISCV_GPREL_I)
+            write32le(ptr, (read32le(ptr) & 0xfffff)
+                           | ((off32 & 0xfff) << 20));
+        else
+            write32le(ptr, (read32le(ptr) & ~0xfe000f80)
+                           | ((off32 & 0xfe0) << 20)
+                           | ((off32 & 0x01f) << 7));
+        return;
+
     case R_RISCV_RVC_BRANCH:
         off64 = (val - addr);
         if ((off64 + (1 << 8)) & ~(uint64_t)0x1fe)
@@ -353,6 +774,29 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr,
         *ptr = (*ptr & ~0x3f) | ((*ptr - val) & 0x3f);
         return;
 
+    case R_RISCV_TPREL_HI20:
+        write32le(ptr, (read32le(ptr) & 0xfff)
+                       | ((tls_tpoff(s1, val) + 0x800) & 0xfffff000));
+        return;
+    case R_RISCV_TPREL_LO12_I:
+        write32le(ptr, (read32le(ptr) & 0xfffff)
+                       | ((tls_tpoff(s1, val) & 0xfff) << 20));
+        return;
+    case R_RISCV_TPREL_LO12_S:
+        off32 = tls_tpoff(s1, val);
+        write32le(ptr, (read32le(ptr) & ~0xfe000f80)
+                       | ((off32 & 0xfe0) << 20)
+                       | ((off32 & 0x01f) << 7));
+        return;
+    case R_RISCV_TPREL_ADD:
+        return;
+    case R_RISCV_TLS_DTPREL32:
+        write32le(ptr, tls_dtpoff(s1, val));
+        return;
+    case R_RISCV_TLS_DTPREL64:
+        write64le(ptr, tls_dtpoff(s1, val));
+        return;
+
     case R_RISCV_32_PCREL:
     case R_RISCV_COPY:
         /* XXX */
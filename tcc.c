@@ -95,7 +95,7 @@ static const char help2[] =
     "  -P -P1                        with -E: no/alternative #line output\n"
     "  -dD -dM                       with -E: output #define directives\n"
     "  -pthread                      same as -D_REENTRANT and -lpthread\n"
-    "  -On                           same as -D__OPTIMIZE__ for n > 0\n"
+    "  -On                           -D__OPTIMIZE__ and optimize functions for n > 0\n"
     "  -Wp,-opt                      same as -opt\n"
     "  -include file                 include 'file' above each input file\n"
     "  -isystem dir                  add 'dir' to system include path\n"
@@ -120,6 +120,11 @@ static const char help2[] =
     "  ms-extensions                 allow anonymous struct in struct\n"
     "  dollars-in-identifiers        allow '$' in C symbols\n"
     "  test-coverage                 create code coverage code\n"
+    "  omit-frame-pointer            address locals via %rsp (x86_64)\n"
+    "  inline-functions              expand small static functions inline\n"
+    "  optimize-sibling-calls        jump to 'return f(...)' callees (x86_64)\n"
+    "  function-sections             put each function in its own section\n"
+    "  data-sections                 put each global variable in its own section\n"
     "-m... target specific options:\n"
     "  ms-bitfields                  use MSVC bitfield layout\n"
 #ifdef TCC_TARGET_ARM
@@ -127,10 +132,21 @@ static const char help2[] =
 #endif
 #ifdef TCC_TARGET_X86_64
     "  no-sse                        disable floats on x86_64\n"
+    "  popcnt lzcnt bmi              use these instructions for __builtin_popcount...\n"
+#endif
+#ifdef TCC_TARGET_RISCV64
+    "  arch=..._zbb                  use Zbb instructions for __builtin_clz...\n"
 #endif
     "-Wl,... linker options:\n"
     "  -nostdlib                     do not link with standard crt/libs\n"
     "  -[no-]whole-archive           load lib(s) fully/only as needed\n"
+#ifndef TCC_TARGET_PE
+    "  -[no-]gc-sections             discard unreferenced sections\n"
+    "  -icf=all|safe|none            fold identical functions\n"
+    "  -threads=N -no-threads        threads for relocation and output\n"
+    "  -[no-]incremental             patch the output if only objects changed\n"
+    "  -[no-]relax                   shorten RISC-V calls and addresses\n"
+#endif
     "  -export-all-symbols           same as -rdynamic\n"
     "  -export-dynamic               same as -rdynamic\n"
     "  -image-base= -Ttext=          set base address of executable\n"
@@ -278,7 +294,7 @@ static unsigned getclock_ms(void)
 int main(int argc0, char **argv0)
 {
     TCCState *s, *s1;
-    int ret, opt, n = 0, t = 0, done;
+    int ret, opt, n = 0, t = 0, done, relinked = 0;
     unsigned start_time = 0, end_time = 0;
     const char *first_file;
     int argc; char **argv;
@@ -361,6 +377,17 @@ redo:
 
     /* compile or add each files or library */
     first_file = NULL;
+#if CONFIG_TCC_INCREMENTAL
+    if (s->incremental && s->output_type == TCC_OUTPUT_EXE) {
+        if (!s->outfile)
+            s->outfile = default_outputfile(s, NULL);
+        /* the previous output was patched in place */
+        relinked = 0 == tcc_relink(s);
+    }
+    if (relinked)
+        ret = 0, n = s->nb_files;
+    else
+#endif
     do {
         struct filespec *f = s->files[n];
         s->filetype = f->type;
@@ -391,7 +418,7 @@ redo:
         } else {
             if (!s->outfile)
                 s->outfile = default_outputfile(s, first_file);
-            if (!s->just_deps && tcc_output_file(s, s->outfile))
+            if (relinked || (!s->just_deps && tcc_output_file(s, s->outfile)))
                 ;
             else if (s->gen_deps)
                 gen_makedeps(s, s->outfile, s->deps_outfile);
@@ -383,6 +383,24 @@ extern long double strtold (const char *__nptr, char **__endptr);
 # define CONFIG_TCC_SEMLOCK 1
 #endif
 
+/* relocate and write large outputs with several threads */
+#ifndef CONFIG_TCC_THREADS
+# if CONFIG_TCC_SEMLOCK && !defined _WIN32
+#  define CONFIG_TCC_THREADS 1
+# else
+#  define CONFIG_TCC_THREADS 0
+# endif
+#endif
+
+/* patch executables in place when only some objects changed */
+#ifndef CONFIG_TCC_INCREMENTAL
+# if !defined ELF_OBJ_ONLY && !defined _WIN32
+#  define CONFIG_TCC_INCREMENTAL 1
+# else
+#  define CONFIG_TCC_INCREMENTAL 0
+# endif
+#endif
+
 #if ONE_SOURCE
 #define ST_INLN static inline
 #define ST_FUNC static
@@ -542,7 +560,8 @@ struct SymAttr {
     dllimport   : 1,
     addrtaken   : 1,
     nodebug     : 1,
-    xxxx        : 2; /* not used */
+    tls         : 1, /* _Thread_local / __thread */
+    hasbody     : 1; /* function defined in this unit (maybe deferred) */
 };
 
 /* function attributes or temporary attributes for parsing */
@@ -555,7 +574,8 @@ struct FuncAttr {
     func_dtor   : 1, /* attribute((destructor)) */
     func_args   : 8, /* PE __stdcall args */
     func_alwinl : 1, /* always_inline */
-    xxxx        : 15;
+    func_used   : 1, /* attribute((used)) */
+    xxxx        : 14;
 };
 
 /* symbol management */
@@ -608,11 +628,18 @@ typedef struct Section {
     int nb_hashed_syms;      /* used to resize the hash table */
     struct Section *link;    /* link to another section */
     struct Section *reloc;   /* corresponding section for relocation, if any */
-    struct Section *hash;    /* hash table for symbols */
+    struct Section *hash;    /* hash table for symbols (or strings) */
     struct Section *prev;    /* previous section on section stack */
     char name[1];           /* section name */
 } Section;
 
+/* a binary input file mapped in memory */
+typedef struct MappedFile {
+    const unsigned char *data;
+    unsigned long size;
+    int fd;
+} MappedFile;
+
 typedef struct DLLReference {
     int level;
     void *handle;
@@ -688,6 +715,7 @@ typedef struct TokenString {
     int allocated_len;
     int last_line_num;
     int save_line_num;
+    int save_pp_state; /* state before its first TOK_PPSTATE, or -1 */
     /* used to chain token-strings with begin/end_macro() */
     struct TokenString *prev;
     const int *prev_ptr;
@@ -703,12 +731,17 @@ typedef struct AttributeDef {
     int alias_target; /* token */
     int asm_label; /* associated asm label */
     char attr_mode; /* __attribute__((__mode__(...))) */
+    int vector_size; /* __attribute__((vector_size(n))) */
 } AttributeDef;
 
-/* inline functions */
+/* inline functions, and with -O1 other static functions and initialized
+   static variables, recorded as tokens until they are referenced */
 typedef struct InlineFunc {
     TokenString *func_str;
     Sym *sym;
+    int expand; /* -finline-functions: 0 unknown, 1 yes, -1 never */
+    int expanding; /* currently expanded at a call site */
+    int keep; /* constructor or 'used': emit even if not referenced */
     char filename[1];
 } InlineFunc;
 
@@ -751,6 +784,7 @@ typedef struct ASMOperand {
 struct sym_attr {
     unsigned got_offset;
     unsigned plt_offset;
+    unsigned tlsgd_offset; /* GOT pair for a general-dynamic TLS access */
     int plt_sym;
     int dyn_index;
 #ifdef TCC_TARGET_ARM
@@ -767,9 +801,14 @@ struct TCCState {
     unsigned char rdynamic; /* if true, all symbols are exported */
     unsigned char symbolic; /* if true, resolve symbols in the current module first */
     unsigned char filetype; /* file type for compilation (NONE,C,ASM) */
-    unsigned char optimize; /* only to #define __OPTIMIZE__ */
+    unsigned char optimize; /* -On: #define __OPTIMIZE__, optimize through tccir.c */
     unsigned char option_pthread; /* -pthread option */
     unsigned char enable_new_dtags; /* -Wl,--enable-new-dtags */
+    unsigned char gc_sections; /* -Wl,--gc-sections */
+    unsigned char icf; /* -Wl,--icf=all (1) or safe (2) */
+    unsigned char nb_threads; /* -Wl,--threads=N, 0: by the size of the work */
+    unsigned char incremental; /* -Wl,--incremental */
+    unsigned char no_relax; /* -Wl,--no-relax */
     unsigned int  cversion; /* supported C ISO version, 199901 (the default), 201112, ... */
 
     /* C language options */
@@ -806,6 +845,11 @@ struct TCCState {
     unsigned char do_bounds_check;
 #endif
     unsigned char test_coverage;  /* generate test coverage code */
+    unsigned char omit_frame_pointer; /* -fomit-frame-pointer */
+    unsigned char inline_functions; /* -finline-functions */
+    unsigned char optimize_sibling_calls; /* -foptimize-sibling-calls */
+    unsigned char function_sections; /* -ffunction-sections */
+    unsigned char data_sections; /* -fdata-sections */
 
     /* use GNU C extensions */
     unsigned char gnu_ext;
@@ -817,6 +861,10 @@ struct TCCState {
 
 #ifdef TCC_TARGET_X86_64
     unsigned char nosse; /* For -mno-sse support. */
+    unsigned char mpopcnt, mlzcnt, mbmi; /* -mpopcnt, -mlzcnt, -mbmi */
+#endif
+#ifdef TCC_TARGET_RISCV64
+    unsigned char mzbb; /* -march=..._zbb: bit manipulation extension */
 #endif
 #ifdef TCC_TARGET_ARM
     unsigned char float_abi; /* float ABI of the generated code*/
@@ -848,6 +896,10 @@ struct TCCState {
     DLLReference **loaded_dlls;
     int nb_loaded_dlls;
 
+    /* symbol indexes of the archives seen so far (-l twice, GROUP) */
+    struct ArchiveIndex **ar_indexes;
+    int nb_ar_indexes;
+
     /* include paths */
     char **include_paths;
     int nb_include_paths;
@@ -912,6 +964,15 @@ struct TCCState {
     Section **priv_sections;
     int nb_priv_sections; /* number of private sections */
 
+    /* where the code of each file starts, as pairs of section number
+       and offset (for -Wl,--icf and relax_sections()) */
+    addr_t *code_pieces;
+    int nb_code_pieces;
+
+    /* inputs and their placement (for -Wl,--incremental) */
+    struct IncState *inc;
+    unsigned args_hash; /* of the command line */
+
     /* predefined sections */
     Section *text_section, *data_section, *rodata_section, *bss_section;
     Section *common_section;
@@ -929,6 +990,7 @@ struct TCCState {
     Section *dynsym;
     /* got & plt handling */
     Section *got, *plt;
+    unsigned tlsld_offset; /* GOT pair for local-dynamic TLS accesses */
     /* debug sections */
     Section *stab_section;
     Section *dwarf_info_section;
@@ -993,6 +1055,7 @@ struct TCCState {
     const char *run_main; /* entry for tcc_run() */
     void *run_ptr; /* runtime_memory */
     unsigned run_size; /* size of runtime_memory  */
+    void *run_tls; /* thread-local storage of the program */
 #ifdef _WIN64
     void *run_function_table; /* unwind data */
 #endif
@@ -1021,6 +1084,8 @@ struct TCCState {
 
     /* for warnings/errors for object files */
     const char *current_filename;
+    /* the binary file being loaded, read in place when mapped */
+    MappedFile map;
 
     /* used by main and tcc_parse_args only */
     struct filespec **files; /* files seen on command line */
@@ -1097,10 +1162,12 @@ struct filespec {
 #define VT_UNION    (1 << VT_STRUCT_SHIFT | VT_STRUCT)
 #define VT_ENUM     (2 << VT_STRUCT_SHIFT) /* integral type is an enum really */
 #define VT_ENUM_VAL (3 << VT_STRUCT_SHIFT) /* integral type is an enum constant really */
+#define VT_VECTOR   (4 << VT_STRUCT_SHIFT | VT_STRUCT) /* vector_size() type */
 
 #define IS_ENUM(t) ((t & VT_STRUCT_MASK) == VT_ENUM)
 #define IS_ENUM_VAL(t) ((t & VT_STRUCT_MASK) == VT_ENUM_VAL)
 #define IS_UNION(t) ((t & (VT_STRUCT_MASK|VT_BTYPE)) == VT_UNION)
+#define IS_VECTOR(t) ((t & (VT_STRUCT_MASK|VT_BTYPE)) == VT_VECTOR)
 
 #define VT_ATOMIC   VT_VOLATILE
 
@@ -1153,6 +1220,8 @@ struct filespec {
 #define TOK_SHL     '<' /* shift left */
 #define TOK_SAR     '>' /* signed shift right */
 #define TOK_SHR     0x8b /* unsigned shift right */
+#define TOK_UMULH   0x8c /* unsigned multiply, high part of the product */
+#define TOK_SMULH   0x8d /* signed multiply, high part of the product */
 #define TOK_NEG     TOK_MID /* unary minus operation (for floats) */
 
 #define TOK_ARROW   0xa0 /* -> */
@@ -1195,8 +1264,9 @@ struct filespec {
 #define TOK_PPNUM   0xcd /* preprocessor number */
 #define TOK_PPSTR   0xce /* preprocessor string */
 #define TOK_LINENUM 0xcf /* line number info */
+#define TOK_PPSTATE 0xd0 /* #pragma pack/option state in a saved body */
 
-#define TOK_HAS_VALUE(t) (t >= TOK_CCHAR && t <= TOK_LINENUM)
+#define TOK_HAS_VALUE(t) (t >= TOK_CCHAR && t <= TOK_PPSTATE)
 
 #define TOK_EOF       (-1)  /* end of file */
 #define TOK_LINEFEED  10    /* line feed */
@@ -1345,6 +1415,7 @@ ST_DATA const int *macro_ptr;
 ST_DATA int parse_flags;
 ST_DATA int tok_flags;
 ST_DATA CString tokcstr; /* current parsed string, if any */
+ST_DATA TokenString *tok_saving; /* body being saved, for #pragma pack */
 
 /* display benchmark infos */
 ST_DATA int tok_ident;
@@ -1389,6 +1460,7 @@ ST_FUNC void tok_str_free(TokenString *s);
 ST_FUNC void tok_str_free_str(int *str);
 ST_FUNC void tok_str_add(TokenString *s, int t);
 ST_FUNC void tok_str_add_tok(TokenString *s);
+ST_FUNC void tok_str_add_pp_state(TokenString *s);
 ST_INLN void define_push(int v, int macro_type, int *str, Sym *first_arg);
 ST_FUNC void define_undef(Sym *s);
 ST_INLN Sym *define_find(int v);
@@ -1551,10 +1623,18 @@ ST_FUNC void section_realloc(Section *sec, unsigned long new_size);
 ST_FUNC size_t section_add(Section *sec, addr_t size, int align);
 ST_FUNC void *section_ptr_add(Section *sec, addr_t size);
 ST_FUNC Section *find_section(TCCState *s1, const char *name);
+ST_FUNC Section *find_sub_section(TCCState *s1, Section *sec, const char *name);
+ST_FUNC Section *tls_section(TCCState *s1, int has_init);
+#ifdef R_TPOFF
+ST_FUNC addr_t get_tls_block(TCCState *s1, addr_t *psize, addr_t *palign);
+#endif
 ST_FUNC void free_section(Section *s);
 ST_FUNC Section *new_symtab(TCCState *s1, const char *symtab_name, int sh_type, int sh_flags, const char *strtab_name, const char *hash_name, int hash_sh_flags);
 ST_FUNC void init_symtab(Section *s);
 
+ST_FUNC void init_str_hash(Section *s);
+ST_FUNC int put_shared_data(Section *s, const void *data, int len, int align);
+ST_FUNC int share_data(Section *s, int offset, int len, int align);
 ST_FUNC int put_elf_str(Section *s, const char *sym);
 ST_FUNC int put_elf_sym(Section *s, addr_t value, unsigned long size, int info, int other, int shndx, const char *name);
 ST_FUNC int set_elf_sym(Section *s, addr_t value, unsigned long size, int info, int other, int shndx, const char *name);
@@ -1591,6 +1671,13 @@ ST_FUNC int tcc_load_ldscript(TCCState *s1, int fd);
 ST_FUNC void tccelf_add_crtbegin(TCCState *s1);
 ST_FUNC void tccelf_add_crtend(TCCState *s1);
 #endif
+#if CONFIG_TCC_INCREMENTAL
+ST_FUNC void tcc_inc_add_file(TCCState *s1, const char *filename, int fd, int obj_type);
+#ifdef LINK_RELAX
+ST_FUNC void tcc_inc_disable(TCCState *s1);
+#endif
+PUB_FUNC int tcc_relink(TCCState *s1);
+#endif
 #ifndef TCC_TARGET_PE
 ST_FUNC void tcc_add_runtime(TCCState *s1);
 #endif
@@ -1606,7 +1693,10 @@ enum gotplt_entry {
     NO_GOTPLT_ENTRY,	/* never generate (eg. GLOB_DAT & JMP_SLOT relocs) */
     BUILD_GOT_ONLY,	/* only build GOT (eg. TPOFF relocs) */
     AUTO_GOTPLT_ENTRY,	/* generate if sym is UNDEF */
-    ALWAYS_GOTPLT_ENTRY	/* always generate (eg. PLTOFF relocs) */
+    ALWAYS_GOTPLT_ENTRY,	/* always generate (eg. PLTOFF relocs) */
+    TLS_IE_ENTRY,	/* TP offset slot unless relaxed (eg. GOTTPOFF) */
+    TLS_GD_ENTRY,	/* module/offset pair unless relaxed (eg. TLSGD) */
+    TLS_LD_ENTRY	/* module pair of the output unless relaxed (eg. TLSLD) */
 };
 #define NEED_RELOC_TYPE
 
@@ -1615,6 +1705,15 @@ ST_FUNC unsigned create_plt_entry(TCCState *s1, unsigned got_offset, struct sym_
 ST_FUNC void relocate_plt(TCCState *s1);
 ST_FUNC void build_got_entries(TCCState *s1, int got_sym); /* in tccelf.c */
 #define NEED_BUILD_GOT
+#ifdef R_TPOFF
+ST_FUNC addr_t tls_got_entry(TCCState *s1, int kind, int sym_index, addr_t off);
+#endif
+#ifdef GOT_RELAX
+ST_FUNC int relax_got_reloc(TCCState *s1, Section *s, ElfW_Rel *rel);
+#endif
+#ifdef LINK_RELAX
+ST_FUNC void relax_sections(TCCState *s1);
+#endif
 
 #endif
 #endif
@@ -1651,6 +1750,11 @@ ST_FUNC void gen_vla_sp_save(int addr);
 ST_FUNC void gen_vla_sp_restore(int addr);
 ST_FUNC void gen_vla_alloc(CType *type, int align);
 
+/* thread-local access models, see gen_tls_addr() */
+#define TLS_GD 0 /* general dynamic: ask __tls_get_addr() */
+#define TLS_IE 1 /* initial exec: offset from the thread pointer in the GOT */
+#define TLS_LE 2 /* local exec: offset from the thread pointer at link time */
+
 static inline uint16_t read16le(unsigned char *p) {
     return p[0] | (uint16_t)p[1] << 8;
 }
@@ -1698,6 +1802,81 @@ ST_FUNC void gen_vla_result(int addr);
 #endif
 ST_FUNC void gen_cvt_sxtw(void);
 ST_FUNC void gen_cvt_csti(int t);
+ST_FUNC void gen_need_frame(void);
+#endif
+
+/* ------------ tccir.c ------------ */
+#ifdef TCC_TARGET_IR
+/* with -O1, a function is first recorded as a list of IRInsn by the
+   backend, optimized, given registers and then lowered to machine code */
+enum {
+    IR_NOP, IR_ENTRY, IR_RET, IR_CALL, IR_JMP, IR_JCC,
+    IR_MOV, IR_LI, IR_LEA, IR_GOT, IR_LOAD, IR_STORE,
+    IR_ADD, IR_SUB, IR_AND, IR_OR, IR_XOR, IR_MUL,
+    IR_SHL, IR_SHR, IR_SAR, IR_DIV, IR_UDIV, IR_MOD, IR_UMOD,
+    IR_UMULH, IR_SMULH, IR_CMP, IR_SETCC, IR_EXT,
+    IR_FADD, IR_FSUB, IR_FMUL, IR_FDIV, IR_FXOR, IR_FCMP,
+    IR_ITOF, IR_FTOI, IR_FTOF
+};
+
+/* IRInsn.t: value types, and memory types for IR_LOAD/IR_STORE */
+enum {
+    IRT_I32, IRT_I64, IRT_F32, IRT_F64, IRT_S8, IRT_U8, IRT_S16, IRT_U16
+};
+#define IRT_FLOAT(t) ((t) == IRT_F32 || (t) == IRT_F64)
+
+/* IRInsn.am: address of IR_LOAD, IR_STORE and IR_LEA */
+enum {
+    IRA_REG,   /* a + c */
+    IRA_FRAME, /* frame pointer + c */
+    IRA_SYM,   /* sym + c, pc relative */
+    IRA_ABS    /* c */
+};
+
+#define IRF_IMM  1 /* 'b' is the constant 'c' */
+#define IRF_VOL  2 /* volatile memory access */
+#define IRF_DONE 4 /* jump: 'c' is the target, not the next jump */
+#define IRF_TAIL 8 /* IR_CALL: 'return f(...)', may become a jump */
+
+/* IRInsn.cc for IR_JCC and IR_SETCC: a float compare, with the
+   vtop->cmp_r that goes with it in the upper bits */
+#define IRC_FLOAT 0x100
+
+typedef struct IRInsn {
+    unsigned char op, t, am, f;
+    int cc;     /* condition, source type of IR_EXT ..., argument count */
+    int d;      /* register defined, or -1 */
+    int a, b;   /* registers used, or -1 */
+    int p;      /* IR_CALL, IR_ENTRY: first pair in ir_pool */
+    int64_t c;  /* constant, displacement or jump target */
+    int sym;    /* ELF symbol of IRA_SYM, IR_GOT and IR_CALL */
+} IRInsn;
+
+/* registers 0 .. NB_REGS - 1 are those of tccgen, more are made up
+   by ir_vreg().  After ir_optimize(), ir_loc[] is a machine register
+   (0 .. 31), a frame offset or IR_NOLOC for each of them. */
+#define IR_VREG0 32
+#define IR_NOLOC 0x7fffffff
+
+ST_DATA int ir_active, ir_failed;
+ST_DATA IRInsn *ir_code;
+ST_DATA int ir_n, ir_nv, *ir_pool, *ir_loc, ir_frame;
+
+ST_FUNC void ir_begin(void);
+ST_FUNC void ir_end(void);
+ST_FUNC IRInsn *ir_emit(int op, int t, int d, int a, int b);
+ST_FUNC int ir_vreg(int fl);
+ST_FUNC int ir_pool_add(int r, int where);
+ST_FUNC void ir_escape(int c);
+ST_FUNC int ir_jmp(IRInsn *i, int t);
+ST_FUNC void ir_gsym_addr(int t, int a);
+ST_FUNC int ir_gjmp_append(int n, int t);
+ST_FUNC int ir_optimize(void);
+
+/* in the backend */
+ST_DATA const signed char ir_hregs[2][16];
+ST_FUNC unsigned ir_clobbers(IRInsn *i);
+ST_FUNC void ir_hint(IRInsn *i, int *hint);
 #endif
 
 /* ------------ arm-gen.c ------------ */
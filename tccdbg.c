@@ -462,6 +462,7 @@ ST_FUNC void tcc_debug_new(TCCState *s1)
         stab_section->sh_entsize = sizeof(Stab_Sym);
         stab_section->sh_addralign = sizeof ((Stab_Sym*)0)->n_value;
         stab_section->link = new_section(s1, ".stabstr", SHT_STRTAB, shf);
+        init_str_hash(stab_section->link);
         /* put first entry */
         put_stabs(s1, "", 0, 0, 0, 0);
     }
@@ -1963,6 +1964,18 @@ ST_FUNC void tcc_debug_extern_sym(TCCState *s1, Sym *sym, int sh_num, int sym_bi
 	dwarf_data4(dwarf_info_section, debug_type - dwarf_info.start);
 	if (sym_bind == STB_GLOBAL)
 	    dwarf_data1(dwarf_info_section, 1);
+#ifdef R_DTPOFF
+	if (sym_type == STT_TLS) {
+	    /* offset in the TLS block of the module */
+	    dwarf_data1(dwarf_info_section, PTR_SIZE + 2);
+	    dwarf_data1(dwarf_info_section, DW_OP_const8u);
+	    greloca(dwarf_info_section, sym, dwarf_info_section->data_offset,
+		    R_DTPOFF, 0);
+	    dwarf_data8(dwarf_info_section, 0);
+	    dwarf_data1(dwarf_info_section, DW_OP_form_tls_address);
+	    return;
+	}
+#endif
 	dwarf_data1(dwarf_info_section, PTR_SIZE + 1);
 	dwarf_data1(dwarf_info_section, DW_OP_addr);
 	greloca(dwarf_info_section, sym, dwarf_info_section->data_offset,
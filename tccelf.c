@@ -24,6 +24,17 @@
 
 #include "tcc.h"
 
+#ifndef _WIN32
+# include <sys/mman.h>
+#endif
+#if CONFIG_TCC_THREADS
+# include <pthread.h>
+#endif
+#include <sys/stat.h>
+#if CONFIG_TCC_INCREMENTAL
+static void inc_free(struct IncState *inc);
+#endif
+
 /* Define this to get some debug output during relocation processing.  */
 #undef DEBUG_RELOC
 
@@ -131,6 +142,9 @@ ST_FUNC void tccelf_delete(TCCState *s1)
     tcc_free(sym_versions);
     tcc_free(sym_to_version);
 #endif
+#if CONFIG_TCC_INCREMENTAL
+    inc_free(s1->inc);
+#endif
 
     /* free all sections */
     for(i = 1; i < s1->nb_sections; i++)
@@ -141,10 +155,30 @@ ST_FUNC void tccelf_delete(TCCState *s1)
         free_section(s1->priv_sections[i]);
     dynarray_reset(&s1->priv_sections, &s1->nb_priv_sections);
 
+    dynarray_reset(&s1->ar_indexes, &s1->nb_ar_indexes);
+    tcc_free(s1->code_pieces);
     tcc_free(s1->sym_attrs);
     symtab_section = NULL; /* for tccrun.c:rt_printline() */
 }
 
+#ifdef LINK_RELAX
+# define want_code_pieces(s1) 1 /* relax_sections() may always shrink code */
+#else
+# define want_code_pieces(s1) ((s1)->icf)
+#endif
+
+/* remember where code from a file starts in section 's' */
+static void add_code_piece(TCCState *s1, Section *s)
+{
+    int n = s1->nb_code_pieces;
+    if ((n & (n - 1)) == 0)
+        s1->code_pieces = tcc_realloc(s1->code_pieces,
+                                      (n ? 4 * n : 2) * sizeof (addr_t));
+    s1->code_pieces[2 * n] = s->sh_num;
+    s1->code_pieces[2 * n + 1] = s->data_offset;
+    s1->nb_code_pieces = n + 1;
+}
+
 /* save section data state */
 ST_FUNC void tccelf_begin_file(TCCState *s1)
 {
@@ -152,6 +186,9 @@ ST_FUNC void tccelf_begin_file(TCCState *s1)
     for (i = 1; i < s1->nb_sections; i++) {
         s = s1->sections[i];
         s->sh_offset = s->data_offset;
+        if (want_code_pieces(s1) && (s->sh_flags & SHF_EXECINSTR)
+            && s->data_offset)
+            add_code_piece(s1, s);
     }
     /* disable symbol hashing during compilation */
     s = s1->symtab, s->reloc = s->hash, s->hash = NULL;
@@ -183,7 +220,8 @@ ST_FUNC void tccelf_end_file(TCCState *s1)
             if (sym_bind == STB_LOCAL)
                 sym_bind = STB_GLOBAL;
 #ifndef TCC_TARGET_PE
-            if (sym_bind == STB_GLOBAL && s1->output_type == TCC_OUTPUT_OBJ) {
+            if (sym_bind == STB_GLOBAL && s1->output_type == TCC_OUTPUT_OBJ
+                && sym_type != STT_TLS) {
                 /* undefined symbols with STT_FUNC are confusing gnu ld when
                    linking statically to STT_GNU_IFUNC */
                 sym_type = STT_NOTYPE;
@@ -265,10 +303,11 @@ ST_FUNC void init_symtab(Section *s)
     int *ptr, nb_buckets = 1;
     put_elf_str(s->link, "");
     section_ptr_add(s, sizeof (ElfW(Sym)));
-    ptr = section_ptr_add(s->hash, (2 + nb_buckets + 1) * sizeof(int));
+    ptr = section_ptr_add(s->hash, (2 + nb_buckets + 2) * sizeof(int));
     ptr[0] = nb_buckets;
     ptr[1] = 1;
-    memset(ptr + 2, 0, (nb_buckets + 1) * sizeof(int));
+    memset(ptr + 2, 0, (nb_buckets + 2) * sizeof(int));
+    s->hash->nb_hashed_syms = 0;
 }
 
 ST_FUNC Section *new_symtab(TCCState *s1,
@@ -364,14 +403,179 @@ ST_FUNC Section *find_section(TCCState *s1, const char *name)
     return new_section(s1, name, SHT_PROGBITS, SHF_ALLOC);
 }
 
+/* return the section "<sec>.<name>", created like 'sec' if needed
+   (-ffunction-sections, -fdata-sections) */
+ST_FUNC Section *find_sub_section(TCCState *s1, Section *sec, const char *name)
+{
+    char buf[256];
+    Section *s;
+
+    snprintf(buf, sizeof buf, "%s.%s", sec->name, name);
+    s = have_section(s1, buf);
+    if (!s)
+        s = new_section(s1, buf, sec->sh_type, sec->sh_flags);
+    return s;
+}
+
+/* return the section for thread-local variables, initialized (.tdata)
+   or not (.tbss), and create it if it does not exist */
+ST_FUNC Section *tls_section(TCCState *s1, int has_init)
+{
+    const char *name = has_init ? ".tdata" : ".tbss";
+    Section *s = have_section(s1, name);
+    if (!s)
+        s = new_section(s1, name, has_init ? SHT_PROGBITS : SHT_NOBITS,
+                        SHF_ALLOC | SHF_WRITE | SHF_TLS);
+    return s;
+}
+
 /* ------------------------------------------------------------------------- */
 
+/* Sections with shared contents (the string tables .dynstr and
+   .stabstr, merged input sections, string literals) keep a hash of
+   their entries in the private section s->hash: the number of buckets,
+   the buckets, then (offset, hash, next) triples.  Entries are not
+   removed when a section is cut back, so a match is always checked
+   against the current data. */
+static unsigned str_hash(const unsigned char *p)
+{
+    unsigned h = 5381;
+    while (*p)
+        h = h * 33 + *p++;
+    return h ^ (h >> 15);
+}
+
+static unsigned mem_hash(const unsigned char *p, int len)
+{
+    unsigned h = 5381;
+    while (len--)
+        h = h * 33 + *p++;
+    return h ^ (h >> 15);
+}
+
+static void init_data_hash(Section *hs, int nb_buckets)
+{
+    int *ptr;
+
+    hs->data_offset = 0;
+    ptr = section_ptr_add(hs, (1 + nb_buckets + 3) * sizeof(int));
+    ptr[0] = nb_buckets;
+    memset(ptr + 1, 0, (nb_buckets + 3) * sizeof(int));
+}
+
+static void put_data_hash(Section *hs, unsigned h, int offset)
+{
+    int *ptr, *base, nb_buckets, n, *old;
+
+    base = (int *)hs->data;
+    nb_buckets = base[0];
+    n = (hs->data_offset / sizeof(int) - 1 - nb_buckets) / 3;
+    if (n > nb_buckets) {
+        /* grow, using the cached hashes */
+        old = tcc_malloc(3 * n * sizeof(int));
+        memcpy(old, base + 1 + nb_buckets, 3 * n * sizeof(int));
+        init_data_hash(hs, 2 * nb_buckets);
+        while (--n > 0)
+            put_data_hash(hs, old[3 * n + 1], old[3 * n]);
+        tcc_free(old);
+        base = (int *)hs->data;
+        nb_buckets = base[0];
+    }
+    ptr = section_ptr_add(hs, 3 * sizeof(int));
+    base = (int *)hs->data;
+    ptr[0] = offset;
+    ptr[1] = h;
+    ptr[2] = base[1 + (h & (nb_buckets - 1))];
+    base[1 + (h & (nb_buckets - 1))] = (ptr - (base + 1 + nb_buckets)) / 3;
+}
+
+/* return the offset of an entry of 's' equal to the 'len' bytes at
+   'data' and aligned per 'align', or -1 */
+static int find_data_hash(Section *s, const void *data, int len, int align,
+                          unsigned h)
+{
+    int *base, *e, n, offset, nb_buckets;
+
+    base = (int *)s->hash->data;
+    nb_buckets = base[0];
+    for (n = base[1 + (h & (nb_buckets - 1))]; n; n = e[2]) {
+        e = base + 1 + nb_buckets + 3 * n;
+        offset = e[0];
+        if ((unsigned)e[1] == h && !(offset & (align - 1))
+            && offset + len <= s->data_offset
+            && !memcmp(s->data + offset, data, len))
+            return offset;
+    }
+    return -1;
+}
+
+static void new_data_hash(Section *s)
+{
+    s->hash = new_section(s->s1, ".datahash", SHT_HASH, SHF_PRIVATE);
+    init_data_hash(s->hash, 64);
+}
+
+/* make put_elf_str() share equal strings in string table 's' */
+ST_FUNC void init_str_hash(Section *s)
+{
+    int i, j;
+
+    new_data_hash(s);
+    for (i = 0; i < s->data_offset; i = j + 1) {
+        for (j = i; j < s->data_offset && s->data[j]; j++)
+            ;
+        if (j < s->data_offset)
+            put_data_hash(s->hash, mem_hash(s->data + i, j + 1 - i), i);
+    }
+}
+
+/* put 'len' bytes from 'data' in 's' unless equal ones are already
+   there, and return their offset */
+ST_FUNC int put_shared_data(Section *s, const void *data, int len, int align)
+{
+    int offset;
+    unsigned h;
+
+    if (!s->hash)
+        new_data_hash(s);
+    h = mem_hash(data, len);
+    offset = find_data_hash(s, data, len, align, h);
+    if (offset < 0) {
+        offset = section_add(s, len, align);
+        memmove(s->data + offset, data, len);
+        put_data_hash(s->hash, h, offset);
+    }
+    return offset;
+}
+
+/* the 'len' bytes at 'offset' were just added to 's': if equal ones
+   were shared before, drop them and return where those are */
+ST_FUNC int share_data(Section *s, int offset, int len, int align)
+{
+    int o;
+    unsigned h;
+
+    if (!s->hash)
+        new_data_hash(s);
+    h = mem_hash(s->data + offset, len);
+    o = find_data_hash(s, s->data + offset, len, align, h);
+    if (o >= 0 && o < offset) {
+        memset(s->data + offset, 0, s->data_offset - offset);
+        s->data_offset = offset;
+        return o;
+    }
+    put_data_hash(s->hash, h, offset);
+    return offset;
+}
+
 ST_FUNC int put_elf_str(Section *s, const char *sym)
 {
     int offset, len;
     char *ptr;
 
     len = strlen(sym) + 1;
+    if (s->hash)
+        return put_shared_data(s, sym, len, 1);
     offset = s->data_offset;
     ptr = section_ptr_add(s, len);
     memmove(ptr, sym, len);
@@ -393,22 +597,133 @@ static ElfW(Word) elf_hash(const unsigned char *name)
     return h;
 }
 
-/* rebuild hash table of section s */
-/* NOTE: we do factorize the hash table code to go faster */
-static void rebuild_hash(Section *s, unsigned int nb_buckets)
+typedef struct StrRef {
+    const char *str;
+    int len;
+    int *offset; /* where to store the offset of the string */
+} StrRef;
+
+/* compare the strings from their ends */
+static int cmp_str_tails(const void *a, const void *b)
+{
+    const StrRef *p = a, *q = b;
+    const unsigned char *s = (unsigned char *)p->str + p->len;
+    const unsigned char *t = (unsigned char *)q->str + q->len;
+
+    while (s > (unsigned char *)p->str && t > (unsigned char *)q->str)
+        if (*--s != *--t)
+            return *s - *t;
+    return p->len - q->len;
+}
+
+/* put the strings of 'refs' into the empty string table 's'.  A string
+   which ends another one ("bar" and "foobar") points into it: sorted by
+   their ends, such a string comes just before the longer one. */
+static void put_str_tails(Section *s, StrRef *refs, int n)
+{
+    StrRef *r, *p;
+    int i;
+
+    put_elf_str(s, "");
+    qsort(refs, n, sizeof *refs, cmp_str_tails);
+    for (i = n; i-- > 0;) {
+        r = &refs[i], p = r + 1;
+        if (i + 1 < n && p->len >= r->len
+            && !memcmp(p->str + p->len - r->len, r->str, r->len))
+            *r->offset = *p->offset + p->len - r->len;
+        else
+            *r->offset = put_elf_str(s, r->str);
+    }
+}
+
+/* rebuild the string table of 'symtab' with shared string tails */
+static void merge_sym_names(Section *symtab)
+{
+    Section *strtab = symtab->link;
+    ElfW(Sym) *sym, *sym_end;
+    StrRef *refs, *r;
+    char *old;
+
+    old = tcc_malloc(strtab->data_offset);
+    memcpy(old, strtab->data, strtab->data_offset);
+    refs = r = tcc_malloc(symtab->data_offset / sizeof *sym * sizeof *refs);
+    sym_end = (ElfW(Sym) *)(symtab->data + symtab->data_offset);
+    for (sym = (ElfW(Sym) *)symtab->data + 1; sym < sym_end; sym++) {
+        if (!sym->st_name)
+            continue;
+        r->str = old + sym->st_name;
+        r->len = strlen(r->str);
+        r->offset = (int *)&sym->st_name;
+        r++;
+    }
+    strtab->data_offset = 0;
+    put_str_tails(strtab, refs, r - refs);
+    tcc_free(refs);
+    tcc_free(old);
+}
+
+/* Symbols are looked up through the private index s->hash: the
+   number of buckets (a power of two), the number of symbols, the
+   buckets, then for each symbol the next one in its chain and the
+   full hash of its name, compared before the name itself.  Local
+   symbols are not entered. */
+static void rebuild_sym_hash(Section *s, int nb_buckets, int rehash)
+{
+    Section *hs = s->hash;
+    int *ptr, *old, nb_syms, sym_index, n;
+    unsigned h;
+    ElfW(Sym) *sym;
+
+    nb_syms = s->data_offset / sizeof(ElfW(Sym));
+    old = NULL;
+    if (!rehash) {
+        old = tcc_malloc(2 * nb_syms * sizeof(int));
+        memcpy(old, (int *)hs->data + 2 + ((int *)hs->data)[0],
+               2 * nb_syms * sizeof(int));
+    }
+    hs->data_offset = 0;
+    ptr = section_ptr_add(hs, (2 + nb_buckets + 2 * nb_syms) * sizeof(int));
+    ptr[0] = nb_buckets;
+    ptr[1] = nb_syms;
+    ptr += 2;
+    memset(ptr, 0, (nb_buckets + 2) * sizeof(int));
+    n = 0;
+    sym = (ElfW(Sym) *)s->data + 1;
+    for(sym_index = 1; sym_index < nb_syms; sym_index++, sym++) {
+        int *e = ptr + nb_buckets + 2 * sym_index;
+        if (ELFW(ST_BIND)(sym->st_info) != STB_LOCAL) {
+            if (rehash)
+                h = str_hash(s->link->data + sym->st_name);
+            else
+                h = old[2 * sym_index + 1];
+            e[0] = ptr[h & (nb_buckets - 1)];
+            e[1] = h;
+            ptr[h & (nb_buckets - 1)] = sym_index;
+            n++;
+        } else {
+            e[0] = e[1] = 0;
+        }
+    }
+    hs->nb_hashed_syms = n;
+    tcc_free(old);
+}
+
+#ifndef ELF_OBJ_ONLY
+/* fill the SysV hash table 'hs' of the output symbol table 's' */
+static void fill_elf_hash(Section *s, Section *hs)
 {
     ElfW(Sym) *sym;
-    int *ptr, *hash, nb_syms, sym_index, h;
+    int *ptr, *hash, nb_buckets, nb_syms, nb_globals, sym_index, h;
     unsigned char *strtab;
 
     strtab = s->link->data;
     nb_syms = s->data_offset / sizeof(ElfW(Sym));
+    nb_globals = s->hash->nb_hashed_syms;
+    for (nb_buckets = 1; nb_globals > 2 * nb_buckets; nb_buckets *= 2)
+        ;
 
-    if (!nb_buckets)
-        nb_buckets = ((int*)s->hash->data)[0];
-
-    s->hash->data_offset = 0;
-    ptr = section_ptr_add(s->hash, (2 + nb_buckets + nb_syms) * sizeof(int));
+    hs->data_offset = 0;
+    ptr = section_ptr_add(hs, (2 + nb_buckets + nb_syms) * sizeof(int));
     ptr[0] = nb_buckets;
     ptr[1] = nb_syms;
     ptr += 2;
@@ -429,13 +744,14 @@ static void rebuild_hash(Section *s, unsigned int nb_buckets)
         sym++;
     }
 }
+#endif
 
 /* return the symbol number */
 ST_FUNC int put_elf_sym(Section *s, addr_t value, unsigned long size,
     int info, int other, int shndx, const char *name)
 {
-    int name_offset, sym_index;
-    int nbuckets, h;
+    int name_offset, sym_index, nbuckets;
+    unsigned h;
     ElfW(Sym) *sym;
     Section *hs;
 
@@ -455,24 +771,22 @@ ST_FUNC int put_elf_sym(Section *s, addr_t value, unsigned long size,
     hs = s->hash;
     if (hs) {
         int *ptr, *base;
-        ptr = section_ptr_add(hs, sizeof(int));
+        ptr = section_ptr_add(hs, 2 * sizeof(int));
         base = (int *)hs->data;
+        base[1]++;
         /* only add global or weak symbols. */
         if (ELFW(ST_BIND)(info) != STB_LOCAL) {
             /* add another hashing entry */
             nbuckets = base[0];
-            h = elf_hash((unsigned char *)s->link->data + name_offset) % nbuckets;
-            *ptr = base[2 + h];
-            base[2 + h] = sym_index;
-            base[1]++;
+            h = str_hash((unsigned char *)s->link->data + name_offset);
+            ptr[0] = base[2 + (h & (nbuckets - 1))];
+            ptr[1] = h;
+            base[2 + (h & (nbuckets - 1))] = sym_index;
             /* we resize the hash table */
-            hs->nb_hashed_syms++;
-            if (hs->nb_hashed_syms > 2 * nbuckets) {
-                rebuild_hash(s, 2 * nbuckets);
-            }
+            if (++hs->nb_hashed_syms > nbuckets)
+                rebuild_sym_hash(s, 2 * nbuckets, 0);
         } else {
-            *ptr = 0;
-            base[1]++;
+            ptr[0] = ptr[1] = 0;
         }
     }
     return sym_index;
@@ -482,21 +796,26 @@ ST_FUNC int find_elf_sym(Section *s, const char *name)
 {
     ElfW(Sym) *sym;
     Section *hs;
-    int nbuckets, sym_index, h;
+    int nbuckets, sym_index, *base, *e;
+    unsigned h;
     const char *name1;
 
     hs = s->hash;
     if (!hs)
         return 0;
-    nbuckets = ((int *)hs->data)[0];
-    h = elf_hash((unsigned char *) name) % nbuckets;
-    sym_index = ((int *)hs->data)[2 + h];
+    base = (int *)hs->data;
+    nbuckets = base[0];
+    h = str_hash((unsigned char *) name);
+    sym_index = base[2 + (h & (nbuckets - 1))];
     while (sym_index != 0) {
-        sym = &((ElfW(Sym) *)s->data)[sym_index];
-        name1 = (char *) s->link->data + sym->st_name;
-        if (!strcmp(name, name1))
-            return sym_index;
-        sym_index = ((int *)hs->data)[2 + nbuckets + sym_index];
+        e = base + 2 + nbuckets + 2 * sym_index;
+        if ((unsigned)e[1] == h) {
+            sym = &((ElfW(Sym) *)s->data)[sym_index];
+            name1 = (char *) s->link->data + sym->st_name;
+            if (!strcmp(name, name1))
+                return sym_index;
+        }
+        sym_index = e[0];
     }
     return 0;
 }
@@ -659,6 +978,22 @@ version_add (TCCState *s1)
 }
 #endif /* ndef ELF_OBJ_ONLY */
 
+/* tentative definitions are in .bss, or with -fdata-sections in
+   .bss.<name> */
+static int is_bss_shndx(Section *s, int shndx)
+{
+    TCCState *s1 = s->s1;
+    Section *sec;
+
+    if (shndx == bss_section->sh_num)
+        return 1;
+    if (shndx == SHN_UNDEF || shndx >= SHN_LORESERVE
+        || shndx >= s1->nb_sections || (s->sh_flags & SHF_DYNSYM))
+        return 0;
+    sec = s1->sections[shndx];
+    return sec->sh_type == SHT_NOBITS && !strncmp(sec->name, ".bss.", 5);
+}
+
 /* add an elf symbol : check if it is already defined and patch
    it. Return symbol index. NOTE that sh_num can be SHN_UNDEF. */
 ST_FUNC int set_elf_sym(Section *s, addr_t value, unsigned long size,
@@ -709,12 +1044,12 @@ ST_FUNC int set_elf_sym(Section *s, addr_t value, unsigned long size,
             } else if (sym_vis == STV_HIDDEN || sym_vis == STV_INTERNAL) {
                 /* ignore hidden symbols after */
             } else if ((esym->st_shndx == SHN_COMMON
-                            || esym->st_shndx == bss_section->sh_num)
+                            || is_bss_shndx(s, esym->st_shndx))
                         && (shndx < SHN_LORESERVE
-                            && shndx != bss_section->sh_num)) {
+                            && !is_bss_shndx(s, shndx))) {
                 /* data symbol gets precedence over common/bss */
                 goto do_patch;
-            } else if (shndx == SHN_COMMON || shndx == bss_section->sh_num) {
+            } else if (shndx == SHN_COMMON || is_bss_shndx(s, shndx)) {
                 /* data symbol keeps precedence over common/bss */
             } else if (s->sh_flags & SHF_DYNSYM) {
                 /* we accept that two DLL define the same symbol */
@@ -885,7 +1220,7 @@ static Section *create_gnu_hash(TCCState *s1)
     Elf32_Word *ptr;
 
     gnu_hash = new_section(s1, ".gnu.hash", SHT_GNU_HASH, SHF_ALLOC);
-    gnu_hash->link = dynsym->hash->link;
+    gnu_hash->link = dynsym;
 
     nb_syms = dynsym->data_offset / sizeof(ElfW(Sym));
 
@@ -1034,9 +1369,8 @@ static void update_gnu_hash(TCCState *s1, Section *gnu_hash)
 
     tcc_free(old_to_new_syms);
 
-    /* rebuild hash */
-    ptr = (Elf32_Word *) dynsym->hash->data;
-    rebuild_hash(dynsym, ptr[0]);
+    /* symbols were moved: rebuild the index */
+    rebuild_sym_hash(dynsym, ((int *)dynsym->hash->data)[0], 1);
 }
 #endif /* ELF_OBJ_ONLY */
 
@@ -1098,10 +1432,125 @@ ST_FUNC void relocate_syms(TCCState *s1, Section *symtab, int do_resolve)
     }
 }
 
-/* relocate a given section (CPU dependent) by applying the relocations
-   in the associated relocation section */
-static void relocate_section(TCCState *s1, Section *s, Section *sr)
+#ifdef R_TPOFF
+/* return the start address of the thread-local storage block, whose
+   size rounded to its alignment is stored in '*psize' and alignment in
+   '*palign' if not NULL */
+ST_FUNC addr_t get_tls_block(TCCState *s1, addr_t *psize, addr_t *palign)
+{
+    Section *s;
+    addr_t start = 0, end = 0, align = 1;
+    int i;
+
+    for (i = 1; i < s1->nb_sections; i++) {
+        s = s1->sections[i];
+        if ((s->sh_flags & (SHF_ALLOC | SHF_TLS)) != (SHF_ALLOC | SHF_TLS))
+            continue;
+        if (end == 0 || s->sh_addr < start)
+            start = s->sh_addr;
+        if (s->sh_addr + s->data_offset > end)
+            end = s->sh_addr + s->data_offset;
+        if (s->sh_addralign > align)
+            align = s->sh_addralign;
+    }
+    *psize = (end - start + align - 1) & -align;
+    if (palign)
+        *palign = align;
+    return start;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Run 'fn' on the 'n' tasks of 'size' bytes at 'tasks', with several
+   threads when 'work' (the bytes to touch) is large enough or with
+   -Wl,--threads=N.  Each thread has its own copy of the state, for
+   'qrel' and for the errors.  The tasks must not touch the same data. */
+typedef void TaskFn(TCCState *s1, void *task);
+
+#if CONFIG_TCC_THREADS
+typedef struct Workers {
+    TCCState *s1;
+    TaskFn *fn;
+    char *tasks;
+    int size, n, next, nb_errors;
+    pthread_mutex_t lock;
+} Workers;
+
+static void *run_worker(void *arg)
+{
+    Workers *w = arg;
+    TCCState s = *w->s1;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        i = w->next++;
+        pthread_mutex_unlock(&w->lock);
+        if (i >= w->n)
+            break;
+        w->fn(&s, w->tasks + i * w->size);
+    }
+    pthread_mutex_lock(&w->lock);
+    w->nb_errors += s.nb_errors - w->s1->nb_errors;
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+#endif
+
+static void run_tasks(TCCState *s1, TaskFn *fn, void *tasks, int size, int n,
+                      size_t work)
+{
+    int i;
+#if CONFIG_TCC_THREADS
+    int nt = s1->nb_threads;
+    pthread_t *th;
+    Workers w;
+
+    if (nt == 0 && work >= 16 << 20) {
+        nt = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nt > 16)
+            nt = 16;
+    }
+    if (nt > n)
+        nt = n;
+    if (nt > 1) {
+        w.s1 = s1, w.fn = fn, w.tasks = tasks, w.size = size, w.n = n;
+        w.next = w.nb_errors = 0;
+        pthread_mutex_init(&w.lock, NULL);
+        th = tcc_malloc(nt * sizeof *th);
+        for (i = 1; i < nt; i++)
+            if (pthread_create(&th[i], NULL, run_worker, &w))
+                break;
+        run_worker(&w);
+        while (--i > 0)
+            pthread_join(th[i], NULL);
+        tcc_free(th);
+        pthread_mutex_destroy(&w.lock);
+        s1->nb_errors += w.nb_errors;
+        return;
+    }
+#endif
+    for (i = 0; i < n; i++)
+        fn(s1, (char *)tasks + i * size);
+}
+
+/* relocations applied by one task: a section, or a part of one */
+typedef struct RelocTask {
+    Section *s, *sr;
+    ElfW_Rel *start, *end;
+    ElfW_Rel *dyn; /* where its dynamic relocations go */
+} RelocTask;
+
+/* relocations to split sections which are not loaded into (debug
+   information), as these produce no dynamic relocations and no code
+   patches which depend on the next relocation */
+#define RELOC_CHUNK 65536
+
+/* apply the relocations of a task (CPU dependent) */
+static void relocate_task(TCCState *s1, void *task)
 {
+    RelocTask *t = task;
+    Section *s = t->s;
     ElfW_Rel *rel;
     ElfW(Sym) *sym;
     int type, sym_index;
@@ -1109,8 +1558,8 @@ static void relocate_section(TCCState *s1, Section *s, Section *sr)
     addr_t tgt, addr;
     int is_dwarf = s->sh_num >= s1->dwlo && s->sh_num < s1->dwhi;
 
-    qrel = (ElfW_Rel *)sr->data;
-    for_each_elem(sr, 0, rel, ElfW_Rel) {
+    qrel = t->dyn;
+    for (rel = t->start; rel < t->end; rel++) {
         ptr = s->data + rel->r_offset;
         sym_index = ELFW(R_SYM)(rel->r_info);
         sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
@@ -1128,6 +1577,12 @@ static void relocate_section(TCCState *s1, Section *s, Section *sr)
         addr = s->sh_addr + rel->r_offset;
         relocate(s1, rel, type, ptr, addr, tgt);
     }
+    t->dyn = qrel;
+}
+
+/* finish a relocated section */
+static void relocate_section_end(TCCState *s1, Section *s, Section *sr)
+{
 #ifndef ELF_OBJ_ONLY
     /* if the relocation is allocated, we change its symbol table */
     if (sr->sh_flags & SHF_ALLOC) {
@@ -1150,31 +1605,60 @@ static void relocate_section(TCCState *s1, Section *s, Section *sr)
 /* relocate all sections */
 ST_FUNC void relocate_sections(TCCState *s1)
 {
-    int i;
+    int i, n;
     Section *s, *sr;
+    RelocTask *tasks, *t;
+    ElfW_Rel *rel, *end;
+    size_t work;
 
+    tasks = NULL, n = 0, work = 0;
     for (i = 1; i < s1->nb_sections; ++i) {
         sr = s1->sections[i];
         if (sr->sh_type != SHT_RELX)
             continue;
         s = s1->sections[sr->sh_info];
 #ifndef TCC_TARGET_MACHO
-        if (s != s1->got
-            || s1->static_link
-            || s1->output_type == TCC_OUTPUT_MEMORY)
+        if (s == s1->got
+            && !s1->static_link
+            && s1->output_type != TCC_OUTPUT_MEMORY)
+            continue;
 #endif
-        {
-            relocate_section(s1, s, sr);
-        }
+        rel = (ElfW_Rel *)sr->data;
+        end = (ElfW_Rel *)(sr->data + sr->data_offset);
+        do {
+            if ((n & (n - 1)) == 0)
+                tasks = tcc_realloc(tasks, (n ? 2 * n : 1) * sizeof *tasks);
+            t = &tasks[n++];
+            t->s = s, t->sr = sr, t->start = t->dyn = rel;
+            if (!(sr->sh_flags & SHF_ALLOC) && end - rel > RELOC_CHUNK)
+                rel += RELOC_CHUNK;
+            else
+                rel = end;
+            t->end = rel;
+        } while (rel < end);
+        work += sr->data_offset;
+    }
+    run_tasks(s1, relocate_task, tasks, sizeof *tasks, n, work);
+
+    for (t = tasks; t < tasks + n; t++) {
+        if (t + 1 < tasks + n && t[1].sr == t->sr)
+            continue;
+        qrel = t->dyn;
+        relocate_section_end(s1, t->s, t->sr);
+    }
+    tcc_free(tasks);
+
 #ifndef ELF_OBJ_ONLY
-        if (sr->sh_flags & SHF_ALLOC) {
-            ElfW_Rel *rel;
-            /* relocate relocation table in 'sr' */
-            for_each_elem(sr, 0, rel, ElfW_Rel)
-                rel->r_offset += s->sh_addr;
-        }
-#endif
+    for (i = 1; i < s1->nb_sections; ++i) {
+        sr = s1->sections[i];
+        if (sr->sh_type != SHT_RELX || !(sr->sh_flags & SHF_ALLOC))
+            continue;
+        s = s1->sections[sr->sh_info];
+        /* relocate relocation table in 'sr' */
+        for_each_elem(sr, 0, rel, ElfW_Rel)
+            rel->r_offset += s->sh_addr;
     }
+#endif
 }
 
 #ifndef ELF_OBJ_ONLY
@@ -1358,6 +1842,106 @@ static struct sym_attr * put_got_entry(TCCState *s1, int dyn_reloc_type,
     return attr;
 }
 
+#ifdef R_TPOFF
+/* Create the GOT entries of a TLS access that the linker does not relax
+   to local-exec: one slot with the offset from the thread pointer for
+   initial-exec, or a module/offset pair for general-dynamic and (shared
+   by all symbols) local-dynamic.  Only what is unknown at link time gets
+   a dynamic relocation, the rest is filled in by tls_got_entry(). */
+static void put_tls_got_entry(TCCState *s1, int kind, int sym_index)
+{
+    ElfW(Sym) *sym = &((ElfW(Sym) *) symtab_section->data)[sym_index];
+    struct sym_attr *attr = get_sym_attr(s1, sym_index, 1);
+    int exe = s1->output_type & TCC_OUTPUT_EXE;
+    unsigned offset, *poffset;
+    const char *name;
+
+#ifdef TLS_RELAX
+    if (exe) {
+        if (kind == TLS_LD_ENTRY || sym->st_shndx != SHN_UNDEF)
+            return;
+        kind = TLS_IE_ENTRY; /* general-dynamic relaxed to initial-exec */
+    }
+#endif
+    poffset = kind == TLS_LD_ENTRY ? &s1->tlsld_offset
+        : kind == TLS_GD_ENTRY ? &attr->tlsgd_offset : &attr->got_offset;
+    if (*poffset)
+        return;
+    *poffset = offset = s1->got->data_offset;
+    section_ptr_add(s1->got, kind == TLS_IE_ENTRY ? PTR_SIZE : 2 * PTR_SIZE);
+
+    if (!s1->dynsym || (exe && (kind == TLS_LD_ENTRY
+                                || sym->st_shndx != SHN_UNDEF)))
+        return;
+    if (kind != TLS_LD_ENTRY && ELFW(ST_BIND)(sym->st_info) != STB_LOCAL) {
+        if (0 == attr->dyn_index) {
+            name = (char *) symtab_section->link->data + sym->st_name;
+            attr->dyn_index = set_elf_sym(s1->dynsym, sym->st_value,
+                                          sym->st_size, sym->st_info, 0,
+                                          sym->st_shndx, name);
+        }
+        if (kind == TLS_IE_ENTRY) {
+            put_elf_reloc(s1->dynsym, s1->got, offset, R_TPOFF,
+                          attr->dyn_index);
+        } else {
+            put_elf_reloc(s1->dynsym, s1->got, offset, R_DTPMOD,
+                          attr->dyn_index);
+            put_elf_reloc(s1->dynsym, s1->got, offset + PTR_SIZE, R_DTPOFF,
+                          attr->dyn_index);
+        }
+    } else if (kind == TLS_IE_ENTRY) {
+        /* would need the offset of the block in the static TLS area */
+        tcc_error_noabort("initial-exec access to local thread-local "
+                          "variable in shared object");
+    } else {
+        /* the module of this object, local offset filled in later */
+        put_elf_reloc(s1->dynsym, s1->got, offset, R_DTPMOD, 0);
+    }
+}
+
+/* Return the address of the GOT entry made by put_tls_got_entry() for
+   a TLS access, after storing what is known at link time: the offset
+   'off' from the thread pointer for initial-exec, or the module and the
+   offset 'off' in its block otherwise. */
+ST_FUNC addr_t tls_got_entry(TCCState *s1, int kind, int sym_index, addr_t off)
+{
+    ElfW(Sym) *sym = &((ElfW(Sym) *) symtab_section->data)[sym_index];
+    struct sym_attr *attr = get_sym_attr(s1, sym_index, 0);
+    unsigned offset;
+    addr_t module = 1; /* the executable */
+
+#ifdef TLS_RELAX
+    if (kind == TLS_GD_ENTRY && (s1->output_type & TCC_OUTPUT_EXE))
+        kind = TLS_IE_ENTRY;
+#endif
+    offset = kind == TLS_LD_ENTRY ? s1->tlsld_offset
+        : kind == TLS_GD_ENTRY ? attr->tlsgd_offset : attr->got_offset;
+    if (kind == TLS_LD_ENTRY || sym->st_shndx != SHN_UNDEF) {
+        if (s1->output_type == TCC_OUTPUT_MEMORY) {
+            if (sym->st_shndx == SHN_ABS)
+                goto undef; /* resolved with dlsym() */
+            if (kind == TLS_IE_ENTRY)
+                tcc_error_noabort("initial-exec TLS model not supported "
+                                  "with -run");
+#ifdef TCC_IS_NATIVE
+            module = (addr_t)s1->run_tls;
+#endif
+        }
+        if (kind == TLS_IE_ENTRY) {
+            write64le(s1->got->data + offset, off);
+        } else {
+            write64le(s1->got->data + offset, module);
+            write64le(s1->got->data + offset + PTR_SIZE, off);
+        }
+    } else if (!s1->dynsym) {
+    undef:
+        tcc_error_noabort("cannot access thread-local '%s' with -run",
+            (char *) symtab_section->link->data + sym->st_name);
+    }
+    return s1->got->sh_addr + offset;
+}
+#endif
+
 /* build GOT and PLT entries */
 /* Two passes because R_JMP_SLOT should become first. Some targets
    (arm, arm64) do not allow mixing R_JMP_SLOT and R_GLOB_DAT. */
@@ -1391,6 +1975,17 @@ redo:
                 continue;
             }
 
+#ifdef R_TPOFF
+            if (gotplt_entry >= TLS_IE_ENTRY) {
+                if (pass != 1)
+                    continue;
+                if (!s1->got)
+                    got_sym = build_got(s1);
+                put_tls_got_entry(s1, gotplt_entry, sym_index);
+                continue;
+            }
+#endif
+
             /* Automatically create PLT/GOT [entry] if it is an undefined
 	       reference (resolved at runtime), or the symbol is absolute,
 	       probably created by tcc_add_symbol, and thus on 64-bit
@@ -1446,6 +2041,19 @@ redo:
                 rel->r_info = ELFW(R_INFO)(sym_index, R_X86_64_PC32);
                 continue;
             }
+#endif
+#ifdef GOT_RELAX
+            /* no GOT entry when the symbol binds locally (with -run,
+               all symbols not from dlsym() do) */
+            if ((type == R_X86_64_GOTPCRELX || type == R_X86_64_REX_GOTPCRELX)
+                && sym->st_shndx != SHN_UNDEF && sym->st_shndx < SHN_LORESERVE
+                && ELFW(ST_TYPE)(sym->st_info) != STT_TLS
+                && (ELFW(ST_VISIBILITY)(sym->st_other) != STV_DEFAULT
+                    || ELFW(ST_BIND)(sym->st_info) == STB_LOCAL
+                    || s1->output_type & TCC_OUTPUT_EXE
+                    || s1->output_type == TCC_OUTPUT_MEMORY)
+                && relax_got_reloc(s1, s1->sections[s->sh_info], rel))
+                continue;
 #endif
             reloc_type = code_reloc(type);
             if (reloc_type == -1) {
@@ -1950,6 +2558,22 @@ static void fill_local_got_entries(TCCState *s1)
     }
 }
 
+#ifdef R_TPOFF
+/* In executables and shared objects the value of a thread-local symbol
+   is its offset in the TLS template, after relocations used addresses. */
+static void tls_sym_offsets(TCCState *s1, Section *symtab)
+{
+    ElfW(Sym) *sym;
+    addr_t size, start = get_tls_block(s1, &size, NULL);
+
+    for_each_elem(symtab, 1, sym, ElfW(Sym)) {
+        if (ELFW(ST_TYPE)(sym->st_info) == STT_TLS
+            && sym->st_shndx != SHN_UNDEF && sym->st_shndx < SHN_LORESERVE)
+            sym->st_value -= start;
+    }
+}
+#endif
+
 /* Bind symbols of executable: resolve undefined symbols from exported symbols
    in shared libraries */
 static void bind_exe_dynsyms(TCCState *s1, int is_PIE)
@@ -2080,44 +2704,567 @@ static void export_global_syms(TCCState *s1)
     }
 }
 
-/* decide if an unallocated section should be output. */
-static int set_sec_sizes(TCCState *s1)
+/* sections that -Wl,--gc-sections may discard */
+static int gc_candidate(Section *s)
 {
-    int i;
+    static const char * const prefix[] = {
+        ".text.", ".data.", ".rodata.", ".bss.", ".tdata.", ".tbss.", NULL
+    };
+    const char * const *p;
+
+    if (!(s->sh_flags & SHF_ALLOC)
+        || (s->sh_type != SHT_PROGBITS && s->sh_type != SHT_NOBITS))
+        return 0;
+    for (p = prefix; *p; ++p)
+        if (!strncmp(s->name, *p, strlen(*p)))
+            return 1;
+    return 0;
+}
+
+static void gc_mark_sym(unsigned char *mark, int *stack, int *sp, ElfW(Sym) *sym)
+{
+    int i = sym->st_shndx;
+    if (i != SHN_UNDEF && i < SHN_LORESERVE && !mark[i])
+        mark[i] = 1, stack[(*sp)++] = i;
+}
+
+/* Discard the sections (from -ffunction-sections, -fdata-sections or
+   objects compiled like that) that are not reachable through
+   relocations from the entry point, exported symbols or any other
+   allocated section.  Must run after all files are loaded and before
+   the GOT and the dynamic symbols are built. */
+static void gc_sections(TCCState *s1)
+{
+    int i, sp, export_all;
+    int *stack;
+    unsigned char *mark;
+    const char *name;
+    ElfW(Sym) *sym;
+    ElfW_Rel *rel;
     Section *s;
-    int textrel = 0;
-    int file_type = s1->output_type;
 
-    /* Allocate strings for section names */
-    for(i = 1; i < s1->nb_sections; i++) {
+    mark = tcc_mallocz(s1->nb_sections);
+    stack = tcc_malloc(s1->nb_sections * sizeof *stack);
+    sp = 0;
+
+    for (i = 1; i < s1->nb_sections; i++) {
         s = s1->sections[i];
-        if (s->sh_type == SHT_RELX && !(s->sh_flags & SHF_ALLOC)) {
-            /* when generating a DLL, we include relocations but
-               we may patch them */
-            if ((file_type & TCC_OUTPUT_DYN)
-                && (s1->sections[s->sh_info]->sh_flags & SHF_ALLOC)) {
-                int count = prepare_dynamic_rel(s1, s);
-                if (count) {
-                    /* allocate the section */
-                    s->sh_flags |= SHF_ALLOC;
-                    s->sh_size = count * sizeof(ElfW_Rel);
-                    if (!(s1->sections[s->sh_info]->sh_flags & SHF_WRITE))
-                        textrel += count;
-                }
-            }
-        } else if ((s->sh_flags & SHF_ALLOC)
-#ifdef TCC_TARGET_ARM
-                   || s->sh_type == SHT_ARM_ATTRIBUTES
-#endif
-                   || s1->do_debug) {
-            s->sh_size = s->data_offset;
+        if ((s->sh_flags & SHF_ALLOC) && !gc_candidate(s)) {
+            mark[i] = 1;
+            /* the FDEs point to every function, don't follow them */
+            if (strcmp(s->name, ".eh_frame"))
+                stack[sp++] = i;
         }
+    }
 
-#ifdef TCC_TARGET_ARM
-        /* XXX: Suppress stack unwinding section. */
-        if (s->sh_type == SHT_ARM_EXIDX) {
-            s->sh_flags = 0;
-            s->sh_size = 0;
+    name = s1->elf_entryname ? s1->elf_entryname : "_start";
+    i = find_elf_sym(symtab_section, name);
+    if (i)
+        gc_mark_sym(mark, stack, &sp, (ElfW(Sym) *)symtab_section->data + i);
+
+    export_all = s1->output_type == TCC_OUTPUT_DLL || s1->rdynamic;
+    for_each_elem(symtab_section, 1, sym, ElfW(Sym)) {
+        if (ELFW(ST_BIND)(sym->st_info) == STB_LOCAL)
+            continue;
+        name = (char *)symtab_section->link->data + sym->st_name;
+        /* shared libraries may refer to symbols of the executable */
+        if (export_all || find_elf_sym(s1->dynsymtab_section, name))
+            gc_mark_sym(mark, stack, &sp, sym);
+    }
+
+    while (sp) {
+        s = s1->sections[stack[--sp]];
+        if (!s->reloc)
+            continue;
+        for_each_elem(s->reloc, 0, rel, ElfW_Rel) {
+            sym = (ElfW(Sym) *)symtab_section->data + ELFW(R_SYM)(rel->r_info);
+            gc_mark_sym(mark, stack, &sp, sym);
+        }
+    }
+
+    for (i = 1; i < s1->nb_sections; i++) {
+        s = s1->sections[i];
+        if (mark[i] || !gc_candidate(s))
+            continue;
+        if (s1->verbose == 2)
+            printf("   -- %s\n", s->name);
+        /* without SHF_ALLOC and without data it won't be output */
+        s->sh_flags &= ~SHF_ALLOC;
+        s->data_offset = 0;
+        if (s->reloc)
+            s->reloc->data_offset = 0;
+    }
+    tcc_free(stack);
+    tcc_free(mark);
+}
+
+#if SHT_RELX == SHT_RELA
+/* relocations (in section 's') that only call or jump to their target */
+static int call_reloc(Section *s, ElfW_Rel *rel)
+{
+    int type = ELFW(R_TYPE)(rel->r_info);
+#if defined TCC_TARGET_X86_64
+    unsigned char *p = s->data + rel->r_offset;
+    /* call, jmp or jcc with a 32 bit displacement */
+    return (type == R_X86_64_PLT32 || type == R_X86_64_PC32)
+        && (s->sh_flags & SHF_EXECINSTR) && rel->r_offset >= 2
+        && rel->r_addend == -4
+        && (p[-1] == 0xe8 || p[-1] == 0xe9 || (p[-2] == 0x0f && (p[-1] & 0xf0) == 0x80));
+#elif defined TCC_TARGET_ARM64
+    return type == R_AARCH64_CALL26 || type == R_AARCH64_JUMP26;
+#elif defined TCC_TARGET_RISCV64
+    return type == R_RISCV_CALL || type == R_RISCV_CALL_PLT;
+#else
+    return 0;
+#endif
+}
+
+typedef struct IcfFunc {
+    Section *s;
+    addr_t start, size;
+    addr_t lo;          /* start of its piece, or of itself */
+    addr_t cut;         /* bytes removed from 'lo' when folded */
+    addr_t end;         /* end of the code and of what is removed */
+    addr_t shift;       /* bytes removed before in the same section */
+    unsigned hash;
+    int canon;          /* the function it is folded into, or itself */
+    int keep;           /* may not go (address taken, not alone) */
+    int nrels;
+    ElfW_Rel **rels;    /* its relocations by offset */
+} IcfFunc;
+
+static int icf_cmp(const void *a, const void *b)
+{
+    const IcfFunc *p = a, *q = b;
+    if (p->s != q->s)
+        return p->s->sh_num - q->s->sh_num;
+    return p->start < q->start ? -1 : p->start > q->start;
+}
+
+static int icf_cmp_hash(const void *a, const void *b)
+{
+    const IcfFunc *p = *(IcfFunc **)a, *q = *(IcfFunc **)b;
+    if (p->hash != q->hash)
+        return p->hash < q->hash ? -1 : 1;
+    if (p->size != q->size)
+        return p->size < q->size ? -1 : 1;
+    if (p->keep != q->keep)
+        return q->keep - p->keep;
+    return p < q ? -1 : p > q;
+}
+
+static int icf_cmp_piece(const void *a, const void *b)
+{
+    const addr_t *x = a, *y = b;
+    if (x[0] != y[0])
+        return x[0] < y[0] ? -1 : 1;
+    return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+static int icf_cmp_rel(const void *a, const void *b)
+{
+    addr_t x = (*(ElfW_Rel **)a)->r_offset, y = (*(ElfW_Rel **)b)->r_offset;
+    return x < y ? -1 : x > y;
+}
+
+/* the last function from 'x' or before in section 'shndx', or before */
+static int icf_lookup(IcfFunc *f, int n, int shndx, addr_t x)
+{
+    int lo = -1, hi = n, m;
+    while (hi - lo > 1) {
+        m = (lo + hi) / 2;
+        if (f[m].s->sh_num < shndx
+            || (f[m].s->sh_num == shndx && f[m].lo <= x))
+            lo = m;
+        else
+            hi = m;
+    }
+    return lo;
+}
+
+static int icf_root(IcfFunc *f, int i)
+{
+    while (f[i].canon != i)
+        i = f[i].canon;
+    return i;
+}
+
+/* the function at 'x' in section 'shndx', or -1 */
+static int icf_find(IcfFunc *f, int n, int shndx, addr_t x)
+{
+    int i = icf_lookup(f, n, shndx, x);
+    if (i < 0 || f[i].s->sh_num != shndx || x >= f[i].end)
+        return -1;
+    return i;
+}
+
+/* What a relocation of function 'i' refers to, as (kind, value).  The
+   symbol is enough: references through a section symbol are into the
+   piece it starts, whatever the addend (PC relative ones have it
+   biased by the size of the rest of the instruction). */
+static void icf_target(TCCState *s1, IcfFunc *f, int n, int i, ElfW_Rel *rel, addr_t *k)
+{
+    ElfW(Sym) *sym;
+    int g, sym_index = ELFW(R_SYM)(rel->r_info);
+
+    sym = (ElfW(Sym) *)symtab_section->data + sym_index;
+    k[0] = 0, k[1] = sym_index;
+    if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+        return;
+    k[0] = 1 + sym->st_shndx, k[1] = sym->st_value;
+    g = icf_find(f, n, sym->st_shndx, sym->st_value);
+    if (g < 0)
+        return;
+    /* into itself, or into a function which may be folded */
+    k[0] = g == i ? SHN_LORESERVE : SHN_LORESERVE + 1 + icf_root(f, g);
+    k[1] = sym->st_value - f[g].start;
+}
+
+static int icf_equal(TCCState *s1, IcfFunc *f, int n, int a, int b)
+{
+    IcfFunc *p = &f[a], *q = &f[b];
+    ElfW_Rel *r, *t;
+    addr_t ka[2], kb[2];
+    int j;
+
+    if (p->nrels != q->nrels || p->start - p->lo != q->start - q->lo
+        || memcmp(p->s->data + p->lo, q->s->data + q->lo, p->start + p->size - p->lo))
+        return 0;
+    for (j = 0; j < p->nrels; j++) {
+        r = p->rels[j], t = q->rels[j];
+        if (r->r_offset - p->lo != t->r_offset - q->lo
+            || ELFW(R_TYPE)(r->r_info) != ELFW(R_TYPE)(t->r_info)
+            || r->r_addend != t->r_addend)
+            return 0;
+        icf_target(s1, f, n, a, r, ka);
+        icf_target(s1, f, n, b, t, kb);
+        if (ka[0] != kb[0] || ka[1] != kb[1])
+            return 0;
+    }
+    return 1;
+}
+
+/* where offset 'x' of section 's' goes: into the kept copy when it is
+   in a folded function (unless 'shift_only'), else down by the bytes
+   removed before it */
+static Section *icf_map(IcfFunc *f, int n, Section *s, addr_t *x, int shift_only)
+{
+    int i = icf_lookup(f, n, s->sh_num, *x);
+    IcfFunc *p, *c;
+
+    if (i < 0 || f[i].s != s)
+        return s;
+    p = &f[i];
+    if (p->canon != i && *x < p->end) {
+        if (shift_only) {
+            *x = p->lo - p->shift;
+            return s;
+        }
+        c = &f[icf_root(f, i)];
+        *x = c->start + (*x - p->start);
+        return icf_map(f, n, c->s, x, 1);
+    }
+    *x -= p->shift + (p->canon != i ? p->cut : 0);
+    return s;
+}
+
+/* Fold the functions with the same code and equivalent relocations
+   (-Wl,--icf=all), or only those whose address is not taken
+   (--icf=safe).  The symbols of the copies go to the one that is kept
+   and their code is removed.  Must run where gc_sections() does. */
+static void icf_functions(TCCState *s1)
+{
+    IcfFunc *f, *p, *q, **order;
+    ElfW_Rel **rels, *rel, *r;
+    ElfW(Sym) *sym;
+    Section *s, *sr, *s2;
+    int i, j, k, m, n, np, nrels, changed, export_all, redirect_only, *secsym;
+    addr_t x, next, align, shift, *pc;
+    const char *name;
+
+    /* the sized functions in code sections */
+    f = NULL, n = 0;
+    for_each_elem(symtab_section, 1, sym, ElfW(Sym)) {
+        if (ELFW(ST_TYPE)(sym->st_info) != STT_FUNC || !sym->st_size
+            || sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+            continue;
+        s = s1->sections[sym->st_shndx];
+        if (!(s->sh_flags & SHF_EXECINSTR) || s->sh_type != SHT_PROGBITS
+            || sym->st_value + sym->st_size > s->data_offset)
+            continue;
+        if ((n & (n - 1)) == 0)
+            f = tcc_realloc(f, (n ? 2 * n : 1) * sizeof *f);
+        p = &f[n++];
+        memset(p, 0, sizeof *p);
+        p->s = s, p->start = sym->st_value, p->size = sym->st_size;
+    }
+    if (n < 2)
+        goto done;
+    qsort(f, n, sizeof *f, icf_cmp);
+    /* one entry for aliases, overlaps stay */
+    for (i = j = 0; i < n; i++) {
+        p = &f[j ? j - 1 : 0];
+        if (j && p->s == f[i].s && p->start == f[i].start && p->size == f[i].size)
+            continue;
+        if (j && p->s == f[i].s && f[i].start < p->start + p->size)
+            p->keep = f[i].keep = 1;
+        f[j++] = f[i];
+    }
+    n = j;
+    /* The pieces of code loaded from each object file, and the code
+       compiled before.  Only a function which is a piece by itself (as
+       with -ffunction-sections) may go: references within a piece need
+       no relocations, assemblers resolve them.  What goes is its code
+       and its padding, by whole alignment units unless the section
+       ends there. */
+    pc = s1->code_pieces, np = s1->nb_code_pieces;
+    qsort(pc, np, 2 * sizeof *pc, icf_cmp_piece);
+    for (i = k = 0; i < n; i++) {
+        p = &f[i], s = p->s;
+        while (k < np && (pc[2 * k] < s->sh_num
+               || (pc[2 * k] == s->sh_num && pc[2 * k + 1] <= p->start)))
+            k++;
+        x = k && pc[2 * k - 2] == s->sh_num ? pc[2 * k - 1] : 0;
+        next = k < np && pc[2 * k] == s->sh_num ? pc[2 * k + 1] : s->data_offset;
+        align = s->sh_addralign ? s->sh_addralign : 1;
+        q = &f[i ? i - 1 : 0];
+        if (i && q->s == s && q->start >= x) {
+            /* not alone */
+            q->keep = p->keep = 1;
+            q->lo = q->start, q->cut = 0, q->end = q->start + q->size;
+        }
+        p->lo = p->start, p->cut = 0;
+        if (!p->keep && next >= p->start + p->size
+            && next <= ((p->start + p->size + align - 1) & -align)) {
+            /* leading padding is part of it */
+            p->lo = x;
+            p->cut = next - x;
+            if (next < s->data_offset)
+                p->cut &= -align;
+        } else
+            p->keep = 1;
+        p->end = p->lo + p->cut > p->start + p->size ? p->lo + p->cut : p->start + p->size;
+        p->canon = i;
+    }
+
+    /* functions whose address is taken or which are exported
+       (--icf=safe) */
+    export_all = s1->output_type == TCC_OUTPUT_DLL || s1->rdynamic;
+    if (s1->icf == 2) {
+        for_each_elem(symtab_section, 1, sym, ElfW(Sym)) {
+            if (ELFW(ST_BIND)(sym->st_info) == STB_LOCAL
+                || sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+                continue;
+            name = (char *)symtab_section->link->data + sym->st_name;
+            if (export_all || find_elf_sym(s1->dynsymtab_section, name))
+                if ((k = icf_find(f, n, sym->st_shndx, sym->st_value)) >= 0)
+                    f[k].keep = 1;
+        }
+    }
+    nrels = 0;
+    for (i = 1; i < s1->nb_sections; i++) {
+        sr = s1->sections[i];
+        if (sr->sh_type != SHT_RELX)
+            continue;
+        s = s1->sections[sr->sh_info];
+        if (s->sh_flags & SHF_EXECINSTR)
+            nrels += sr->data_offset / sizeof *rel;
+        if (s1->icf != 2 || !(s->sh_flags & SHF_ALLOC)
+            || !strcmp(s->name, ".eh_frame"))
+            continue;
+        for_each_elem(sr, 0, rel, ElfW_Rel) {
+            sym = (ElfW(Sym) *)symtab_section->data + ELFW(R_SYM)(rel->r_info);
+            if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE
+                || call_reloc(s, rel))
+                continue;
+            if ((k = icf_find(f, n, sym->st_shndx, sym->st_value)) >= 0)
+                f[k].keep = 1;
+        }
+    }
+
+    /* the relocations of each function, by offset */
+    rels = tcc_malloc((nrels + 1) * sizeof *rels);
+    for (i = 0, m = 0; i < n; i = j) {
+        s = f[i].s;
+        for (j = i; j < n && f[j].s == s; j++)
+            ;
+        k = m;
+        if (s->reloc)
+            for_each_elem(s->reloc, 0, rel, ElfW_Rel)
+                rels[m++] = rel;
+        qsort(rels + k, m - k, sizeof *rels, icf_cmp_rel);
+        for (p = &f[i]; p < &f[j]; p++) {
+            while (k < m && rels[k]->r_offset < p->lo)
+                k++;
+            p->rels = rels + k;
+            while (k < m && rels[k]->r_offset < p->start + p->size)
+                k++;
+            p->nrels = rels + k - p->rels;
+            p->hash = mem_hash(s->data + p->lo, p->start + p->size - p->lo)
+                + p->nrels;
+        }
+    }
+
+    /* group by contents, fold until nothing changes */
+    order = tcc_malloc(n * sizeof *order);
+    for (i = 0; i < n; i++)
+        order[i] = &f[i];
+    qsort(order, n, sizeof *order, icf_cmp_hash);
+    do {
+        changed = 0;
+        for (i = 0; i < n; i = j) {
+            for (j = i + 1; j < n && order[j]->hash == order[i]->hash
+                 && order[j]->size == order[i]->size; j++)
+                ;
+            for (k = i; k < j; k++) {
+                p = order[k];
+                if (p->canon != p - f)
+                    continue;
+                for (m = k + 1; m < j; m++) {
+                    q = order[m];
+                    if (q->canon == q - f && !q->keep
+                        && icf_equal(s1, f, n, p - f, q - f))
+                        q->canon = p - f, changed = 1;
+                }
+            }
+        }
+    } while (changed);
+    tcc_free(order);
+
+    /* line tables step over functions: only redirect then */
+    s = have_section(s1, ".debug_line");
+    redirect_only = s && s->data_offset;
+    for (i = 0; i < n; i = j) {
+        x = 0;
+        for (j = i; j < n && f[j].s == f[i].s; j++) {
+            f[j].shift = x;
+            if (redirect_only)
+                f[j].cut = 0;
+            if (f[j].canon != j)
+                x += f[j].cut;
+        }
+    }
+
+    /* references through section symbols: point them to a section
+       symbol at offset zero, with the offset in the addend */
+    secsym = tcc_mallocz(s1->nb_sections * sizeof *secsym);
+    for (i = 1; i < s1->nb_sections; i++) {
+        sr = s1->sections[i];
+        if (sr->sh_type != SHT_RELX)
+            continue;
+        for_each_elem(sr, 0, rel, ElfW_Rel) {
+            sym = (ElfW(Sym) *)symtab_section->data + ELFW(R_SYM)(rel->r_info);
+            if (ELFW(ST_TYPE)(sym->st_info) != STT_SECTION
+                || sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+                continue;
+            s = s1->sections[sym->st_shndx];
+            if (!(s->sh_flags & SHF_EXECINSTR))
+                continue;
+            x = sym->st_value;
+            s2 = icf_map(f, n, s, &x, 0);
+            x += rel->r_addend;
+            k = secsym[s2->sh_num];
+            if (!k)
+                k = secsym[s2->sh_num] = put_elf_sym(symtab_section, 0, 0,
+                    ELFW(ST_INFO)(STB_LOCAL, STT_SECTION), 0, s2->sh_num, NULL);
+            rel->r_info = ELFW(R_INFO)(k, ELFW(R_TYPE)(rel->r_info));
+            rel->r_addend = x;
+        }
+    }
+    tcc_free(secsym);
+
+    /* the symbols */
+    for_each_elem(symtab_section, 1, sym, ElfW(Sym)) {
+        if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+            continue;
+        s = s1->sections[sym->st_shndx];
+        if (!(s->sh_flags & SHF_EXECINSTR))
+            continue;
+        x = sym->st_value;
+        s2 = icf_map(f, n, s, &x, ELFW(ST_TYPE)(sym->st_info) == STT_SECTION);
+        sym->st_shndx = s2->sh_num;
+        sym->st_value = x;
+    }
+
+    /* remove the code and its relocations */
+    for (i = 0; i < n; i = j) {
+        s = f[i].s;
+        for (j = i; j < n && f[j].s == s; j++)
+            ;
+        if (s->reloc) {
+            r = (ElfW_Rel *)s->reloc->data;
+            for_each_elem(s->reloc, 0, rel, ElfW_Rel) {
+                x = rel->r_offset;
+                k = icf_lookup(f, n, s->sh_num, x);
+                if (k >= 0 && f[k].s == s && f[k].canon != k
+                    && x < f[k].lo + f[k].cut)
+                    continue;
+                icf_map(f, n, s, &x, 1);
+                *r = *rel;
+                r++->r_offset = x;
+            }
+            s->reloc->data_offset = (unsigned char *)r - s->reloc->data;
+        }
+        shift = 0;
+        for (p = &f[i]; p < &f[j]; p++) {
+            next = p + 1 < &f[j] ? p[1].lo : s->data_offset;
+            x = p->lo + (p->canon != p - f ? p->cut : 0);
+            shift = p->shift + (x - p->lo);
+            if (shift)
+                memmove(s->data + x - shift, s->data + x, next - x);
+        }
+        s->data_offset -= shift;
+    }
+    /* the pieces move with their code */
+    for (k = 0; k < np; k++) {
+        x = pc[2 * k + 1];
+        icf_map(f, n, s1->sections[pc[2 * k]], &x, 1);
+        pc[2 * k + 1] = x;
+    }
+    tcc_free(rels);
+ done:
+    tcc_free(f);
+}
+#endif
+
+/* decide if an unallocated section should be output. */
+static int set_sec_sizes(TCCState *s1)
+{
+    int i;
+    Section *s;
+    int textrel = 0;
+    int file_type = s1->output_type;
+
+    /* Allocate strings for section names */
+    for(i = 1; i < s1->nb_sections; i++) {
+        s = s1->sections[i];
+        if (s->sh_type == SHT_RELX && !(s->sh_flags & SHF_ALLOC)) {
+            /* when generating a DLL, we include relocations but
+               we may patch them */
+            if ((file_type & TCC_OUTPUT_DYN)
+                && (s1->sections[s->sh_info]->sh_flags & SHF_ALLOC)) {
+                int count = prepare_dynamic_rel(s1, s);
+                if (count) {
+                    /* allocate the section */
+                    s->sh_flags |= SHF_ALLOC;
+                    s->sh_size = count * sizeof(ElfW_Rel);
+                    if (!(s1->sections[s->sh_info]->sh_flags & SHF_WRITE))
+                        textrel += count;
+                }
+            }
+        } else if ((s->sh_flags & SHF_ALLOC)
+#ifdef TCC_TARGET_ARM
+                   || s->sh_type == SHT_ARM_ATTRIBUTES
+#endif
+                   || s1->do_debug) {
+            s->sh_size = s->data_offset;
+        }
+
+#ifdef TCC_TARGET_ARM
+        /* XXX: Suppress stack unwinding section. */
+        if (s->sh_type == SHT_ARM_EXIDX) {
+            s->sh_flags = 0;
+            s->sh_size = 0;
         }
 #endif
 
@@ -2140,6 +3287,7 @@ struct dyn_inf {
     int phnum;
     Section *interp;
     Section *note;
+    Section *hash;
     Section *gnu_hash;
 
     /* read only segment mapping for GNU_RELRO */
@@ -2163,8 +3311,6 @@ static int sort_sections(TCCState *s1, int *sec_order, Section *interp)
             j = 0x100;
             if (s->sh_flags & SHF_WRITE)
                 j = 0x200;
-            if (s->sh_flags & SHF_TLS)
-                j += 0x200;
         } else if (s->sh_name) {
             j = 0x700;
         } else {
@@ -2182,22 +3328,26 @@ static int sort_sections(TCCState *s1, int *sec_order, Section *interp)
             k = 0x20;
             if (s1->plt && s == s1->plt->reloc)
                 k = 0x21;
+        } else if (s->sh_flags & SHF_TLS) {
+            k = 0x40; /* the TLS initialization image */
+            if (s->sh_type == SHT_NOBITS)
+                k = 0x41;
         } else if (s->sh_type == SHT_PREINIT_ARRAY) {
-            k = 0x41;
-        } else if (s->sh_type == SHT_INIT_ARRAY) {
             k = 0x42;
-        } else if (s->sh_type == SHT_FINI_ARRAY) {
+        } else if (s->sh_type == SHT_INIT_ARRAY) {
             k = 0x43;
+        } else if (s->sh_type == SHT_FINI_ARRAY) {
+            k = 0x44;
 #ifdef CONFIG_TCC_BCHECK
         } else if (s == bounds_section || s == lbounds_section) {
-            k = 0x44;
+            k = 0x45;
 #endif
         } else if (s == rodata_section || 0 == strcmp(s->name, ".data.rel.ro")) {
-            k = 0x45;
-        } else if (s->sh_type == SHT_DYNAMIC) {
             k = 0x46;
+        } else if (s->sh_type == SHT_DYNAMIC) {
+            k = 0x47;
         } else if (s == s1->got) {
-            k = 0x47; /* .got as RELRO needs BIND_NOW in DT_FLAGS */
+            k = 0x48; /* .got as RELRO needs BIND_NOW in DT_FLAGS */
         } else {
             k = 0x50;
             if (s->sh_type == SHT_NOTE)
@@ -2224,7 +3374,7 @@ static int sort_sections(TCCState *s1, int *sec_order, Section *interp)
         k = sec_cls[i];
         f = 0;
         if (k < 0x700) {
-            f = s->sh_flags & (SHF_ALLOC|SHF_WRITE|SHF_EXECINSTR|SHF_TLS);
+            f = s->sh_flags & (SHF_ALLOC|SHF_WRITE|SHF_EXECINSTR);
 #if TARGETOS_NetBSD
 	    /* NetBSD only supports 2 PT_LOAD sections.
 	       See: https://blog.netbsd.org/tnf/entry/the_first_report_on_lld */
@@ -2261,8 +3411,8 @@ static ElfW(Phdr) *fill_phdr(ElfW(Phdr) *ph, int type, Section *s)
    in memory. This function also fills corresponding program headers. */
 static int layout_sections(TCCState *s1, int *sec_order, struct dyn_inf *d)
 {
-    Section *s;
-    addr_t addr, tmp, align, s_align, base;
+    Section *s, tls;
+    addr_t addr, tmp, align, s_align, base, size, tls_align, tls_memsz;
     ElfW(Phdr) *ph = NULL;
     int i, f, n, phnum, phfill;
     int file_offset;
@@ -2275,6 +3425,18 @@ static int layout_sections(TCCState *s1, int *sec_order, struct dyn_inf *d)
     phnum += phfill;
     if (d->note)
         ++phnum;
+    /* the TLS image has a PT_TLS header within its PT_LOAD one, and is
+       aligned as its most aligned section */
+    tls_align = tls_memsz = 0;
+    for (i = 1; i < s1->nb_sections; i++) {
+        s = s1->sections[i];
+        if ((s->sh_flags & (SHF_ALLOC|SHF_TLS)) == (SHF_ALLOC|SHF_TLS)
+            && s->sh_addralign > tls_align)
+            tls_align = s->sh_addralign;
+    }
+    memset(&tls, 0, sizeof tls);
+    if (tls_align)
+        ++phnum;
     if (d->dynamic)
         ++phnum;
     if (d->roinf)
@@ -2337,12 +3499,29 @@ static int layout_sections(TCCState *s1, int *sec_order, struct dyn_inf *d)
             }
         }
 
+        if ((s->sh_flags & SHF_TLS) && tls.sh_addralign == 0)
+            align = tls_align - 1;
         tmp = addr;
         addr = (addr + align) & ~align;
         file_offset += (int)(addr - tmp);
         s->sh_offset = file_offset;
         s->sh_addr = addr;
 
+        /* .tbss takes no room outside of the TLS block */
+        size = s->sh_size;
+        if (s->sh_flags & SHF_TLS) {
+            if (tls.sh_addralign == 0) {
+                tls.sh_offset = s->sh_offset;
+                tls.sh_addr = s->sh_addr;
+                tls.sh_addralign = tls_align;
+            }
+            tls_memsz = (addr - tls.sh_addr) + s->sh_size;
+            if (s->sh_type == SHT_NOBITS)
+                size = 0;
+            else
+                tls.sh_size = tls_memsz;
+        }
+
         if (f & 1<<8) {
             /* set new program header */
             ph = &d->phdr[phfill + n];
@@ -2353,10 +3532,6 @@ static int layout_sections(TCCState *s1, int *sec_order, struct dyn_inf *d)
                 ph->p_flags |= PF_W;
             if (f & SHF_EXECINSTR)
                 ph->p_flags |= PF_X;
-            if (f & SHF_TLS) {
-                ph->p_type = PT_TLS;
-                ph->p_align = align + 1;
-            }
 
             ph->p_offset = file_offset;
             ph->p_vaddr = addr;
@@ -2379,10 +3554,10 @@ static int layout_sections(TCCState *s1, int *sec_order, struct dyn_inf *d)
                 roinf->sh_addr = s->sh_addr;
                 roinf->sh_addralign = 1;
 	    }
-            roinf->sh_size = (addr - roinf->sh_addr) + s->sh_size;
+            roinf->sh_size = (addr - roinf->sh_addr) + size;
         }
 
-        addr += s->sh_size;
+        addr += size;
         if (s->sh_type != SHT_NOBITS)
             file_offset += s->sh_size;
 
@@ -2397,6 +3572,8 @@ static int layout_sections(TCCState *s1, int *sec_order, struct dyn_inf *d)
         fill_phdr(++ph, PT_DYNAMIC, d->dynamic)->p_flags |= PF_W;
     if (d->roinf)
         fill_phdr(++ph, PT_GNU_RELRO, d->roinf)->p_flags |= PF_W;
+    if (tls_align)
+        fill_phdr(++ph, PT_TLS, &tls)->p_memsz = tls_memsz;
     if (d->interp)
         fill_phdr(&d->phdr[1], PT_INTERP, d->interp);
     if (phfill) {
@@ -2427,7 +3604,7 @@ static void fill_dynamic(TCCState *s1, struct dyn_inf *dyninf)
     Section *s;
 
     /* put dynamic section entries */
-    put_dt(dynamic, DT_HASH, s1->dynsym->hash->sh_addr);
+    put_dt(dynamic, DT_HASH, dyninf->hash->sh_addr);
     put_dt(dynamic, DT_GNU_HASH, dyninf->gnu_hash->sh_addr);
     put_dt(dynamic, DT_STRTAB, dyninf->dynstr->sh_addr);
     put_dt(dynamic, DT_SYMTAB, s1->dynsym->sh_addr);
@@ -2524,6 +3701,92 @@ static void update_reloc_sections(TCCState *s1, struct dyn_inf *dyninf)
 static int tidy_section_headers(TCCState *s1, int *sec_order);
 #endif /* ndef ELF_OBJ_ONLY */
 
+static void fill_section_header(Section *s, ElfW(Shdr) *sh)
+{
+    memset(sh, 0, sizeof(ElfW(Shdr)));
+    if (s) {
+        sh->sh_name = s->sh_name;
+        sh->sh_type = s->sh_type;
+        sh->sh_flags = s->sh_flags;
+        sh->sh_entsize = s->sh_entsize;
+        sh->sh_info = s->sh_info;
+        if (s->link)
+            sh->sh_link = s->link->sh_num;
+        sh->sh_addralign = s->sh_addralign;
+        sh->sh_addr = s->sh_addr;
+        sh->sh_offset = s->sh_offset;
+        sh->sh_size = s->sh_size;
+    }
+}
+
+#ifndef _WIN32
+/* a part of a section copied into the output image */
+typedef struct CopyTask {
+    unsigned char *dst, *src;
+    size_t size;
+} CopyTask;
+
+#define COPY_CHUNK (1 << 20)
+
+static void copy_task(TCCState *s1, void *task)
+{
+    CopyTask *t = task;
+    memcpy(t->dst, t->src, t->size);
+}
+
+/* Write the file through a shared mapping of its final size, with
+   the sections copied in place (in parallel for large outputs).
+   Returns 0 if the file cannot be mapped (a pipe, for example) */
+static int tcc_output_mapped(TCCState *s1, FILE *f, ElfW(Ehdr) *ehdr,
+                             ElfW(Phdr) *phdr, int *sec_order)
+{
+    size_t size, len, work;
+    unsigned char *p;
+    int fd, i, n;
+    Section *s;
+    CopyTask *tasks, *t;
+    ElfW(Shdr) shdr;
+
+    fd = fileno(f);
+    size = ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr));
+    if (ftruncate(fd, size))
+        return 0;
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return 0;
+    memcpy(p, ehdr, sizeof(ElfW(Ehdr)));
+    if (phdr)
+        memcpy(p + ehdr->e_phoff, phdr, ehdr->e_phnum * sizeof(ElfW(Phdr)));
+
+    tasks = NULL, n = 0, work = 0;
+    for(i = 1; i < ehdr->e_shnum; i++) {
+        s = s1->sections[sec_order ? sec_order[i] : i];
+        if (s->sh_type == SHT_NOBITS)
+            continue;
+        for (len = 0; len < s->sh_size; len += t->size) {
+            if ((n & (n - 1)) == 0)
+                tasks = tcc_realloc(tasks, (n ? 2 * n : 1) * sizeof *tasks);
+            t = &tasks[n++];
+            t->dst = p + s->sh_offset + len;
+            t->src = s->data + len;
+            t->size = s->sh_size - len;
+            if (t->size > COPY_CHUNK)
+                t->size = COPY_CHUNK;
+        }
+        work += s->sh_size;
+    }
+    run_tasks(s1, copy_task, tasks, sizeof *tasks, n, work);
+    tcc_free(tasks);
+
+    for(i = 0; i < ehdr->e_shnum; i++) {
+        fill_section_header(s1->sections[i], &shdr);
+        memcpy(p + ehdr->e_shoff + i * sizeof(ElfW(Shdr)), &shdr, sizeof shdr);
+    }
+    munmap(p, size);
+    return 1;
+}
+#endif
+
 /* Create an ELF file on disk.
    This function handle ELF specific layout requirements */
 static int tcc_output_elf(TCCState *s1, FILE *f, int phnum, ElfW(Phdr) *phdr,
@@ -2532,7 +3795,7 @@ static int tcc_output_elf(TCCState *s1, FILE *f, int phnum, ElfW(Phdr) *phdr,
     int i, shnum, offset, size, file_type;
     Section *s;
     ElfW(Ehdr) ehdr;
-    ElfW(Shdr) shdr, *sh;
+    ElfW(Shdr) shdr;
 
     file_type = s1->output_type;
     shnum = s1->nb_sections;
@@ -2598,13 +3861,17 @@ static int tcc_output_elf(TCCState *s1, FILE *f, int phnum, ElfW(Phdr) *phdr,
     ehdr.e_shnum = shnum;
     ehdr.e_shstrndx = shnum - 1;
 
+    sort_syms(s1, symtab_section);
+#ifndef _WIN32
+    if (tcc_output_mapped(s1, f, &ehdr, phdr, sec_order))
+        return 0;
+#endif
+
     fwrite(&ehdr, 1, sizeof(ElfW(Ehdr)), f);
     if (phdr)
         fwrite(phdr, 1, phnum * sizeof(ElfW(Phdr)), f);
     offset = sizeof(ElfW(Ehdr)) + phnum * sizeof(ElfW(Phdr));
 
-    sort_syms(s1, symtab_section);
-
     for(i = 1; i < shnum; i++) {
         s = s1->sections[sec_order ? sec_order[i] : i];
         if (s->sh_type != SHT_NOBITS) {
@@ -2626,23 +3893,8 @@ static int tcc_output_elf(TCCState *s1, FILE *f, int phnum, ElfW(Phdr) *phdr,
     }
 
     for(i = 0; i < shnum; i++) {
-        sh = &shdr;
-        memset(sh, 0, sizeof(ElfW(Shdr)));
-        s = s1->sections[i];
-        if (s) {
-            sh->sh_name = s->sh_name;
-            sh->sh_type = s->sh_type;
-            sh->sh_flags = s->sh_flags;
-            sh->sh_entsize = s->sh_entsize;
-            sh->sh_info = s->sh_info;
-            if (s->link)
-                sh->sh_link = s->link->sh_num;
-            sh->sh_addralign = s->sh_addralign;
-            sh->sh_addr = s->sh_addr;
-            sh->sh_offset = s->sh_offset;
-            sh->sh_size = s->sh_size;
-        }
-        fwrite(sh, 1, sizeof(ElfW(Shdr)), f);
+        fill_section_header(s1->sections[i], &shdr);
+        fwrite(&shdr, 1, sizeof(ElfW(Shdr)), f);
     }
     return 0;
 }
@@ -2683,7 +3935,8 @@ static int tcc_write_elf_file(TCCState *s1, const char *filename, int phnum,
     else
         mode = 0777;
     unlink(filename);
-    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, mode);
+    /* read access for tcc_output_mapped() */
+    fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, mode);
     if (fd < 0 || (f = fdopen(fd, "wb")) == NULL)
         return tcc_error_noabort("could not write '%s: %s'", filename, strerror(errno));
     if (s1->verbose)
@@ -2806,6 +4059,783 @@ static Section *create_bsd_note_section(TCCState *s1,
 }
 #endif
 
+#if CONFIG_TCC_INCREMENTAL
+/* ------------------------------------------------------------------------- */
+/* Incremental relinking (-Wl,--incremental)
+
+   A full link of an executable records in '<output>.tccinc' the files
+   it read, where the sections of each object were put (with room to
+   grow after each one) and the values of the global symbols.  When only
+   objects changed since, tcc_relink() loads them alone, relocates them
+   against the recorded symbols and writes them over their old places
+   in the output.  Whatever it cannot do that way falls back to a full
+   link. */
+
+#define INC_MAGIC "tccinc " TCC_VERSION
+
+/* a section of an object, and its place in the output */
+typedef struct IncSlot {
+    const char *name;
+    Section *s; /* while loading */
+    addr_t offset; /* in 's' */
+    addr_t size, room; /* 'room' includes the padding */
+    addr_t addr, file_offset;
+    unsigned align, nobits;
+} IncSlot;
+
+typedef struct IncFile {
+    const char *name;
+    unsigned long long stat[3]; /* size, mtime and inode */
+    int object; /* 1: an object which can be patched, 2: one which cannot */
+    int nb_slots;
+    IncSlot *slots;
+} IncFile;
+
+/* a global symbol of the output */
+typedef struct IncSym {
+    const char *name;
+    addr_t value, got, plt;
+    int defined; /* 1: in a section, 2: absolute */
+    int owner; /* file which defines it, or -1 */
+} IncSym;
+
+typedef struct IncState {
+    IncFile **files;
+    int nb_files;
+    IncFile *cur; /* object being loaded */
+    IncSym *syms;
+    int nb_syms;
+    addr_t got;
+    unsigned long long out_stat[3];
+    int disabled;
+    char *buf; /* contents of a loaded '.tccinc' file */
+} IncState;
+
+/* one write to the output file */
+typedef struct IncPatch {
+    addr_t file_offset, size;
+    unsigned char *data;
+} IncPatch;
+
+static void inc_stat(struct stat *st, unsigned long long *v)
+{
+    v[0] = st->st_size;
+#ifdef __APPLE__
+    v[1] = st->st_mtimespec.tv_sec * 1000000000ULL + st->st_mtimespec.tv_nsec;
+#else
+    v[1] = st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+#endif
+    v[2] = st->st_ino;
+}
+
+static void inc_free(IncState *inc)
+{
+    int i;
+    if (!inc)
+        return;
+    for (i = 0; i < inc->nb_files; i++) {
+        if (!inc->buf)
+            tcc_free((char *)inc->files[i]->name);
+        tcc_free(inc->files[i]->slots);
+    }
+    dynarray_reset(&inc->files, &inc->nb_files);
+    tcc_free(inc->syms);
+    tcc_free(inc->buf);
+    tcc_free(inc);
+}
+
+/* whether the output can be relinked incrementally */
+static int inc_possible(TCCState *s1)
+{
+    return s1->output_type == TCC_OUTPUT_EXE
+        && s1->output_format == TCC_OUTPUT_FORMAT_ELF
+        && !s1->icf && !s1->gc_sections
+        && !s1->do_debug && !s1->do_backtrace && !s1->test_coverage
+#ifdef CONFIG_TCC_BCHECK
+        && !s1->do_bounds_check
+#endif
+        ;
+}
+
+/* record a file read by the linker (a source file if obj_type < 0) */
+ST_FUNC void tcc_inc_add_file(TCCState *s1, const char *filename, int fd, int obj_type)
+{
+    IncState *inc = s1->inc;
+    IncFile *f;
+    struct stat st;
+
+    if (!inc)
+        inc = s1->inc = tcc_mallocz(sizeof *inc);
+    inc->cur = NULL;
+    if (obj_type < 0 || fstat(fd, &st)) {
+        /* compiled code has no place to be patched */
+        inc->disabled = 1;
+        return;
+    }
+    f = tcc_mallocz(sizeof *f);
+    f->name = tcc_strdup(filename);
+    inc_stat(&st, f->stat);
+    if (obj_type == AFF_BINTYPE_REL)
+        f->object = 1, inc->cur = f;
+    dynarray_add(&inc->files, &inc->nb_files, f);
+}
+
+/* remember where a section of the object being loaded was put and
+   leave room after it, except for sections which are read as arrays */
+static void inc_add_slot(TCCState *s1, Section *s, addr_t offset, addr_t size,
+                         unsigned align)
+{
+    IncFile *f = s1->inc->cur;
+    IncSlot *sl;
+    addr_t pad;
+    int n = f->nb_slots;
+
+    if ((n & (n - 1)) == 0)
+        f->slots = tcc_realloc(f->slots, (n ? 2 * n : 1) * sizeof *sl);
+    sl = &f->slots[f->nb_slots++];
+    memset(sl, 0, sizeof *sl);
+    sl->name = s->name, sl->s = s, sl->offset = offset;
+    sl->size = sl->room = size, sl->align = align;
+    sl->nobits = s->sh_type == SHT_NOBITS;
+    if ((s->sh_type == SHT_PROGBITS || s->sh_type == SHT_NOBITS)
+        && strcmp(s->name, ".init") && strcmp(s->name, ".fini")
+        && strcmp(s->name, ".eh_frame")
+        && strncmp(s->name, ".ctors", 6) && strncmp(s->name, ".dtors", 6)) {
+        pad = (size >> 3) + 64;
+        sl->room += pad;
+        if (sl->nobits)
+            s->data_offset += pad;
+        else
+            section_ptr_add(s, pad);
+    }
+}
+
+/* the slot of 'f' which holds 'offset' of section 's' */
+static IncSlot *inc_slot_at(IncFile *f, Section *s, addr_t offset)
+{
+    IncSlot *sl;
+    for (sl = f->slots; sl < f->slots + f->nb_slots; sl++)
+        if (sl->s == s && offset >= sl->offset && offset <= sl->offset + sl->size)
+            return sl;
+    return NULL;
+}
+
+typedef struct IncRange {
+    int shndx, file;
+    addr_t lo, hi;
+} IncRange;
+
+static int inc_range_cmp(const void *a, const void *b)
+{
+    const IncRange *x = a, *y = b;
+    if (x->shndx != y->shndx)
+        return x->shndx < y->shndx ? -1 : 1;
+    return x->lo < y->lo ? -1 : x->lo > y->lo;
+}
+
+/* the file which defines a symbol in section 'shndx' at 'offset' */
+static int inc_owner(IncRange *r, int n, int shndx, addr_t offset)
+{
+    int lo = 0, hi = n, m;
+    while (lo < hi) {
+        m = (lo + hi) >> 1;
+        if (r[m].shndx < shndx || (r[m].shndx == shndx && r[m].lo <= offset))
+            lo = m + 1;
+        else
+            hi = m;
+    }
+    if (lo && r[lo - 1].shndx == shndx && offset <= r[lo - 1].hi)
+        return r[lo - 1].file;
+    return -1;
+}
+
+/* once the output is laid out and relocated, fill in the places of
+   the slots and the global symbols */
+static void inc_capture(TCCState *s1)
+{
+    IncState *inc = s1->inc;
+    IncFile *f;
+    IncSlot *sl;
+    IncSym *is;
+    IncRange *r;
+    ElfW(Sym) *sym;
+    struct sym_attr *attr;
+    int i, j, n, nb_syms;
+
+    if (!inc_possible(s1) || s1->nb_errors || inc->disabled) {
+        inc->disabled = 1;
+        return;
+    }
+    for (i = n = 0; i < inc->nb_files; i++)
+        n += inc->files[i]->nb_slots;
+    r = tcc_malloc((n + 1) * sizeof *r);
+    for (i = n = 0; i < inc->nb_files; i++) {
+        f = inc->files[i];
+        for (j = 0; j < f->nb_slots; j++) {
+            sl = &f->slots[j];
+            sl->addr = sl->s->sh_addr + sl->offset;
+            sl->file_offset = sl->nobits ? 0 : sl->s->sh_offset + sl->offset;
+            r[n].shndx = sl->s->sh_num, r[n].file = i;
+            r[n].lo = sl->offset, r[n++].hi = sl->offset + sl->size;
+        }
+    }
+    qsort(r, n, sizeof *r, inc_range_cmp);
+
+    nb_syms = symtab_section->data_offset / sizeof *sym;
+    inc->syms = tcc_malloc(nb_syms * sizeof *is);
+    inc->nb_syms = 0;
+    for (i = 1; i < nb_syms; i++) {
+        sym = (ElfW(Sym) *)symtab_section->data + i;
+        if (ELFW(ST_BIND)(sym->st_info) == STB_LOCAL || !sym->st_name)
+            continue;
+        is = &inc->syms[inc->nb_syms++];
+        memset(is, 0, sizeof *is);
+        is->name = (char *)symtab_section->link->data + sym->st_name;
+        is->value = sym->st_value;
+        is->owner = -1;
+        if (sym->st_shndx == SHN_ABS) {
+            is->defined = 2;
+        } else if (sym->st_shndx != SHN_UNDEF && sym->st_shndx < SHN_LORESERVE) {
+            is->defined = 1;
+            is->owner = inc_owner(r, n, sym->st_shndx, sym->st_value
+                                  - s1->sections[sym->st_shndx]->sh_addr);
+        }
+        if (i < s1->nb_sym_attrs) {
+            attr = &s1->sym_attrs[i];
+            if (attr->got_offset && s1->got)
+                is->got = s1->got->sh_addr + attr->got_offset;
+            if (attr->plt_offset && s1->plt)
+                is->plt = s1->plt->sh_addr + attr->plt_offset;
+        }
+    }
+    inc->got = s1->got ? s1->got->sh_addr : 0;
+    tcc_free(r);
+}
+
+static void inc_put(CString *cs, unsigned long long v)
+{
+    cstr_cat(cs, (char *)&v, sizeof v);
+}
+
+static void inc_puts(CString *cs, const char *str)
+{
+    cstr_cat(cs, str, strlen(str) + 1);
+}
+
+static void inc_path(char *buf, int size, const char *filename)
+{
+    snprintf(buf, size, "%s.tccinc", filename);
+}
+
+/* write the state of the link of 'filename' */
+static int inc_write(TCCState *s1, IncState *inc, const char *filename)
+{
+    char path[1024], cwd[1024];
+    CString cs;
+    IncFile *f;
+    IncSlot *sl;
+    IncSym *is;
+    struct stat st;
+    FILE *fp;
+    int i, j, ret = -1;
+
+    if (stat(filename, &st) || !getcwd(cwd, sizeof cwd))
+        return -1;
+    inc_stat(&st, inc->out_stat);
+    cstr_new(&cs);
+    inc_puts(&cs, INC_MAGIC);
+    inc_puts(&cs, cwd);
+    inc_put(&cs, s1->args_hash);
+    for (i = 0; i < 3; i++)
+        inc_put(&cs, inc->out_stat[i]);
+    inc_put(&cs, inc->got);
+    inc_put(&cs, inc->nb_files);
+    for (i = 0; i < inc->nb_files; i++) {
+        f = inc->files[i];
+        inc_puts(&cs, f->name);
+        for (j = 0; j < 3; j++)
+            inc_put(&cs, f->stat[j]);
+        inc_put(&cs, f->object);
+        inc_put(&cs, f->nb_slots);
+        for (sl = f->slots; sl < f->slots + f->nb_slots; sl++) {
+            inc_puts(&cs, sl->name);
+            inc_put(&cs, sl->size);
+            inc_put(&cs, sl->room);
+            inc_put(&cs, sl->addr);
+            inc_put(&cs, sl->file_offset);
+            inc_put(&cs, sl->align);
+            inc_put(&cs, sl->nobits);
+        }
+    }
+    inc_put(&cs, inc->nb_syms);
+    for (is = inc->syms; is < inc->syms + inc->nb_syms; is++) {
+        inc_puts(&cs, is->name);
+        inc_put(&cs, is->value);
+        inc_put(&cs, is->got);
+        inc_put(&cs, is->plt);
+        inc_put(&cs, is->defined);
+        inc_put(&cs, is->owner);
+    }
+    inc_path(path, sizeof path, filename);
+    fp = fopen(path, "wb");
+    if (fp) {
+        if (fwrite(cs.data, 1, cs.size, fp) == cs.size)
+            ret = 0;
+        if (fclose(fp))
+            ret = -1;
+        if (ret)
+            unlink(path);
+    }
+    cstr_free(&cs);
+    return ret;
+}
+
+#ifdef LINK_RELAX
+/* the output cannot be patched from the objects as they are */
+ST_FUNC void tcc_inc_disable(TCCState *s1)
+{
+    if (s1->inc)
+        s1->inc->disabled = 1;
+}
+#endif
+
+/* after a full link: record its state, or remove an old one */
+static void inc_save(TCCState *s1, const char *filename, int ret)
+{
+    char path[1024];
+    inc_path(path, sizeof path, filename);
+    unlink(path);
+    if (ret == 0 && s1->inc && !s1->inc->disabled)
+        inc_write(s1, s1->inc, filename);
+}
+
+typedef struct IncReader {
+    char *p, *end;
+    int err;
+} IncReader;
+
+static unsigned long long inc_get(IncReader *rd)
+{
+    unsigned long long v = 0;
+    if (rd->end - rd->p < (long)sizeof v)
+        rd->err = 1;
+    else
+        memcpy(&v, rd->p, sizeof v), rd->p += sizeof v;
+    return v;
+}
+
+static const char *inc_gets(IncReader *rd)
+{
+    char *s = rd->p, *e = memchr(s, 0, rd->end - s);
+    if (!e) {
+        rd->err = 1;
+        return "";
+    }
+    rd->p = e + 1;
+    return s;
+}
+
+/* a count of items of at least 'size' bytes each */
+static int inc_getn(IncReader *rd, int size)
+{
+    unsigned long long n = inc_get(rd);
+    if (n > (unsigned long long)(rd->end - rd->p) / size)
+        rd->err = 1, n = 0;
+    return n;
+}
+
+static int inc_fail(TCCState *s1, const char *msg, const char *arg)
+{
+    if (s1->verbose)
+        printf("-- full link: %s%s\n", msg, arg);
+    return -1;
+}
+
+/* read the state of the last link of 'filename', if still valid */
+static IncState *inc_load(TCCState *s1, const char *filename)
+{
+    char path[1024], cwd[1024];
+    IncState *inc;
+    IncReader rd;
+    IncFile *f;
+    IncSlot *sl;
+    IncSym *is;
+    unsigned long long st_out[3];
+    struct stat st;
+    long size;
+    int fd, i, j;
+
+    inc_path(path, sizeof path, filename);
+    fd = open(path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        inc_fail(s1, "no ", path);
+        return NULL;
+    }
+    inc = tcc_mallocz(sizeof *inc);
+    size = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    inc->buf = tcc_malloc(size > 0 ? size : 1);
+    rd.p = inc->buf, rd.end = rd.p + size, rd.err = 0;
+    if (size <= 0 || full_read(fd, inc->buf, size) != size)
+        rd.err = 1;
+    close(fd);
+
+    if (rd.err || strcmp(inc_gets(&rd), INC_MAGIC)) {
+        inc_fail(s1, "invalid ", path);
+        goto fail;
+    }
+    if (!getcwd(cwd, sizeof cwd) || strcmp(inc_gets(&rd), cwd)
+        || inc_get(&rd) != s1->args_hash) {
+        inc_fail(s1, "other options", "");
+        goto fail;
+    }
+    for (i = 0; i < 3; i++)
+        inc->out_stat[i] = inc_get(&rd);
+    if (stat(filename, &st) || (inc_stat(&st, st_out),
+        memcmp(st_out, inc->out_stat, sizeof st_out))) {
+        inc_fail(s1, "changed ", filename);
+        goto fail;
+    }
+    inc->got = inc_get(&rd);
+    for (i = inc_getn(&rd, 40); i > 0 && !rd.err; i--) {
+        f = tcc_mallocz(sizeof *f);
+        dynarray_add(&inc->files, &inc->nb_files, f);
+        f->name = inc_gets(&rd);
+        for (j = 0; j < 3; j++)
+            f->stat[j] = inc_get(&rd);
+        f->object = inc_get(&rd);
+        f->nb_slots = inc_getn(&rd, 49);
+        f->slots = tcc_mallocz(f->nb_slots * sizeof *sl);
+        for (sl = f->slots; sl < f->slots + f->nb_slots; sl++) {
+            sl->name = inc_gets(&rd);
+            sl->size = inc_get(&rd);
+            sl->room = inc_get(&rd);
+            sl->addr = inc_get(&rd);
+            sl->file_offset = inc_get(&rd);
+            sl->align = inc_get(&rd);
+            sl->nobits = inc_get(&rd);
+        }
+    }
+    inc->nb_syms = inc_getn(&rd, 41);
+    inc->syms = tcc_mallocz(inc->nb_syms * sizeof *is);
+    for (is = inc->syms; is < inc->syms + inc->nb_syms; is++) {
+        is->name = inc_gets(&rd);
+        is->value = inc_get(&rd);
+        is->got = inc_get(&rd);
+        is->plt = inc_get(&rd);
+        is->defined = inc_get(&rd);
+        is->owner = inc_get(&rd);
+    }
+    if (rd.err || rd.p != rd.end) {
+        inc_fail(s1, "invalid ", path);
+        goto fail;
+    }
+    return inc;
+fail:
+    inc_free(inc);
+    return NULL;
+}
+
+static int inc_sym_cmp(const void *a, const void *b)
+{
+    return strcmp(((const IncSym *)a)->name, ((const IncSym *)b)->name);
+}
+
+static IncSym *inc_find_sym(IncState *inc, const char *name)
+{
+    IncSym key;
+    key.name = name;
+    return bsearch(&key, inc->syms, inc->nb_syms, sizeof key, inc_sym_cmp);
+}
+
+static void inc_quiet(void *opaque, const char *msg)
+{
+}
+
+/* Load the changed object number 'fi' alone, relocate it at its old
+   place against the recorded symbols and add the writes to '*pp' */
+static int inc_patch_object(TCCState *s1, IncState *inc, int fi,
+                            IncPatch **pp, int *pn)
+{
+    IncFile *f = inc->files[fi], *nf;
+    IncSlot *sl, *ol, **olds;
+    IncSym *rec, **recs;
+    TCCState *p;
+    Section *s, *sr;
+    ElfW(Sym) *sym;
+    ElfW_Rel *rel;
+    IncPatch *pa;
+    const char *name;
+    char *placed, *seen;
+    addr_t tgt;
+    int i, j, nb_syms, type, sym_index, dynamic, ret = -1;
+
+    p = tcc_new();
+    tcc_set_error_func(p, NULL, inc_quiet);
+    p->nostdlib = 1;
+    p->incremental = 1;
+    tcc_set_output_type(p, s1->output_type);
+    recs = NULL, olds = NULL, placed = seen = NULL;
+    if (tcc_add_file_internal(p, f->name, AFF_TYPE_BIN) || p->nb_errors
+        || !p->inc || p->inc->disabled || p->inc->nb_files != 1
+        || (nf = p->inc->files[0])->object != 1) {
+        inc_fail(s1, "cannot patch ", f->name);
+        goto the_end;
+    }
+
+    /* the new sections go where the old ones with the same names were */
+    olds = tcc_mallocz(f->nb_slots * sizeof *olds);
+    for (sl = nf->slots; sl < nf->slots + nf->nb_slots; sl++) {
+        for (j = 0; j < f->nb_slots; j++)
+            if (!olds[j] && !strcmp(f->slots[j].name, sl->name))
+                break;
+        ol = &f->slots[j];
+        if (j == f->nb_slots || sl->size > ol->room || sl->nobits != ol->nobits
+            || (ol->addr & (sl->align - 1))) {
+            inc_fail(s1, "no room for ", sl->name);
+            goto the_end;
+        }
+        olds[j] = sl;
+        sl->addr = ol->addr, sl->file_offset = ol->file_offset;
+        sl->room = ol->room;
+    }
+    for (j = 0; j < f->nb_slots; j++)
+        if (!olds[j] && f->slots[j].size) {
+            inc_fail(s1, "removed ", f->slots[j].name);
+            goto the_end;
+        }
+
+    /* move the symbols, and check those seen by the other files */
+    nb_syms = p->symtab->data_offset / sizeof *sym;
+    recs = tcc_mallocz(nb_syms * sizeof *recs);
+    placed = tcc_mallocz(nb_syms);
+    seen = tcc_mallocz(inc->nb_syms);
+    for (i = 1; i < nb_syms; i++) {
+        sym = (ElfW(Sym) *)p->symtab->data + i;
+        name = (char *)p->symtab->link->data + sym->st_name;
+        rec = NULL;
+        if (ELFW(ST_BIND)(sym->st_info) != STB_LOCAL && *name)
+            rec = inc_find_sym(inc, name);
+        recs[i] = rec;
+        placed[i] = 1;
+        if (sym->st_shndx == SHN_UNDEF) {
+            if (!rec)
+                goto new_sym;
+            sym->st_value = rec->defined ? rec->value : 0;
+            continue;
+        }
+        if (sym->st_shndx == SHN_ABS) {
+            if (rec && (rec->defined != 2 || rec->value != sym->st_value))
+                goto new_sym;
+            continue;
+        }
+        sl = NULL;
+        if (sym->st_shndx < SHN_LORESERVE)
+            sl = inc_slot_at(nf, p->sections[sym->st_shndx], sym->st_value);
+        if (!sl) {
+            /* in a section not loaded into memory */
+            placed[i] = 0;
+            if (!rec)
+                continue;
+            goto new_sym;
+        }
+        sym->st_value += sl->addr - sl->offset;
+        if (!rec)
+            continue;
+        seen[rec - inc->syms] = 1;
+        if (rec->defined == 1 && rec->owner == fi) {
+            if (rec->value == sym->st_value)
+                continue;
+        } else if (rec->defined && ELFW(ST_BIND)(sym->st_info) == STB_WEAK) {
+            /* another file has the definition */
+            sym->st_value = rec->value;
+            continue;
+        }
+    new_sym:
+        inc_fail(s1, "changed symbol ", name);
+        goto the_end;
+    }
+    for (rec = inc->syms; rec < inc->syms + inc->nb_syms; rec++)
+        if (rec->owner == fi && !seen[rec - inc->syms]) {
+            inc_fail(s1, "removed symbol ", rec->name);
+            goto the_end;
+        }
+
+    /* resolve the relocations as build_got_entries() did */
+    if (inc->got) {
+        p->got = new_section(p, ".got", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE);
+        p->got->sh_addr = inc->got;
+    }
+    for (i = 1; i < p->nb_sections; i++) {
+        sr = p->sections[i];
+        if (sr->sh_type != SHT_RELX)
+            continue;
+        s = p->sections[sr->sh_info];
+        if (!(s->sh_flags & SHF_ALLOC))
+            continue;
+        for_each_elem(sr, 0, rel, ElfW_Rel) {
+            type = ELFW(R_TYPE)(rel->r_info);
+            sym_index = ELFW(R_SYM)(rel->r_info);
+            sym = (ElfW(Sym) *)p->symtab->data + sym_index;
+            rec = recs[sym_index];
+            sl = inc_slot_at(nf, s, rel->r_offset);
+            if (!sl || !placed[sym_index]
+                || ELFW(ST_TYPE)(sym->st_info) == STT_TLS)
+                goto bad_reloc;
+            tgt = sym->st_value;
+            dynamic = sym->st_shndx == SHN_UNDEF && !(rec && rec->defined);
+            if ((sym->st_shndx == SHN_ABS || (rec && rec->defined == 2))
+                && tgt && gotplt_entry_type(type) != NO_GOTPLT_ENTRY)
+                goto bad_reloc;
+#ifdef GOT_RELAX
+            if ((type == R_X86_64_GOTPCRELX || type == R_X86_64_REX_GOTPCRELX)
+                && !dynamic && relax_got_reloc(p, s, rel))
+                type = R_X86_64_PC32;
+#endif
+#ifdef LINK_RELAX
+            if (type == R_RISCV_ALIGN)
+                goto bad_reloc; /* its nops need relax_sections() */
+#endif
+            switch (gotplt_entry_type(type)) {
+            case NO_GOTPLT_ENTRY:
+                break;
+            case BUILD_GOT_ONLY:
+                if (!inc->got)
+                    goto bad_reloc;
+                break;
+            case AUTO_GOTPLT_ENTRY:
+                if (dynamic) {
+                    if (!rec || !rec->plt)
+                        goto bad_reloc;
+                    tgt = rec->plt;
+                }
+                break;
+            case ALWAYS_GOTPLT_ENTRY:
+#ifdef TCC_TARGET_X86_64
+                if ((type == R_X86_64_PLT32 || type == R_X86_64_PC32)
+                    && !dynamic)
+                    break;
+#endif
+                if (code_reloc(type)) {
+                    if (!rec || !rec->plt)
+                        goto bad_reloc;
+                    tgt = rec->plt;
+                } else {
+                    if (!rec || !rec->got || !inc->got)
+                        goto bad_reloc;
+                    get_sym_attr(p, sym_index, 1)->got_offset = rec->got - inc->got;
+                }
+                break;
+            default:
+            bad_reloc:
+                inc_fail(s1, "cannot relocate ", s->name);
+                goto the_end;
+            }
+#if SHT_RELX == SHT_RELA
+            tgt += rel->r_addend;
+#endif
+            relocate(p, rel, type, s->data + rel->r_offset,
+                     sl->addr + rel->r_offset - sl->offset, tgt);
+        }
+    }
+    if (p->nb_errors) {
+        inc_fail(s1, "cannot relocate ", f->name);
+        goto the_end;
+    }
+
+    /* the new contents, padded with zeros */
+    for (sl = nf->slots; sl < nf->slots + nf->nb_slots; sl++) {
+        if (sl->nobits || !sl->room)
+            continue;
+        if ((*pn & (*pn - 1)) == 0)
+            *pp = tcc_realloc(*pp, (*pn ? 2 * *pn : 1) * sizeof **pp);
+        pa = &(*pp)[(*pn)++];
+        pa->file_offset = sl->file_offset;
+        pa->size = sl->room;
+        pa->data = tcc_mallocz(sl->room);
+        memcpy(pa->data, sl->s->data + sl->offset, sl->size);
+    }
+    for (j = 0; j < f->nb_slots; j++)
+        if (olds[j])
+            f->slots[j].size = olds[j]->size;
+    memcpy(f->stat, nf->stat, sizeof f->stat);
+    ret = 0;
+the_end:
+    tcc_free(olds);
+    tcc_free(recs);
+    tcc_free(placed);
+    tcc_free(seen);
+    tcc_delete(p);
+    return ret;
+}
+
+/* Patch the output of the last link in place if only objects changed
+   since.  Returns 0 on success, -1 if a full link is needed. */
+PUB_FUNC int tcc_relink(TCCState *s1)
+{
+    const char *filename = s1->outfile;
+    IncState *inc;
+    IncFile *f;
+    IncPatch *patches = NULL;
+    struct stat st;
+    unsigned long long v[3];
+    int i, fd, nb_patches = 0, changed = 0, ret = -1;
+
+    if (!inc_possible(s1) || !filename)
+        return -1;
+    inc = inc_load(s1, filename);
+    if (!inc)
+        return -1;
+    qsort(inc->syms, inc->nb_syms, sizeof *inc->syms, inc_sym_cmp);
+    for (i = 0; i < inc->nb_files; i++) {
+        f = inc->files[i];
+        if (stat(f->name, &st) == 0) {
+            inc_stat(&st, v);
+            if (0 == memcmp(v, f->stat, sizeof v))
+                continue;
+        }
+        if (f->object != 1) {
+            inc_fail(s1, "changed ", f->name);
+            goto the_end;
+        }
+        if (inc_patch_object(s1, inc, i, &patches, &nb_patches))
+            goto the_end;
+        ++changed;
+    }
+
+    if (changed) {
+        char path[1024];
+        inc_path(path, sizeof path, filename);
+        unlink(path);
+        fd = open(filename, O_WRONLY | O_BINARY);
+        if (fd < 0) {
+            inc_fail(s1, "cannot write ", filename);
+            goto the_end;
+        }
+        for (i = 0; i < nb_patches; i++)
+            if (lseek(fd, patches[i].file_offset, SEEK_SET) < 0
+                || write(fd, patches[i].data, patches[i].size)
+                   != (ssize_t)patches[i].size)
+                break;
+        if (close(fd) || i < nb_patches
+            || inc_write(s1, inc, filename)) {
+            inc_fail(s1, "cannot write ", filename);
+            goto the_end;
+        }
+    }
+    if (s1->verbose)
+        printf("<- %s (%d object%s patched)\n", filename,
+               changed, changed == 1 ? "" : "s");
+    ret = 0;
+the_end:
+    for (i = 0; i < nb_patches; i++)
+        tcc_free(patches[i].data);
+    tcc_free(patches);
+    inc_free(inc);
+    return ret;
+}
+#endif /* CONFIG_TCC_INCREMENTAL */
+
 static void alloc_sec_names(TCCState *s1, int is_obj);
 
 /* Output an elf, coff or binary file */
@@ -2842,6 +4872,15 @@ static int elf_output_file(TCCState *s1, const char *filename)
         /* if linking, also link in runtime libraries (libc, libgcc, etc.) */
         tcc_add_runtime(s1);
 	resolve_common_syms(s1);
+        if (s1->gc_sections)
+            gc_sections(s1);
+#if SHT_RELX == SHT_RELA
+        if (s1->icf)
+            icf_functions(s1);
+#endif
+#ifdef LINK_RELAX
+        relax_sections(s1);
+#endif
 
         if (!s1->static_link) {
             if (file_type & TCC_OUTPUT_EXE) {
@@ -2861,7 +4900,12 @@ static int elf_output_file(TCCState *s1, const char *filename)
             /* add dynamic symbol table */
             s1->dynsym = new_symtab(s1, ".dynsym", SHT_DYNSYM, SHF_ALLOC,
                                     ".dynstr",
-                                    ".hash", SHF_ALLOC);
+                                    ".dynhash", SHF_PRIVATE);
+            /* SysV hash table, filled when the symbols are known */
+            dyninf.hash = new_section(s1, ".hash", SHT_HASH, SHF_ALLOC);
+            dyninf.hash->sh_entsize = sizeof(int);
+            dyninf.hash->link = s1->dynsym;
+            init_str_hash(s1->dynsym->link);
 	    /* Number of local symbols (readelf complains if not set) */
 	    s1->dynsym->sh_info = 1;
             dynstr = s1->dynsym->link;
@@ -2885,11 +4929,15 @@ static int elf_output_file(TCCState *s1, const char *filename)
                 export_global_syms(s1);
             }
 	    dyninf.gnu_hash = create_gnu_hash(s1);
+            fill_elf_hash(s1->dynsym, dyninf.hash);
         } else {
             build_got_entries(s1, 0);
         }
 	version_add (s1);
 
+    /* as set_sec_sizes() decides */
+    if (s1->do_debug || (symtab_section->link->sh_flags & SHF_ALLOC))
+        merge_sym_names(symtab_section);
     textrel = set_sec_sizes(s1);
     alloc_sec_names(s1, 0);
 
@@ -2961,12 +5009,27 @@ static int elf_output_file(TCCState *s1, const char *filename)
             fill_got(s1);
         else if (s1->got)
             fill_local_got_entries(s1);
+#ifdef R_TPOFF
+        tls_sym_offsets(s1, s1->symtab);
+        if (dynamic)
+            tls_sym_offsets(s1, s1->dynsym);
+#endif
 
-    if (dyninf.gnu_hash)
+    if (dyninf.gnu_hash) {
         update_gnu_hash(s1, dyninf.gnu_hash);
+        fill_elf_hash(s1->dynsym, dyninf.hash);
+    }
 
     /* Create the ELF file with name 'filename' */
+#if CONFIG_TCC_INCREMENTAL
+    if (s1->incremental && s1->inc)
+        inc_capture(s1);
+#endif
     ret = tcc_write_elf_file(s1, filename, dyninf.phnum, dyninf.phdr, file_offset, sec_order);
+#if CONFIG_TCC_INCREMENTAL
+    if (s1->incremental)
+        inc_save(s1, filename, ret);
+#endif
  the_end:
     tcc_free(sec_order);
     tcc_free(dyninf.phdr);
@@ -2977,18 +5040,25 @@ static int elf_output_file(TCCState *s1, const char *filename)
 /* Allocate strings for section names */
 static void alloc_sec_names(TCCState *s1, int is_obj)
 {
-    int i;
+    int i, n = 0;
     Section *s, *strsec;
+    StrRef *refs;
 
     strsec = new_section(s1, ".shstrtab", SHT_STRTAB, 0);
-    put_elf_str(strsec, "");
+    refs = tcc_malloc(s1->nb_sections * sizeof *refs);
     for(i = 1; i < s1->nb_sections; i++) {
         s = s1->sections[i];
         if (is_obj)
             s->sh_size = s->data_offset;
-	if (s == strsec || s->sh_size || (s->sh_flags & SHF_ALLOC))
-            s->sh_name = put_elf_str(strsec, s->name);
+	if (s == strsec || s->sh_size || (s->sh_flags & SHF_ALLOC)) {
+            refs[n].str = s->name;
+            refs[n].len = strlen(s->name);
+            refs[n++].offset = &s->sh_name;
+        }
     }
+    /* ".rela.text" also names ".text" */
+    put_str_tails(strsec, refs, n);
+    tcc_free(refs);
     strsec->sh_size = strsec->data_offset;
 }
 
@@ -2998,6 +5068,7 @@ static int elf_output_obj(TCCState *s1, const char *filename)
     Section *s;
     int i, ret, file_offset;
     s1->nb_errors = 0;
+    merge_sym_names(symtab_section);
     /* Allocate strings for section names */
     alloc_sec_names(s1, 1);
     file_offset = sizeof (ElfW(Ehdr));
@@ -3050,16 +5121,102 @@ ST_FUNC void *load_data(int fd, unsigned long file_offset, unsigned long size)
     return data;
 }
 
+/* 'size' bytes at 'offset' of the input file: in place if it is mapped
+   (and the data aligned for the ELF structures), otherwise read into a
+   new buffer.  Release with unload_data(). */
+static void *map_data(TCCState *s1, int fd, unsigned long offset, unsigned long size)
+{
+    MappedFile *m = &s1->map;
+    if (m->data && m->fd == fd && offset < m->size && size <= m->size - offset
+        && 0 == (offset & (sizeof(ElfW(Addr)) - 1)))
+        return (void *)(m->data + offset);
+    return load_data(fd, offset, size);
+}
+
+static void unload_data(TCCState *s1, void *p)
+{
+    MappedFile *m = &s1->map;
+    if (!m->data || (unsigned char *)p < m->data
+        || (unsigned char *)p >= m->data + m->size)
+        tcc_free(p);
+}
+
+/* copy 'size' bytes at 'offset' of the input file to 'buf' */
+static ssize_t read_data(TCCState *s1, int fd, unsigned long offset, void *buf, unsigned long size)
+{
+    MappedFile *m = &s1->map;
+    if (m->data && m->fd == fd) {
+        if (offset > m->size)
+            return 0;
+        if (size > m->size - offset)
+            size = m->size - offset;
+        memcpy(buf, m->data + offset, size);
+        return size;
+    }
+    lseek(fd, offset, SEEK_SET);
+    return full_read(fd, buf, size);
+}
+
 typedef struct SectionMergeInfo {
     Section *s;            /* corresponding existing section */
     unsigned long offset;  /* offset of the new section in the existing section */
     uint8_t new_section;       /* true if section 's' was added */
     uint8_t link_once;         /* true if link once section */
+    int nb_pieces;             /* SHF_MERGE section: number of entries */
+    int *pieces;               /* and their (input, output) offsets */
 } SectionMergeInfo;
 
-ST_FUNC int tcc_object_type(int fd, ElfW(Ehdr) *h)
+#if SHT_RELX == SHT_RELA
+/* put the entries of the SHF_MERGE section 'sh' into 's', sharing the
+   ones already there, and remember where they went */
+static void merge_section(TCCState *s1, SectionMergeInfo *sm, Section *s,
+                          ElfW(Shdr) *sh, int fd, unsigned long file_offset)
+{
+    unsigned char *data;
+    int i, j, len, entsize = sh->sh_entsize, size = sh->sh_size;
+    int align = sh->sh_addralign ? sh->sh_addralign : 1;
+
+    data = map_data(s1, fd, file_offset + sh->sh_offset, size);
+    sm->pieces = tcc_malloc(2 * (size / entsize + 1) * sizeof(int));
+    for (i = 0; i < size; i += len) {
+        for (len = entsize; (sh->sh_flags & SHF_STRINGS) && i + len < size;
+             len += entsize) {
+            for (j = len - entsize; j < len && !data[i + j]; j++)
+                ;
+            if (j == len)
+                break; /* the terminating zero character */
+        }
+        if (len > size - i)
+            len = size - i;
+        sm->pieces[2 * sm->nb_pieces] = i;
+        sm->pieces[2 * sm->nb_pieces + 1] = put_shared_data(s, data + i, len, align);
+        sm->nb_pieces++;
+    }
+    unload_data(s1, data);
+    if (align > s->sh_addralign)
+        s->sh_addralign = align;
+}
+
+/* translate the offset 'x' in a merged input section */
+static addr_t merged_offset(SectionMergeInfo *sm, addr_t x)
+{
+    int lo = 0, hi = sm->nb_pieces, m;
+
+    if (!hi || x < sm->pieces[0])
+        return x;
+    while (hi - lo > 1) {
+        m = (lo + hi) / 2;
+        if (sm->pieces[2 * m] <= x)
+            lo = m;
+        else
+            hi = m;
+    }
+    return sm->pieces[2 * lo + 1] + (x - sm->pieces[2 * lo]);
+}
+#endif
+
+static int elf_object_type(ElfW(Ehdr) *h, int size)
 {
-    int size = full_read(fd, h, sizeof *h);
     if (size == sizeof *h && 0 == memcmp(h, ELFMAG, 4)) {
         if (h->e_type == ET_REL)
             return AFF_BINTYPE_REL;
@@ -3076,6 +5233,11 @@ ST_FUNC int tcc_object_type(int fd, ElfW(Ehdr) *h)
     return 0;
 }
 
+ST_FUNC int tcc_object_type(int fd, ElfW(Ehdr) *h)
+{
+    return elf_object_type(h, full_read(fd, h, sizeof *h));
+}
+
 /* load an object file and merge it with current files */
 /* XXX: handle correctly stab (debug) info */
 ST_FUNC int tcc_load_object_file(TCCState *s1,
@@ -3083,8 +5245,9 @@ ST_FUNC int tcc_load_object_file(TCCState *s1,
 {
     ElfW(Ehdr) ehdr;
     ElfW(Shdr) *shdr, *sh;
-    unsigned long size, offset, offseti;
-    int i, j, nb_syms, sym_index, ret, seencompressed;
+    unsigned long size, offset, offseti, align;
+    addr_t value;
+    int i, j, nb_syms, sym_index, ret, seencompressed, shndx;
     char *strsec, *strtab;
     int stab_index, stabstr_index;
     int *old_to_new_syms;
@@ -3094,8 +5257,8 @@ ST_FUNC int tcc_load_object_file(TCCState *s1,
     ElfW_Rel *rel;
     Section *s;
 
-    lseek(fd, file_offset, SEEK_SET);
-    if (tcc_object_type(fd, &ehdr) != AFF_BINTYPE_REL)
+    if (elf_object_type(&ehdr, read_data(s1, fd, file_offset, &ehdr, sizeof ehdr))
+        != AFF_BINTYPE_REL)
         goto invalid;
     /* test CPU specific stuff */
     if (ehdr.e_ident[5] != ELFDATA2LSB ||
@@ -3104,13 +5267,13 @@ invalid:
         return tcc_error_noabort("invalid object file");
     }
     /* read sections */
-    shdr = load_data(fd, file_offset + ehdr.e_shoff,
-                     sizeof(ElfW(Shdr)) * ehdr.e_shnum);
+    shdr = map_data(s1, fd, file_offset + ehdr.e_shoff,
+                    sizeof(ElfW(Shdr)) * ehdr.e_shnum);
     sm_table = tcc_mallocz(sizeof(SectionMergeInfo) * ehdr.e_shnum);
 
     /* load section names */
     sh = &shdr[ehdr.e_shstrndx];
-    strsec = load_data(fd, file_offset + sh->sh_offset, sh->sh_size);
+    strsec = map_data(s1, fd, file_offset + sh->sh_offset, sh->sh_size);
 
     /* load symtab and strtab */
     old_to_new_syms = NULL;
@@ -3129,12 +5292,12 @@ invalid:
                 goto the_end;
             }
             nb_syms = sh->sh_size / sizeof(ElfW(Sym));
-            symtab = load_data(fd, file_offset + sh->sh_offset, sh->sh_size);
+            symtab = map_data(s1, fd, file_offset + sh->sh_offset, sh->sh_size);
             sm_table[i].s = symtab_section;
 
             /* now load strtab */
             sh = &shdr[sh->sh_link];
-            strtab = load_data(fd, file_offset + sh->sh_offset, sh->sh_size);
+            strtab = map_data(s1, fd, file_offset + sh->sh_offset, sh->sh_size);
         }
 	if (sh->sh_flags & SHF_COMPRESSED)
 	    seencompressed = 1;
@@ -3170,8 +5333,7 @@ invalid:
 
 	sh = &shdr[i];
         sh_name = strsec + sh->sh_name;
-        if (sh->sh_addralign < 1)
-            sh->sh_addralign = 1;
+        align = sh->sh_addralign ? sh->sh_addralign : 1;
         /* find corresponding section, if any */
         for(j = 1; j < s1->nb_sections;j++) {
             s = s1->sections[j];
@@ -3198,7 +5360,7 @@ invalid:
         s = new_section(s1, sh_name, sh->sh_type, sh->sh_flags & ~SHF_GROUP);
         /* take as much info as possible from the section. sh_link and
            sh_info will be updated later */
-        s->sh_addralign = sh->sh_addralign;
+        s->sh_addralign = align;
         s->sh_entsize = sh->sh_entsize;
         sm_table[i].new_section = 1;
     found:
@@ -3210,22 +5372,47 @@ invalid:
             tcc_error_noabort("invalid section type");
             goto the_end;
         }
+#if SHT_RELX == SHT_RELA
+        /* share the entries of mergeable sections (without relocations) */
+        if ((sh->sh_flags & s->sh_flags & SHF_MERGE) && !s1->incremental
+            && sh->sh_entsize && sh->sh_entsize == s->sh_entsize
+            && sh->sh_type == SHT_PROGBITS) {
+            for (j = 1; j < ehdr.e_shnum; j++)
+                if (shdr[j].sh_type == SHT_RELX && shdr[j].sh_info == i)
+                    break;
+            if (j == ehdr.e_shnum) {
+                sm_table[i].s = s;
+                merge_section(s1, &sm_table[i], s, sh, fd, file_offset);
+                goto next;
+            }
+        }
+#endif
         /* align start of section */
-        s->data_offset += -s->data_offset & (sh->sh_addralign - 1);
-        if (sh->sh_addralign > s->sh_addralign)
-            s->sh_addralign = sh->sh_addralign;
+        s->data_offset += -s->data_offset & (align - 1);
+        if (align > s->sh_addralign)
+            s->sh_addralign = align;
         sm_table[i].offset = s->data_offset;
         sm_table[i].s = s;
+        if (want_code_pieces(s1) && (s->sh_flags & SHF_EXECINSTR))
+            add_code_piece(s1, s);
         /* concatenate sections */
         size = sh->sh_size;
         if (sh->sh_type != SHT_NOBITS) {
             unsigned char *ptr;
-            lseek(fd, file_offset + sh->sh_offset, SEEK_SET);
             ptr = section_ptr_add(s, size);
-            full_read(fd, ptr, size);
+            read_data(s1, fd, file_offset + sh->sh_offset, ptr, size);
         } else {
             s->data_offset += size;
         }
+#if CONFIG_TCC_INCREMENTAL
+        if (s1->inc && s1->inc->cur && !file_offset) {
+            if (sh->sh_flags & SHF_ALLOC)
+                inc_add_slot(s1, s, sm_table[i].offset, size, align);
+            else if (size && (!strncmp(s->name, ".debug", 6)
+                              || !strncmp(s->name, ".stab", 5)))
+                s1->inc->cur->object = 2;
+        }
+#endif
     next: ;
     }
 
@@ -3265,8 +5452,10 @@ invalid:
 
     sym = symtab + 1;
     for(i = 1; i < nb_syms; i++, sym++) {
-        if (sym->st_shndx != SHN_UNDEF &&
-            sym->st_shndx < SHN_LORESERVE) {
+        /* the symbol table may be read-only (mapped) */
+        shndx = sym->st_shndx;
+        value = sym->st_value;
+        if (shndx != SHN_UNDEF && shndx < SHN_LORESERVE) {
             sm = &sm_table[sym->st_shndx];
             if (sm->link_once) {
                 /* if a symbol is in a link once section, we use the
@@ -3284,15 +5473,19 @@ invalid:
             if (!sm->s)
                 continue;
             /* convert section number */
-            sym->st_shndx = sm->s->sh_num;
+            shndx = sm->s->sh_num;
             /* offset value */
-            sym->st_value += sm->offset;
+#if SHT_RELX == SHT_RELA
+            if (sm->pieces && ELFW(ST_TYPE)(sym->st_info) != STT_SECTION)
+                value = merged_offset(sm, value);
+#endif
+            value += sm->offset;
         }
         /* add symbol */
         name = strtab + sym->st_name;
-        sym_index = set_elf_sym(symtab_section, sym->st_value, sym->st_size,
+        sym_index = set_elf_sym(symtab_section, value, sym->st_size,
                                 sym->st_info, sym->st_other,
-                                sym->st_shndx, name);
+                                shndx, name);
         old_to_new_syms[i] = sym_index;
     }
 
@@ -3319,6 +5512,15 @@ invalid:
                 /* NOTE: only one symtab assumed */
                 if (sym_index >= nb_syms)
                     goto invalid_reloc;
+#if SHT_RELX == SHT_RELA
+                /* section symbol + addend into a merged section */
+                sym = symtab + sym_index;
+                if (ELFW(ST_TYPE)(sym->st_info) == STT_SECTION
+                    && sym->st_shndx < ehdr.e_shnum
+                    && sm_table[sym->st_shndx].pieces && rel->r_addend >= 0)
+                    rel->r_addend = merged_offset(&sm_table[sym->st_shndx],
+                                                  rel->r_addend);
+#endif
                 sym_index = old_to_new_syms[sym_index];
                 /* ignore link_once in rel section. */
                 if (!sym_index && !sm_table[sh->sh_info].link_once
@@ -3358,12 +5560,14 @@ invalid:
 
     ret = 0;
  the_end:
-    tcc_free(symtab);
-    tcc_free(strtab);
+    unload_data(s1, symtab);
+    unload_data(s1, strtab);
     tcc_free(old_to_new_syms);
+    for (i = 1; i < ehdr.e_shnum; i++)
+        tcc_free(sm_table[i].pieces);
     tcc_free(sm_table);
-    tcc_free(strsec);
-    tcc_free(shdr);
+    unload_data(s1, strsec);
+    unload_data(s1, shdr);
     return ret;
 }
 
@@ -3387,12 +5591,11 @@ static unsigned long long get_be(const uint8_t *b, int n)
     return ret;
 }
 
-static int read_ar_header(int fd, int offset, ArchiveHeader *hdr)
+static int read_ar_header(TCCState *s1, int fd, int offset, ArchiveHeader *hdr)
 {
     char *p, *e;
     int len;
-    lseek(fd, offset, SEEK_SET);
-    len = full_read(fd, hdr, sizeof(ArchiveHeader));
+    len = read_data(s1, fd, offset, hdr, sizeof(ArchiveHeader));
     if (len != sizeof(ArchiveHeader))
         return len ? -1 : 0;
     p = hdr->ar_name;
@@ -3403,52 +5606,124 @@ static int read_ar_header(int fd, int offset, ArchiveHeader *hdr)
     return len;
 }
 
-/* load only the objects which resolve undefined symbols */
-static int tcc_load_alacarte(TCCState *s1, int fd, int size, int entrysize)
+/* the symbol index of an archive, hashed by name.  Allocated as one
+   block so that dynarray_reset() frees it. */
+typedef struct ArchiveIndex {
+    const char *filename;
+    long long mtime; /* of the archive */
+    int size; /* of the index member */
+    int nsyms, entrysize, hmask;
+    int *hash; /* first entry with this hash or -1 */
+    int *next; /* next entry with the same hash or -1 */
+    const char **names;
+    uint8_t *data; /* the index member itself */
+} ArchiveIndex;
+
+static ArchiveIndex *get_ar_index(TCCState *s1, int fd, unsigned long offset,
+                                  int size, int entrysize)
+{
+    ArchiveIndex *ai;
+    const char *fn = s1->current_filename, *p, *end;
+    uint8_t cnt[8];
+    unsigned long long n;
+    long long mtime;
+    int i, hsize, nsyms;
+    struct stat st;
+
+    /* an archive rewritten since gets a new index */
+    mtime = fstat(fd, &st) ? 0 : (long long)st.st_mtime;
+    for (i = 0; i < s1->nb_ar_indexes; i++) {
+        ai = s1->ar_indexes[i];
+        if (ai->size == size && ai->mtime == mtime
+            && !strcmp(ai->filename, fn))
+            return ai;
+    }
+    if (read_data(s1, fd, offset, cnt, entrysize) != entrysize)
+        return NULL;
+    n = get_be(cnt, entrysize);
+    if (n >= size / entrysize)
+        return NULL;
+    nsyms = n;
+    for (hsize = 1; hsize < nsyms; hsize *= 2)
+        ;
+    ai = tcc_malloc(sizeof *ai + nsyms * sizeof(char *)
+                    + (hsize + nsyms) * sizeof(int) + size + 1 + strlen(fn) + 1);
+    ai->names = (const char **)(ai + 1);
+    ai->hash = (int *)(ai->names + nsyms);
+    ai->next = ai->hash + hsize;
+    ai->data = (uint8_t *)(ai->next + nsyms);
+    ai->filename = strcpy((char *)ai->data + size + 1, fn);
+    ai->mtime = mtime;
+    ai->size = size;
+    ai->nsyms = nsyms;
+    ai->entrysize = entrysize;
+    ai->hmask = hsize - 1;
+    memcpy(ai->data, cnt, entrysize);
+    if (read_data(s1, fd, offset + entrysize, ai->data + entrysize,
+                  size - entrysize) != size - entrysize) {
+        tcc_free(ai);
+        return NULL;
+    }
+    ai->data[size] = 0;
+    end = (char *)ai->data + size;
+    p = (char *)ai->data + (nsyms + 1) * entrysize;
+    for (i = 0; i < nsyms; i++, p += strlen(p) + 1)
+        ai->names[i] = p < end ? p : end;
+    /* insert backwards so that chains keep the archive order */
+    memset(ai->hash, -1, hsize * sizeof(int));
+    while (i--) {
+        int h = elf_hash((unsigned char *)ai->names[i]) & ai->hmask;
+        ai->next[i] = ai->hash[h];
+        ai->hash[h] = i;
+    }
+    dynarray_add(&s1->ar_indexes, &s1->nb_ar_indexes, ai);
+    return ai;
+}
+
+/* load only the objects which resolve undefined symbols.  Each
+   undefined symbol is looked up once in the index, including those
+   that the loaded objects add to the end of the symbol table. */
+static int tcc_load_alacarte(TCCState *s1, int fd, unsigned long file_offset,
+                             int size, int entrysize)
 {
-    int i, bound, nsyms, sym_index, len, ret = -1;
+    int i, e, len;
     unsigned long long off;
-    uint8_t *data;
-    const char *ar_names, *p;
-    const uint8_t *ar_index;
+    const char *name;
     ElfW(Sym) *sym;
     ArchiveHeader hdr;
-
-    data = tcc_malloc(size);
-    if (full_read(fd, data, size) != size)
-        goto the_end;
-    nsyms = get_be(data, entrysize);
-    ar_index = data + entrysize;
-    ar_names = (char *) ar_index + nsyms * entrysize;
-
-    do {
-        bound = 0;
-        for (p = ar_names, i = 0; i < nsyms; i++, p += strlen(p)+1) {
-            Section *s = symtab_section;
-            sym_index = find_elf_sym(s, p);
-            if (!sym_index)
-                continue;
-            sym = &((ElfW(Sym) *)s->data)[sym_index];
-            if(sym->st_shndx != SHN_UNDEF)
+    ArchiveIndex *ai;
+    Section *s = symtab_section;
+
+    ai = get_ar_index(s1, fd, file_offset, size, entrysize);
+    if (!ai)
+        return tcc_error_noabort("invalid archive");
+    for (i = 1; i < s->data_offset / sizeof *sym; i++) {
+        sym = (ElfW(Sym) *)s->data + i;
+        if (sym->st_shndx != SHN_UNDEF
+            || ELFW(ST_BIND)(sym->st_info) == STB_LOCAL)
+            continue;
+        name = (char *)s->link->data + sym->st_name;
+        e = ai->hash[elf_hash((unsigned char *)name) & ai->hmask];
+        for (; e >= 0; e = ai->next[e]) {
+            if (strcmp(ai->names[e], name))
                 continue;
-            off = get_be(ar_index + i * entrysize, entrysize);
-            len = read_ar_header(fd, off, &hdr);
-            if (len <= 0 || memcmp(hdr.ar_fmag, ARFMAG, 2)) {
-                tcc_error_noabort("invalid archive");
-                goto the_end;
-            }
+            off = get_be(ai->data + (e + 1) * entrysize, entrysize);
+            len = read_ar_header(s1, fd, off, &hdr);
+            if (len <= 0 || memcmp(hdr.ar_fmag, ARFMAG, 2))
+                return tcc_error_noabort("invalid archive");
             off += len;
             if (s1->verbose == 2)
                 printf("   -> %s\n", hdr.ar_name);
             if (tcc_load_object_file(s1, fd, off) < 0)
-                goto the_end;
-            ++bound;
+                return -1;
+            sym = (ElfW(Sym) *)s->data + i;
+            if (sym->st_shndx != SHN_UNDEF)
+                break;
+            /* the loaded object may have moved the string table */
+            name = (char *)s->link->data + sym->st_name;
         }
-    } while(bound);
-    ret = 0;
- the_end:
-    tcc_free(data);
-    return ret;
+    }
+    return 0;
 }
 
 /* load a '.a' file */
@@ -3465,7 +5740,7 @@ ST_FUNC int tcc_load_archive(TCCState *s1, int fd, int alacarte)
     file_offset = sizeof ARMAG - 1;
 
     for(;;) {
-        len = read_ar_header(fd, file_offset, &hdr);
+        len = read_ar_header(s1, fd, file_offset, &hdr);
         if (len == 0)
             return 0;
         if (len < 0)
@@ -3477,10 +5752,11 @@ ST_FUNC int tcc_load_archive(TCCState *s1, int fd, int alacarte)
         if (alacarte) {
             /* coff symbol table : we handle it */
             if (!strcmp(hdr.ar_name, "/"))
-                return tcc_load_alacarte(s1, fd, size, 4);
+                return tcc_load_alacarte(s1, fd, file_offset, size, 4);
             if (!strcmp(hdr.ar_name, "/SYM64/"))
-                return tcc_load_alacarte(s1, fd, size, 8);
-        } else if (tcc_object_type(fd, &ehdr) == AFF_BINTYPE_REL) {
+                return tcc_load_alacarte(s1, fd, file_offset, size, 8);
+        } else if (elf_object_type(&ehdr, read_data(s1, fd, file_offset,
+                                   &ehdr, sizeof ehdr)) == AFF_BINTYPE_REL) {
             if (s1->verbose == 2)
                 printf("   -> %s\n", hdr.ar_name);
             if (tcc_load_object_file(s1, fd, file_offset) < 0)
@@ -3638,7 +5914,7 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
     const char *name, *soname;
     struct versym_info v;
 
-    full_read(fd, &ehdr, sizeof(ehdr));
+    read_data(s1, fd, 0, &ehdr, sizeof(ehdr));
 
     /* test CPU specific stuff */
     if (ehdr.e_ident[5] != ELFDATA2LSB ||
@@ -3647,7 +5923,7 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
     }
 
     /* read sections */
-    shdr = load_data(fd, ehdr.e_shoff, sizeof(ElfW(Shdr)) * ehdr.e_shnum);
+    shdr = map_data(s1, fd, ehdr.e_shoff, sizeof(ElfW(Shdr)) * ehdr.e_shnum);
 
     /* load dynamic section and dynamic symbols */
     nb_syms = 0;
@@ -3661,23 +5937,23 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
         switch(sh->sh_type) {
         case SHT_DYNAMIC:
             nb_dts = sh->sh_size / sizeof(ElfW(Dyn));
-            dynamic = load_data(fd, sh->sh_offset, sh->sh_size);
+            dynamic = map_data(s1, fd, sh->sh_offset, sh->sh_size);
             break;
         case SHT_DYNSYM:
             nb_syms = sh->sh_size / sizeof(ElfW(Sym));
-            dynsym = load_data(fd, sh->sh_offset, sh->sh_size);
+            dynsym = map_data(s1, fd, sh->sh_offset, sh->sh_size);
             sh1 = &shdr[sh->sh_link];
-            dynstr = load_data(fd, sh1->sh_offset, sh1->sh_size);
+            dynstr = map_data(s1, fd, sh1->sh_offset, sh1->sh_size);
             break;
         case SHT_GNU_verdef:
-	    v.verdef = load_data(fd, sh->sh_offset, sh->sh_size);
+	    v.verdef = map_data(s1, fd, sh->sh_offset, sh->sh_size);
 	    break;
         case SHT_GNU_verneed:
-	    v.verneed = load_data(fd, sh->sh_offset, sh->sh_size);
+	    v.verneed = map_data(s1, fd, sh->sh_offset, sh->sh_size);
 	    break;
         case SHT_GNU_versym:
             v.nb_versyms = sh->sh_size / sizeof(ElfW(Half));
-	    v.versym = load_data(fd, sh->sh_offset, sh->sh_size);
+	    v.versym = map_data(s1, fd, sh->sh_offset, sh->sh_size);
 	    break;
         default:
             break;
@@ -3698,7 +5974,7 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
         goto ret_success;
 
     if (v.nb_versyms != nb_syms)
-        tcc_free (v.versym), v.versym = NULL;
+        unload_data(s1, v.versym), v.versym = NULL;
     else
         store_version(s1, &v, dynstr);
 
@@ -3747,14 +6023,14 @@ ST_FUNC int tcc_load_dll(TCCState *s1, int fd, const char *filename, int level)
  ret_success:
     ret = 0;
  the_end:
-    tcc_free(dynstr);
-    tcc_free(dynsym);
-    tcc_free(dynamic);
-    tcc_free(shdr);
+    unload_data(s1, dynstr);
+    unload_data(s1, dynsym);
+    unload_data(s1, dynamic);
+    unload_data(s1, shdr);
     tcc_free(v.local_ver);
-    tcc_free(v.verdef);
-    tcc_free(v.verneed);
-    tcc_free(v.versym);
+    unload_data(s1, v.verdef);
+    unload_data(s1, v.verneed);
+    unload_data(s1, v.versym);
     return ret;
 }
 
@@ -119,8 +119,49 @@ static struct scope {
     struct { Sym *s; int n; } cl;
     int *bsym, *csym;
     Sym *lstk, *llstk;
+    int loc; /* stack frame position at entry */
 } *cur_scope, *loop_scope, *root_scope;
 
+/* -O1: lowest 'loc' of scopes whose slots were given back */
+static int loc_low;
+
+/* -finline-functions: the call currently expanded in place, if any */
+static struct inline_call {
+    int ret_loc; /* local receiving the return value */
+    int ret_scope; /* local_scope of the outermost block of the body */
+} *cur_inline;
+
+#define INLINE_MAX_SIZE 100 /* token string words */
+#define INLINE_MAX_DEPTH 4
+
+/* -O1: statements of an 'if' that __builtin_expect() says are not
+   expected to run, compiled at the end of the enclosing compound
+   statement instead, out of the way of the expected path */
+typedef struct cold_stmt {
+    struct cold_stmt *next;
+    TokenString *str;
+    struct scope *owner; /* the compound statement */
+    struct scope scope; /* its state at the 'if' */
+    Sym *lstk; /* local symbols visible at the 'if' */
+    int jmp; /* jumps to the statement */
+    int back; /* where to continue after it */
+} cold_stmt;
+static cold_stmt *cold_stmts;
+
+/* 1 + the value expected by the __builtin_expect() that makes up the
+   whole condition of an 'if', or 0 */
+static int expect_hint;
+
+/* vector_size() types made so far, so that equal vectors share a type */
+static Sym **vector_types;
+static int nb_vector_types;
+
+#ifdef TCC_TARGET_TAIL_CALL
+/* -foptimize-sibling-calls: the next unary() starts the expression
+   of a 'return' statement */
+static int ret_tail;
+#endif
+
 typedef struct {
     Section *sec;
     int local_offset;
@@ -138,6 +179,7 @@ static void block(int flags);
 
 static void gen_cast(CType *type);
 static void gen_cast_s(int t);
+static void gen_opvec(int op);
 static inline CType *pointed_type(CType *type);
 static int is_compatible_types(CType *type1, CType *type2);
 static int parse_btype(CType *type, AttributeDef *ad, int ignore_label);
@@ -156,6 +198,9 @@ static void vpush(CType *type);
 static int gvtst(int inv, int t);
 static void gen_inline_functions(TCCState *s);
 static void free_inline_functions(TCCState *s);
+static InlineFunc *inline_record(Sym *sym, int keep);
+static InlineFunc *inline_find(void);
+static void inline_call(InlineFunc *fn);
 static void skip_or_save_block(TokenString **str);
 static void gv_dup(void);
 static int get_temp_local_var(int size,int align);
@@ -235,6 +280,10 @@ static int btype_size(int bt)
 /* returns function return register from type */
 static int R_RET(int t)
 {
+#ifdef TCC_TARGET_VECTOR
+    if (IS_VECTOR(t))
+        return REG_FRET;
+#endif
     if (!is_float(t))
         return REG_IRET;
 #ifdef TCC_TARGET_X86_64
@@ -284,6 +333,10 @@ static int RC_RET(int t)
 /* returns generic register class for type t */
 static int RC_TYPE(int t)
 {
+#ifdef TCC_TARGET_VECTOR
+    if (IS_VECTOR(t))
+        return RC_FLOAT;
+#endif
     if (!is_float(t))
         return RC_INT;
 #ifdef TCC_TARGET_X86_64
@@ -414,6 +467,9 @@ ST_FUNC int tccgen_compile(TCCState *s1)
 ST_FUNC void tccgen_finish(TCCState *s1)
 {
     tcc_debug_end(s1); /* just in case of errors: free memory */
+#ifdef TCC_TARGET_IR
+    ir_end();
+#endif
     free_inline_functions(s1);
     sym_pop(&global_stack, NULL, 0);
     sym_pop(&local_stack, NULL, 0);
@@ -425,6 +481,15 @@ ST_FUNC void tccgen_finish(TCCState *s1)
     dynarray_reset(&stk_data, &nb_stk_data);
     while (cur_switch)
         end_switch();
+    tcc_free(vector_types);
+    vector_types = NULL;
+    nb_vector_types = 0;
+    while (cold_stmts) {
+        cold_stmt *c = cold_stmts;
+        cold_stmts = c->next;
+        tok_str_free(c->str);
+        tcc_free(c);
+    }
     local_scope = 0;
     loop_scope = NULL;
     all_cleanups = NULL;
@@ -509,6 +574,8 @@ ST_FUNC void put_extern_sym2(Sym *sym, int sh_num,
             sym_type = STT_NOTYPE;
             if ((t & (VT_BTYPE|VT_ASM_FUNC)) == VT_ASM_FUNC)
                 sym_type = STT_FUNC;
+        } else if (sym->a.tls) {
+            sym_type = STT_TLS;
         } else {
             sym_type = STT_OBJECT;
         }
@@ -1168,6 +1235,7 @@ static void merge_symattr(struct SymAttr *sa, struct SymAttr *sa1)
     sa->dllexport |= sa1->dllexport;
     sa->nodecorate |= sa1->nodecorate;
     sa->dllimport |= sa1->dllimport;
+    sa->tls |= sa1->tls;
 }
 
 /* Merge function attributes.  */
@@ -1185,6 +1253,8 @@ static void merge_funcattr(struct FuncAttr *fa, struct FuncAttr *fa1)
       fa->func_ctor = 1;
     if (fa1->func_dtor)
       fa->func_dtor = 1;
+    if (fa1->func_used)
+      fa->func_used = 1;
 }
 
 /* Merge attributes.  */
@@ -1201,6 +1271,8 @@ static void merge_attr(AttributeDef *ad, AttributeDef *ad1)
       ad->asm_label = ad1->asm_label;
     if (ad1->attr_mode)
       ad->attr_mode = ad1->attr_mode;
+    if (ad1->vector_size)
+      ad->vector_size = ad1->vector_size;
 }
 
 /* Merge some type attributes.  */
@@ -1377,6 +1449,8 @@ ST_FUNC void save_reg_upstack(int r, int n)
                 if ((p->r & VT_LVAL) || bt == VT_FUNC)
                     bt = VT_PTR;
                 sv.type.t = bt;
+                if (bt == VT_STRUCT) /* vector in a register */
+                    sv.type = p->type;
                 size = type_size(&sv.type, &align);
                 l = get_temp_local_var(size,align);
                 sv.r = VT_LOCAL | VT_LVAL;
@@ -2300,6 +2374,176 @@ static int gen_opic_lt(uint64_t a, uint64_t b)
     return (a ^ (uint64_t)1 << 63) < (b ^ (uint64_t)1 << 63);
 }
 
+/* 2^p / d, with the remainder in *r. d > 1 and the quotient must
+   fit in 64 bits */
+static uint64_t gen_divc_pow2(int p, uint64_t d, uint64_t *r)
+{
+    uint64_t q = 0, m = 1;
+    int c;
+
+    while (p--) {
+        c = m >> 63;
+        m <<= 1, q <<= 1;
+        if (c || m >= d)
+            m -= d, q |= 1;
+    }
+    *r = m;
+    return q;
+}
+
+static void gen_divc_op(int op, int t, uint64_t c)
+{
+    vpush64(t, c);
+    gen_op(op);
+}
+
+/* replace 'x / d' and 'x % d' with a constant 'd' by multiplications
+   and shifts, see Granlund & Montgomery, "Division by Invariant Integers
+   using Multiplication". Return 0 if the division must be kept. */
+static int gen_opic_divc(int op, uint64_t d)
+{
+    int t = vtop[-1].type.t, bt = t & VT_BTYPE, tu = bt | VT_UNSIGNED;
+    int n = bt == VT_LLONG ? 64 : 32, w = PTR_SIZE * 8;
+    int uns = op == TOK_UDIV || op == TOK_UMOD;
+    int mod = op == '%' || op == TOK_UMOD;
+    int neg, k, s, add, i;
+    uint64_t ad, m, r;
+
+    if ((bt != VT_INT && bt != VT_LLONG)
+        || (vtop->type.t & VT_BTYPE) != bt)
+        return 0;
+    ad = n == 64 ? d : (uint32_t)d;
+    neg = !uns && ad >> (n - 1);
+    if (neg)
+        ad = n == 64 ? -ad : (uint32_t)-ad;
+    if (ad <= 1)
+        return 0;
+    for (k = 0; ad >> k > 1; ++k)
+        ;
+
+    if (op == TOK_PDIV) {
+        /* exact division: shift out the factors of two, then multiply
+           by the inverse of the odd part modulo 2^n */
+        if (neg || !(ad & (ad - 1)))
+            return 0;
+        for (k = 0; !(ad >> k & 1); ++k)
+            ;
+        m = ad >> k;
+        for (r = m, i = 0; i < 5; ++i)
+            r *= 2 - m * r;
+        vtop--;
+        if (k)
+            gen_divc_op(TOK_SAR, bt, k);
+        gen_divc_op('*', bt, r);
+        return 1;
+    }
+
+    if (!(ad & (ad - 1))) {
+        if (op == TOK_UMOD) {
+            vtop--;
+            gen_divc_op('&', tu, ad - 1);
+            return 1;
+        }
+        if (uns)
+            return 0; /* shifted by the caller */
+        /* signed: add 2^k - 1 to negative x to round towards zero */
+        vtop--;
+        gen_cast_s(bt);
+        if (mod)
+            gv_dup();
+        gv_dup();
+        if (k > 1)
+            gen_divc_op(TOK_SAR, bt, n - 1);
+        gen_cast_s(tu);
+        gen_divc_op(TOK_SHR, tu, n - k);
+        gen_cast_s(bt);
+        gen_op('+');
+        gen_divc_op(TOK_SAR, bt, k);
+        if (neg)
+            vpush64(bt, 0), vswap(), gen_op('-');
+        goto done;
+    }
+
+#ifndef HAVE_MULH
+    return 0;
+#endif
+    if (n > w)
+        return 0;
+
+    /* m = 2^s / |d| rounded up, with an extra bit if 'add' */
+    if (uns) {
+        m = gen_divc_pow2(n + k, ad, &r);
+        if (ad - r < (uint64_t)1 << k)
+            m += 1, s = n + k, add = 0;
+        else
+            m = 2 * m + (r >= ad - r) + 1, s = n + k + 1, add = 1;
+    } else {
+        m = gen_divc_pow2(n - 1 + k, ad, &r);
+        if (ad - r < (uint64_t)1 << k)
+            m += 1, s = n - 1 + k, add = 0;
+        else
+            m = 2 * m + (r >= ad - r) + 1, s = n + k, add = 1;
+    }
+
+    vtop--;
+    gen_cast_s(uns ? tu : bt);
+    if (mod)
+        gv_dup();
+    if (n < w) {
+        /* m has at most 33 bits: use the high part of a 64 bit product */
+        m <<= 64 - s;
+        if (uns) {
+            gen_cast_s(VT_LLONG | VT_UNSIGNED);
+            gen_divc_op(TOK_UMULH, VT_LLONG | VT_UNSIGNED, m);
+        } else {
+            gen_cast_s(VT_LLONG);
+            gen_divc_op(TOK_SMULH, VT_LLONG, neg ? -m : m);
+        }
+        /* |q| < 2^31 is already in 32 bit form, and the signed rounding
+           below uses 32 bit operations */
+        vtop->type.t = uns ? tu : bt;
+    } else if (uns) {
+        if (add) {
+            /* t = mulh(x, m), q = (((x - t) >> 1) + t) >> (s - n - 1) */
+            gv_dup();
+            gen_divc_op(TOK_UMULH, tu, m);
+            gv_dup();
+            vrott(3);
+            gen_op('-');
+            gen_divc_op(TOK_SHR, tu, 1);
+            gen_op('+');
+            s--;
+        } else {
+            gen_divc_op(TOK_UMULH, tu, m);
+        }
+        gen_divc_op(TOK_SHR, tu, s - n);
+    } else {
+        if (add)
+            gv_dup();
+        gen_divc_op(TOK_SMULH, bt, neg ? -m : m);
+        if (add)
+            vswap(), gen_op(neg ? '-' : '+');
+        if (s > n)
+            gen_divc_op(TOK_SAR, bt, s - n);
+    }
+    if (!uns) {
+        /* add one if negative to round towards zero */
+        gv_dup();
+        gen_cast_s(tu);
+        gen_divc_op(TOK_SHR, tu, n - 1);
+        gen_cast_s(bt);
+        gen_op('+');
+    }
+
+ done:
+    if (mod) {
+        gen_divc_op('*', uns ? tu : bt, d);
+        gen_op('-');
+    }
+    vtop->type.t = t;
+    return 1;
+}
+
 /* handle integer constant optimizations and various machine
    independent opt */
 static void gen_opic(int op)
@@ -2409,6 +2653,10 @@ static void gen_opic(int op)
                             (l2 == -1 || (l2 == 0xFFFFFFFF && t2 != VT_LLONG))))) {
             /* filter out NOP operations like x*1, x-0, x&-1... */
             vtop--;
+        } else if (c2 && (op == '/' || op == '%' || op == TOK_UDIV
+                          || op == TOK_UMOD || op == TOK_PDIV)
+                   && gen_opic_divc(op, l2)) {
+            /* division by a constant without a divide instruction */
         } else if (c2 && (op == '*' || op == TOK_PDIV || op == TOK_UDIV)) {
             /* try to use shifts instead of muls or divs */
             if (l2 > 0 && (l2 & (l2 - 1)) == 0) {
@@ -2984,6 +3232,9 @@ redo:
 	    vswap();
 	}
 	goto redo;
+    } else if (IS_VECTOR(t1) || IS_VECTOR(t2)) {
+        gen_opvec(op); /* the result stays in memory */
+        return;
     } else if (!combine_types(&combtype, vtop - 1, vtop, op)) {
         tcc_error("invalid operand types for binary operation");
     } else if (bt1 == VT_PTR || bt2 == VT_PTR) {
@@ -3184,6 +3435,11 @@ static void gen_cast(CType *type)
     if (vtop->type.t & VT_BITFIELD)
         gv(RC_INT);
 
+    /* vectors of the same size are just reinterpreted */
+    if (IS_VECTOR(type->t) && IS_VECTOR(vtop->type.t)
+        && type_size(type, &c) != type_size(&vtop->type, &c))
+        tcc_error("cannot cast between vectors of different size");
+
     dbt = type->t & (VT_BTYPE | VT_UNSIGNED);
     sbt = vtop->type.t & (VT_BTYPE | VT_UNSIGNED);
     if (sbt == VT_FUNC)
@@ -3501,6 +3757,162 @@ ST_FUNC void mk_pointer(CType *type)
     type->ref = s;
 }
 
+/* make 'type' a vector of 'size' bytes of its elements.  Vectors are
+   structs with one anonymous array member, so that they are copied,
+   initialized and indexed like these. */
+static void mk_vector(CType *type, int size)
+{
+    Sym *s, *f;
+    int i, t, bt, esize, align;
+
+    t = type->t & (VT_BTYPE | VT_UNSIGNED | VT_DEFSIGN | VT_LONG);
+    bt = t & VT_BTYPE;
+    if ((!is_integer_btype(bt) && bt != VT_FLOAT && bt != VT_DOUBLE)
+        || bt == VT_BOOL || (type->t & VT_STRUCT_MASK))
+        tcc_error("invalid vector element type");
+    esize = type_size(type, &align);
+    if (size < esize)
+        tcc_error("vector size smaller than its element");
+    for (i = 0; i < nb_vector_types; i++) {
+        s = vector_types[i];
+        if (s->c == size && s->next->type.ref->type.t == t)
+            goto found;
+    }
+    s = sym_push2(&global_stack, SYM_FIELD, t, size / esize);
+    f = sym_push2(&global_stack, anon_sym++ | SYM_FIELD, VT_PTR | VT_ARRAY, 0);
+    f->type.ref = s;
+    s = sym_push2(&global_stack, anon_sym++ | SYM_STRUCT, VT_VECTOR, size);
+    s->r = size < 16 ? size : 16;
+    s->next = f;
+    dynarray_add(&vector_types, &nb_vector_types, s);
+found:
+    type->t = (type->t & ~(VT_BTYPE | VT_UNSIGNED | VT_DEFSIGN | VT_LONG))
+        | VT_VECTOR;
+    type->ref = s;
+}
+
+/* element type of vector type */
+static inline CType *vector_elem(CType *type)
+{
+    return &type->ref->next->type.ref->type;
+}
+
+/* make vtop usable several times without holding a register: a local
+   or static lvalue or a constant */
+static void vec_direct(void)
+{
+    CType type;
+    int size, align, r = vtop->r & (VT_VALMASK | VT_LVAL);
+
+    if (r == (VT_LOCAL | VT_LVAL) || r == (VT_CONST | VT_LVAL) || r == VT_CONST)
+        return;
+    if (IS_VECTOR(vtop->type.t)) {
+        type = vtop->type;
+        type.t &= ~(VT_CONSTANT | VT_VOLATILE);
+        size = type_size(&type, &align);
+        vset(&type, VT_LOCAL | VT_LVAL, get_temp_local_var(size, align));
+        vswap();
+        vstore();
+    } else {
+        gv(RC_TYPE(vtop->type.t));
+        save_reg(vtop->r);
+    }
+}
+
+/* push element at offset 'c' of the vector 'sv' */
+static void vpush_elem(SValue *sv, CType *type, int c)
+{
+    vpushv(sv);
+    vtop->type = *type;
+    vtop->c.i += c;
+}
+
+/* replace the scalar on vtop by a vector 'vt' with all elements set
+   to it */
+static void vec_splat(CType *vt)
+{
+    CType *et = vector_elem(vt);
+    int i, size, esize, align;
+
+    gen_cast(et);
+    vec_direct();
+    esize = type_size(et, &align);
+    size = type_size(vt, &align);
+    vset(vt, VT_LOCAL | VT_LVAL, get_temp_local_var(size, align));
+    for (i = 0; i < size; i += esize) {
+        vpush_elem(vtop, et, i);
+        vpushv(vtop - 2);
+        vstore();
+        vpop();
+    }
+    vswap();
+    vpop();
+}
+
+/* element-wise operation on two vectors, or a vector and a scalar */
+static void gen_opvec(int op)
+{
+    CType vt, et, rt;
+    int i, size, esize, align;
+
+    vt = IS_VECTOR(vtop[-1].type.t) ? vtop[-1].type : vtop->type;
+    vt.t &= ~(VT_CONSTANT | VT_VOLATILE);
+    if (!IS_VECTOR(vtop->type.t)) {
+        vec_splat(&vt);
+    } else if (!IS_VECTOR(vtop[-1].type.t)) {
+        vswap();
+        vec_splat(&vt);
+        vswap();
+    } else if (vtop[-1].type.ref != vtop->type.ref) {
+        tcc_error("invalid operand types for binary operation");
+    }
+    et = *vector_elem(&vt);
+    esize = type_size(&et, &align);
+    size = type_size(&vt, &align);
+    rt = vt;
+    if (TOK_ISCOND(op)) {
+        /* comparisons give -1 or 0 in integers of the element size */
+        rt.t = esize == 8 ? VT_LLONG : esize == 4 ? VT_INT
+             : esize == 2 ? VT_SHORT : VT_BYTE;
+        mk_vector(&rt, size);
+    }
+    if (nocode_wanted) {
+        vpop();
+        vpop();
+        vset(&rt, VT_LOCAL | VT_LVAL, 0);
+        return;
+    }
+#ifdef TCC_TARGET_VECTOR
+    if (!TOK_ISCOND(op) && gen_opv(op, et.t)) {
+        /* keep the result in memory like other vectors */
+        vtop->type = rt;
+        save_reg(vtop->r);
+        return;
+    }
+#endif
+    vec_direct();
+    vswap();
+    vec_direct();
+    vswap();
+    vset(&rt, VT_LOCAL | VT_LVAL, get_temp_local_var(size, align));
+    for (i = 0; i < size; i += esize) {
+        vpush_elem(vtop, vector_elem(&rt), i);
+        vpush_elem(vtop - 3, &et, i);
+        vpush_elem(vtop - 3, &et, i);
+        gen_op(op);
+        if (TOK_ISCOND(op)) {
+            vpushi(0);
+            vswap();
+            gen_op('-');
+        }
+        vstore();
+        vpop();
+    }
+    vrott(3);
+    vpop();
+    vpop();
+}
+
 /* return true if type1 and type2 are exactly the same (including
    qualifiers). 
 */
@@ -3623,7 +4035,8 @@ ST_FUNC void vstore(void)
     dbt = ft & VT_BTYPE;
     verify_assign_cast(&vtop[-1].type);
 
-    if (sbt == VT_STRUCT) {
+    if (sbt == VT_STRUCT
+        && (!IS_VECTOR(vtop->type.t) || (vtop->r & VT_LVAL))) {
         /* if structure, only generate pointer */
         /* structure assignment : generate memcpy */
         size = type_size(&vtop->type, &align);
@@ -3745,7 +4158,7 @@ ST_FUNC void vstore(void)
                 vswap();
             }
 #endif
-            gv(RC_TYPE(dbt)); /* generate value */
+            gv(RC_TYPE(ft)); /* generate value */
 
             if (delayed_cast) {
                 vtop->r |= BFVAL(VT_MUSTCAST, (sbt == VT_LLONG) + 1);
@@ -3884,6 +4297,10 @@ redo:
         case TOK_ALWAYS_INLINE2:
             ad->f.func_alwinl = 1;
             break;
+        case TOK_USED1:
+        case TOK_USED2:
+            ad->f.func_used = 1;
+            break;
         case TOK_SECTION1:
         case TOK_SECTION2:
             skip('(');
@@ -3930,6 +4347,15 @@ redo:
 	    if (n != 1 << (ad->a.aligned - 1))
 	      tcc_error("alignment of %d is larger than implemented", n);
             break;
+        case TOK_VECTOR_SIZE1:
+        case TOK_VECTOR_SIZE2:
+            skip('(');
+            n = expr_const();
+            if (n <= 0 || (n & (n - 1)) != 0)
+                tcc_error("vector size must be a positive power of two");
+            ad->vector_size = n;
+            skip(')');
+            break;
         case TOK_PACKED1:
         case TOK_PACKED2:
             ad->a.packed = 1;
@@ -4801,7 +5227,13 @@ static int parse_btype(CType *type, AttributeDef *ad, int ignore_label)
                 sym_to_attr(ad, type1.ref);
             goto basic_type2;
         case TOK_THREAD_LOCAL:
-            tcc_error("_Thread_local is not implemented");
+        case TOK_THREAD:
+#ifndef TCC_TARGET_TLS
+            tcc_error("thread-local storage is not implemented for this target");
+#endif
+            ad->a.tls = 1;
+            next();
+            break;
         default:
             if (typespec_found)
                 goto the_end;
@@ -4845,6 +5277,10 @@ the_end:
         t = (t & ~(VT_BTYPE|VT_LONG)) | (VT_DOUBLE|VT_LONG);
 #endif
     type->t = t;
+    if (ad->vector_size && type_found) {
+        mk_vector(type, ad->vector_size);
+        ad->vector_size = 0;
+    }
     return type_found;
 }
 
@@ -5169,6 +5605,10 @@ static CType *type_decl(CType *type, AttributeDef *ad, int *v, int td)
     post_type(post, ad, post != ret ? 0 : storage,
               td & ~(TYPE_DIRECT|TYPE_ABSTRACT));
     parse_attribute(ad);
+    if (ad->vector_size) {
+        mk_vector(ret, ad->vector_size);
+        ad->vector_size = 0;
+    }
     type->t |= storage;
     return ret;
 }
@@ -5196,6 +5636,29 @@ ST_FUNC void indir(void)
     }
 }
 
+#ifdef TCC_TARGET_TLS
+/* replace the thread-local variable on vtop by its address in a
+   register, as an lvalue if 'lval' */
+static void gen_tls(int lval)
+{
+    Sym *sym = vtop->sym;
+    ElfSym *esym = elfsym(sym);
+    int model = TLS_GD;
+
+    /* an executable knows where its own variables are, the linker
+       relaxes the general model for everything else */
+    if (tcc_state->output_type == TCC_OUTPUT_EXE) {
+        model = TLS_IE;
+        if (((sym->type.t & VT_STATIC)
+             || (esym && esym->st_shndx != SHN_UNDEF)) && !sym->a.weak)
+            model = TLS_LE;
+    }
+    vtop->r = VT_CONST | VT_SYM;
+    gen_tls_addr(model);
+    vtop->r |= lval;
+}
+#endif
+
 /* pass a parameter to a function and do type checking and casting */
 static void gfunc_param_typed(Sym *func, Sym *arg)
 {
@@ -5422,13 +5885,31 @@ static void parse_atomic(int atok)
         break;
     }
 
-    sprintf(buf, "%s_%d", get_tok_str(atok, 0), size);
-    vpush_helper_func(tok_alloc_const(buf));
-    vrott(arg - save + 1);
-    gfunc_call(arg - save);
-
-    vpush(&ct);
-    PUT_R_RET(vtop, ct.t);
+#ifdef TCC_TARGET_NATIVE_ATOMIC
+    if (TCC_TARGET_NATIVE_ATOMIC(size)) {
+        /* drop the memory orders (and the 'weak' flag), the backend
+           only needs to know the one for success as a constant */
+        int n = atok == TOK___atomic_compare_exchange ? 3 : 1;
+        SValue *sv = vtop - (n > 1);
+        int mo = 5; /* __ATOMIC_SEQ_CST */
+        if ((sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST
+            && (unsigned)sv->c.i < 5)
+            mo = sv->c.i;
+        while (n--)
+            vpop();
+        t = gen_atomic(atok, size, mo);
+        vpush(&ct);
+        vtop->r = t;
+    } else
+#endif
+    {
+        sprintf(buf, "%s_%d", get_tok_str(atok, 0), size);
+        vpush_helper_func(tok_alloc_const(buf));
+        vrott(arg - save + 1);
+        gfunc_call(arg - save);
+        vpush(&ct);
+        PUT_R_RET(vtop, ct.t);
+    }
     t = ct.t & VT_BTYPE;
     if (t == VT_BYTE || t == VT_SHORT || t == VT_BOOL) {
 #ifdef PROMOTE_RET
@@ -5446,12 +5927,175 @@ static void parse_atomic(int atok)
     }
 }
 
+/* value of __builtin_'op'() for a constant 'x' of 'bits' bits, with
+   'op' the int form of the builtin.  clz and ctz of 0 give 'bits'. */
+static uint64_t fold_bitop(int op, int bits, uint64_t x)
+{
+    uint64_t m = bits < 64 ? ((uint64_t)1 << bits) - 1 : ~(uint64_t)0, r;
+    int i, n = 0;
+
+    x &= m;
+    switch (op) {
+    case TOK_builtin_bswap16:
+        for (r = 0, i = 0; i < bits; i += 8)
+            r = r << 8 | (x >> i & 0xff);
+        return r;
+    case TOK_builtin_ffs:
+        if (x)
+            for (n = 1; !(x & 1); x >>= 1)
+                ++n;
+        break;
+    case TOK_builtin_clrsb:
+        if (x >> (bits - 1))
+            x = ~x & m;
+        n = -1;
+        /* fall through */
+    case TOK_builtin_clz:
+        for (i = bits; i-- && !(x >> i & 1); )
+            ++n;
+        break;
+    case TOK_builtin_ctz:
+        for (i = 0; i < bits && !(x >> i & 1); ++i)
+            ++n;
+        break;
+    default: /* popcount, parity */
+        for (; x; x &= x - 1)
+            ++n;
+        if (op == TOK_builtin_parity)
+            n &= 1;
+        break;
+    }
+    return n;
+}
+
+/* __builtin_ffs(), clz, ctz, clrsb, popcount, parity (each with its
+   'l' and 'll' forms) and __builtin_bswap16/32/64(): folded for
+   constants, expanded inline when the target has an instruction for
+   it and a call to the libtcc1 function otherwise. */
+static void parse_bitop(int t)
+{
+    CType ct, rt;
+    int op, n, size;
+
+    ct.ref = rt.ref = NULL;
+    if (t >= TOK_builtin_bswap16) {
+        op = TOK_builtin_bswap16;
+        size = 2 << (t - TOK_builtin_bswap16);
+        ct.t = (size == 2 ? VT_SHORT : size == 4 ? VT_INT : VT_LLONG)
+            | VT_UNSIGNED;
+        rt = ct;
+    } else {
+        n = (t - TOK_builtin_ffs) % 3;
+        op = t - n;
+        size = n == 2 || (n == 1 && LONG_SIZE == 8) ? 8 : 4;
+        ct.t = size == 8 ? VT_LLONG : VT_INT;
+        if (op != TOK_builtin_ffs && op != TOK_builtin_clrsb)
+            ct.t |= VT_UNSIGNED;
+        rt.t = VT_INT;
+    }
+    parse_builtin_params(0, "e");
+    gen_assign_cast(&ct);
+
+    if ((vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST) {
+        uint64_t x = fold_bitop(op, size * 8, vtop->c.i);
+        vpop();
+        vpush64(rt.t, x);
+        return;
+    }
+#ifdef TCC_TARGET_BITOP
+    if (TCC_TARGET_BITOP(op)) {
+        n = gen_bitop(op, size);
+        vpush(&rt);
+        vtop->r = n;
+        return;
+    }
+#endif
+    vpush_helper_func(t);
+    vswap();
+    gfunc_call(1);
+    vpush(&rt);
+    PUT_R_RET(vtop, rt.t);
+    if (size == 2) {
+#ifdef PROMOTE_RET
+        vtop->r |= BFVAL(VT_MUSTCAST, 1);
+#else
+        vtop->type.t = VT_INT;
+#endif
+        gen_cast(&rt);
+    }
+}
+
+#ifdef TCC_TARGET_NATIVE_STRUCT_COPY
+/* expand a call to memcpy() or memset() with a small constant size
+   inline.  'f' is the function, followed by its 3 arguments on the
+   value stack. */
+static int gen_small_mem(Sym *f)
+{
+    SValue *sv = vtop - 3;
+    int v, size;
+
+    if ((sv->r & (VT_VALMASK | VT_LVAL | VT_SYM)) != (VT_CONST | VT_SYM)
+        || (sv->sym->type.t & VT_STATIC)
+        || (f->type.t & VT_BTYPE) != VT_PTR
+        || (vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) != VT_CONST
+        || vtop->c.i > SMALL_COPY_MAX)
+        return 0;
+    v = sv->sym->asm_label ? sv->sym->asm_label : sv->sym->v;
+    if (v != TOK_memcpy && v != TOK_memset)
+        return 0;
+    size = vtop->c.i;
+    vpop();
+    if (v == TOK_memset) {
+        /* replicate the byte value */
+        gen_cast_s(VT_BYTE | VT_UNSIGNED);
+        gen_cast_s(VT_LLONG | VT_UNSIGNED);
+        vpushll(0x0101010101010101ULL);
+        gen_op('*');
+    }
+    /* keep dest as the result */
+    vswap();
+    gv(RC_INT);
+    vdup();
+    vrott(3);
+    vswap();
+    if (v == TOK_memset)
+        gen_memset(size);
+    else
+        gen_struct_copy(size);
+    vtop->type = f->type;
+    vswap();
+    vpop();
+    return 1;
+}
+#endif
+
+/* let a string literal just allocated share storage with an equal one */
+static void share_string_literal(void)
+{
+    ElfSym *esym = elfsym(vtop->sym);
+    int align;
+
+#ifdef CONFIG_TCC_BCHECK
+    if (tcc_state->do_bounds_check)
+        return; /* each one has its bounds */
+#endif
+    if (esym && esym->st_size) {
+        type_size(&vtop->type, &align);
+        esym->st_value = share_data(rodata_section, esym->st_value,
+                                    esym->st_size, align);
+    }
+}
+
 ST_FUNC void unary(void)
 {
     int n, t, align, size, r;
     CType type;
     Sym *s;
     AttributeDef ad;
+#ifdef TCC_TARGET_TAIL_CALL
+    int tail = ret_tail;
+    ret_tail = 0;
+#endif
 
     /* generate line number info */
     if (debug_modes)
@@ -5537,6 +6181,7 @@ ST_FUNC void unary(void)
         memset(&ad, 0, sizeof(AttributeDef));
         ad.section = rodata_section;
         decl_initializer_alloc(&type, &ad, VT_CONST, 2, 0, 0);
+        share_string_literal();
         break;
     case TOK_SOTYPE:
     case '(':
@@ -5660,10 +6305,40 @@ ST_FUNC void unary(void)
         break;
 
     case TOK_builtin_expect:
-	/* __builtin_expect is a no-op for now */
 	parse_builtin_params(0, "ee");
+        /* followed by the ')' of an 'if (__builtin_expect(...))' ? */
+        if (tok == ')'
+            && (vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST)
+            expect_hint = 1 + (vtop->c.i != 0);
 	vpop();
         break;
+    case TOK_builtin_prefetch:
+        /* (address [, rw [, locality]]), rw and locality constants */
+        next();
+        skip('(');
+        expr_eq();
+        n = 3;
+        if (tok == ',') {
+            next();
+            expr_const();
+            if (tok == ',') {
+                next();
+                n = expr_const() & 3;
+            }
+        }
+        skip(')');
+        type.t = VT_VOID | VT_CONSTANT;
+        type.ref = NULL;
+        mk_pointer(&type);
+        gen_assign_cast(&type);
+#ifdef TCC_TARGET_PREFETCH
+        gen_prefetch(n);
+#else
+        vpop();
+#endif
+        vpushi(0);
+        vtop->type.t = VT_VOID;
+        break;
     case TOK_builtin_types_compatible_p:
 	parse_builtin_params(0, "tt");
 	vtop[-1].type.t &= ~(VT_CONSTANT | VT_VOLATILE);
@@ -5726,6 +6401,9 @@ ST_FUNC void unary(void)
             skip(')');
             type.t = VT_VOID;
             mk_pointer(&type);
+#if defined TCC_TARGET_X86_64 && !defined TCC_TARGET_PE
+            gen_need_frame();               /* keep the %rbp chain */
+#endif
             vset(&type, VT_LOCAL, 0);       /* local frame */
             while (level--) {
 #ifdef TCC_TARGET_RISCV64
@@ -5835,6 +6513,30 @@ ST_FUNC void unary(void)
         parse_atomic(tok);
         break;
 
+    case TOK_builtin_ffs:
+    case TOK_builtin_ffsl:
+    case TOK_builtin_ffsll:
+    case TOK_builtin_clz:
+    case TOK_builtin_clzl:
+    case TOK_builtin_clzll:
+    case TOK_builtin_ctz:
+    case TOK_builtin_ctzl:
+    case TOK_builtin_ctzll:
+    case TOK_builtin_clrsb:
+    case TOK_builtin_clrsbl:
+    case TOK_builtin_clrsbll:
+    case TOK_builtin_popcount:
+    case TOK_builtin_popcountl:
+    case TOK_builtin_popcountll:
+    case TOK_builtin_parity:
+    case TOK_builtin_parityl:
+    case TOK_builtin_parityll:
+    case TOK_builtin_bswap16:
+    case TOK_builtin_bswap32:
+    case TOK_builtin_bswap64:
+        parse_bitop(tok);
+        break;
+
     /* pre operations */
     case TOK_INC:
     case TOK_DEC:
@@ -5848,6 +6550,11 @@ ST_FUNC void unary(void)
         unary();
 	if (is_float(vtop->type.t)) {
             gen_opif(TOK_NEG);
+	} else if (IS_VECTOR(vtop->type.t)
+                   && is_float(vector_elem(&vtop->type)->t)) {
+            /* unlike 0 - x, gives -0.0 for 0.0 */
+            vpushi(-1);
+            gen_op('*');
 	} else {
             vpushi(0);
             vswap();
@@ -5861,6 +6568,9 @@ ST_FUNC void unary(void)
         /* allow to take the address of a label */
         if (tok < TOK_UIDENT)
             expect("label identifier");
+#ifdef TCC_TARGET_IR
+        ir_failed |= ir_active; /* its address is a code offset */
+#endif
         s = label_find(tok);
         if (!s) {
             s = label_push(&global_label_stack, tok, LABEL_FORWARD);
@@ -5991,6 +6701,10 @@ special_math_val:
 
         if (r & VT_SYM) {
             vtop->c.i = 0;
+#ifdef TCC_TARGET_TLS
+            if (s->a.tls)
+                gen_tls(r & VT_LVAL);
+#endif
         } else if (r == VT_CONST && IS_ENUM_VAL(s->type.t)) {
             vtop->c.i = s->enum_val;
         }
@@ -6031,6 +6745,12 @@ special_math_val:
             }
             next();
         } else if (tok == '[') {
+            if (IS_VECTOR(vtop->type.t)) {
+                /* index the array inside */
+                test_lvalue();
+                gaddrof();
+                vtop->type = vtop->type.ref->next->type;
+            }
             next();
             gexpr();
             gen_op('+');
@@ -6058,6 +6778,13 @@ special_math_val:
             /* get return type */
             s = vtop->type.ref;
             next();
+            if (tcc_state->inline_functions) {
+                InlineFunc *fn = inline_find();
+                if (fn) {
+                    inline_call(fn);
+                    continue;
+                }
+            }
             sa = s->next; /* first parameter */
             nb_args = regsize = 0;
             ret.r2 = VT_CONST;
@@ -6119,6 +6846,18 @@ special_math_val:
             if (sa)
                 tcc_error("too few arguments to function");
             skip(')');
+#ifdef TCC_TARGET_NATIVE_STRUCT_COPY
+            if (nb_args == 3 && gen_small_mem(s))
+                continue;
+#endif
+#ifdef TCC_TARGET_TAIL_CALL
+            /* 'return f(...);' with the value passed through as is */
+            if (tail && tok == ';'
+                && (s->type.t & VT_BTYPE) == (func_vt.t & VT_BTYPE)
+                && (s->type.t & VT_BTYPE) != VT_STRUCT)
+                gfunc_tail_call(nb_args);
+            else
+#endif
             gfunc_call(nb_args);
 
             if (ret_nregs < 0) {
@@ -6874,9 +7613,39 @@ static void new_scope(struct scope *o)
     /* record local declaration stack position */
     o->lstk = local_stack;
     o->llstk = local_label_stack;
+    o->loc = loc;
     ++local_scope;
 }
 
+/* with -O1, let later scopes reuse the stack slots of the locals of
+   the scope 'o' which is being closed */
+static void scope_free_locals(struct scope *o)
+{
+    SValue *p;
+    int i, n;
+
+    if (!tcc_state->optimize || loc >= o->loc)
+        return;
+#ifdef CONFIG_TCC_BCHECK
+    /* the bounds of all locals are registered at function entry */
+    if (tcc_state->do_bounds_check)
+        return;
+#endif
+    /* nothing still on the value stack may live there */
+    for (p = vstack; p <= vtop; p++)
+        if (((p->r & VT_VALMASK) == VT_LOCAL
+             || (p->r & VT_VALMASK) == VT_LLOCAL) && p->c.i < o->loc)
+            return;
+    if (loc < loc_low)
+        loc_low = loc;
+    loc = o->loc;
+    /* forget temporaries that were allocated in the scope */
+    for (i = n = 0; i < nb_temp_local_vars; i++)
+        if (arr_temp_local_vars[i].location >= loc)
+            arr_temp_local_vars[n++] = arr_temp_local_vars[i];
+    nb_temp_local_vars = n;
+}
+
 static void prev_scope(struct scope *o, int is_expr)
 {
     vla_leave(o->prev);
@@ -6897,6 +7666,8 @@ static void prev_scope(struct scope *o, int is_expr)
 
     /* pop locally defined symbols */
     pop_local_syms(o->lstk, is_expr);
+    if (!is_expr)
+        scope_free_locals(o);
     cur_scope = o->prev;
     --local_scope;
 }
@@ -6944,10 +7715,151 @@ static void lblock(int *bsym, int *csym)
     }
 }
 
+/* undo sym_pop(&local_stack, b, 1) for the symbols from 's' down */
+static void sym_unhide(Sym *s, Sym *b)
+{
+    TokenSym *ts;
+    int v;
+
+    if (s == b)
+        return;
+    sym_unhide(s->prev, b);
+    v = s->v;
+    if (!(v & SYM_FIELD) && (v & ~SYM_STRUCT) < SYM_FIRST_ANOM) {
+        ts = table_ident[(v & ~SYM_STRUCT) - TOK_IDENT];
+        if (v & SYM_STRUCT)
+            ts->sym_struct = s;
+        else
+            ts->sym_identifier = s;
+    }
+}
+
+/* can a statement of an 'if' in the context 'flags' be moved to the
+   end of the enclosing compound statement ? */
+static int cold_stmt_ok(int flags)
+{
+    if (!tcc_state->optimize
+        || (flags & (STMT_COMPOUND | STMT_EXPR)) != STMT_COMPOUND
+        || nocode_wanted || cur_inline || debug_modes
+        || cur_scope->cl.s || cur_scope->vla.loc)
+        return 0;
+#ifdef CONFIG_TCC_BCHECK
+    if (tcc_state->do_bounds_check)
+        return 0;
+#endif
+    return 1;
+}
+
+/* a statement that cold_stmt_save() can record: it must end at the
+   first ';' or '}' outside brackets, so no labeled statements */
+static int cold_stmt_tok(void)
+{
+    int t = tok, label;
+
+    if (t == '{' || t == TOK_RETURN || t == TOK_GOTO
+        || t == TOK_BREAK || t == TOK_CONTINUE)
+        return 1;
+    if (t < TOK_UIDENT)
+        return 0;
+    next();
+    label = tok == ':';
+    unget_tok(t);
+    return !label;
+}
+
+/* record the statement at 'tok' for gen_cold_stmts(), 'jmp' being the
+   jumps to it */
+static cold_stmt *cold_stmt_save(int jmp)
+{
+    cold_stmt *c = tcc_mallocz(sizeof *c), **pc;
+    int t, level = 0;
+
+    c->str = tok_str_alloc();
+    do {
+        t = tok;
+        if (t == TOK_EOF)
+            tcc_error("unexpected end of file");
+        tok_str_add_tok(c->str);
+        next();
+        if (t == '{' || t == '(' || t == '[')
+            level++;
+        else if (t == '}' || t == ')' || t == ']')
+            level--;
+    } while (level > 0 || (t != ';' && t != '}'));
+    tok_str_add(c->str, TOK_EOF);
+    c->owner = cur_scope;
+    c->scope = *cur_scope;
+    c->lstk = local_stack;
+    c->jmp = jmp;
+    for (pc = &cold_stmts; *pc; pc = &(*pc)->next)
+        ;
+    *pc = c;
+    return c;
+}
+
+/* compile the recorded statement 'c', removed from the list */
+static void gen_cold_stmt(cold_stmt *c)
+{
+    struct scope o = *cur_scope;
+    Sym *top = local_stack;
+
+    gsym(c->jmp);
+    *cur_scope = c->scope;
+    /* hide what was declared after the 'if' */
+    sym_pop(&local_stack, c->lstk, 1);
+    unget_tok(0);
+    begin_macro(c->str, 1);
+    next();
+    block(0);
+    end_macro();
+    next();
+    sym_unhide(top, c->lstk);
+    *cur_scope = o;
+}
+
+/* the expected path of the 'if' of 'c' does not continue: compile the
+   statement right here where it is out of the way already */
+static void gen_cold_stmt_now(cold_stmt *c)
+{
+    cold_stmt **pc;
+
+    for (pc = &cold_stmts; *pc != c; pc = &(*pc)->next)
+        ;
+    *pc = c->next;
+    gen_cold_stmt(c);
+    tcc_free(c);
+}
+
+/* compile the statements recorded for the compound statement that is
+   being closed, each jumping back to where its 'if' left off */
+static void gen_cold_stmts(void)
+{
+    cold_stmt *c, **pc;
+    int a;
+
+    for (c = cold_stmts; c && c->owner != cur_scope; c = c->next)
+        ;
+    if (!c)
+        return;
+    a = gjmp(0);
+    for (pc = &cold_stmts; (c = *pc);) {
+        if (c->owner != cur_scope) {
+            pc = &c->next;
+            continue;
+        }
+        *pc = c->next;
+        gen_cold_stmt(c);
+        gjmp_addr(c->back);
+        tcc_free(c);
+    }
+    gsym(a);
+}
+
 static void block(int flags)
 {
     int a, b, c, d, e, t;
     struct scope o;
+    cold_stmt *cs;
     Sym *s;
 
     if (flags & STMT_EXPR) {
@@ -6970,18 +7882,44 @@ again:
     if (t == TOK_IF) {
         new_scope_s(&o);
         skip('(');
+        c = tok == TOK_builtin_expect;
+        expect_hint = 0;
         gexpr();
         skip(')');
-        a = gvtst(1, 0);
-        block(0);
-        if (tok == TOK_ELSE) {
-            d = gjmp(0);
-            gsym(a);
-            next();
-            block(0);
-            gsym(d); /* patch else jmp */
+        /* with -O1, move the unexpected statement out of line */
+        if (c)
+            c = expect_hint;
+        if (c && ((vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST
+                  || !cold_stmt_ok(flags)))
+            c = 0;
+        if (c == 1 && cold_stmt_tok()) {
+            cs = cold_stmt_save(gvtst(0, 0));
+            if (tok == TOK_ELSE) {
+                next();
+                block(0);
+            }
+            goto cold_back;
         } else {
-            gsym(a);
+            a = gvtst(1, 0);
+            block(0);
+            if (tok == TOK_ELSE) {
+                next();
+                if (c == 2 && cold_stmt_tok()) {
+                    cs = cold_stmt_save(a);
+                cold_back:
+                    if (nocode_wanted)
+                        gen_cold_stmt_now(cs);
+                    else
+                        cs->back = gind();
+                } else {
+                    d = gjmp(0);
+                    gsym(a);
+                    block(0);
+                    gsym(d); /* patch else jmp */
+                }
+            } else {
+                gsym(a);
+            }
         }
         prev_scope_s(&o);
 
@@ -7024,6 +7962,7 @@ again:
                 block(flags | STMT_COMPOUND);
             }
         }
+        gen_cold_stmts();
 
         prev_scope(&o, flags & STMT_EXPR);
         if (debug_modes)
@@ -7036,6 +7975,10 @@ again:
     } else if (t == TOK_RETURN) {
         b = (func_vt.t & VT_BTYPE) != VT_VOID;
         if (tok != ';') {
+#ifdef TCC_TARGET_TAIL_CALL
+            ret_tail = tcc_state->optimize_sibling_calls
+                && !cur_inline && !nocode_wanted;
+#endif
             gexpr();
             if (b) {
                 gen_assign_cast(&func_vt);
@@ -7049,11 +7992,24 @@ again:
             b = 0;
         }
         leave_scope(root_scope);
-        if (b)
-            gfunc_return(&func_vt);
+        if (b) {
+            if (cur_inline) {
+                vset(&func_vt, VT_LOCAL | VT_LVAL, cur_inline->ret_loc);
+                vswap();
+                vstore();
+                vpop();
+            } else {
+                gfunc_return(&func_vt);
+            }
+        }
+#ifdef TCC_TARGET_TAIL_CALL
+        if (!cur_inline)
+            gfunc_tail_return();
+#endif
         skip(';');
         /* jump unless last stmt in top-level block */
-        if (tok != '}' || local_scope != 1)
+        if (tok != '}' || local_scope != (cur_inline ? cur_inline->ret_scope : 1)
+            || cold_stmts)
             rsym = gjmp(rsym);
         if (debug_modes)
 	    tcc_tcov_block_end (tcc_state, -1);
@@ -7316,8 +8272,15 @@ static void skip_or_save_block(TokenString **str)
 {
     int braces = tok == '{';
     int level = 0;
-    if (str)
+    TokenString *saving = tok_saving;
+    if (str) {
       *str = tok_str_alloc();
+      if (braces) {
+        /* parse it again with the '#pragma pack' in effect here */
+        tok_str_add_pp_state(*str);
+        tok_saving = *str;
+      }
+    }
 
     while (1) {
 	int t = tok;
@@ -7347,6 +8310,7 @@ static void skip_or_save_block(TokenString **str)
     }
     if (str)
 	tok_str_add(*str, TOK_EOF);
+    tok_saving = saving;
 }
 
 #define EXPR_CONST 1
@@ -7396,6 +8360,12 @@ static void init_putz(init_params *p, unsigned long c, int size)
     init_assert(p, c + size);
     if (p->sec) {
         /* nothing to do because globals are already set to zero */
+#ifdef TCC_TARGET_NATIVE_STRUCT_COPY
+    } else if (size <= SMALL_COPY_MAX) {
+        vseti(VT_LOCAL, c);
+        vpushi(0);
+        gen_memset(size);
+#endif
     } else {
         vpush_helper_func(TOK_memset);
         vseti(VT_LOCAL, c);
@@ -8008,8 +8978,8 @@ static void decl_initializer(init_params *p, CType *type, unsigned long c, int f
 static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r, 
                                    int has_init, int v, int global)
 {
-    int size, align, addr;
-    TokenString *init_str = NULL;
+    int size, align, addr, defer;
+    TokenString *init_str = NULL, *str;
 
     Section *sec;
     Sym *flexible_array;
@@ -8024,6 +8994,12 @@ static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r,
     if (v && (r & VT_VALMASK) == VT_CONST)
         nocode_wanted |= DATA_ONLY_WANTED;
 
+    /* with -O1, initialized static data is recorded like static
+       functions and emitted only if referenced */
+    defer = v && global && has_init == 1 && tcc_state->optimize
+        && (type->t & VT_STATIC) && !ad->section && !ad->asm_label
+        && !sym_find(v);
+
     flexible_array = NULL;
     size = type_size(type, &align);
 
@@ -8073,7 +9049,7 @@ static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r,
         unget_tok(0);
 
         /* compute size */
-        begin_macro(init_str, 1);
+        begin_macro(init_str, defer ? 2 : 1);
         next();
         decl_initializer(&p, type, 0, DIF_FIRST | DIF_SIZE_ONLY);
         /* prepare second initializer parsing */
@@ -8101,6 +9077,23 @@ static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r,
         align = 1;
     }
 
+    if (defer) {
+        /* declared until gen_recorded() defines it */
+        sym = sym_push(v, type, r | VT_SYM, 0);
+        sym->type.t |= VT_EXTERN;
+        patch_storage(sym, ad, NULL);
+        if (init_str) {
+            /* the tokens of the dry run, kept by end_macro() */
+            str = tok_str_alloc();
+            str->str = init_str->str;
+            str->len = init_str->len;
+        } else {
+            skip_or_save_block(&str);
+        }
+        inline_record(sym, ad->f.func_used)->func_str = str;
+        goto no_alloc;
+    }
+
     if (!v && NODATA_WANTED)
         size = 0, align = 1;
 
@@ -8172,7 +9165,14 @@ static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r,
             CType *tp = type;
             while ((tp->t & (VT_BTYPE|VT_ARRAY)) == (VT_PTR|VT_ARRAY))
                 tp = &tp->ref->type;
-            if (tp->t & VT_CONSTANT) {
+            if (ad->a.tls || (sym && sym->a.tls)) {
+                /* thread-local variables are never common */
+                sec = tls_section(tcc_state, has_init);
+#ifdef CONFIG_TCC_BCHECK
+                /* and have no fixed address to check */
+                bcheck = 0;
+#endif
+            } else if (tp->t & VT_CONSTANT) {
 		sec = rodata_section;
             } else if (has_init) {
 		sec = data_section;
@@ -8180,6 +9180,8 @@ static void decl_initializer_alloc(CType *type, AttributeDef *ad, int r,
                     tcc_warning("rw data: %s", get_tok_str(v, 0));*/
             } else if (tcc_state->nocommon)
                 sec = bss_section;
+            if (sec && v && tcc_state->data_sections)
+                sec = find_sub_section(tcc_state, sec, get_tok_str(v, NULL));
         }
 
         if (sec) {
@@ -8308,14 +9310,115 @@ static void func_vla_arg(Sym *sym)
             func_vla_arg_code(arg->type.ref);
 }
 
+#ifdef TCC_TARGET_IR
+/* -O1: record the function in tccir.c first */
+static int ir_wanted(void)
+{
+    return tcc_state->optimize
+        && !debug_modes
+        && !func_var
+        && !tcc_state->nosse
+        && !tcc_state->do_backtrace
+#ifdef CONFIG_TCC_BCHECK
+        && !tcc_state->do_bounds_check
+#endif
+        ;
+}
+
+/* what the IR cannot describe, or what must be compiled only once */
+static int ir_check(TokenString *saved)
+{
+    TokenString *str = tok_str_alloc();
+    int ret = 1, prev = 0;
+
+    str->str = saved->str;
+    unget_tok(0);
+    begin_macro(str, 2);
+    for (next(); tok != TOK_EOF; prev = tok, next()) {
+        if (prev == TOK_GOTO && tok == '*')
+            ret = 0; /* labels as values */
+        switch (tok) {
+        case TOK_STATIC:
+        case TOK_ASM1:
+        case TOK_ASM2:
+        case TOK_ASM3:
+        case TOK_alloca:
+        case TOK_builtin_frame_address:
+        case TOK_builtin_return_address:
+            ret = 0;
+            break;
+        }
+    }
+    end_macro();
+    next();
+    return ret;
+}
+#endif
+
+/* parse the body of function 'sym', from 'str' if not NULL */
+static void gen_function_body(Sym *sym, struct scope *f, TokenString *saved)
+{
+    TokenString *str = NULL;
+
+    if (saved) {
+        str = tok_str_alloc();
+        str->str = saved->str;
+        unget_tok(0);
+        begin_macro(str, 2);
+        next();
+    }
+    memset(f, 0, sizeof *f);
+    cur_scope = root_scope = f;
+    cur_inline = NULL;
+    nocode_wanted = 0;
+
+    /* push a dummy symbol to enable local sym storage */
+    sym_push2(&local_stack, SYM_FIELD, 0, 0);
+    local_scope = 1; /* for function parameters */
+    gfunc_prolog(sym);
+    tcc_debug_prolog_epilog(tcc_state, 0);
+
+    local_scope = 0;
+    rsym = 0;
+    loc_low = 0;
+    clear_temp_local_var_list();
+    func_vla_arg(sym);
+    block(0);
+    gsym(rsym);
+
+    nocode_wanted = 0;
+    /* the frame must hold the biggest of the scopes */
+    if (loc_low < loc)
+        loc = loc_low;
+    /* reset local stack */
+    pop_local_syms(NULL, 0);
+    tcc_debug_prolog_epilog(tcc_state, 1);
+    gfunc_epilog();
+    if (str) {
+        next(); /* past what gen_cold_stmts() may have put back */
+        end_macro();
+    }
+}
+
 /* parse a function defined by symbol 'sym' and generate its code in
    'cur_text_section' */
 static void gen_function(Sym *sym)
 {
-    struct scope f = { 0 };
-    cur_scope = root_scope = &f;
+    struct scope f;
+    TokenString *str = NULL;
+#ifdef TCC_TARGET_IR
+    Section *sr;
+    addr_t roff;
+    int warn_none;
+#endif
+
     nocode_wanted = 0;
 
+    /* no line numbers outside of text_section, so not with -g */
+    if (cur_text_section == text_section
+        && tcc_state->function_sections && !tcc_state->do_debug)
+        cur_text_section = find_sub_section(tcc_state, text_section,
+                                            get_tok_str(sym->v, NULL));
     ind = cur_text_section->data_offset;
     if (sym->a.aligned) {
 	size_t newoff = section_add(cur_text_section, 0,
@@ -8339,24 +9442,42 @@ static void gen_function(Sym *sym)
     /* put debug symbol */
     tcc_debug_funcstart(tcc_state, sym);
 
-    /* push a dummy symbol to enable local sym storage */
-    sym_push2(&local_stack, SYM_FIELD, 0, 0);
-    local_scope = 1; /* for function parameters */
-    gfunc_prolog(sym);
-    tcc_debug_prolog_epilog(tcc_state, 0);
-
-    local_scope = 0;
-    rsym = 0;
-    clear_temp_local_var_list();
-    func_vla_arg(sym);
-    block(0);
-    gsym(rsym);
-
-    nocode_wanted = 0;
-    /* reset local stack */
-    pop_local_syms(NULL, 0);
-    tcc_debug_prolog_epilog(tcc_state, 1);
-    gfunc_epilog();
+#ifdef TCC_TARGET_IR
+    if (ir_wanted()) {
+        skip_or_save_block(&str);
+        if (!ir_check(str))
+            goto direct;
+        sr = cur_text_section->reloc;
+        roff = sr ? sr->data_offset : 0;
+        ir_begin();
+        gen_function_body(sym, &f, str);
+        if (!ir_failed)
+            goto done;
+        /* compile it again, without the warnings of the first pass */
+        next();
+        ind = func_ind;
+        /* relocations made by the usual code after ir_failed */
+        sr = cur_text_section->reloc;
+        if (sr)
+            sr->data_offset = roff;
+        label_pop(&global_label_stack, NULL, 0);
+        sym_pop(&all_cleanups, NULL, 0);
+        warn_none = tcc_state->warn_none;
+        tcc_state->warn_none = 1;
+        gen_function_body(sym, &f, str);
+        tcc_state->warn_none = warn_none;
+        goto done;
+    }
+ direct:
+#endif
+    gen_function_body(sym, &f, str);
+#ifdef TCC_TARGET_IR
+ done:
+    if (str)
+        tok_str_free(str);
+#endif
+    /* the backend may have moved the entry past unused prolog space */
+    elfsym(sym)->st_value = func_ind;
 
     /* end of function */
     tcc_debug_funcend(tcc_state, ind - func_ind);
@@ -8383,6 +9504,272 @@ static void gen_function(Sym *sym)
     next();
 }
 
+/* -finline-functions: can we currently expand calls at all */
+static int inline_wanted(void)
+{
+    return tcc_state->inline_functions
+        && !debug_modes
+#ifdef CONFIG_TCC_BCHECK
+        && !tcc_state->do_bounds_check
+#endif
+        ;
+}
+
+/* check once whether the body of 'fn' can be compiled at a call site */
+static int inline_check(InlineFunc *fn)
+{
+    Sym *s = fn->sym->type.ref, *sa;
+    TokenString *str;
+    int ret = 1, after_return = 0;
+
+    if (fn->func_str->len > INLINE_MAX_SIZE
+        || s->f.func_type != FUNC_NEW
+        || s->f.func_noreturn)
+        return -1;
+    for (sa = s->next; sa; sa = sa->next)
+        if ((sa->type.t & VT_BTYPE) == VT_PTR
+            && (sa->type.ref->type.t & VT_VLA))
+            return -1;
+
+    /* things that depend on having a frame or a name of their own */
+    str = tok_str_alloc();
+    str->str = fn->func_str->str;
+    unget_tok(0);
+    begin_macro(str, 2);
+    for (next(); tok != TOK_EOF; next()) {
+        switch (tok) {
+        case TOK_GOTO:
+        case TOK_STATIC:
+        case TOK_ASM1:
+        case TOK_ASM2:
+        case TOK_ASM3:
+        case TOK___FUNCTION__:
+        case TOK___FUNC__:
+#if defined TCC_TARGET_I386 || defined TCC_TARGET_X86_64
+        case TOK_alloca:
+#endif
+        case TOK_builtin_frame_address:
+        case TOK_builtin_return_address:
+            ret = -1;
+            break;
+#ifdef TCC_TARGET_TAIL_CALL
+        case '(':
+            /* 'return f(...)' would lose its sibling call once expanded */
+            if (after_return == 2 && tcc_state->optimize_sibling_calls)
+                ret = -1;
+            break;
+#endif
+        }
+        after_return = tok == TOK_RETURN ? 1
+            : after_return == 1 && tok >= TOK_UIDENT ? 2 : 0;
+    }
+    end_macro();
+    next();
+    return ret;
+}
+
+/* record the tokens of a function or static variable, to be parsed
+   when it is referenced */
+static InlineFunc *inline_record(Sym *sym, int keep)
+{
+    InlineFunc *fn;
+
+    fn = tcc_malloc(sizeof *fn + strlen(file->filename));
+    strcpy(fn->filename, file->filename);
+    fn->sym = sym;
+    fn->expand = fn->expanding = 0;
+    fn->keep = keep;
+    dynarray_add(&tcc_state->inline_fns, &tcc_state->nb_inline_fns, fn);
+    return fn;
+}
+
+/* return the recorded body if the function on vtop is to be expanded */
+static InlineFunc *inline_find(void)
+{
+    InlineFunc *fn;
+    Sym *sym;
+    int i, depth;
+
+    if (nocode_wanted || !inline_wanted()
+        || (vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) != (VT_CONST | VT_SYM)
+        || vtop->c.i)
+        return NULL;
+    sym = vtop->sym;
+    if (!(sym->type.t & VT_STATIC) || (sym->type.t & VT_BTYPE) != VT_FUNC)
+        return NULL;
+    for (i = depth = 0; i < tcc_state->nb_inline_fns; ++i)
+        depth += tcc_state->inline_fns[i]->expanding;
+    if (depth >= INLINE_MAX_DEPTH)
+        return NULL;
+    for (i = 0; i < tcc_state->nb_inline_fns; ++i) {
+        fn = tcc_state->inline_fns[i];
+        if (fn->sym != sym)
+            continue;
+        if (fn->expanding)
+            return NULL;
+        if (fn->expand == 0)
+            fn->expand = inline_check(fn);
+        return fn->expand > 0 ? fn : NULL;
+    }
+    return NULL;
+}
+
+/* hide the caller's local names while an inlined body is parsed */
+static Sym **inline_hide_locals(int *pn)
+{
+    Sym *s, **ps, **tab = NULL;
+    TokenSym *ts;
+    int v;
+
+    *pn = 0;
+    for (s = local_stack; s; s = s->prev) {
+        v = s->v;
+        if ((v & SYM_FIELD) || (v & ~SYM_STRUCT) >= SYM_FIRST_ANOM)
+            continue;
+        ts = table_ident[(v & ~SYM_STRUCT) - TOK_IDENT];
+        ps = v & SYM_STRUCT ? &ts->sym_struct : &ts->sym_identifier;
+        if (*ps == s) {
+            *ps = s->prev_tok;
+            dynarray_add(&tab, pn, s);
+        }
+    }
+    return tab;
+}
+
+static void inline_unhide_locals(Sym **tab, int n)
+{
+    Sym *s;
+    TokenSym *ts;
+
+    while (n--) {
+        s = tab[n];
+        ts = table_ident[(s->v & ~SYM_STRUCT) - TOK_IDENT];
+        if (s->v & SYM_STRUCT)
+            ts->sym_struct = s;
+        else
+            ts->sym_identifier = s;
+    }
+    tcc_free(tab);
+}
+
+/* expand a call to 'fn' in place: the '(' is consumed, the arguments
+   are stored to fresh locals which the parameters name, and the body
+   is compiled with 'return' storing to a result local */
+static void inline_call(InlineFunc *fn)
+{
+    Sym *sym = fn->sym, *sa, **hidden, *gls;
+    struct scope o, *ro, *lo;
+    struct switch_t *sw;
+    struct inline_call ic, *ci;
+    TokenString *str;
+    CType vt, type;
+    int *args = NULL, nb_args = 0, nb_hidden, rs, size, align, i;
+
+    vpop();
+    for (sa = sym->type.ref->next; tok != ')'; sa = sa->next) {
+        if (nb_args)
+            skip(',');
+        expr_eq();
+        gfunc_param_typed(sym->type.ref, sa);
+        type = sa->type;
+        type.t &= ~VT_CONSTANT;
+        size = type_size(&type, &align);
+        loc = (loc - size) & -align;
+        vset(&type, VT_LOCAL | VT_LVAL, loc);
+        vswap();
+        vstore();
+        vpop();
+        args = tcc_realloc(args, (nb_args + 1) * sizeof *args);
+        args[nb_args++] = loc;
+    }
+    if (sa)
+        tcc_error("too few arguments to function");
+    skip(')');
+    save_regs(0);
+
+    vt = sym->type.ref->type;
+    vt.t &= ~VT_CONSTANT;
+    ic.ret_loc = 0;
+    if ((vt.t & VT_BTYPE) != VT_VOID) {
+        size = type_size(&vt, &align);
+        loc = (loc - size) & -align;
+        ic.ret_loc = loc;
+    }
+
+    /* switch to the callee's view */
+    hidden = inline_hide_locals(&nb_hidden);
+    new_scope(&o);
+    o.bsym = o.csym = NULL;
+    ro = root_scope, root_scope = &o;
+    lo = loop_scope, loop_scope = NULL;
+    sw = cur_switch, cur_switch = NULL;
+    gls = global_label_stack, global_label_stack = NULL;
+    rs = rsym, rsym = 0;
+    type = func_vt, func_vt = vt;
+    ci = cur_inline, cur_inline = &ic;
+    ic.ret_scope = local_scope + 1;
+    fn->expanding = 1;
+
+    for (i = 0, sa = sym->type.ref->next; sa; sa = sa->next, ++i)
+        sym_push(sa->v & ~SYM_FIELD, &sa->type, VT_LOCAL | VT_LVAL, args[i]);
+    tcc_free(args);
+
+    str = tok_str_alloc();
+    str->str = fn->func_str->str;
+    unget_tok(0);
+    begin_macro(str, 2);
+    next();
+    block(0);
+    end_macro();
+    gsym(rsym);
+    nocode_wanted = 0;
+
+    fn->expanding = 0;
+    cur_inline = ci;
+    func_vt = type;
+    rsym = rs;
+    label_pop(&global_label_stack, NULL, 0);
+    global_label_stack = gls;
+    cur_switch = sw;
+    loop_scope = lo;
+    root_scope = ro;
+    prev_scope(&o, 0);
+    inline_unhide_locals(hidden, nb_hidden);
+    next();
+
+    /* the value of the call */
+    if (ic.ret_loc) {
+        vset(&vt, VT_LOCAL | VT_LVAL, ic.ret_loc);
+        if ((vt.t & VT_BTYPE) != VT_STRUCT)
+            gv(RC_TYPE(vt.t));
+    } else {
+        vpushi(0);
+        vtop->type.t = VT_VOID;
+    }
+}
+
+/* parse a recorded function or static variable from its tokens */
+static void gen_recorded(InlineFunc *fn)
+{
+    Sym *sym = fn->sym;
+    AttributeDef ad;
+    CType type;
+
+    fn->sym = NULL;
+    begin_macro(fn->func_str, 1);
+    next();
+    if ((sym->type.t & VT_BTYPE) == VT_FUNC) {
+        cur_text_section = text_section;
+        gen_function(sym);
+    } else {
+        memset(&ad, 0, sizeof ad);
+        ad.a = sym->a;
+        type = sym->type;
+        decl_initializer_alloc(&type, &ad, sym->r & ~VT_SYM, 1, sym->v, 1);
+    }
+    end_macro();
+}
+
 static void gen_inline_functions(TCCState *s)
 {
     Sym *sym;
@@ -8396,17 +9783,13 @@ static void gen_inline_functions(TCCState *s)
         for (i = 0; i < s->nb_inline_fns; ++i) {
             fn = s->inline_fns[i];
             sym = fn->sym;
-            if (sym && (sym->c || !(sym->type.t & VT_INLINE))) {
-                /* the function was used or forced (and then not internal):
-                   generate its code and convert it to a normal function */
-                fn->sym = NULL;
+            if (sym && (sym->c || fn->keep || (!(sym->type.t & VT_INLINE)
+                    && !((sym->type.t & VT_STATIC) && s->optimize)))) {
+                /* the function was used or forced (and then not internal,
+                   or static without -O1): generate its code and convert
+                   it to a normal function */
                 tcc_debug_putfile(s, fn->filename);
-                begin_macro(fn->func_str, 1);
-                next();
-                cur_text_section = text_section;
-                gen_function(sym);
-                end_macro();
-
+                gen_recorded(fn);
                 inline_generated = 1;
             }
         }
@@ -8414,6 +9797,26 @@ static void gen_inline_functions(TCCState *s)
     tcc_close();
 }
 
+/* generate a recorded function or variable now, when it is needed
+   before the end of the compilation unit */
+static void gen_deferred(Sym *sym)
+{
+    int i, line_num;
+    struct InlineFunc *fn;
+
+    for (i = 0; i < tcc_state->nb_inline_fns; ++i) {
+        fn = tcc_state->inline_fns[i];
+        if (fn->sym == sym) {
+            line_num = file->line_num;
+            unget_tok(0);
+            gen_recorded(fn);
+            file->line_num = line_num;
+            next();
+            break;
+        }
+    }
+}
+
 static void free_inline_functions(TCCState *s)
 {
     int i;
@@ -8594,18 +9997,22 @@ static int decl(int l)
                 /* put function symbol */
                 type.t &= ~VT_EXTERN;
                 sym = external_sym(v, &type, 0, &ad);
+                sym->a.hasbody = 1;
 
                 /* static inline functions are just recorded as a kind
                    of macro. Their code will be emitted at the end of
-                   the compilation unit only if they are used */
-                if (sym->type.t & VT_INLINE) {
-                    struct InlineFunc *fn;
-                    fn = tcc_malloc(sizeof *fn + strlen(file->filename));
-                    strcpy(fn->filename, file->filename);
-                    fn->sym = sym;
-                    dynarray_add(&tcc_state->inline_fns,
-				 &tcc_state->nb_inline_fns, fn);
-                    skip_or_save_block(&fn->func_str);
+                   the compilation unit only if they are used.
+                   With -O1, other static functions are recorded the
+                   same way and dropped as well unless they are
+                   constructors or marked 'used'.  With
+                   -finline-functions, they are recorded so that calls
+                   may be expanded. */
+                if ((sym->type.t & VT_INLINE)
+                    || ((sym->type.t & VT_STATIC) && !ad.section
+                        && (tcc_state->optimize || inline_wanted()))) {
+                    struct FuncAttr *f = &sym->type.ref->f;
+                    skip_or_save_block(&inline_record(sym,
+                        f->func_ctor || f->func_dtor || f->func_used)->func_str);
                 } else {
                     /* compute text section */
                     cur_text_section = ad.section;
@@ -8654,6 +10061,10 @@ static int decl(int l)
 		    tcc_error("declaration of void object");
                 } else {
                     r = 0;
+                    if (ad.a.tls && ((type.t & VT_BTYPE) == VT_FUNC
+                        || (l != VT_CONST && !(type.t & (VT_STATIC|VT_EXTERN)))))
+                        tcc_error("'%s' cannot be thread-local",
+                                  get_tok_str(v, NULL));
                     if ((type.t & VT_BTYPE) == VT_FUNC) {
                         /* external function definition */
                         /* specific case for func_call attribute */
@@ -8697,6 +10108,10 @@ static int decl(int l)
                            the aliases until the end of the compile unit.  */
                         Sym *alias_target = sym_find(ad.alias_target);
                         ElfSym *esym = elfsym(alias_target);
+                        if (!esym && alias_target) {
+                            gen_deferred(alias_target);
+                            esym = elfsym(alias_target);
+                        }
                         if (!esym)
                             tcc_error("unsupported forward __alias__ attribute");
                         put_extern_sym2(sym_find(v), esym->st_shndx,
@@ -0,0 +1,1458 @@
+/*
+ *  TCC - Tiny C Compiler
+ *
+ *  Intermediate representation for -O1
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* With -O1, the backend does not output machine code while tccgen
+   parses a function body.  Its load(), store(), gen_opi() ... append
+   IRInsn's instead, on registers that are the ones chosen by tccgen
+   at first.  gfunc_epilog() then calls ir_optimize() which
+
+   - keeps local variables in registers when their address is
+     not taken (ir_promote),
+   - renames the registers so that each value has its own (ir_webs),
+   - numbers the values in each block to drop computations done
+     already, fold constants and forward stored values (ir_lvn),
+   - propagates copies (ir_copies),
+   - deletes unused results and stores (ir_dce, ir_dse),
+   - and assigns machine registers with a linear scan (ir_alloc).
+
+   The backend then lowers the list to machine code.  Anything it
+   cannot record sets 'ir_failed' and the function is compiled again
+   the usual way, by tccgen from the same tokens. */
+
+#define USING_GLOBALS
+#include "tcc.h"
+#ifdef TCC_TARGET_IR
+
+ST_DATA int ir_active, ir_failed;
+ST_DATA IRInsn *ir_code;
+ST_DATA int ir_n, ir_nv, *ir_pool, *ir_loc, ir_frame;
+
+static int ir_size, ir_npool, ir_pool_size;
+static unsigned char *ir_cls; /* 1 for float registers */
+static int ir_cls_size;
+static int *ir_esc, ir_nesc, ir_all_esc; /* escaped frame ranges */
+
+/* basic blocks */
+static int ir_nb, *ir_bstart, *ir_bof, *ir_succ;
+/* registers live at the start and at the end of each block */
+static int ir_nw;
+static unsigned *ir_lin, *ir_lout;
+
+static int **ir_ubuf, **ir_dbuf, ir_buf_size;
+
+#define BSET(s, v) ((s)[(v) >> 5] |= 1u << ((v) & 31))
+#define BCLR(s, v) ((s)[(v) >> 5] &= ~(1u << ((v) & 31)))
+#define BTST(s, v) ((s)[(v) >> 5] >> ((v) & 31) & 1)
+
+/* ------------------------------------------------------------------------- */
+/* recording, called by the backend */
+
+ST_FUNC void ir_begin(void)
+{
+    int r;
+    ir_n = ir_npool = ir_nesc = ir_all_esc = 0;
+    ir_nv = IR_VREG0;
+    ir_cls_size = 256;
+    ir_cls = tcc_mallocz(ir_cls_size);
+    for (r = 0; r < NB_REGS; ++r)
+        ir_cls[r] = IR_REG_FLOAT(r);
+    ir_failed = 0;
+    ir_active = 1;
+    ind = 0;
+}
+
+ST_FUNC void ir_end(void)
+{
+    ir_active = 0;
+    tcc_free(ir_code), ir_code = NULL, ir_size = 0;
+    tcc_free(ir_pool), ir_pool = NULL, ir_pool_size = 0;
+    tcc_free(ir_cls), ir_cls = NULL;
+    tcc_free(ir_esc), ir_esc = NULL;
+    tcc_free(ir_loc), ir_loc = NULL;
+    tcc_free(ir_bstart), ir_bstart = NULL;
+    tcc_free(ir_bof), ir_bof = NULL;
+    tcc_free(ir_succ), ir_succ = NULL;
+    tcc_free(ir_lin), ir_lin = NULL;
+    tcc_free(ir_lout), ir_lout = NULL;
+    tcc_free(ir_ubuf), ir_ubuf = NULL;
+    tcc_free(ir_dbuf), ir_dbuf = NULL, ir_buf_size = 0;
+}
+
+/* append an instruction, or return a dummy one if no code is wanted */
+ST_FUNC IRInsn *ir_emit(int op, int t, int d, int a, int b)
+{
+    static IRInsn dummy;
+    IRInsn *i = &dummy;
+
+    if (!nocode_wanted) {
+        if (ir_n == ir_size) {
+            ir_size = ir_size ? ir_size * 2 : 256;
+            ir_code = tcc_realloc(ir_code, ir_size * sizeof *ir_code);
+        }
+        i = &ir_code[ir_n++];
+        ind = ir_n;
+    }
+    memset(i, 0, sizeof *i);
+    i->op = op, i->t = t, i->d = d, i->a = a, i->b = b;
+    return i;
+}
+
+/* a new register, for floats if 'fl' */
+ST_FUNC int ir_vreg(int fl)
+{
+    if (ir_nv == ir_cls_size) {
+        ir_cls = tcc_realloc(ir_cls, ir_cls_size * 2);
+        ir_cls_size *= 2;
+    }
+    ir_cls[ir_nv] = fl;
+    return ir_nv++;
+}
+
+/* add register 'r' passed in 'where' to the arguments of an IR_CALL
+   or the parameters of IR_ENTRY, returns its index */
+ST_FUNC int ir_pool_add(int r, int where)
+{
+    if (ir_npool == ir_pool_size) {
+        ir_pool_size = ir_pool_size ? ir_pool_size * 2 : 64;
+        ir_pool = tcc_realloc(ir_pool, ir_pool_size * 2 * sizeof (int));
+    }
+    ir_pool[2 * ir_npool] = r;
+    ir_pool[2 * ir_npool + 1] = where;
+    return ir_npool++;
+}
+
+static void ir_esc_add(int lo, int hi)
+{
+    if ((ir_nesc & 15) == 0)
+        ir_esc = tcc_realloc(ir_esc, (ir_nesc + 16) * 2 * sizeof (int));
+    ir_esc[2 * ir_nesc] = lo;
+    ir_esc[2 * ir_nesc + 1] = hi;
+    ir_nesc++;
+}
+
+/* the address of the local at 'c' is taken: the variable that holds
+   it must stay in memory.  For anonymous objects, everything up to the
+   next variable does. */
+ST_FUNC void ir_escape(int c)
+{
+    Sym *s;
+    int align, size, found = 0, next = 0;
+
+    if (nocode_wanted)
+        return;
+    for (s = local_stack; s; s = s->prev) {
+        if ((s->r & VT_VALMASK) != VT_LOCAL
+            || (s->v & (SYM_STRUCT | SYM_FIELD))
+            || (s->type.t & VT_TYPEDEF))
+            continue;
+        size = type_size(&s->type, &align);
+        if (size < 1)
+            size = 1;
+        if (s->c <= c && c < s->c + size) {
+            ir_esc_add(s->c, s->c + size);
+            found = 1;
+        } else if (s->c > c && (!next || s->c < next)) {
+            next = s->c;
+        }
+    }
+    if (!found) {
+        if (c >= 0 || next > 0)
+            ir_all_esc = 1;
+        else
+            ir_esc_add(c, next);
+    }
+}
+
+/* jumps: 'ind' is the index of the next instruction.  While a jump is
+   pending, its 'c' links to the previous one to the same label */
+ST_FUNC int ir_jmp(IRInsn *i, int t)
+{
+    if (nocode_wanted)
+        return t;
+    i->c = t;
+    return i - ir_code;
+}
+
+static IRInsn *ir_pending(int t)
+{
+    IRInsn *i;
+    if (t <= 0 || t >= ir_n)
+        return NULL;
+    i = &ir_code[t];
+    if ((i->op != IR_JMP && i->op != IR_JCC) || (i->f & IRF_DONE))
+        return NULL;
+    return i;
+}
+
+ST_FUNC void ir_gsym_addr(int t, int a)
+{
+    IRInsn *i;
+    while (t) {
+        i = ir_pending(t);
+        if (!i || a < 0) {
+            ir_failed = 1;
+            break;
+        }
+        t = i->c;
+        i->c = a;
+        i->f |= IRF_DONE;
+    }
+}
+
+ST_FUNC int ir_gjmp_append(int n, int t)
+{
+    IRInsn *i;
+    int n1 = n;
+    if (n) {
+        while ((i = ir_pending(n1)) && i->c)
+            n1 = i->c;
+        if (!i) {
+            ir_failed = 1;
+            return t;
+        }
+        i->c = t;
+        t = n;
+    }
+    return t;
+}
+
+/* ------------------------------------------------------------------------- */
+/* helpers */
+
+static int ir_tsize(int t)
+{
+    static const unsigned char s[] = { 4, 8, 4, 8, 1, 1, 2, 2 };
+    return s[t];
+}
+
+static int ir_escaped(int lo, int hi)
+{
+    int k;
+    if (ir_all_esc)
+        return 1;
+    for (k = 0; k < ir_nesc; ++k)
+        if (ir_esc[2 * k] < hi && lo < ir_esc[2 * k + 1])
+            return 1;
+    return 0;
+}
+
+/* a frame access that nothing but the same kind of access may touch */
+static int ir_private(IRInsn *i)
+{
+    return i->am == IRA_FRAME
+        && !ir_escaped(i->c, i->c + ir_tsize(i->t));
+}
+
+static void ir_grow_bufs(int n)
+{
+    if (n > ir_buf_size) {
+        ir_buf_size = n + 16;
+        ir_ubuf = tcc_realloc(ir_ubuf, ir_buf_size * sizeof (int *));
+        ir_dbuf = tcc_realloc(ir_dbuf, ir_buf_size * sizeof (int *));
+    }
+}
+
+/* ir_ubuf[] = the registers used by 'i', returns their number */
+static int ir_uses(IRInsn *i)
+{
+    int n = 0, k;
+    ir_grow_bufs(2 + (i->op == IR_CALL ? i->cc : 0));
+    if (i->a >= 0)
+        ir_ubuf[n++] = &i->a;
+    if (i->b >= 0)
+        ir_ubuf[n++] = &i->b;
+    if (i->op == IR_CALL)
+        for (k = 0; k < i->cc; ++k)
+            ir_ubuf[n++] = &ir_pool[2 * (i->p + k)];
+    return n;
+}
+
+/* ir_dbuf[] = the registers defined by 'i' */
+static int ir_defs(IRInsn *i)
+{
+    int n = 0, k;
+    ir_grow_bufs(1 + (i->op == IR_ENTRY ? i->cc : 0));
+    if (i->d >= 0)
+        ir_dbuf[n++] = &i->d;
+    if (i->op == IR_ENTRY)
+        for (k = 0; k < i->cc; ++k)
+            if (ir_pool[2 * (i->p + k)] >= 0)
+                ir_dbuf[n++] = &ir_pool[2 * (i->p + k)];
+    return n;
+}
+
+static void ir_nop(IRInsn *i)
+{
+    memset(i, 0, sizeof *i);
+    i->d = i->a = i->b = -1;
+}
+
+/* instructions without other effect than setting 'd' */
+static int ir_pure(IRInsn *i)
+{
+    switch (i->op) {
+    case IR_LOAD:
+        return !(i->f & IRF_VOL);
+    case IR_MOV: case IR_LI: case IR_LEA: case IR_GOT:
+    case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_XOR:
+    case IR_MUL: case IR_SHL: case IR_SHR: case IR_SAR:
+    case IR_DIV: case IR_UDIV: case IR_MOD: case IR_UMOD:
+    case IR_UMULH: case IR_SMULH: case IR_SETCC: case IR_EXT:
+    case IR_FADD: case IR_FSUB: case IR_FMUL: case IR_FDIV: case IR_FXOR:
+    case IR_ITOF: case IR_FTOI: case IR_FTOF:
+        return 1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* local variables whose address is not taken become registers */
+
+typedef struct IRSlot {
+    int off, size, fl, bad, r;
+} IRSlot;
+
+static int ir_slot_cmp(const void *pa, const void *pb)
+{
+    const IRSlot *a = pa, *b = pb;
+    if (a->off != b->off)
+        return a->off < b->off ? -1 : 1;
+    return a->size - b->size;
+}
+
+static void ir_promote(void)
+{
+    IRSlot *s, key, *p;
+    IRInsn *i;
+    int n = 0, k, j, end;
+
+    s = tcc_malloc((ir_n + 1) * sizeof *s);
+    for (i = ir_code; i < ir_code + ir_n; ++i) {
+        if ((i->op == IR_LOAD || i->op == IR_STORE) && i->am == IRA_FRAME) {
+            s[n].off = i->c;
+            s[n].size = ir_tsize(i->t);
+            s[n].fl = IRT_FLOAT(i->t);
+            s[n].bad = (i->f & IRF_VOL) != 0;
+            n++;
+        }
+    }
+    qsort(s, n, sizeof *s, ir_slot_cmp);
+    /* one slot per offset and size, accessed always as int or float */
+    for (k = j = 0; k < n; ++k) {
+        if (j && s[j - 1].off == s[k].off && s[j - 1].size == s[k].size)
+            s[j - 1].bad |= s[k].bad | (s[j - 1].fl != s[k].fl);
+        else
+            s[j++] = s[k];
+    }
+    n = j;
+    for (k = 0; k < n; ++k) {
+        end = s[k].off + s[k].size;
+        for (j = k + 1; j < n && s[j].off < end; ++j)
+            s[k].bad = s[j].bad = 1;
+        if (s[k].off >= 0 || ir_escaped(s[k].off, end))
+            s[k].bad = 1;
+    }
+    for (k = 0; k < n; ++k)
+        if (!s[k].bad)
+            s[k].r = ir_vreg(s[k].fl);
+
+    for (i = ir_code; i < ir_code + ir_n; ++i) {
+        if ((i->op != IR_LOAD && i->op != IR_STORE) || i->am != IRA_FRAME)
+            continue;
+        key.off = i->c;
+        key.size = ir_tsize(i->t);
+        p = bsearch(&key, s, n, sizeof *s, ir_slot_cmp);
+        if (!p || p->bad)
+            continue;
+        if (i->op == IR_STORE) {
+            /* the register keeps all of the value, loads cut it */
+            i->op = IR_MOV;
+            if (!p->fl)
+                i->t = IRT_I64;
+            i->d = p->r;
+            i->a = i->b;
+            i->b = -1;
+        } else if (i->t >= IRT_S8) {
+            i->op = IR_EXT;
+            i->cc = i->t;
+            i->t = IRT_I32;
+            i->a = p->r;
+        } else {
+            i->op = IR_MOV;
+            i->a = p->r;
+        }
+        i->am = 0;
+        i->c = 0;
+    }
+    tcc_free(s);
+}
+
+/* ------------------------------------------------------------------------- */
+/* control flow */
+
+static int ir_cfg(void)
+{
+    unsigned char *lead;
+    IRInsn *i;
+    int k, b, t;
+
+    lead = tcc_mallocz(ir_n + 1);
+    lead[0] = 1;
+    for (k = 0; k < ir_n; ++k) {
+        i = &ir_code[k];
+        if (i->op == IR_JMP || i->op == IR_JCC) {
+            if (!(i->f & IRF_DONE) || i->c <= 0 || i->c >= ir_n) {
+                tcc_free(lead);
+                return -1;
+            }
+            lead[i->c] = 1;
+            lead[k + 1] = 1;
+        } else if (i->op == IR_RET) {
+            lead[k + 1] = 1;
+        }
+    }
+    for (ir_nb = k = 0; k < ir_n; ++k)
+        ir_nb += lead[k];
+    ir_bstart = tcc_malloc((ir_nb + 1) * sizeof (int));
+    ir_bof = tcc_malloc(ir_n * sizeof (int));
+    ir_succ = tcc_malloc(ir_nb * 2 * sizeof (int));
+    for (b = -1, k = 0; k < ir_n; ++k) {
+        if (lead[k])
+            ir_bstart[++b] = k;
+        ir_bof[k] = b;
+    }
+    ir_bstart[ir_nb] = ir_n;
+    for (b = 0; b < ir_nb; ++b) {
+        i = &ir_code[ir_bstart[b + 1] - 1];
+        t = b + 1 < ir_nb ? b + 1 : -1;
+        ir_succ[2 * b] = t, ir_succ[2 * b + 1] = -1;
+        if (i->op == IR_JMP)
+            ir_succ[2 * b] = ir_bof[i->c];
+        else if (i->op == IR_JCC)
+            ir_succ[2 * b + 1] = ir_bof[i->c];
+        else if (i->op == IR_RET)
+            ir_succ[2 * b] = -1;
+    }
+    tcc_free(lead);
+    return 0;
+}
+
+static int ir_liveness(void)
+{
+    unsigned *use, *def, *in, *out, x;
+    int b, k, w, n, s, changed;
+    IRInsn *i;
+
+    ir_nw = (ir_nv + 31) >> 5;
+    if ((double)ir_nb * ir_nw > (1 << 21))
+        return -1; /* too big, not worth it */
+    n = ir_nb * ir_nw;
+    tcc_free(ir_lin), ir_lin = tcc_mallocz(n * sizeof (unsigned));
+    tcc_free(ir_lout), ir_lout = tcc_mallocz(n * sizeof (unsigned));
+    use = tcc_mallocz(n * sizeof (unsigned));
+    def = tcc_mallocz(n * sizeof (unsigned));
+    for (b = 0; b < ir_nb; ++b) {
+        unsigned *u = use + b * ir_nw, *d = def + b * ir_nw;
+        for (k = ir_bstart[b]; k < ir_bstart[b + 1]; ++k) {
+            i = &ir_code[k];
+            for (n = ir_uses(i); n--; )
+                if (!BTST(d, *ir_ubuf[n]))
+                    BSET(u, *ir_ubuf[n]);
+            for (n = ir_defs(i); n--; )
+                BSET(d, *ir_dbuf[n]);
+        }
+    }
+    do {
+        changed = 0;
+        for (b = ir_nb; b--; ) {
+            in = ir_lin + b * ir_nw, out = ir_lout + b * ir_nw;
+            for (k = 0; k < 2; ++k) {
+                s = ir_succ[2 * b + k];
+                if (s >= 0)
+                    for (w = 0; w < ir_nw; ++w)
+                        out[w] |= ir_lin[s * ir_nw + w];
+            }
+            for (w = 0; w < ir_nw; ++w) {
+                x = use[b * ir_nw + w] | (out[w] & ~def[b * ir_nw + w]);
+                if (x != in[w])
+                    in[w] = x, changed = 1;
+            }
+        }
+    } while (changed);
+    tcc_free(use);
+    tcc_free(def);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* webs: the definitions that reach a common use get one register,
+   separate values of the same register get separate ones */
+
+static int *ir_uf, ir_nuf, ir_uf_size;
+static unsigned char *ir_ufcls;
+
+static int ir_node(int fl)
+{
+    if (ir_nuf == ir_uf_size) {
+        ir_uf_size = ir_uf_size ? ir_uf_size * 2 : 1024;
+        ir_uf = tcc_realloc(ir_uf, ir_uf_size * sizeof (int));
+        ir_ufcls = tcc_realloc(ir_ufcls, ir_uf_size);
+    }
+    ir_uf[ir_nuf] = ir_nuf;
+    ir_ufcls[ir_nuf] = fl;
+    return ir_nuf++;
+}
+
+static int ir_find(int x)
+{
+    while (ir_uf[x] != x)
+        x = ir_uf[x] = ir_uf[ir_uf[x]];
+    return x;
+}
+
+static void ir_webs(void)
+{
+    int *lbase, *lvar, *lnode, *cur, *stamp, *id;
+    int b, k, n, v, s, j, nl;
+    IRInsn *i;
+
+    /* one node for each register live at the start of each block */
+    lbase = tcc_malloc((ir_nb + 1) * sizeof (int));
+    for (nl = b = 0; b < ir_nb; ++b) {
+        lbase[b] = nl;
+        for (v = 0; v < ir_nv; ++v)
+            nl += BTST(ir_lin + b * ir_nw, v);
+    }
+    lbase[ir_nb] = nl;
+    lvar = tcc_malloc((nl + 1) * sizeof (int));
+    lnode = tcc_malloc((nl + 1) * sizeof (int));
+    ir_nuf = 0;
+    for (nl = b = 0; b < ir_nb; ++b)
+        for (v = 0; v < ir_nv; ++v)
+            if (BTST(ir_lin + b * ir_nw, v))
+                lvar[nl] = v, lnode[nl++] = ir_node(ir_cls[v]);
+
+    cur = tcc_malloc(ir_nv * sizeof (int));
+    stamp = tcc_malloc(ir_nv * sizeof (int));
+    for (v = 0; v < ir_nv; ++v)
+        stamp[v] = -1;
+    for (b = 0; b < ir_nb; ++b) {
+        for (k = lbase[b]; k < lbase[b + 1]; ++k)
+            cur[lvar[k]] = lnode[k], stamp[lvar[k]] = b;
+        for (k = ir_bstart[b]; k < ir_bstart[b + 1]; ++k) {
+            i = &ir_code[k];
+            for (n = ir_uses(i); n--; ) {
+                v = *ir_ubuf[n];
+                if (stamp[v] != b)
+                    cur[v] = ir_node(ir_cls[v]), stamp[v] = b;
+                *ir_ubuf[n] = cur[v];
+            }
+            for (n = ir_defs(i); n--; ) {
+                v = *ir_dbuf[n];
+                cur[v] = *ir_dbuf[n] = ir_node(ir_cls[v]);
+                stamp[v] = b;
+            }
+        }
+        for (j = 0; j < 2; ++j) {
+            s = ir_succ[2 * b + j];
+            if (s < 0)
+                continue;
+            for (k = lbase[s]; k < lbase[s + 1]; ++k) {
+                v = lvar[k];
+                if (stamp[v] == b)
+                    ir_uf[ir_find(cur[v])] = ir_find(lnode[k]);
+            }
+        }
+    }
+
+    /* number the webs */
+    id = tcc_malloc(ir_nuf * sizeof (int));
+    for (k = 0; k < ir_nuf; ++k)
+        id[k] = -1;
+    tcc_free(ir_cls);
+    ir_cls = tcc_malloc(ir_nuf + 1);
+    ir_cls_size = ir_nuf + 1;
+    for (n = k = 0; k < ir_nuf; ++k) {
+        v = ir_find(k);
+        if (id[v] < 0)
+            ir_cls[n] = ir_ufcls[v], id[v] = n++;
+        id[k] = id[v];
+    }
+    ir_nv = n;
+    for (i = ir_code; i < ir_code + ir_n; ++i) {
+        for (n = ir_uses(i); n--; )
+            *ir_ubuf[n] = id[*ir_ubuf[n]];
+        for (n = ir_defs(i); n--; )
+            *ir_dbuf[n] = id[*ir_dbuf[n]];
+    }
+    tcc_free(id);
+    tcc_free(cur);
+    tcc_free(stamp);
+    tcc_free(lbase);
+    tcc_free(lvar);
+    tcc_free(lnode);
+    tcc_free(ir_uf), ir_uf = NULL;
+    tcc_free(ir_ufcls), ir_ufcls = NULL;
+    ir_uf_size = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* local value numbering */
+
+typedef struct IRKey {
+    unsigned char op, t, am, f;
+    int cc, a, b, ver;
+    int64_t c;
+    int sym, vn;
+} IRKey;
+
+static IRKey *ir_ht;
+static int ir_ht_mask, *ir_ht_used, ir_ht_nused;
+
+/* for each value: the register that holds it first, its constant */
+static int *vn_holder, vn_n, vn_size;
+static unsigned char *vn_flags;
+static int64_t *vn_val;
+#define VN_CONST 1
+#define VN_CLEAN 2 /* the upper 32 bits are zero */
+
+/* value number of each register in the current block */
+static int *vn_of, *vn_stamp, vn_blk;
+
+static int ir_new_vn(int holder, int flags, int64_t val)
+{
+    if (vn_n == vn_size) {
+        vn_size = vn_size ? vn_size * 2 : 1024;
+        vn_holder = tcc_realloc(vn_holder, vn_size * sizeof (int));
+        vn_flags = tcc_realloc(vn_flags, vn_size);
+        vn_val = tcc_realloc(vn_val, vn_size * sizeof (int64_t));
+    }
+    vn_holder[vn_n] = holder;
+    vn_flags[vn_n] = flags;
+    vn_val[vn_n] = val;
+    return vn_n++;
+}
+
+static int ir_vn(int r)
+{
+    if (vn_stamp[r] != vn_blk) {
+        vn_stamp[r] = vn_blk;
+        vn_of[r] = ir_new_vn(r, 0, 0);
+    }
+    return vn_of[r];
+}
+
+static void ir_set_vn(int r, int vn)
+{
+    vn_stamp[r] = vn_blk;
+    vn_of[r] = vn;
+}
+
+/* a register that still holds 'vn', or -1 */
+static int ir_holder(int vn)
+{
+    int h = vn_holder[vn];
+    return h >= 0 && vn_stamp[h] == vn_blk && vn_of[h] == vn ? h : -1;
+}
+
+static IRKey *ir_lookup(IRKey *k)
+{
+    unsigned h;
+    IRKey *e;
+
+    h = k->op + k->t * 31 + k->am * 97 + k->f * 7 + k->cc * 131
+        + k->a * 1031 + k->b * 4099 + k->ver * 65537
+        + (unsigned)k->c * 2654435761u + (unsigned)(k->c >> 32)
+        + (unsigned)k->sym * 40503u;
+    for (h &= ir_ht_mask;; h = (h + 1) & ir_ht_mask) {
+        e = &ir_ht[h];
+        if (e->vn < 0) {
+            *e = *k;
+            e->vn = -1;
+            ir_ht_used[ir_ht_nused++] = h;
+            return e;
+        }
+        if (e->op == k->op && e->t == k->t && e->am == k->am && e->f == k->f
+            && e->cc == k->cc && e->a == k->a && e->b == k->b
+            && e->ver == k->ver && e->c == k->c && e->sym == k->sym)
+            return e;
+    }
+}
+
+static int ir_clean(IRInsn *i)
+{
+    switch (i->op) {
+    case IR_LI:
+        return (uint64_t)i->c <= 0xffffffff;
+    case IR_LOAD:
+        return i->t != IRT_I64;
+    case IR_EXT:
+        return i->t == IRT_I32 || i->cc == IRT_U8 || i->cc == IRT_U16;
+    case IR_SETCC:
+        return 1;
+    case IR_MOV: case IR_FTOI:
+    case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_XOR:
+    case IR_MUL: case IR_SHL: case IR_SHR: case IR_SAR:
+    case IR_DIV: case IR_UDIV: case IR_MOD: case IR_UMOD:
+    case IR_UMULH: case IR_SMULH:
+        return i->t == IRT_I32;
+    }
+    return 0;
+}
+
+static int ir_has_imm(int op)
+{
+    return (op >= IR_ADD && op <= IR_SAR) || op == IR_CMP;
+}
+
+static int ir_fold(IRInsn *i, uint64_t x, uint64_t y, int64_t *res)
+{
+    int w = i->t == IRT_I64 ? 63 : 31;
+    switch (i->op) {
+    case IR_ADD: x += y; break;
+    case IR_SUB: x -= y; break;
+    case IR_AND: x &= y; break;
+    case IR_OR: x |= y; break;
+    case IR_XOR: x ^= y; break;
+    case IR_MUL: x *= y; break;
+    case IR_SHL: x <<= y & w; break;
+    case IR_SHR:
+        if (w == 31)
+            x = (uint32_t)x;
+        x >>= y & w;
+        break;
+    case IR_SAR:
+        if (w == 31)
+            x = (uint32_t)((int32_t)x >> (y & w));
+        else
+            x = (int64_t)x >> (y & w);
+        break;
+    default:
+        return 0;
+    }
+    if (w == 31)
+        x = (uint32_t)x;
+    *res = x;
+    return 1;
+}
+
+static void ir_to_copy(IRInsn *i, int h)
+{
+    int d = i->d;
+    ir_nop(i);
+    i->op = IR_MOV;
+    i->t = ir_cls[d] ? IRT_F64 : IRT_I64;
+    i->d = d;
+    i->a = h;
+}
+
+static void ir_to_li(IRInsn *i, int64_t v)
+{
+    int d = i->d;
+    ir_nop(i);
+    i->op = IR_LI;
+    i->t = IRT_I64;
+    i->d = d;
+    i->c = v;
+}
+
+/* 'i' copies its operand if 'v' is 0 or -1 */
+static int ir_neutral(IRInsn *i, int64_t v)
+{
+    switch (i->op) {
+    case IR_ADD: case IR_SUB: case IR_OR: case IR_XOR:
+    case IR_SHL: case IR_SHR: case IR_SAR:
+        return v == 0;
+    case IR_MUL:
+        return v == 1;
+    case IR_AND:
+        return v == -1 || (i->t == IRT_I32 && v == 0xffffffff);
+    }
+    return 0;
+}
+
+static void ir_lvn_insn(IRInsn *i, int *ver)
+{
+    IRKey k;
+    IRKey *e;
+    int n, vn, h, fa, fb, vf, clean;
+    int64_t va = 0, vb = 0, v;
+
+    /* use the first register that has the value */
+    for (n = ir_uses(i); n--; ) {
+        h = ir_holder(ir_vn(*ir_ubuf[n]));
+        if (h >= 0 && ir_cls[h] == ir_cls[*ir_ubuf[n]])
+            *ir_ubuf[n] = h;
+    }
+
+    fa = fb = 0;
+    if (i->a >= 0) {
+        vn = ir_vn(i->a);
+        fa = vn_flags[vn], va = vn_val[vn];
+    }
+    if (i->f & IRF_IMM)
+        fb = VN_CONST, vb = i->c;
+    else if (i->b >= 0) {
+        vn = ir_vn(i->b);
+        fb = vn_flags[vn], vb = vn_val[vn];
+    }
+
+    if (ir_has_imm(i->op)) {
+        /* constant operands */
+        if (!(fa & VN_CONST) || !(fb & VN_CONST) || i->op == IR_CMP) {
+            if ((fa & VN_CONST) && !(fb & VN_CONST) && i->op != IR_CMP
+                && i->op != IR_SUB && i->op < IR_SHL) {
+                n = i->a, i->a = i->b, i->b = n;
+                v = va, va = vb, vb = v;
+                n = fa, fa = fb, fb = n;
+            }
+            if ((fb & VN_CONST) && !(i->f & IRF_IMM)
+                && (i->t == IRT_I32 || vb == (int32_t)vb)) {
+                i->f |= IRF_IMM;
+                i->b = -1;
+                i->c = (int32_t)vb;
+            }
+            if ((i->f & IRF_IMM) && i->op != IR_CMP
+                && ir_neutral(i, i->t == IRT_I32 ? (uint32_t)vb : vb)
+                && (i->t == IRT_I64 || (fa & VN_CLEAN))) {
+                n = i->a;
+                ir_to_copy(i, n);
+            } else if ((i->f & IRF_IMM) && vb == 0
+                       && (i->op == IR_AND || i->op == IR_MUL)) {
+                ir_to_li(i, 0);
+            }
+        } else if (ir_fold(i, va, vb, &v)) {
+            ir_to_li(i, v);
+        }
+    }
+
+    if (i->d < 0) {
+        switch (i->op) {
+        case IR_STORE:
+            if (i->f & IRF_VOL)
+                ++ver[0], ++ver[1];
+            else {
+                /* a load of the same place gives back the value */
+                memset(&k, 0, sizeof k);
+                k.op = IR_LOAD, k.t = i->t, k.am = i->am;
+                k.a = i->am == IRA_REG ? ir_vn(i->a) : -1;
+                k.b = -1;
+                k.c = i->c, k.sym = i->sym;
+                k.ver = ir_private(i) ? 2 * ++ver[0] : 2 * ++ver[1] + 1;
+                vn = ir_vn(i->b);
+                if (i->t == IRT_I64 || IRT_FLOAT(i->t)
+                    || (i->t == IRT_I32 && (vn_flags[vn] & VN_CLEAN))) {
+                    e = ir_lookup(&k);
+                    e->vn = vn;
+                }
+            }
+            break;
+        case IR_CALL:
+            ++ver[1];
+            break;
+        }
+        return;
+    }
+
+    vf = ir_clean(i) ? VN_CLEAN : 0;
+    switch (i->op) {
+    case IR_MOV:
+        vn = ir_vn(i->a);
+        if (i->t != IRT_I32 || (vn_flags[vn] & VN_CLEAN)) {
+            if (i->t == IRT_I32)
+                i->t = IRT_I64;
+            ir_set_vn(i->d, vn);
+            return;
+        }
+        break;
+    case IR_LI:
+        memset(&k, 0, sizeof k);
+        k.op = IR_LI, k.c = i->c, k.a = k.b = -1;
+        e = ir_lookup(&k);
+        if (e->vn < 0)
+            e->vn = ir_new_vn(i->d, VN_CONST | vf, i->c);
+        ir_set_vn(i->d, e->vn);
+        return;
+    case IR_LOAD:
+        if (i->f & IRF_VOL)
+            goto fresh;
+    case IR_LEA: case IR_GOT:
+    case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_XOR:
+    case IR_MUL: case IR_SHL: case IR_SHR: case IR_SAR:
+    case IR_DIV: case IR_UDIV: case IR_MOD: case IR_UMOD:
+    case IR_UMULH: case IR_SMULH: case IR_EXT:
+    case IR_FADD: case IR_FSUB: case IR_FMUL: case IR_FDIV: case IR_FXOR:
+    case IR_ITOF: case IR_FTOI: case IR_FTOF:
+        break;
+    default:
+        goto fresh;
+    }
+
+    /* same operation on the same values: reuse the result */
+    memset(&k, 0, sizeof k);
+    k.op = i->op, k.t = i->t, k.am = i->am, k.f = i->f & IRF_IMM;
+    k.cc = i->cc, k.c = i->c, k.sym = i->sym;
+    k.a = i->a >= 0 ? ir_vn(i->a) : -1;
+    k.b = i->b >= 0 ? ir_vn(i->b) : -1;
+    if (i->op == IR_LOAD)
+        k.ver = ir_private(i) ? 2 * ver[0] : 2 * ver[1] + 1;
+    e = ir_lookup(&k);
+    if (e->vn >= 0) {
+        h = ir_holder(e->vn);
+        if (h >= 0 && ir_cls[h] == ir_cls[i->d]) {
+            clean = vn_flags[e->vn] & VN_CLEAN;
+            if (i->op == IR_LOAD && i->t < IRT_I64 && !clean)
+                goto fresh; /* forwarded from a 64 bit register */
+            ir_to_copy(i, h);
+            ir_set_vn(i->d, e->vn);
+            return;
+        }
+    }
+    vn = ir_new_vn(i->d, vf, 0);
+    if (e->vn < 0 || ir_holder(e->vn) < 0)
+        e->vn = vn;
+    ir_set_vn(i->d, vn);
+    return;
+ fresh:
+    for (n = ir_defs(i); n--; )
+        ir_set_vn(*ir_dbuf[n], ir_new_vn(*ir_dbuf[n], vf, 0));
+    if (i->op == IR_CALL)
+        ++ver[1];
+}
+
+static void ir_lvn(void)
+{
+    int b, k, n, size, ver[2];
+
+    for (size = 16, b = 0; b < ir_nb; ++b)
+        while (size < 4 * (ir_bstart[b + 1] - ir_bstart[b]))
+            size *= 2;
+    ir_ht = tcc_malloc(size * sizeof *ir_ht);
+    ir_ht_used = tcc_malloc(size * sizeof (int));
+    ir_ht_mask = size - 1;
+    for (k = 0; k < size; ++k)
+        ir_ht[k].vn = -1;
+    vn_of = tcc_malloc(ir_nv * sizeof (int));
+    vn_stamp = tcc_malloc(ir_nv * sizeof (int));
+    for (k = 0; k < ir_nv; ++k)
+        vn_stamp[k] = -1;
+    vn_n = 0;
+    ver[0] = ver[1] = 0;
+
+    for (b = 0; b < ir_nb; ++b) {
+        vn_blk = b;
+        ir_ht_nused = 0;
+        for (k = ir_bstart[b]; k < ir_bstart[b + 1]; ++k) {
+            IRInsn *i = &ir_code[k];
+            if (i->op == IR_NOP)
+                continue;
+            if (i->op == IR_ENTRY || i->op == IR_CALL) {
+                /* arguments first */
+                for (n = ir_uses(i); n--; ) {
+                    int h = ir_holder(ir_vn(*ir_ubuf[n]));
+                    if (h >= 0 && ir_cls[h] == ir_cls[*ir_ubuf[n]])
+                        *ir_ubuf[n] = h;
+                }
+                for (n = ir_defs(i); n--; )
+                    ir_set_vn(*ir_dbuf[n], ir_new_vn(*ir_dbuf[n], 0, 0));
+                if (i->op == IR_CALL)
+                    ++ver[1];
+                continue;
+            }
+            ir_lvn_insn(i, ver);
+        }
+        while (ir_ht_nused)
+            ir_ht[ir_ht_used[--ir_ht_nused]].vn = -1;
+    }
+    tcc_free(ir_ht), ir_ht = NULL;
+    tcc_free(ir_ht_used), ir_ht_used = NULL;
+    tcc_free(vn_of), vn_of = NULL;
+    tcc_free(vn_stamp), vn_stamp = NULL;
+    tcc_free(vn_holder), vn_holder = NULL;
+    tcc_free(vn_flags), vn_flags = NULL;
+    tcc_free(vn_val), vn_val = NULL;
+    vn_size = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* copies and dead code */
+
+static int *ir_ndef, *ir_nuse, *ir_defi;
+
+static void ir_count(void)
+{
+    IRInsn *i;
+    int n;
+    memset(ir_ndef, 0, ir_nv * sizeof (int));
+    memset(ir_nuse, 0, ir_nv * sizeof (int));
+    memset(ir_defi, 0, ir_nv * sizeof (int));
+    for (i = ir_code; i < ir_code + ir_n; ++i) {
+        for (n = ir_uses(i); n--; )
+            ir_nuse[*ir_ubuf[n]]++;
+        for (n = ir_defs(i); n--; )
+            ir_ndef[*ir_dbuf[n]]++, ir_defi[*ir_dbuf[n]] = i - ir_code;
+    }
+}
+
+/* whether insns from 'k0' to 'k1' (excluded) use (or define if 'def')
+   register 'r' */
+static int ir_refs(int k0, int k1, int r, int def)
+{
+    int n;
+    for (; k0 < k1; ++k0) {
+        IRInsn *i = &ir_code[k0];
+        for (n = ir_uses(i); n--; )
+            if (!def && *ir_ubuf[n] == r)
+                return 1;
+        for (n = ir_defs(i); n--; )
+            if (*ir_dbuf[n] == r)
+                return 1;
+    }
+    return 0;
+}
+
+/* the operands that use each register: ir_uhead[r], then ir_unext[],
+   with the operand in ir_uslot[] and the insn in ir_upos[].  Operands
+   that were changed since are skipped. */
+static int *ir_uhead, *ir_unext, *ir_upos;
+static int **ir_uslot;
+
+static void ir_use_lists(void)
+{
+    int k, n, u, v;
+
+    for (u = k = 0; k < ir_n; ++k)
+        u += ir_uses(&ir_code[k]);
+    ir_unext = tcc_realloc(ir_unext, (u + 1) * sizeof (int));
+    ir_upos = tcc_realloc(ir_upos, (u + 1) * sizeof (int));
+    ir_uslot = tcc_realloc(ir_uslot, (u + 1) * sizeof (int *));
+    ir_uhead = tcc_realloc(ir_uhead, ir_nv * sizeof (int));
+    for (v = 0; v < ir_nv; ++v)
+        ir_uhead[v] = -1;
+    for (u = k = 0; k < ir_n; ++k)
+        for (n = ir_uses(&ir_code[k]); n--; ) {
+            v = *ir_ubuf[n];
+            ir_uslot[u] = ir_ubuf[n], ir_upos[u] = k;
+            ir_unext[u] = ir_uhead[v], ir_uhead[v] = u++;
+        }
+}
+
+/* whether insns from 'k0' to 'k1' (excluded) use register 'r' */
+static int ir_used(int r, int k0, int k1)
+{
+    int u;
+    for (u = ir_uhead[r]; u >= 0; u = ir_unext[u])
+        if (*ir_uslot[u] == r && ir_upos[u] >= k0 && ir_upos[u] < k1)
+            return 1;
+    return 0;
+}
+
+static void ir_replace(int from, int to)
+{
+    int u, *last = &ir_uhead[from];
+    for (u = ir_uhead[from]; u >= 0; u = ir_unext[u]) {
+        if (*ir_uslot[u] == from)
+            *ir_uslot[u] = to;
+        last = &ir_unext[u];
+    }
+    *last = ir_uhead[to];
+    ir_uhead[to] = ir_uhead[from];
+    ir_uhead[from] = -1;
+}
+
+static int ir_copy(int k)
+{
+    IRInsn *i = &ir_code[k], *p;
+    int d = i->d, a = i->a, b = ir_bof[k], k0 = ir_bstart[b], ka, m, n;
+
+    if (i->t == IRT_I32 || d == a)
+        return 0;
+    ka = ir_defi[a];
+    if (ir_ndef[a] == 1 && ir_nuse[a] == 1 && ir_bof[ka] == b && ka < k) {
+        /* the value was computed just for the copy */
+        p = &ir_code[ka];
+        if (p->d == a && p->op != IR_CALL && !ir_refs(ka + 1, k, d, 0)) {
+            p->d = d;
+            ir_nop(i);
+            ir_ndef[a] = ir_nuse[a] = 0;
+            ir_defi[d] = ka;
+            return 1;
+        }
+    }
+    if (ir_ndef[d] != 1)
+        return 0;
+    if (ir_ndef[a] == 1 && ir_bof[ka] == b && ka < k
+        && !ir_used(d, k0, k)) {
+        /* 'a' never changes after the copy */
+        ir_replace(d, a);
+        goto done;
+    }
+    /* all uses follow in the block and 'a' is still there */
+    for (m = k + 1, n = ir_nuse[d]; n && m < ir_bstart[b + 1]; ++m) {
+        p = &ir_code[m];
+        for (ka = ir_uses(p); ka--; )
+            n -= *ir_ubuf[ka] == d;
+        if (n && ir_refs(m, m + 1, a, 1))
+            return 0;
+    }
+    if (n)
+        return 0;
+    ir_replace(d, a);
+ done:
+    ir_nop(i);
+    ir_nuse[a] += ir_nuse[d] - 1;
+    ir_ndef[d] = ir_nuse[d] = 0;
+    return 1;
+}
+
+static void ir_copies(void)
+{
+    int k, changed, pass;
+    for (pass = 0; pass < 4; ++pass) {
+        ir_count();
+        ir_use_lists();
+        changed = 0;
+        for (k = 0; k < ir_n; ++k) {
+            if (ir_code[k].op == IR_MOV && ir_copy(k))
+                changed = 1;
+        }
+        if (!changed)
+            break;
+    }
+    tcc_free(ir_uhead), ir_uhead = NULL;
+    tcc_free(ir_unext), ir_unext = NULL;
+    tcc_free(ir_upos), ir_upos = NULL;
+    tcc_free(ir_uslot), ir_uslot = NULL;
+}
+
+/* flags set by a compare are used before the next one.  The code of
+   'c ? a < b : x < y' tests them after a jump to where both meet. */
+static int ir_flags_used(int k)
+{
+    int jumps = 0;
+    while (++k < ir_n) {
+        int op = ir_code[k].op;
+        if (op == IR_JCC || op == IR_SETCC)
+            return 1;
+        if (op == IR_JMP && ++jumps < 8)
+            k = ir_code[k].c - 1;
+        else if (op == IR_CMP || op == IR_FCMP || op == IR_JMP || op == IR_RET)
+            break;
+    }
+    return 0;
+}
+
+static void ir_dce(void)
+{
+    IRInsn *i;
+    int k, n, changed;
+
+    do {
+        ir_count();
+        changed = 0;
+        for (k = ir_n; k--; ) {
+            i = &ir_code[k];
+            if ((i->d >= 0 && !ir_nuse[i->d] && ir_pure(i))
+                || ((i->op == IR_CMP || i->op == IR_FCMP)
+                    && !ir_flags_used(k))
+                || (i->op == IR_MOV && i->d == i->a && i->t != IRT_I32)) {
+                for (n = ir_uses(i); n--; )
+                    ir_nuse[*ir_ubuf[n]]--;
+                ir_nop(i);
+                changed = 1;
+            } else if (i->d >= 0 && !ir_nuse[i->d]) {
+                i->d = -1; /* result of a call */
+            } else if (i->op == IR_ENTRY) {
+                for (n = 0; n < i->cc; ++n)
+                    if (ir_pool[2 * (i->p + n)] >= 0
+                        && !ir_nuse[ir_pool[2 * (i->p + n)]])
+                        ir_pool[2 * (i->p + n)] = -1;
+            }
+        }
+    } while (changed);
+}
+
+static int ir_overlap(IRInsn *i, IRInsn *j)
+{
+    return i->c < j->c + ir_tsize(j->t) && j->c < i->c + ir_tsize(i->t);
+}
+
+/* stores that are overwritten or never loaded */
+static void ir_dse(void)
+{
+    IRInsn *i, *j;
+    int b, k, m, n, *pend, np;
+
+    pend = tcc_malloc(ir_n * sizeof (int));
+    for (b = 0; b < ir_nb; ++b) {
+        np = 0;
+        for (k = ir_bstart[b]; k < ir_bstart[b + 1]; ++k) {
+            i = &ir_code[k];
+            if (i->op == IR_STORE && !(i->f & IRF_VOL)
+                && (i->am == IRA_FRAME || i->am == IRA_SYM)) {
+                for (m = n = 0; n < np; ++n) {
+                    j = &ir_code[pend[n]];
+                    if (j->am == i->am && j->sym == i->sym
+                        && i->c <= j->c
+                        && j->c + ir_tsize(j->t) <= i->c + ir_tsize(i->t))
+                        ir_nop(j);
+                    else
+                        pend[m++] = pend[n];
+                }
+                np = m;
+                pend[np++] = k;
+            } else if ((i->op == IR_LOAD || i->op == IR_STORE)
+                       && ir_private(i)) {
+                for (m = n = 0; n < np; ++n) {
+                    j = &ir_code[pend[n]];
+                    if (!(j->am == IRA_FRAME && ir_overlap(i, j)))
+                        pend[m++] = pend[n];
+                }
+                np = m;
+            } else if (i->op == IR_LOAD || i->op == IR_STORE
+                       || i->op == IR_CALL) {
+                /* may read anything but the private frame */
+                for (m = n = 0; n < np; ++n)
+                    if (ir_private(&ir_code[pend[n]]))
+                        pend[m++] = pend[n];
+                np = m;
+            }
+        }
+    }
+    tcc_free(pend);
+
+    /* private frame slots that are never loaded */
+    for (k = 0; k < ir_n; ++k) {
+        i = &ir_code[k];
+        if (i->op != IR_STORE || (i->f & IRF_VOL) || !ir_private(i))
+            continue;
+        for (m = 0; m < ir_n; ++m) {
+            j = &ir_code[m];
+            if (j->op == IR_LOAD && j->am == IRA_FRAME && ir_overlap(i, j))
+                break;
+        }
+        if (m == ir_n)
+            ir_nop(i);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* linear scan register allocation */
+
+static int *ls_start, *ls_end;
+
+static int ir_ls_cmp(const void *pa, const void *pb)
+{
+    int a = *(const int *)pa, b = *(const int *)pb;
+    if (ls_start[a] != ls_start[b])
+        return ls_start[a] < ls_start[b] ? -1 : 1;
+    return a - b;
+}
+
+static void ir_alloc(void)
+{
+    int *order, *hint, *mate, *active, *cpos;
+    unsigned *forbid, *cmask, busy, allowed, m, all;
+    int k, n, v, b, x, r, na, nc, nact, pos, best, spill;
+    IRInsn *i;
+
+    ls_start = tcc_malloc(ir_nv * sizeof (int));
+    ls_end = tcc_malloc(ir_nv * sizeof (int));
+    hint = tcc_malloc(ir_nv * sizeof (int));
+    mate = tcc_malloc(ir_nv * sizeof (int));
+    forbid = tcc_mallocz(ir_nv * sizeof (unsigned));
+    for (v = 0; v < ir_nv; ++v)
+        ls_start[v] = 0x7fffffff, ls_end[v] = -1, hint[v] = mate[v] = -1;
+
+    /* intervals: uses at 4k, clobbers at 4k+1, definitions at 4k+2 */
+    for (b = 0; b < ir_nb; ++b) {
+        for (x = 0; x < ir_nw; ++x) {
+            m = ir_lin[b * ir_nw + x] | ir_lout[b * ir_nw + x];
+            for (v = 32 * x; m; m >>= 1, ++v) {
+                if (!(m & 1))
+                    continue;
+                if (BTST(ir_lin + b * ir_nw, v) && ls_start[v] > 4 * ir_bstart[b])
+                    ls_start[v] = 4 * ir_bstart[b];
+                if (BTST(ir_lout + b * ir_nw, v) && ls_end[v] < 4 * ir_bstart[b + 1] - 1)
+                    ls_end[v] = 4 * ir_bstart[b + 1] - 1;
+            }
+        }
+    }
+    cpos = tcc_malloc((ir_n + 1) * sizeof (int));
+    cmask = tcc_malloc((ir_n + 1) * sizeof (unsigned));
+    for (nc = k = 0; k < ir_n; ++k) {
+        i = &ir_code[k];
+        for (n = ir_uses(i); n--; ) {
+            v = *ir_ubuf[n];
+            if (ls_start[v] > 4 * k)
+                ls_start[v] = 4 * k;
+            if (ls_end[v] < 4 * k)
+                ls_end[v] = 4 * k;
+        }
+        for (n = ir_defs(i); n--; ) {
+            v = *ir_dbuf[n];
+            if (ls_start[v] > 4 * k + 2)
+                ls_start[v] = 4 * k + 2;
+            if (ls_end[v] < 4 * k + 2)
+                ls_end[v] = 4 * k + 2;
+        }
+        m = ir_clobbers(i);
+        if (m)
+            cpos[nc] = 4 * k + 1, cmask[nc++] = m;
+        /* preferred registers */
+        if (i->op == IR_ENTRY || i->op == IR_CALL)
+            for (n = 0; n < i->cc; ++n) {
+                v = ir_pool[2 * (i->p + n)];
+                r = ir_pool[2 * (i->p + n) + 1];
+                if (v >= 0 && r < 32 && hint[v] < 0)
+                    hint[v] = r;
+            }
+        ir_hint(i, hint);
+        if (i->op == IR_MOV && i->t != IRT_I32)
+            mate[i->d] = i->a, mate[i->a] = i->d;
+    }
+    for (all = k = 0; k < nc; ++k)
+        all |= cmask[k];
+    for (v = 0; v < ir_nv; ++v) {
+        /* the first clobber after the start, cpos[] is sorted */
+        for (x = 0, k = nc; x < k; )
+            if (cpos[(x + k) / 2] > ls_start[v])
+                k = (x + k) / 2;
+            else
+                x = (x + k) / 2 + 1;
+        for (; k < nc && cpos[k] < ls_end[v] && forbid[v] != all; ++k)
+            forbid[v] |= cmask[k];
+    }
+    tcc_free(cpos);
+    tcc_free(cmask);
+
+    order = tcc_malloc(ir_nv * sizeof (int));
+    for (n = v = 0; v < ir_nv; ++v)
+        if (ls_end[v] >= 0)
+            order[n++] = v;
+    qsort(order, n, sizeof (int), ir_ls_cmp);
+
+    ir_loc = tcc_malloc(ir_nv * sizeof (int));
+    for (v = 0; v < ir_nv; ++v)
+        ir_loc[v] = IR_NOLOC;
+    active = tcc_malloc((ir_nv + 1) * sizeof (int));
+    nact = 0;
+    spill = ir_frame;
+    for (k = 0; k < n; ++k) {
+        v = order[k];
+        pos = ls_start[v];
+        for (na = x = 0; x < nact; ++x)
+            if (ls_end[active[x]] >= pos)
+                active[na++] = active[x];
+        nact = na;
+        busy = 0;
+        for (x = 0; x < nact; ++x)
+            busy |= 1u << ir_loc[active[x]];
+        allowed = 0;
+        for (x = 0; (r = ir_hregs[ir_cls[v]][x]) >= 0; ++x)
+            allowed |= 1u << r;
+        allowed &= ~forbid[v];
+        r = -1;
+        if (hint[v] >= 0 && ((allowed & ~busy) >> hint[v] & 1))
+            r = hint[v];
+        else if (mate[v] >= 0 && ir_loc[mate[v]] >= 0
+                 && ir_loc[mate[v]] < 32
+                 && ((allowed & ~busy) >> ir_loc[mate[v]] & 1))
+            r = ir_loc[mate[v]];
+        else
+            for (x = 0; ir_hregs[ir_cls[v]][x] >= 0; ++x)
+                if ((allowed & ~busy) >> ir_hregs[ir_cls[v]][x] & 1) {
+                    r = ir_hregs[ir_cls[v]][x];
+                    break;
+                }
+        if (r < 0) {
+            /* spill what lives longest */
+            best = -1;
+            for (x = 0; x < nact; ++x)
+                if ((allowed >> ir_loc[active[x]] & 1)
+                    && (best < 0 || ls_end[active[x]] > ls_end[active[best]]))
+                    best = x;
+            if (best >= 0 && ls_end[active[best]] > ls_end[v]) {
+                r = ir_loc[active[best]];
+                ir_loc[active[best]] = spill -= 8;
+                active[best] = active[--nact];
+            } else {
+                ir_loc[v] = spill -= 8;
+                continue;
+            }
+        }
+        ir_loc[v] = r;
+        active[nact++] = v;
+    }
+    ir_frame = spill;
+    tcc_free(active);
+    tcc_free(order);
+    tcc_free(hint);
+    tcc_free(mate);
+    tcc_free(forbid);
+    tcc_free(ls_start), ls_start = NULL;
+    tcc_free(ls_end), ls_end = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+ST_FUNC int ir_optimize(void)
+{
+    IRInsn *i;
+    int ret = -1;
+
+    if (ir_failed)
+        return -1;
+    ir_promote();
+    if (ir_cfg() < 0 || ir_liveness() < 0)
+        goto done;
+    ir_webs();
+    ir_lvn();
+    ir_ndef = tcc_malloc(ir_nv * sizeof (int));
+    ir_nuse = tcc_malloc(ir_nv * sizeof (int));
+    ir_defi = tcc_malloc(ir_nv * sizeof (int));
+    ir_copies();
+    ir_dce();
+    ir_dse();
+    ir_dce();
+    tcc_free(ir_ndef), ir_ndef = NULL;
+    tcc_free(ir_nuse), ir_nuse = NULL;
+    tcc_free(ir_defi), ir_defi = NULL;
+    if (ir_liveness() < 0)
+        goto done;
+    /* spill slots go below the locals that are still in memory */
+    ir_frame = 0;
+    for (i = ir_code; i < ir_code + ir_n; ++i)
+        if (i->am == IRA_FRAME && i->c < 0
+            && (i->op == IR_LOAD || i->op == IR_STORE || i->op == IR_LEA))
+            ir_frame = loc & -8;
+    ir_alloc();
+    ret = 0;
+ done:
+    if (ret)
+        ir_failed = 1;
+    return ret;
+}
+
+#endif /* TCC_TARGET_IR */
@@ -39,6 +39,7 @@ ST_DATA int tok;
 ST_DATA CValue tokc;
 ST_DATA const int *macro_ptr;
 ST_DATA CString tokcstr; /* current parsed string, if any */
+ST_DATA TokenString *tok_saving;
 
 /* display benchmark infos */
 ST_DATA int tok_ident;
@@ -588,6 +589,8 @@ ST_FUNC const char *get_tok_str(int v, CValue *cv)
         return strcpy(p, "<long double>");
     case TOK_LINENUM:
         return strcpy(p, "<linenumber>");
+    case TOK_PPSTATE:
+        return strcpy(p, "<pragma>");
 
     /* above tokens have value, the ones below don't */
     case TOK_LT:
@@ -982,6 +985,7 @@ static inline int tok_size(const int *p)
     case TOK_LCHAR:
     case TOK_CFLOAT:
     case TOK_LINENUM:
+    case TOK_PPSTATE:
         return 1 + 1;
     case TOK_STR:
     case TOK_LSTR:
@@ -1063,12 +1067,26 @@ ST_FUNC void tok_str_add(TokenString *s, int t)
     s->len = len;
 }
 
+/* what '#pragma pack' and '#pragma comment(option)' change in the
+   parsing of a recorded body, to replay it as it was read */
+static int pp_state(void)
+{
+    return *tcc_state->pack_stack_ptr | tcc_state->ms_bitfields << 8;
+}
+
+static void pp_set_state(int v)
+{
+    *tcc_state->pack_stack_ptr = v & 0xff;
+    tcc_state->ms_bitfields = v >> 8;
+}
+
 ST_FUNC void begin_macro(TokenString *str, int alloc)
 {
     str->alloc = alloc;
     str->prev = macro_stack;
     str->prev_ptr = macro_ptr;
     str->save_line_num = file->line_num;
+    str->save_pp_state = -1;
     macro_ptr = str->str;
     macro_stack = str;
 }
@@ -1079,6 +1097,8 @@ ST_FUNC void end_macro(void)
     macro_stack = str->prev;
     macro_ptr = str->prev_ptr;
     file->line_num = str->save_line_num;
+    if (str->save_pp_state >= 0)
+        pp_set_state(str->save_pp_state);
     if (str->alloc == 0) {
         /* matters if str not alloced, may be tokstr_buf */
         str->len = str->need_spc = 0;
@@ -1107,6 +1127,7 @@ static void tok_str_add2(TokenString *s, int t, CValue *cv)
     case TOK_LCHAR:
     case TOK_CFLOAT:
     case TOK_LINENUM:
+    case TOK_PPSTATE:
 #if LONG_SIZE == 4
     case TOK_CLONG:
     case TOK_CULONG:
@@ -1175,6 +1196,15 @@ ST_FUNC void tok_str_add_tok(TokenString *s)
     tok_str_add2(s, tok, &tokc);
 }
 
+/* record the current '#pragma pack' state in token string 's' */
+ST_FUNC void tok_str_add_pp_state(TokenString *s)
+{
+    CValue cval;
+
+    cval.i = pp_state();
+    tok_str_add2(s, TOK_PPSTATE, &cval);
+}
+
 /* like tok_str_add2(), add a space if needed */
 static void tok_str_add2_spc(TokenString *s, int t, CValue *cv)
 {
@@ -1199,6 +1229,7 @@ static inline void tok_get(int *t, const int **pp, CValue *cv)
     case TOK_CCHAR:
     case TOK_LCHAR:
     case TOK_LINENUM:
+    case TOK_PPSTATE:
         cv->i = *p++;
         break;
 #if LONG_SIZE == 4
@@ -1745,6 +1776,8 @@ static void pragma_parse(TCCState *s1)
         }
         if (tok != ')')
             goto pragma_err;
+        if (tok_saving)
+            tok_str_add_pp_state(tok_saving);
 
     } else if (tok == TOK_comment) {
         char *p; int t;
@@ -1762,8 +1795,11 @@ static void pragma_parse(TCCState *s1)
         if (t == TOK_lib) {
             dynarray_add(&s1->pragma_libs, &s1->nb_pragma_libs, p);
         } else {
-            if (t == TOK_option)
+            if (t == TOK_option) {
                 tcc_set_options(s1, p);
+                if (tok_saving)
+                    tok_str_add_pp_state(tok_saving);
+            }
             tcc_free(p);
         }
 
@@ -3445,6 +3481,12 @@ redo:
                 file->line_num = tokc.i;
                 goto redo;
             }
+            if (t == TOK_PPSTATE) {
+                if (macro_stack->save_pp_state < 0)
+                    macro_stack->save_pp_state = pp_state();
+                pp_set_state(tokc.i);
+                goto redo;
+            }
             goto convert;
         } else if (t == 0) {
             /* end of macro or unget token string */
@@ -3558,6 +3600,18 @@ static void tcc_predefs(TCCState *s1, CString *cs, int is_asm)
 #ifdef TCC_TARGET_ARM
     if (s1->float_abi == ARM_HARD_FLOAT)
       putdef(cs, "__ARM_PCS_VFP");
+#endif
+#ifdef TCC_TARGET_X86_64
+    if (s1->mpopcnt)
+      putdef(cs, "__POPCNT__");
+    if (s1->mlzcnt)
+      putdef(cs, "__LZCNT__");
+    if (s1->mbmi)
+      putdef(cs, "__BMI__");
+#endif
+#ifdef TCC_TARGET_RISCV64
+    if (s1->mzbb)
+      putdef(cs, "__riscv_zbb");
 #endif
     if (is_asm)
       putdef(cs, "__ASSEMBLER__");
@@ -3639,6 +3693,7 @@ ST_FUNC void preprocess_end(TCCState *s1)
     while (macro_stack)
         end_macro();
     macro_ptr = NULL;
+    tok_saving = NULL;
     while (file)
         tcc_close();
     tccpp_delete(s1);
@@ -89,11 +89,17 @@ static void st_link(TCCState *s1);
 static void st_unlink(TCCState *s1);
 #ifdef CONFIG_TCC_BACKTRACE
 static int _tcc_backtrace(rt_frame *f, const char *fmt, va_list ap);
+static int rt_error(rt_frame *f, const char *fmt, ...);
 #endif
 #ifdef _WIN64
 static void *win64_add_function_table(TCCState *s1);
 static void win64_del_function_table(void *);
 #endif
+#ifdef TCC_TARGET_TLS
+static void rt_tls_new(TCCState *s1);
+static void rt_tls_free(TCCState *s1);
+static void *rt_tls_get_addr(addr_t *ti);
+#endif
 
 #if !defined PAGESIZE
 # if defined _SC_PAGESIZE
@@ -154,6 +160,9 @@ LIBTCCAPI int tcc_relocate(TCCState *s1)
 #ifdef CONFIG_TCC_BACKTRACE
     if (s1->do_backtrace)
         tcc_add_symbol(s1, "_tcc_backtrace", _tcc_backtrace); /* for bt-log.c */
+#endif
+#ifdef TCC_TARGET_TLS
+    tcc_add_symbol(s1, "__tls_get_addr", rt_tls_get_addr);
 #endif
     size = tcc_relocate_ex(s1, NULL, 0);
     if (size < 0)
@@ -188,6 +197,9 @@ ST_FUNC void tcc_run_free(TCCState *s1)
     if (NULL == ptr)
         return;
     st_unlink(s1);
+#ifdef TCC_TARGET_TLS
+    rt_tls_free(s1);
+#endif
     size = s1->run_size;
 #ifdef HAVE_SELINUX
     munmap(ptr, size);
@@ -319,6 +331,9 @@ static int tcc_relocate_ex(TCCState *s1, void *ptr, unsigned ptr_diff)
 #else
         tcc_add_runtime(s1);
 	resolve_common_syms(s1);
+#ifdef LINK_RELAX
+        relax_sections(s1);
+#endif
         build_got_entries(s1, 0);
 #endif
     }
@@ -333,14 +348,15 @@ redo:
     if (copy == 3)
         return 0;
 
-    for (k = 0; k < 3; ++k) { /* 0:rx, 1:ro, 2:rw sections */
+    for (k = 0; k < 4; ++k) { /* 0:rx, 1:ro, 2:rw, 3:tls sections */
         n = 0; addr = 0;
         for(i = 1; i < s1->nb_sections; i++) {
-            static const char shf[] = {
-                SHF_ALLOC|SHF_EXECINSTR, SHF_ALLOC, SHF_ALLOC|SHF_WRITE
+            static const short shf[] = {
+                SHF_ALLOC|SHF_EXECINSTR, SHF_ALLOC, SHF_ALLOC|SHF_WRITE,
+                SHF_ALLOC|SHF_WRITE|SHF_TLS
                 };
             s = s1->sections[i];
-            if (shf[k] != (s->sh_flags & (SHF_ALLOC|SHF_WRITE|SHF_EXECINSTR)))
+            if (shf[k] != (s->sh_flags & (SHF_ALLOC|SHF_WRITE|SHF_EXECINSTR|SHF_TLS)))
                 continue;
             length = s->data_offset;
             if (copy == 2) {
@@ -422,6 +438,9 @@ redo:
         goto redo;
     }
 
+#ifdef TCC_TARGET_TLS
+    rt_tls_new(s1);
+#endif
     /* relocate symbols */
     relocate_syms(s1, s1->symtab, !(s1->nostdlib));
     /* relocate sections */
@@ -434,6 +453,84 @@ redo:
     goto redo;
 }
 
+/* ------------------------------------------------------------- */
+#ifdef TCC_TARGET_TLS
+#include <pthread.h>
+/* the blocks belong to the threads of the program */
+#undef malloc
+#undef free
+#ifndef TLS_DTV_OFFSET
+# define TLS_DTV_OFFSET 0
+#endif
+
+/* thread-local storage of the program: each thread gets its own
+   copy of the .tdata/.tbss image on first access */
+typedef struct rt_tls {
+    pthread_key_t key;
+    char *image;
+    addr_t size, align;
+} rt_tls;
+
+static void rt_tls_new(TCCState *s1)
+{
+    rt_tls *t;
+    addr_t size, align, start = get_tls_block(s1, &size, &align);
+
+    if (0 == start)
+        return;
+    t = tcc_mallocz(sizeof *t);
+    if (pthread_key_create(&t->key, free)) {
+        tcc_free(t);
+        tcc_error_noabort("tccrun: could not create thread-local storage");
+        return;
+    }
+    t->image = (char*)start;
+    t->size = size;
+    t->align = align;
+    s1->run_tls = t;
+}
+
+static void rt_tls_free(TCCState *s1)
+{
+    rt_tls *t = s1->run_tls;
+
+    if (t) {
+        free(pthread_getspecific(t->key));
+        pthread_key_delete(t->key);
+        tcc_free(t);
+        s1->run_tls = NULL;
+    }
+}
+
+/* __tls_get_addr() for code run in memory.  'ti' points to the
+   module/offset pair in the GOT as set up by tls_got_entry(). */
+static void *rt_tls_get_addr(addr_t *ti)
+{
+    rt_tls *t = (rt_tls*)ti[0];
+    char *p = pthread_getspecific(t->key);
+
+    if (NULL == p) {
+        p = malloc(t->size + t->align);
+        if (NULL == p || pthread_setspecific(t->key, p)) {
+            rt_frame f;
+            free(p);
+            f.ip = (addr_t)__builtin_return_address(0);
+            f.fp = f.sp = 0;
+#ifdef CONFIG_TCC_BACKTRACE
+            rt_error(&f, "could not allocate thread-local storage");
+#else
+            fprintf(stderr, "tccrun: could not allocate thread-local storage\n");
+#endif
+            rt_exit(&f, 255);
+        }
+        memcpy((char*)((addr_t)(p + t->align - 1) & -t->align),
+            t->image, t->size);
+    }
+    return (char*)((addr_t)(p + t->align - 1) & -t->align)
+        + ti[1] + TLS_DTV_OFFSET;
+}
+#endif
+
 /* ------------------------------------------------------------- */
 /* allow to run code in memory */
 
@@ -39,6 +39,7 @@
      DEF(TOK_RESTRICT3, "__restrict__")
      DEF(TOK_EXTENSION, "__extension__") /* gcc keyword */
      DEF(TOK_THREAD_LOCAL, "_Thread_local") /* C11 thread-local storage */
+     DEF(TOK_THREAD, "__thread") /* gcc keyword */
 
      DEF(TOK_GENERIC, "_Generic")
      DEF(TOK_STATIC_ASSERT, "_Static_assert")
@@ -145,6 +146,10 @@
      DEF(TOK_DESTRUCTOR2, "__destructor__")
      DEF(TOK_ALWAYS_INLINE1, "always_inline")
      DEF(TOK_ALWAYS_INLINE2, "__always_inline__")
+     DEF(TOK_USED1, "used")
+     DEF(TOK_USED2, "__used__")
+     DEF(TOK_VECTOR_SIZE1, "vector_size")
+     DEF(TOK_VECTOR_SIZE2, "__vector_size__")
 
      DEF(TOK_MODE, "__mode__")
      DEF(TOK_MODE_QI, "__QI__")
@@ -168,6 +173,28 @@
      DEF(TOK_builtin_frame_address, "__builtin_frame_address")
      DEF(TOK_builtin_return_address, "__builtin_return_address")
      DEF(TOK_builtin_expect, "__builtin_expect")
+     DEF(TOK_builtin_prefetch, "__builtin_prefetch")
+     DEF(TOK_builtin_ffs, "__builtin_ffs")
+     DEF(TOK_builtin_ffsl, "__builtin_ffsl")
+     DEF(TOK_builtin_ffsll, "__builtin_ffsll")
+     DEF(TOK_builtin_clz, "__builtin_clz")
+     DEF(TOK_builtin_clzl, "__builtin_clzl")
+     DEF(TOK_builtin_clzll, "__builtin_clzll")
+     DEF(TOK_builtin_ctz, "__builtin_ctz")
+     DEF(TOK_builtin_ctzl, "__builtin_ctzl")
+     DEF(TOK_builtin_ctzll, "__builtin_ctzll")
+     DEF(TOK_builtin_clrsb, "__builtin_clrsb")
+     DEF(TOK_builtin_clrsbl, "__builtin_clrsbl")
+     DEF(TOK_builtin_clrsbll, "__builtin_clrsbll")
+     DEF(TOK_builtin_popcount, "__builtin_popcount")
+     DEF(TOK_builtin_popcountl, "__builtin_popcountl")
+     DEF(TOK_builtin_popcountll, "__builtin_popcountll")
+     DEF(TOK_builtin_parity, "__builtin_parity")
+     DEF(TOK_builtin_parityl, "__builtin_parityl")
+     DEF(TOK_builtin_parityll, "__builtin_parityll")
+     DEF(TOK_builtin_bswap16, "__builtin_bswap16")
+     DEF(TOK_builtin_bswap32, "__builtin_bswap32")
+     DEF(TOK_builtin_bswap64, "__builtin_bswap64")
      /*DEF(TOK_builtin_va_list, "__builtin_va_list")*/
 #if defined TCC_TARGET_PE && defined TCC_TARGET_X86_64
      DEF(TOK_builtin_va_start, "__builtin_va_start")
@@ -302,6 +329,9 @@
 #if defined TCC_TARGET_PE
      DEF(TOK___chkstk, "__chkstk")
 #endif
+#ifdef TCC_TARGET_TLS
+     DEF(TOK___tls_get_addr, "__tls_get_addr")
+#endif
 #if defined TCC_TARGET_ARM64 || defined TCC_TARGET_RISCV64
      DEF(TOK___arm64_clear_cache, "__arm64_clear_cache")
      DEF(TOK___addtf3, "__addtf3")
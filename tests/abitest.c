@@ -617,6 +617,57 @@ static int stdarg_struct_test(void) {
   return run_callback(src, stdarg_struct_test_callback);
 }
 
+/* with tcc as CC, <sys/cdefs.h> defines __attribute__() away */
+#if defined __x86_64__ && !defined _WIN32 && defined __GNUC__
+/*
+ * vector_size() types, passed and returned in both directions: gcc
+ * calls f, which calls back the gcc function vec_sub.  Vectors of up
+ * to 4 bytes go in general registers, one float or double in memory
+ * and the others in one SSE register.
+ */
+#define VEC_TEST(name, type, n) \
+  typedef type name ## _v __attribute__((vector_size(n * sizeof(type)))); \
+  \
+  static name ## _v name ## _sub(name ## _v a, name ## _v b) { \
+    return a - b; \
+  } \
+  \
+  static int vec_ ## name ## _test_callback(void *ptr) { \
+    name ## _v (*f)(char, name ## _v, double, name ## _v, \
+        name ## _v (*)(name ## _v, name ## _v)) = ptr; \
+    name ## _v a, b, r; \
+    int i; \
+    for (i = 0; i < n; i++) \
+      a[i] = i + 1, b[i] = 2 * i + 4; \
+    r = f(3, a, 5.0, b, name ## _sub); \
+    for (i = 0; i < n; i++) \
+      if (r[i] != a[i] - b[i] + (i == 0 ? 3 : 0) + (i == n - 1 ? 5 : 0)) \
+        return -1; \
+    return 0; \
+  } \
+  \
+  static int vec_ ## name ## _test(void) { \
+    const char *src = \
+    "typedef " #type " v __attribute__((vector_size(" #n " * sizeof(" #type "))));\n" \
+    "v f(char c, v a, double d, v b, v (*g)(v, v)) {\n" \
+    "  a[0] += c;\n" \
+    "  a[" #n " - 1] += d;\n" \
+    "  return g(a, b);\n" \
+    "}\n"; \
+    return run_callback(src, vec_ ## name ## _test_callback); \
+  }
+
+VEC_TEST(v4qi, signed char, 4)
+VEC_TEST(v2hi, short, 2)
+VEC_TEST(v1sf, float, 1)
+VEC_TEST(v8qi, signed char, 8)
+VEC_TEST(v2sf, float, 2)
+VEC_TEST(v1df, double, 1)
+VEC_TEST(v4si, int, 4)
+VEC_TEST(v4sf, float, 4)
+VEC_TEST(v2df, double, 2)
+#endif
+
 /* Test that x86-64 arranges the stack correctly for arguments with alignment >8 bytes */
 
 typedef LONG_DOUBLE (*arg_align_test_callback_type) (LONG_DOUBLE,int,LONG_DOUBLE,int,LONG_DOUBLE);
@@ -687,5 +738,16 @@ int main(int argc, char **argv) {
   RUN_TEST(stdarg_many_test);
   RUN_TEST(stdarg_struct_test);
   RUN_TEST(arg_align_test);
+#if defined __x86_64__ && !defined _WIN32 && defined __GNUC__
+  RUN_TEST(vec_v4qi_test);
+  RUN_TEST(vec_v2hi_test);
+  RUN_TEST(vec_v1sf_test);
+  RUN_TEST(vec_v8qi_test);
+  RUN_TEST(vec_v2sf_test);
+  RUN_TEST(vec_v1df_test);
+  RUN_TEST(vec_v4si_test);
+  RUN_TEST(vec_v4sf_test);
+  RUN_TEST(vec_v2df_test);
+#endif
   return retval;
 }
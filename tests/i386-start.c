@@ -0,0 +1,79 @@
+/* Just enough of a C library to run a test which prints integers, as a
+   static i386 program on an x86_64 Linux kernel without an i386 libc:
+   printf() with %d, %s and %c, memset() and memcpy(). */
+
+#include <stdarg.h>
+
+int main(void);
+
+static int syscall3(int n, int a, int b, int c)
+{
+    int r;
+    __asm__ volatile("int $0x80" : "=a"(r) : "a"(n), "b"(a), "c"(b), "d"(c)
+                     : "memory");
+    return r;
+}
+
+void *memset(void *p, int c, unsigned n)
+{
+    char *q = p;
+    while (n--)
+        *q++ = c;
+    return p;
+}
+
+void *memcpy(void *p, const void *s, unsigned n)
+{
+    char *q = p;
+    const char *r = s;
+    while (n--)
+        *q++ = *r++;
+    return p;
+}
+
+int printf(const char *fmt, ...)
+{
+    char buf[256], num[12], *p;
+    const char *s;
+    int len = 0, i, v;
+    va_list ap;
+
+    va_start(ap, fmt);
+    for (; *fmt && len < 200; fmt++) {
+        if (*fmt != '%') {
+            buf[len++] = *fmt;
+            continue;
+        }
+        switch (*++fmt) {
+        case 'd':
+            v = va_arg(ap, int);
+            i = v < 0;
+            p = num + sizeof num - 1, *p = 0;
+            do
+                *--p = '0' + (i ? -(v % 10) : v % 10);
+            while (v /= 10);
+            if (i)
+                *--p = '-';
+            s = p;
+            break;
+        case 's':
+            s = va_arg(ap, const char *);
+            break;
+        case 'c':
+            num[0] = va_arg(ap, int), num[1] = 0, s = num;
+            break;
+        default:
+            s = "?";
+            break;
+        }
+        while (*s && len < 250)
+            buf[len++] = *s++;
+    }
+    va_end(ap);
+    return syscall3(4, 1, (int)buf, len); /* write */
+}
+
+void _start(void)
+{
+    syscall3(1, main(), 0, 0); /* exit */
+}
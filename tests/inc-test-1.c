@@ -0,0 +1,11 @@
+#include <stdio.h>
+
+extern int counter;
+extern const char *version(void);
+int scale(int x);
+
+int main(void)
+{
+    printf("%s: scale(3) = %d, counter = %d\n", version(), scale(3), counter);
+    return 0;
+}
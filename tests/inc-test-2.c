@@ -0,0 +1,16 @@
+/* changed with -DV=2 to test -Wl,--incremental */
+#ifndef V
+# define V 1
+#endif
+
+int counter = 10 * V;
+
+const char *version(void)
+{
+    return V == 1 ? "first" : "second, somewhat longer";
+}
+
+int scale(int x)
+{
+    return x * V + counter;
+}
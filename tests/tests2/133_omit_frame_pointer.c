@@ -0,0 +1,103 @@
+/* frame layouts: leaf functions in the red zone, %rsp based frames
+   (-fomit-frame-pointer) and the fallbacks to a %rbp frame */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <alloca.h>
+
+int g;
+struct big { long a, b, c, d; };
+
+int get(void) { return g; }
+int add(int a, int b) { return a + b; }
+
+int leaf_array(int n)
+{
+    int a[16], i, s = 0;
+    for (i = 0; i < 16; i++)
+        a[i] = i * n;
+    for (i = 0; i < 16; i++)
+        s += a[i];
+    return s;
+}
+
+int leaf_big(int n)
+{
+    char buf[300];
+    memset(buf, n, sizeof buf);
+    return buf[0] + buf[299];
+}
+
+long double ld_conv(double d, int i)
+{
+    long double x = d;
+    return x + i;
+}
+
+int many_args(int a, int b, int c, int d, int e, int f, int g1, int h,
+              struct big s, double x)
+{
+    return a + b + c + d + e + f + g1 + h + s.a + s.b + s.c + s.d + (int)x;
+}
+
+int call_many(int n)
+{
+    struct big s = { 1, 2, 3, 4 };
+    int local = n * 2;
+    return many_args(n, local, 3, 4, 5, 6, add(local, 1), 8, s, 1.5) + local;
+}
+
+int sum_va(int n, ...)
+{
+    va_list ap;
+    int s = 0;
+    va_start(ap, n);
+    while (n--)
+        s += va_arg(ap, int);
+    va_end(ap);
+    return s;
+}
+
+int with_vla(int n)
+{
+    int v[n], i, s = 0;
+    for (i = 0; i < n; i++)
+        v[i] = add(i, 1);
+    for (i = 0; i < n; i++)
+        s += v[i];
+    return s;
+}
+
+int with_alloca(int n)
+{
+    int *p = alloca(n * sizeof(int)), i, s = 0;
+    for (i = 0; i < n; i++)
+        p[i] = add(i, i);
+    for (i = 0; i < n; i++)
+        s += p[i];
+    return s;
+}
+
+int fib(int n)
+{
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+void *frame(void)
+{
+    return __builtin_return_address(0);
+}
+
+int main(void)
+{
+    g = 42;
+    printf("%d %d\n", get(), add(3, 4));
+    printf("%d %d\n", leaf_array(3), leaf_big(2));
+    printf("%d\n", (int)ld_conv(2.5, 3));
+    printf("%d\n", call_many(10));
+    printf("%d\n", sum_va(5, 1, 2, 3, 4, 5));
+    printf("%d %d\n", with_vla(10), with_alloca(10));
+    printf("%d\n", fib(20));
+    printf("%d\n", frame() != 0);
+    return 0;
+}
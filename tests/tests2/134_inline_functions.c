@@ -0,0 +1,85 @@
+/* calls to small static functions expanded in place (-finline-functions) */
+#include <stdio.h>
+
+struct pt { int x, y; };
+static int g = 5;
+
+static int getx(const struct pt *p) { return p->x; }
+static void setx(struct pt *p, int v) { p->x = v; }
+static inline int sq(int a) { return a * a; }
+static int getg(void) { return g; }
+static struct pt mk(int x, int y) { struct pt p; p.x = x; p.y = y; return p; }
+static char low(int c) { return c; }
+static double half(double d) { return d / 2; }
+static int fact(int n) { return n <= 1 ? 1 : n * fact(n - 1); }
+static int twice(int n) { return sq(n) + sq(n); }
+
+static int find(const int *a, int n, int v)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        if (a[i] == v)
+            return i;
+    return -1;
+}
+
+static const char *kind(int c)
+{
+    switch (c) {
+    case 0: return "zero";
+    case 1: break;
+    default: return "many";
+    }
+    return "one";
+}
+
+static void clamp(int *p)
+{
+    if (*p >= 0)
+        return;
+    *p = 0;
+}
+
+static int count;
+static int next_id(void) { return ++count; }
+static int sub(int a, int b) { return a - b; }
+static int label(int a) { if (a) goto out; a = 1; out: return a; }
+
+int main(void)
+{
+    struct pt p = { 1, 2 };
+    int a[] = { 3, 1, 4, 1, 5 }, i, g = 7, r = -3;
+    int (*fp)(int) = fact;
+
+    setx(&p, 42);
+    printf("%d %d %d\n", getx(&p), sq(getx(&p) + 1), getx(&p));
+    /* the caller's local 'g' is invisible in the body */
+    printf("%d %d\n", getg(), g);
+    p = mk(sq(2), sq(3));
+    printf("%d %d %d %d\n", p.x, p.y, mk(7, 8).y, low(0x141));
+    printf("%g %d %d %d\n", half(3), fact(5), fp(4), twice(3));
+
+    for (i = 0; i < 6; i++) {
+        if (find(a, 5, i) < 0)
+            continue;
+        switch (i) {
+        case 1:
+            printf("%d %s %s\n", find(a, 5, i), kind(i), kind(i + 1));
+            break;
+        default:
+            printf("%d %s\n", find(a, 5, i), kind(i * 0));
+        }
+    }
+
+    clamp(&r);
+    clamp(&g);
+    printf("%d %d\n", r, g);
+
+    /* arguments are evaluated once */
+    i = sub(next_id(), 10);
+    printf("%d %d\n", i, count);
+    printf("%d %d %d\n", next_id() > 2 && sq(2) == 4, 1 ? sq(5) : sq(6),
+           ({ int t = sq(3); t + 1; }));
+    printf("%d %d\n", label(0), label(2));
+    return 0;
+}
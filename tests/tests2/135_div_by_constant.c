@@ -0,0 +1,61 @@
+/* division and modulo by constants, done with multiplications */
+#include <stdio.h>
+
+#define CHECK(ty, fmt, D) \
+    do { \
+        volatile ty d = (D); \
+        ty x = v, q = x / (ty)(D), r = x % (ty)(D); \
+        if (q != x / d || r != x % d) \
+            printf("%s " fmt " / %s: " fmt " " fmt "\n", #ty, x, #D, q, r); \
+    } while (0)
+
+#define ALL(D) \
+    CHECK(int, "%d", D); \
+    CHECK(unsigned, "%u", D); \
+    CHECK(long long, "%lld", D); \
+    CHECK(unsigned long long, "%llu", D)
+
+static void test(long long v)
+{
+    ALL(3); ALL(5); ALL(6); ALL(7); ALL(10); ALL(12); ALL(60); ALL(100);
+    ALL(641); ALL(1000); ALL(86400); ALL(1000000007); ALL(0x7fffffff);
+    ALL(-3); ALL(-7); ALL(-10); ALL(-1000);
+    ALL(2); ALL(8); ALL(-8); ALL(1024);
+    CHECK(unsigned, "%u", 0x80000001u);
+    CHECK(unsigned, "%u", 0xfffffffbu);
+    CHECK(int, "%d", (int)0x80000000);
+    CHECK(long long, "%lld", 0x100000001LL);
+    CHECK(long long, "%lld", 0x7fffffffffffffffLL);
+    CHECK(long long, "%lld", -0x7fffffffffffffffLL);
+    CHECK(long long, "%lld", -(1LL << 40));
+    CHECK(unsigned long long, "%llu", 0x8000000000000001ULL);
+    CHECK(unsigned long long, "%llu", 0xfffffffffffffff1ULL);
+}
+
+struct s12 { char c[12]; };
+
+int main(void)
+{
+    static const long long vals[] = {
+        0, 1, -1, 2, -2, 3, -3, 7, 9, 10, -10, 99, 100, 101, -99, -101,
+        12345, -12345, 86399, 86400, -86401, 0x7fffffff, -0x7fffffff,
+        -0x7fffffff - 1, 0xffffffffLL, 0x80000000LL, 0x123456789abcdefLL,
+        -0x123456789abcdefLL, 0x7fffffffffffffffLL, -0x7fffffffffffffffLL,
+        -0x7fffffffffffffffLL - 1,
+    };
+    unsigned long long s = 88172645463325252ULL;
+    struct s12 a[20];
+    int i;
+
+    for (i = 0; i < sizeof vals / sizeof vals[0]; i++)
+        test(vals[i]);
+    for (i = 0; i < 10000; i++) {
+        s ^= s << 13, s ^= s >> 7, s ^= s << 17;
+        test(s);
+        test((long long)s >> (i & 63));
+    }
+    printf("%d %d\n", (int)(&a[17] - &a[3]), (int)(&a[2] - &a[19]));
+    printf("%d %d %u %u\n", -7 / 2, -7 % 2, 4000000000u / 7, 4000000000u % 7);
+    printf("done\n");
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+
+/* struct copies, zero initializers and memcpy/memset with small
+   constant sizes, which may be expanded inline */
+
+static unsigned char src[100], dst[100];
+
+static unsigned sum(unsigned char *p, int n)
+{
+    unsigned s = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        s = s * 31 + p[i];
+    return s;
+}
+
+static void reset(void)
+{
+    int i;
+    for (i = 0; i < 100; i++)
+        src[i] = i * 7 + 1, dst[i] = 0xee;
+}
+
+#define TEST(n) \
+    { \
+        struct s##n { unsigned char a[n]; } x, y = { { n } }, *p; \
+        reset(); \
+        p = memcpy(dst + 3, src + 1, n); \
+        printf("cpy %2d: %08x %d", n, sum(dst, 100), p == (void*)(dst + 3)); \
+        reset(); \
+        p = memset(dst + 1, n + 0x40, n); \
+        printf(" set: %08x %d", sum(dst, 100), p == (void*)(dst + 1)); \
+        memset(dst + 2, 0, n); \
+        printf(" %08x", sum(dst, 100)); \
+        memcpy(&x, src + 2, sizeof x); \
+        *(struct s##n *)(dst + 5) = x; \
+        printf(" struct: %08x %08x\n", sum(dst, 100), sum(y.a, n)); \
+    }
+
+int main(void)
+{
+    int c = 0x1ff;
+
+    TEST(1) TEST(2) TEST(3) TEST(4) TEST(5) TEST(7) TEST(8) TEST(9)
+    TEST(12) TEST(15) TEST(16) TEST(17) TEST(24) TEST(31) TEST(32)
+    TEST(33) TEST(40) TEST(48) TEST(63) TEST(64) TEST(65) TEST(100)
+
+    /* non-constant value, only the low byte is used */
+    reset();
+    memset(dst, c, 23);
+    memset(dst + 30, c - 0x100, 7);
+    printf("var: %08x\n", sum(dst, 100));
+    /* self assignment */
+    {
+        struct { long l[5]; char c; } s = { { 1, 2, 3, 4, 5 }, 6 };
+        s = s;
+        printf("self: %ld %ld %d\n", s.l[0], s.l[4], s.c);
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+
+/* with -foptimize-sibling-calls, 'return f(...)' jumps to f, so the
+   deep recursions below run in constant stack space */
+
+#define DEEP 10000000
+
+long is_odd(long n, long acc);
+
+long is_even(long n, long acc)
+{
+    if (n == 0)
+        return acc;
+    return is_odd(n - 1, acc + 2);
+}
+
+long is_odd(long n, long acc)
+{
+    if (n == 0)
+        return acc;
+    return is_even(n - 1, acc + 1);
+}
+
+/* state machine through function pointers */
+typedef int (*state)(const char *s, int n);
+static int st_a(const char *s, int n);
+static int st_b(const char *s, int n);
+
+static int st_next(const char *s, int n)
+{
+    state next = *s == 'a' ? st_a : st_b;
+    if (!*s)
+        return n;
+    return next(s, n);
+}
+
+static int st_a(const char *s, int n) { return st_next(s + 1, n + 1); }
+static int st_b(const char *s, int n) { return st_next(s + 1, n - 1); }
+
+double dsum(double x, int n)
+{
+    if (n == 0)
+        return x;
+    return dsum(x + 0.5, n - 1);
+}
+
+static int count;
+void vloop(int n)
+{
+    count++;
+    if (n)
+        return vloop(n - 1);
+}
+
+/* not turned into jumps, but must still work */
+int addr_taken(int n)
+{
+    int x = n;
+    int *p = &x;
+    if (n == 0)
+        return 42;
+    return addr_taken(*p - 1) + 0 * *p;
+}
+
+int by_ref(int n, int *r)
+{
+    if (n == 0)
+        return *r;
+    return by_ref(n - 1, r);
+}
+
+int use_ref(int n)
+{
+    int r = n * 3;
+    return by_ref(n, &r);
+}
+
+long many(long a, long b, long c, long d, long e, long f, long g, long h)
+{
+    if (a == 0)
+        return b + c + d + e + f + g + h;
+    return many(a - 1, b + 1, c, d, e, f, g, h);
+}
+
+int narrow(long n)
+{
+    return n > 0 ? narrow(n - 1) : 7;
+}
+
+long widen(int n)
+{
+    return narrow(n);
+}
+
+struct pair { long a, b; };
+struct pair mkpair(long n) { struct pair p; p.a = n; p.b = -n; return p; }
+struct pair getpair(long n) { return mkpair(n + 1); }
+
+int main(void)
+{
+    static char buf[DEEP / 10 + 1];
+    int i;
+
+    printf("%ld\n", is_even(DEEP, 0));
+    for (i = 0; i < DEEP / 10; i++)
+        buf[i] = i % 3 ? 'a' : 'b';
+    printf("%d\n", st_next(buf, 0));
+    printf("%g\n", dsum(0, DEEP));
+    vloop(DEEP);
+    printf("%d\n", count);
+    printf("%d\n", addr_taken(1000));
+    printf("%d\n", use_ref(1000));
+    printf("%ld\n", many(1000, 1, 2, 3, 4, 5, 6, 7));
+    printf("%ld\n", widen(1000));
+    printf("%ld %ld\n", getpair(5).a, getpair(5).b);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+
+/* with -O1, locals whose address is not taken live in registers;
+   stores through pointers, overlapping locals and labels must still
+   be seen */
+
+union u { long l; int i[2]; };
+
+static int sideways(int *p, int v)
+{
+    *p = v;
+    return v;
+}
+
+int main(void)
+{
+    int a, b, c, i, *p, t[3];
+    long l, m;
+    float f, g;
+    union u u;
+    volatile int v;
+
+    a = 5;
+    b = a + 1;
+    c = a * b;
+    printf("%d %d %d\n", a, b, c);
+
+    p = &a;
+    a = 7;
+    *p = 8;
+    b = a;
+    printf("%d %d\n", a, b);
+
+    a = 1;
+    sideways(&a, 3);
+    b = a;
+    printf("%d\n", b);
+
+    u.l = 0x100000002;
+    u.i[0] = 9;
+    l = u.l;
+    printf("%lx %d %d\n", l, u.i[0], u.i[1]);
+
+    l = -1;
+    a = l;
+    m = a;
+    printf("%d %ld\n", a, m);
+
+    m = 0;
+    for (i = 0; i < 10; i++) {
+        m = m + i;
+        a = i;
+    }
+    printf("%ld %d\n", m, a);
+
+    a = 1;
+    i = 0;
+again:
+    b = a;
+    a = a + 1;
+    if (++i < 3)
+        goto again;
+    printf("%d %d\n", a, b);
+
+    a = 2;
+    b = a > 1 ? a : -a;
+    c = a;
+    printf("%d %d\n", b, c);
+
+    v = 4;
+    a = v;
+    v = a + 1;
+    printf("%d %d\n", a, v);
+
+    /* an element of an array reached through a pointer to its start */
+    t[1] = 1;
+    p = t;
+    p[1] = 6;
+    printf("%d\n", t[1]);
+
+    /* the compare of each arm is tested where both arms meet */
+    p = a > 0 ? &b : 0;
+    for (i = 0; i < 2; i++)
+        if (p ? i < b : i > a)
+            printf("%d", i);
+    printf("\n");
+
+    f = 1.5;
+    g = -f;
+    printf("%g %g\n", f, g);
+
+    /* parsed again from the saved tokens, with the same packing */
+    {
+#pragma pack(push, 1)
+        struct packed { char c; int i; } s;
+#pragma pack(pop)
+        struct loose { char c; int i; } z;
+        printf("%d %d\n", (int)sizeof s, (int)sizeof z);
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+/* with -O1, static functions and initialized static data that are
+   never referenced are not emitted, so the missing symbols below are
+   never needed */
+
+int printf(const char *, ...);
+extern void not_defined_anywhere(void);
+extern int not_defined_data;
+
+static void unused(void) { not_defined_anywhere(); }
+static void unused_caller(void) { unused(); }
+
+static int twice(int x) { return x * 2; }
+static int twice_plus_one(int x) { return twice(x) + 1; }
+static int (*fp)(int) = twice;
+
+static void __attribute__((constructor)) ctor(void) { printf("ctor\n"); }
+static void __attribute__((used)) kept(void) { }
+
+static int impl(int x) { return x + 100; }
+int api(int x) __attribute__((alias("impl")));
+
+static int *const unused_table[] = { &not_defined_data, 0 };
+static const char *const names[] = { "zero", "one", "two" };
+static const char *const *const pnames = names;
+static int counter = 40;
+static int __attribute__((used)) kept_data = 1;
+static const int squares[] = { 0, 1, 4, 9 };
+extern const int api_data[4] __attribute__((alias("squares")));
+
+static void defined_later(void);
+
+int main(void)
+{
+    defined_later();
+    printf("%d %d %d\n", twice_plus_one(3), fp(4), api(1));
+    printf("%s %d %d %d\n", pnames[2], ++counter,
+           (int)(sizeof squares / sizeof *squares), api_data[3]);
+    return 0;
+}
+
+static void defined_later(void) { printf("later\n"); }
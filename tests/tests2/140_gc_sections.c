@@ -0,0 +1,55 @@
+/* with -ffunction-sections -fdata-sections -Wl,--gc-sections, the
+   sections of unreferenced functions and variables do not make it
+   into the executable */
+
+#include <stdio.h>
+#include <string.h>
+
+int table[1000] = { 1, 2, 3 };
+int dead_table[1000] = { 4, 5, 6 };
+static int counter;
+
+int used_fn(int x) { return table[x] + counter++; }
+int dead_fn(int x) { return dead_table[x]; }
+static int dead_static(void) { return dead_fn(1); }
+static int (*dead_ptr)(void) = dead_static;
+
+/* look for a section name in the output file */
+static int has_section(const char *file, const char *name)
+{
+    static char buf[1 << 16];
+    char sname[100];
+    size_t n, l;
+    int found = 0;
+    FILE *f = fopen(file, "rb");
+
+    if (!f)
+        return -1;
+    /* build the name at run time so that it is not in .rodata */
+    strcpy(sname, ".");
+    strcat(sname, name);
+    l = strlen(sname) + 1;
+    while (!found && (n = fread(buf, 1, sizeof buf, f)) >= l) {
+        size_t i;
+        for (i = 0; i + l <= n; i++)
+            if (!memcmp(buf + i, sname, l))
+                found = 1;
+        if (n == sizeof buf)
+            fseek(f, 1 - (long)l, SEEK_CUR);
+    }
+    fclose(f);
+    return found;
+}
+
+int main(int argc, char **argv)
+{
+    printf("%d %d\n", used_fn(1), used_fn(2));
+    printf("text.used_fn %d\n", has_section(argv[0], "text.used_fn"));
+    printf("text.dead_fn %d\n", has_section(argv[0], "text.dead_fn"));
+    printf("text.dead_static %d\n", has_section(argv[0], "text.dead_static"));
+    printf("data.table %d\n", has_section(argv[0], "data.table"));
+    printf("data.dead_table %d\n", has_section(argv[0], "data.dead_table"));
+    printf("data.dead_ptr %d\n", has_section(argv[0], "data.dead_ptr"));
+    printf("bss.counter %d\n", has_section(argv[0], "bss.counter"));
+    return 0;
+}
@@ -0,0 +1,51 @@
+/* with -O1 on i386, static functions with up to three int or pointer
+   parameters take them in registers, while their address still leads
+   to an ABI entry point.  Static declarations which are aliases or
+   asm labels, and functions defined after the call, are called the
+   normal way.  (Also run as i386 code by tests/Makefile:private-call-i386,
+   hence no headers.) */
+
+extern int printf(const char *, ...);
+
+static int sum3(int a, int b, int c);
+static int old();
+
+static int one(int a) { return a + 1; }
+static int two(char a, short b) { return a * 1000 + b; }
+static int sum3(int a, int b, int c) { return a * 100 + b * 10 + c; }
+static int old(a, b) int a, b; { return a - b; }
+static int fact(int n) { return n <= 1 ? 1 : n * fact(n - 1); }
+static int deref(int *p, int i, const char *s) { return p[i] + s[0]; }
+static int (*fp3)(int, int, int) = sum3;
+static long long big(int a, int b) { return (long long)a * b; }
+static double half(int a) { return a / 2.0; }
+int ext(int a, int b) { return a - b; }
+int ext_twice(int a) { return 2 * a; }
+static int twice(int a) __attribute__((alias("ext_twice")));
+static int renamed(int a) __asm__("renamed_plus5");
+static int renamed(int a) { return a + 5; }
+static int later(int a, int b);
+
+static int apply(int (*f)(int, int, int), int x)
+{
+    return f(x, x + 1, x + 2);
+}
+
+int main(void)
+{
+    int arr[4] = { 10, 20, 30, 40 }, x = 7, y = 3;
+    int (*f1)(int) = one;
+
+    printf("%d %d %d %d\n", one(41), two(-3, 300), sum3(1, 2, 3), old(10, 4));
+    printf("%d %d\n", fact(10), deref(arr, 2, "A"));
+    printf("%d %d %d\n", fp3(4, 5, 6), f1(99), apply(sum3, 1));
+    printf("%d\n", x + sum3(one(x), two(1, y), fact(y)) * one(y));
+    printf("%d\n", sum3(x > y, x < y, x == 7));
+    printf("%d %d\n", (int)(big(100000, 30000) >> 16), half(9) == 4.5);
+    printf("%d\n", ext(one(1), sum3(x, y, 1)));
+    printf("%d\n", sum3(arr[x & 3], *arr, arr[y]));
+    printf("%d %d %d\n", twice(21), renamed(x), later(x, y));
+    return 0;
+}
+
+static int later(int a, int b) { return a * b; }
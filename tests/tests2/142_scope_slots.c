@@ -0,0 +1,68 @@
+/* with -O1, blocks that follow each other share the stack space of
+   their local variables */
+
+int printf(const char *, ...);
+typedef unsigned long uptr;
+
+struct big { int v[64]; };
+
+static void done(int *p) { printf("cleanup %d\n", *p); }
+
+static struct big make(int n)
+{
+    struct big b;
+    int i;
+    for (i = 0; i < 64; i++)
+        b.v[i] = n + i;
+    return b;
+}
+
+static int sum(int *v, int n)
+{
+    int s = 0;
+    while (n--)
+        s += v[n];
+    return s;
+}
+
+int main(void)
+{
+    uptr pa, pb;
+    int k, total = 0;
+    struct big r;
+
+    {
+        int a[100], i;
+        for (i = 0; i < 100; i++)
+            a[i] = i;
+        pa = (uptr)a;
+        total += sum(a, 100);
+    }
+    {
+        int b[100], i;
+        for (i = 0; i < 100; i++)
+            b[i] = 2 * i;
+        pb = (uptr)b;
+        total += sum(b, 100);
+    }
+    printf("%d %s\n", total, pa == pb ? "shared" : "separate");
+
+    for (k = 0; k < 3; k++) {
+        switch (k) {
+        case 0: { int __attribute__((cleanup(done))) x = 10; total = x; break; }
+        case 1: { char s[50]; s[0] = 'a'; s[1] = 0; total += s[0]; break; }
+        default: { int y[10]; y[9] = 5; total += y[9]; }
+        }
+    }
+    printf("%d\n", total);
+
+    /* the result of a statement expression stays valid */
+    r = ({ struct big t = make(3); t; });
+    {
+        struct big u = make(100);
+        printf("%d %d %d\n", r.v[0], r.v[63], u.v[1]);
+    }
+    k = ({ int z[20]; z[3] = 7; z[3]; }) + ({ int w = 8; w; });
+    printf("%d\n", k);
+    return 0;
+}
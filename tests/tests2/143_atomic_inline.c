@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdatomic.h>
+
+/* __atomic builtins expanded inline, for all sizes and operations */
+
+#define TEST(T, name) \
+static void test_##name(void) \
+{ \
+    static T v; \
+    T e, r, n = 3; \
+    int ok, mo = __ATOMIC_SEQ_CST; \
+    atomic_store_explicit(&v, (T)-2, __ATOMIC_RELAXED); \
+    r = atomic_load_explicit(&v, __ATOMIC_ACQUIRE); \
+    printf("%s: load %lld", #name, (long long)r); \
+    atomic_store_explicit(&v, (T)100, mo); \
+    r = atomic_exchange_explicit(&v, (T)-5, __ATOMIC_ACQ_REL); \
+    printf(" xchg %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_fetch_add(&v, n, __ATOMIC_SEQ_CST); \
+    printf(" fadd %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_add_fetch(&v, n, __ATOMIC_RELAXED); \
+    printf(" addf %lld", (long long)r); \
+    r = __atomic_fetch_sub(&v, 10, mo); \
+    printf(" fsub %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_sub_fetch(&v, n, __ATOMIC_RELEASE); \
+    printf(" subf %lld\n", (long long)r); \
+    atomic_store_explicit(&v, (T)0x5a, __ATOMIC_RELEASE); \
+    r = __atomic_fetch_and(&v, (T)0x0f, mo); \
+    printf("  fand %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_or_fetch(&v, (T)0x70, mo); \
+    printf(" orf %lld", (long long)r); \
+    r = __atomic_fetch_xor(&v, (T)0x11, mo); \
+    printf(" fxor %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_and_fetch(&v, (T)0x3c, mo); \
+    printf(" andf %lld", (long long)r); \
+    r = __atomic_fetch_or(&v, (T)0x01, mo); \
+    printf(" for %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_xor_fetch(&v, (T)0xff, mo); \
+    printf(" xorf %lld", (long long)r); \
+    r = __atomic_fetch_nand(&v, (T)0x0f, mo); \
+    printf(" fnand %lld %lld", (long long)r, (long long)v); \
+    r = __atomic_nand_fetch(&v, (T)0x33, mo); \
+    printf(" nandf %lld\n", (long long)r); \
+    e = 1; \
+    ok = atomic_compare_exchange_strong_explicit(&v, &e, (T)7, \
+             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED); \
+    printf("  cas %d %lld %lld", ok, (long long)e, (long long)v); \
+    ok = atomic_compare_exchange_weak_explicit(&v, &e, (T)-7, mo, mo); \
+    printf(" cas %d %lld %lld", ok, (long long)e, (long long)v); \
+    ok = atomic_compare_exchange_strong_explicit(&v, &e, (T)9, \
+             __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE); \
+    printf(" cas %d %lld %lld\n", ok, (long long)e, (long long)v); \
+}
+
+TEST(signed char, char)
+TEST(unsigned char, uchar)
+TEST(short, short)
+TEST(unsigned short, ushort)
+TEST(int, int)
+TEST(unsigned, uint)
+TEST(long long, llong)
+TEST(unsigned long long, ullong)
+
+/* operands from complex expressions */
+static int a[4];
+
+static int *ptr(int i)
+{
+    return &a[i];
+}
+
+int main(void)
+{
+    int i, j, s = 0;
+    _Bool b = 0;
+
+    test_char();
+    test_uchar();
+    test_short();
+    test_ushort();
+    test_int();
+    test_uint();
+    test_llong();
+    test_ullong();
+
+    for (i = 0; i < 4; i++)
+        j = __atomic_add_fetch(ptr(i), i * 2 + s, __ATOMIC_SEQ_CST),
+        s += j * (__atomic_fetch_sub(&a[3 - i], 1, __ATOMIC_RELAXED) + 1);
+    printf("%d %d %d %d %d\n", s, a[0], a[1], a[2], a[3]);
+    printf("%d", atomic_exchange_explicit(&b, 1, __ATOMIC_SEQ_CST));
+    printf(" %d\n", atomic_load_explicit(&b, __ATOMIC_SEQ_CST));
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+/* _Thread_local and __thread variables: each thread has its own copy,
+   initialized from the initial image */
+
+__thread int counter = 10;
+_Thread_local long table[4] = { 1, 2, 3, 4 };
+_Thread_local char name[16];
+static __thread int hidden;
+static _Alignas(64) __thread char aligned[3];
+extern __thread int later;
+__thread int later = 42;
+
+int *counter_addr(void)
+{
+    return &counter;
+}
+
+static int bump(int n)
+{
+    static __thread int calls;
+    hidden += n;
+    return ++calls;
+}
+
+static void *worker(void *arg)
+{
+    int id = (int)(long)arg, i;
+
+    sprintf(name, "worker%d", id);
+    for (i = 0; i < 1000; ++i) {
+        counter++;
+        bump(id);
+    }
+    table[id & 3] += id;
+    printf("%s: counter %d hidden %d calls %d table %ld later %d\n",
+        name, counter, hidden, bump(0), table[id & 3], later);
+    return counter_addr();
+}
+
+int main(void)
+{
+    pthread_t th;
+    void *addr;
+    int i;
+
+    strcpy(name, "main");
+    counter = 1;
+    later++;
+    bump(5);
+    for (i = 1; i <= 2; ++i) {
+        pthread_create(&th, NULL, worker, (void *)(long)i);
+        pthread_join(th, &addr);
+        printf("own copy: %d\n", addr != (void *)counter_addr());
+    }
+    printf("%s: counter %d hidden %d calls %d table %ld %ld later %d\n",
+        name, counter, hidden, bump(0), table[1], table[2], later);
+    printf("aligned: %d\n", (int)((long)aligned & 63));
+    return 0;
+}
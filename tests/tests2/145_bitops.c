@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+/* __builtin_clz() & co: inline code or libtcc1 calls for variables,
+   folded for constants */
+
+static int ref_clz(unsigned long long x, int bits)
+{
+    int n = 0;
+    while (n < bits && !(x >> (bits - 1 - n) & 1))
+        n++;
+    return n;
+}
+
+static int ref_ctz(unsigned long long x, int bits)
+{
+    int n = 0;
+    while (n < bits && !(x >> n & 1))
+        n++;
+    return n;
+}
+
+static int ref_popcount(unsigned long long x)
+{
+    int n = 0;
+    for (; x; x >>= 1)
+        n += x & 1;
+    return n;
+}
+
+static unsigned long long ref_bswap(unsigned long long x, int bits)
+{
+    unsigned long long r = 0;
+    int i;
+    for (i = 0; i < bits; i += 8)
+        r = r << 8 | (x >> i & 0xff);
+    return r;
+}
+
+static const unsigned long long values[] = {
+    1, 2, 3, 0x80, 0xff, 0x1234, 0x8000, 0x12345678, 0x7fffffff,
+    0x80000000, 0xfffffffe, 0xffffffff, 0x100000000ull,
+    0x123456789abcdef0ull, 0x7fffffffffffffffull, 0x8000000000000000ull,
+    0xffffffffffffffffull
+};
+
+#define N (sizeof values / sizeof values[0])
+
+int main(void)
+{
+    int i, err = 0;
+
+    for (i = 0; i < N; i++) {
+        volatile unsigned long long v = values[i];
+        unsigned long long x = v;
+        unsigned u = x;
+        unsigned short h = x;
+        int s = u;
+        long long sl = x;
+
+#define CHECK(e, r) \
+        if ((e) != (r)) \
+            printf("%s %llx: %llx != %llx\n", #e, values[i], \
+                   (unsigned long long)(e), (unsigned long long)(r)), err++
+
+        if (u) {
+            CHECK(__builtin_clz(u), ref_clz(u, 32));
+            CHECK(__builtin_ctz(u), ref_ctz(u, 32));
+        }
+        CHECK(__builtin_clzll(x), ref_clz(x, 64));
+        CHECK(__builtin_ctzll(x), ref_ctz(x, 64));
+        CHECK(__builtin_ffs(s), u ? ref_ctz(u, 32) + 1 : 0);
+        CHECK(__builtin_ffsll(sl), ref_ctz(x, 64) + 1);
+        CHECK(__builtin_clrsb(s), ref_clz(s < 0 ? ~u : u, 32) - 1);
+        CHECK(__builtin_clrsbll(sl), ref_clz(sl < 0 ? ~x : x, 64) - 1);
+        CHECK(__builtin_popcount(u), ref_popcount(u));
+        CHECK(__builtin_popcountll(x), ref_popcount(x));
+        CHECK(__builtin_parity(u), ref_popcount(u) & 1);
+        CHECK(__builtin_parityll(x), ref_popcount(x) & 1);
+        CHECK(__builtin_bswap16(h), ref_bswap(h, 16));
+        CHECK(__builtin_bswap32(u), ref_bswap(u, 32));
+        CHECK(__builtin_bswap64(x), ref_bswap(x, 64));
+        CHECK(__builtin_clzl(x), ref_clz((unsigned long)x, sizeof(long) * 8));
+        CHECK(__builtin_popcountl(x), ref_popcount((unsigned long)x));
+    }
+    printf("variables: %d errors\n", err);
+
+    /* constant folding, usable in constant expressions */
+    {
+        static const int c[] = {
+            __builtin_clz(1), __builtin_clzll(1), __builtin_ctz(0x100),
+            __builtin_ffs(0), __builtin_ffsll(1ull << 40),
+            __builtin_clrsb(-1), __builtin_clrsb(0), __builtin_clrsb(1),
+            __builtin_clrsbll(-2), __builtin_popcount(-1),
+            __builtin_popcountll(-1), __builtin_parity(7),
+            __builtin_parityll(0x300000000ull),
+        };
+        for (i = 0; i < sizeof c / sizeof c[0]; i++)
+            printf("%d ", c[i]);
+        printf("\n");
+        printf("%x %x %llx\n", __builtin_bswap16(0x1234),
+               __builtin_bswap32(0x12345678),
+               __builtin_bswap64(0x0102030405060708ull));
+        printf("%d %d\n", (int)sizeof __builtin_bswap16(0),
+               (int)sizeof __builtin_bswap64(0));
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+
+/* with -O1, statements that __builtin_expect() says are unlikely to
+   run are compiled out of line */
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+int x = 100;
+
+int sum(int *p, int n)
+{
+    int i, s = 0;
+
+    if (unlikely(!p))
+        return -1;
+    for (i = 0; i < n; i++) {
+        __builtin_prefetch(p + i + 8);
+        __builtin_prefetch(p + i + 8, 1);
+        __builtin_prefetch(p + i + 16, 0, 0);
+        if (unlikely(p[i] < 0)) {
+            s -= 1000;
+            continue;
+        }
+        if (unlikely(p[i] > 50))
+            break;
+        s += p[i];
+    }
+    if (likely(s > 0))
+        s *= 2;
+    else {
+        int s = 5;
+        printf("else %d\n", s);
+    }
+    return s;
+}
+
+int scopes(int v)
+{
+    int r = 0;
+
+    switch (v) {
+    case 1:
+        if (unlikely(v == 1)) {
+            r = x; /* the global x, not the local declared below */
+            break;
+        }
+        r = -1;
+        break;
+    default:
+        r = 7;
+    }
+    int x = 3;
+    if (unlikely(v == 9))
+        goto out;
+    r += x;
+    {
+        if (unlikely(v > 100))
+            return x + 1000;
+        struct s { int a; } z = { 5 };
+        r += z.a;
+    }
+    if (unlikely(v == 4)) {
+        if (unlikely(r == 15))
+            r = 40;
+        r += 2;
+    } else if (likely(v != 5))
+        r += 1;
+    else
+        r = 50;
+out:
+    return r;
+}
+
+int both(int v)
+{
+    if (__builtin_expect(v, 0))
+        return 1;
+    else
+        return 2;
+}
+
+int stmt_expr(int v)
+{
+    return ({ int t = 0; if (__builtin_expect(v, 0)) t = 5; t; });
+}
+
+/* a labeled statement is not moved, its 'else' stays with it */
+int labeled(int v, int w)
+{
+    int r = 0;
+
+    if (__builtin_expect(v, 0))
+    L: if (w)
+            r = 1;
+        else
+            r = 2;
+    else
+        r = 10;
+    if (r == 10 && w < 5) {
+        w += 5;
+        goto L;
+    }
+    return r + v * 10 + w;
+}
+
+int main(void)
+{
+    int a[64], i;
+
+    for (i = 0; i < 64; i++)
+        a[i] = i == 5 ? -1 : i;
+    printf("%d %d %d\n", sum(a, 40), sum(0, 3), sum(a, 6));
+    for (i = 0; i < 10; i++)
+        printf("%d ", scopes(i));
+    printf("%d\n", scopes(200));
+    printf("%d %d %d %d\n", both(0), both(3), stmt_expr(0), stmt_expr(1));
+    printf("%d %d %d %d\n",
+        labeled(0, 0), labeled(0, 1), labeled(1, 0), labeled(1, 1));
+    return 0;
+}
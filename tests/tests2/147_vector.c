@@ -0,0 +1,64 @@
+#include <stdio.h>
+#undef __attribute__
+
+/* GCC vector extensions: element-wise operators on vector_size() types */
+
+typedef int v4si __attribute__((vector_size(16)));
+typedef float v4sf __attribute__((vector_size(16)));
+typedef double v2df __attribute__((vector_size(16)));
+typedef short v8hi __attribute__((vector_size(16)));
+typedef unsigned char v16qu __attribute__((vector_size(16)));
+typedef long long v2di __attribute__((vector_size(16)));
+typedef int v2si __attribute__((vector_size(8)));
+typedef int v8si __attribute__((vector_size(32)));
+
+v4si add(v4si a, v4si b) { return a + b; }
+v4sf fma4(v4sf a, v4sf b, v4sf c) { return a * b + c; }
+v2df many(v2df a, v2df b, v2df c, v2df d, v2df e, v2df f, v2df g, v2df h, v2df i, v2df j)
+{ return a + b + c + d + e + f + g + h + i + j; }
+v2si add2(v2si a, v2si b) { return a + b; }
+v8si add8(v8si a, v8si b) { return a + b; }
+v4si gv = {1, 2, 3, 4};
+struct S { int x; v4si v; } gs = { 5, {9, 8, 7, 6} };
+
+int main(void)
+{
+    v4si a = {1, 2, 3, 4}, b = {10, 20, 30, 40}, c, *p = &a;
+    v4sf fa = {1.5f, 2.5f, -3.0f, 4.0f}, fb = {2, 2, 2, 2}, fc;
+    v2df da = {1.0, 2.0}, dr;
+    v8hi h = {1,2,3,4,5,6,7,8};
+    v16qu q = {250,251,252,253,254,255,0,1,2,3,4,5,6,7,8,9};
+    v2di l = {1LL << 40, -5};
+    v2si s2 = {3, 4};
+    v8si s8 = {1,2,3,4,5,6,7,8};
+    int i;
+
+    c = add(a, b);
+    printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = a - b; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = a * b; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = b / a; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = b % 7; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = a << 2; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = (a & 1) | (b ^ 3); printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = ~a; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = -a; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = a < 3; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c = 100 - *p; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    c += gv; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    gs.v *= 2; printf("%d %d %d %d %d\n", gs.x, gs.v[0], gs.v[1], gs.v[2], gs.v[3]);
+    fc = fma4(fa, fb, fa); printf("%g %g %g %g\n", fc[0], fc[1], fc[2], fc[3]);
+    fc = fa / fb; printf("%g %g %g %g\n", fc[0], fc[1], fc[2], fc[3]);
+    fc = -fa; printf("%g %g %g %g\n", fc[0], fc[1], fc[2], fc[3]);
+    c = fa > fb; printf("%d %d %d %d\n", c[0], c[1], c[2], c[3]);
+    dr = many(da, da, da, da, da, da, da, da, da, da); printf("%g %g\n", dr[0], dr[1]);
+    h = h * h - 1; for (i = 0; i < 8; i++) printf("%d ", h[i]); printf("\n");
+    q = q + 10; for (i = 0; i < 16; i++) printf("%d ", q[i]); printf("\n");
+    l = l + l; printf("%lld %lld\n", l[0], l[1]);
+    s2 = add2(s2, s2); printf("%d %d\n", s2[0], s2[1]);
+    s8 = add8(s8, s8 * 10); for (i = 0; i < 8; i++) printf("%d ", s8[i]); printf("\n");
+    a[2] = 42; printf("%d %d\n", a[2], (*p)[2]);
+    c = (v4si)fa; printf("%x\n", c[0]);
+    printf("%d %d %d\n", (int)sizeof(v4si), (int)sizeof(v2si), (int)_Alignof(v4si));
+    return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <string.h>
+
+/* equal string literals share storage */
+
+const char *g = "shared";
+static const char *tab[] = { "one", "two", "one" };
+
+const char *f(void)
+{
+    return "shared";
+}
+
+int main(void)
+{
+    const char *a = "shared", *b = "sha" "red";
+    char copy[] = "shared";
+    const int *w = (const int *)L"one";
+
+    printf("%d %d %d\n", a == g, a == b, a == f());
+    printf("%d %d\n", tab[0] == tab[2], tab[0] == tab[1]);
+    /* arrays initialized from a literal are still copies */
+    copy[0] = 'S';
+    printf("%s %s %d\n", copy, a, copy != a);
+    /* differently typed literals do not mix */
+    printf("%d %d\n", (void *)w != (void *)tab[0], w[0] == 'o');
+    printf("%d %d\n", (int)sizeof "shared", strcmp(g, b));
+    return 0;
+}
@@ -0,0 +1,34 @@
+/* with -ffunction-sections -Wl,--icf=all, functions with the same code
+   and equivalent relocations share one copy */
+
+#include <stdio.h>
+
+int g = 10;
+
+int add1(int x) { return x + g; }
+int add2(int x) { return x + g; }
+static int add3(int x) { return x + g; }
+int sub1(int x) { return x - g; }
+
+/* equal once add1 and add2 are folded */
+int twice1(int x) { return add1(add1(x)); }
+int twice2(int x) { return add2(add2(x)); }
+/* calls another function */
+int twice3(int x) { return sub1(sub1(x)); }
+
+/* recursive */
+int fact1(int n) { return n > 1 ? n * fact1(n - 1) : 1; }
+int fact2(int n) { return n > 1 ? n * fact2(n - 1) : 1; }
+
+int (*fp)(int) = add3;
+
+int main(void)
+{
+    printf("%d %d %d %d\n", add1(1), add2(2), fp(3), sub1(4));
+    printf("%d %d %d\n", twice1(1), twice2(2), twice3(3));
+    printf("%d %d\n", fact1(5), fact2(6));
+    printf("add %d %d sub %d\n", add1 == add2, add1 == fp, add1 == sub1);
+    printf("twice %d %d\n", twice1 == twice2, twice1 == twice3);
+    printf("fact %d\n", fact1 == fact2);
+    return 0;
+}
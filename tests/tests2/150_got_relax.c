@@ -0,0 +1,34 @@
+/* accesses to global symbols defined in the output go through
+   'lea foo(%rip)' instead of a GOT entry */
+
+#include <stdio.h>
+
+int gv = 5;
+int arr[4] = { 1, 2, 3, 4 };
+struct { int a, b; } st = { 7, 8 };
+const char msg[] = "relaxed";
+
+int *addr_gv(void) { return &gv; }
+int get_arr(int i) { return arr[i]; }
+int get_b(void) { return st.b; }
+
+/* whether the code of 'f' loads an address from the GOT */
+static int uses_got(void *f)
+{
+    unsigned char *p = f;
+    int i;
+    for (i = 0; i < 24; i++)
+        if ((p[i] & 0xf0) == 0x40 && p[i + 1] == 0x8b && (p[i + 2] & 0xc7) == 5)
+            return 1;
+    return 0;
+}
+
+int main(void)
+{
+    *addr_gv() += 1;
+    printf("%d %d %d %d\n", gv, get_arr(2), get_b(), &arr[3] - arr);
+    printf("%s %d\n", msg, addr_gv() == &gv);
+    printf("got %d %d %d\n", uses_got(addr_gv), uses_got(get_arr),
+           uses_got(get_b));
+    return 0;
+}
@@ -0,0 +1,14 @@
+int x;
+int y = 42; /* initialized data wins over the tentative definition */
+int z[4];
+
+void set_in_unit2(int v)
+{
+    x = v;
+    z[2] = v + 1;
+}
+
+int get_in_unit2(void)
+{
+    return x;
+}
@@ -0,0 +1,18 @@
+/* tentative definitions in two files, with -fdata-sections */
+#include <stdio.h>
+
+int x;
+int y;
+int z[4];
+
+void set_in_unit2(int v);
+int get_in_unit2(void);
+
+int main(void)
+{
+    x = 3;
+    printf("x = %d, y = %d\n", get_in_unit2(), y);
+    set_in_unit2(7);
+    printf("x = %d, z[2] = %d\n", x, z[2]);
+    return 0;
+}
@@ -112,8 +112,51 @@ enum {
    at caller side (for interfacing with non-TCC compilers) */
 #define PROMOTE_RET
 
+/* define if gen_opi() implements TOK_UMULH and TOK_SMULH */
+#define HAVE_MULH
+
 #define TCC_TARGET_NATIVE_STRUCT_COPY
 ST_FUNC void gen_struct_copy(int size);
+ST_FUNC void gen_memset(int size);
+#define SMALL_COPY_MAX 64 /* copies/sets up to this size are unrolled */
+
+/* __atomic_xxx() builtins of this size are expanded inline */
+#define TCC_TARGET_NATIVE_ATOMIC(size) 1
+ST_FUNC int gen_atomic(int atok, int size, int memorder);
+
+/* __builtin_clz() and friends expanded inline: popcount and parity
+   need -mpopcnt, the others are done with bsf/bsr if needed */
+#define TCC_TARGET_BITOP(op) \
+    (tcc_state->mpopcnt || ((op) != TOK_builtin_popcount \
+                            && (op) != TOK_builtin_parity))
+ST_FUNC int gen_bitop(int op, int size);
+
+/* __builtin_prefetch() emits prefetchnta/t2/t1/t0 */
+#define TCC_TARGET_PREFETCH
+ST_FUNC void gen_prefetch(int locality);
+
+/* vector_size() types are loaded into xmm registers and operated on
+   with SSE2 where possible */
+#define TCC_TARGET_VECTOR
+ST_FUNC int gen_opv(int op, int t);
+
+#if !defined TCC_TARGET_PE && !defined TCC_TARGET_MACHO
+/* thread-local variables, addressed from %fs */
+#define TCC_TARGET_TLS
+ST_FUNC void gen_tls_addr(int model);
+
+/* -O1 compiles functions through tccir.c */
+#define TCC_TARGET_IR
+#define IR_REG_FLOAT(r) ((r) >= TREG_XMM0)
+#endif
+
+#ifndef TCC_TARGET_PE
+/* gfunc_tail_call() is a gfunc_call() that gfunc_tail_return() may
+   turn into a jump */
+#define TCC_TARGET_TAIL_CALL
+ST_FUNC void gfunc_tail_call(int nb_args);
+ST_FUNC void gfunc_tail_return(void);
+#endif
 
 /******************************************************/
 #else /* ! TARGET_DEFS_ONLY */
@@ -161,6 +204,22 @@ ST_DATA const int reg_classes[NB_REGS] = {
 static unsigned long func_sub_sp_offset;
 static int func_ret_sub;
 
+/* frame layout of the current function, decided in gfunc_epilog */
+static int func_leaf;      /* no calls, pushes or scratch below %rsp */
+static int func_need_fp;   /* %rsp moves dynamically, keep %rbp frame */
+static int func_uses_fp;   /* some code refers to the %rbp frame */
+static int func_nofp;      /* -fomit-frame-pointer: patchable local refs */
+static int func_sp_depth;  /* bytes pushed by gfunc_call so far */
+static int *func_local_refs, func_nb_local_refs;
+static int func_frame_escapes; /* the address of a local was taken */
+static int func_tail_call;  /* next call may become a tail jump */
+static int func_tail_slot; /* last call, if it may */
+#ifndef TCC_TARGET_PE
+static int func_tail_end;
+static int func_fixed_entry; /* entry point must stay at func_ind */
+static int *func_tail_sites, func_nb_tail_sites;
+#endif
+
 #if defined(CONFIG_TCC_BCHECK)
 static addr_t func_bound_offset;
 static unsigned long func_bound_ind;
@@ -177,6 +236,12 @@ ST_FUNC void g(int c)
     int ind1;
     if (nocode_wanted)
         return;
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        ir_failed = 1; /* no machine code while recording */
+        return;
+    }
+#endif
     ind1 = ind + 1;
     if (ind1 > cur_text_section->data_allocated)
         section_realloc(cur_text_section, ind1);
@@ -232,6 +297,12 @@ static void orex(int ll, int r, int r2, int b)
 /* output a symbol and patch all calls to it */
 ST_FUNC void gsym_addr(int t, int a)
 {
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        ir_gsym_addr(t, a);
+        return;
+    }
+#endif
     while (t) {
         unsigned char *ptr = cur_text_section->data + t;
         uint32_t n = read32le(ptr); /* next value */
@@ -296,7 +367,13 @@ static void gen_gotpcrel(int r, Sym *sym, int c)
         cur_text_section->data[ind-1]
         );
 #endif
+#ifdef TCC_TARGET_MACHO
     greloca(cur_text_section, sym, ind, R_X86_64_GOTPCREL, -4);
+#else
+    /* always 'mov foo@GOTPCREL(%rip),%r' with REX.W, which the linker
+       may turn into a 'lea' */
+    greloca(cur_text_section, sym, ind, R_X86_64_REX_GOTPCRELX, -4);
+#endif
     gen_le32(0);
     if (c) {
         /* we use add c, %xxx for displacement */
@@ -306,6 +383,30 @@ static void gen_gotpcrel(int r, Sym *sym, int c)
     }
 }
 
+/* output sib + disp32 for a frame reference, to be rebased on %rsp
+   or %rbp when the frame layout is known */
+static void gen_local_ref(int c)
+{
+    if (!nocode_wanted) {
+        if ((func_nb_local_refs & 63) == 0)
+            func_local_refs = tcc_realloc(func_local_refs,
+                (func_nb_local_refs + 64) * 2 * sizeof (int));
+        func_local_refs[2 * func_nb_local_refs] = ind;
+        func_local_refs[2 * func_nb_local_refs + 1] = func_sp_depth;
+        func_nb_local_refs++;
+    }
+    g(0x25);
+    gen_le32(c);
+}
+
+/* the current function must keep its %rbp frame and must not
+   use the red zone (dynamic %rsp, inline asm, ...) */
+ST_FUNC void gen_need_frame(void)
+{
+    func_leaf = 0;
+    func_need_fp = 1;
+}
+
 static void gen_modrm_impl(int op_reg, int r, Sym *sym, int c, int is_got)
 {
     op_reg = REG_VALUE(op_reg) << 3;
@@ -324,6 +425,14 @@ static void gen_modrm_impl(int op_reg, int r, Sym *sym, int c, int is_got)
 	    }
 	}
     } else if ((r & VT_VALMASK) == VT_LOCAL) {
+        if (!nocode_wanted)
+            func_uses_fp = 1;
+        if (func_nofp) {
+            /* disp32(%rsp/%rbp) with sib, fixed by gfunc_epilog */
+            o(0x84 | op_reg);
+            gen_local_ref(c);
+            return;
+        }
         /* currently, we use only ebp as base */
         if (c == (char)c) {
             /* short reference */
@@ -361,15 +470,228 @@ static void gen_modrm64(int opcode, int op_reg, int r, Sym *sym, int c)
     gen_modrm_impl(op_reg, r, sym, c, is_got);
 }
 
+#ifdef TCC_TARGET_IR
+/* -O1: while a function is recorded, the code generators below append
+   IRInsn's (see tccir.c) instead of machine code.  The ir_xxx() helpers
+   return 1 if they did, or 0 after setting 'ir_failed' for what they
+   cannot express.  The usual code then runs without output (g() does
+   nothing) and the function is compiled again without IR. */
+
+static int ir_give_up(void)
+{
+    ir_failed = 1;
+    return 0;
+}
+
+/* the ELF symbol of 'sym', which may be gone when the IR is lowered */
+static int ir_sym(Sym *sym)
+{
+    if (!sym->c)
+        put_extern_sym(sym, NULL, 0, 0);
+    return sym->c;
+}
+
+/* IR type of a value of 'type' in a general ('fl' = 0) or an xmm
+   register, or -1 */
+static int ir_type(CType *type, int fl)
+{
+    int t, align, size, bt = type->t & VT_BTYPE;
+
+    switch (bt) {
+    case VT_BOOL:
+        t = IRT_U8;
+        break;
+    case VT_BYTE:
+        t = type->t & VT_UNSIGNED ? IRT_U8 : IRT_S8;
+        break;
+    case VT_SHORT:
+        t = type->t & VT_UNSIGNED ? IRT_U16 : IRT_S16;
+        break;
+    case VT_INT:
+        t = IRT_I32;
+        break;
+    case VT_LLONG: case VT_PTR: case VT_FUNC:
+        t = IRT_I64;
+        break;
+    case VT_FLOAT:
+        t = IRT_F32;
+        break;
+    case VT_DOUBLE:
+        t = IRT_F64;
+        break;
+    case VT_STRUCT:
+        /* small structs and vectors, like load() does */
+        size = type_size(type, &align);
+        if (fl)
+            return size == 4 ? IRT_F32 : size == 8 ? IRT_F64 : -1;
+        return size == 1 ? IRT_S8 : size == 2 ? IRT_S16
+            : size == 4 ? IRT_I32 : size == 8 ? IRT_I64 : -1;
+    default:
+        return -1;
+    }
+    return IRT_FLOAT(t) == fl ? t : -1;
+}
+
+/* the address of lvalue 'sv' as IRA_xxx, with base register in '*pa'
+   and displacement in '*pc', or -1 */
+static int ir_addr(SValue *sv, int *pa, int64_t *pc)
+{
+    int v = sv->r & VT_VALMASK, r;
+    IRInsn *i;
+
+    *pa = -1;
+    *pc = sv->c.i;
+    if (v == VT_CONST && (sv->r & VT_SYM)) {
+        if ((int)sv->c.i != sv->c.i)
+            return -1;
+        if (sv->sym->type.t & VT_STATIC)
+            return IRA_SYM;
+        r = ir_vreg(0);
+        ir_emit(IR_GOT, IRT_I64, r, -1, -1)->sym = ir_sym(sv->sym);
+        *pa = r;
+        return IRA_REG;
+    }
+    if (v == VT_CONST) {
+        if ((int)sv->c.i == sv->c.i)
+            return IRA_ABS;
+        r = ir_vreg(0);
+        ir_emit(IR_LI, IRT_I64, r, -1, -1)->c = sv->c.i;
+    } else if (v == VT_LOCAL) {
+        return IRA_FRAME;
+    } else if (v == VT_LLOCAL) {
+        r = ir_vreg(0);
+        i = ir_emit(IR_LOAD, IRT_I64, r, -1, -1);
+        i->am = IRA_FRAME, i->c = sv->c.i;
+    } else if (v < TREG_XMM0) {
+        r = v;
+    } else {
+        return -1;
+    }
+    *pa = r, *pc = 0;
+    return IRA_REG;
+}
+
+/* load() */
+static int ir_load(int r, SValue *sv)
+{
+    int fr = sv->r, v = fr & VT_VALMASK, fl = r >= TREG_XMM0;
+    int t, a, am;
+    int64_t c;
+    IRInsn *i;
+
+    if (r >= TREG_ST0)
+        return ir_give_up();
+    if (fr & VT_LVAL) {
+        if ((sv->type.t & VT_BTYPE) == VT_VOID)
+            return 1; /* zero size struct */
+        t = ir_type(&sv->type, fl);
+        if (t < 0 || (am = ir_addr(sv, &a, &c)) < 0)
+            return ir_give_up();
+        i = ir_emit(IR_LOAD, t, r, a, -1);
+        i->am = am, i->c = c;
+        if (am == IRA_SYM)
+            i->sym = ir_sym(sv->sym);
+        if (sv->type.t & VT_VOLATILE)
+            i->f = IRF_VOL;
+    } else if (v < VT_CONST) {
+        if (v == r)
+            return 1;
+        if (v >= TREG_ST0 || (v >= TREG_XMM0) != fl)
+            return ir_give_up();
+        if (fl) {
+            t = sv->type.t & VT_BTYPE;
+            if (t != VT_FLOAT && t != VT_DOUBLE)
+                return ir_give_up();
+            t = t == VT_FLOAT ? IRT_F32 : IRT_F64;
+        } else {
+            t = is64_type(sv->type.t) ? IRT_I64 : IRT_I32;
+        }
+        ir_emit(IR_MOV, t, r, v, -1);
+    } else if (fl) {
+        return ir_give_up();
+    } else if (v == VT_CONST) {
+        c = sv->c.i;
+        if (!(fr & VT_SYM)) {
+            ir_emit(IR_LI, IRT_I64, r, -1, -1)->c =
+                is64_type(sv->type.t) ? c : (uint32_t)c;
+        } else if ((int)c != c) {
+            return ir_give_up();
+        } else if (sv->sym->type.t & VT_STATIC) {
+            i = ir_emit(IR_LEA, IRT_I64, r, -1, -1);
+            i->am = IRA_SYM, i->c = c, i->sym = ir_sym(sv->sym);
+        } else {
+            ir_emit(IR_GOT, IRT_I64, r, -1, -1)->sym = ir_sym(sv->sym);
+            if (c) {
+                i = ir_emit(IR_LEA, IRT_I64, r, r, -1);
+                i->am = IRA_REG, i->c = c;
+            }
+        }
+    } else if (v == VT_LOCAL) {
+        i = ir_emit(IR_LEA, IRT_I64, r, -1, -1);
+        i->am = IRA_FRAME, i->c = sv->c.i;
+        ir_escape(sv->c.i);
+    } else if (v == VT_CMP) {
+        c = sv->c.i;
+        if (c & 0x100)
+            c |= vtop->cmp_r << 16;
+        ir_emit(IR_SETCC, IRT_I32, r, -1, -1)->cc = c;
+    } else if (v == VT_JMP || v == VT_JMPI) {
+        t = v & 1;
+        ir_emit(IR_LI, IRT_I64, r, -1, -1)->c = t;
+        a = gjmp(0);
+        gsym(sv->c.i);
+        ir_emit(IR_LI, IRT_I64, r, -1, -1)->c = t ^ 1;
+        gsym_addr(a, ind);
+    } else {
+        return ir_give_up();
+    }
+    return 1;
+}
+
+/* store() */
+static int ir_store(int r, SValue *sv)
+{
+    int v = sv->r & VT_VALMASK, bt = sv->type.t & VT_BTYPE;
+    int t, a, am;
+    int64_t c;
+    IRInsn *i;
+
+    t = ir_type(&sv->type, r >= TREG_XMM0);
+    if (r >= TREG_ST0 || bt == VT_STRUCT || t < 0)
+        return ir_give_up();
+    if (v == VT_CONST || v == VT_LOCAL || (sv->r & VT_LVAL)) {
+        if ((am = ir_addr(sv, &a, &c)) < 0)
+            return ir_give_up();
+        i = ir_emit(IR_STORE, t, -1, a, r);
+        i->am = am, i->c = c;
+        if (am == IRA_SYM)
+            i->sym = ir_sym(sv->sym);
+        if (sv->type.t & VT_VOLATILE)
+            i->f = IRF_VOL;
+    } else if (v != r) {
+        if (v >= TREG_XMM0 || r >= TREG_XMM0)
+            return ir_give_up();
+        ir_emit(IR_MOV, t == IRT_I64 ? IRT_I64 : IRT_I32, v, r, -1);
+    }
+    return 1;
+}
+#endif
 
 /* load 'r' from value 'sv' */
 void load(int r, SValue *sv)
 {
     int v, t, ft, fc, fr;
     SValue v1;
-
 #ifdef TCC_TARGET_PE
     SValue v2;
+#endif
+
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_load(r, sv))
+        return;
+#endif
+
+#ifdef TCC_TARGET_PE
     sv = pe_getimport(sv, &v2);
 #endif
 
@@ -387,7 +709,7 @@ void load(int r, SValue *sv)
         (fr & VT_LVAL) && !(sv->sym->type.t & VT_STATIC)) {
         /* use the result register as a temporal register */
         int tr = r | TREG_MEM;
-        if (is_float(ft)) {
+        if (is_float(ft) || r >= TREG_XMM0) {
             /* we cannot use float registers as a temporal register */
             tr = get_reg(RC_INT) | TREG_MEM;
         }
@@ -429,8 +751,16 @@ void load(int r, SValue *sv)
 	   XXX maybe move to generic operand handling, but should
 	   occur only with asm, so tccasm.c might also be a better place */
 	if ((ft & VT_BTYPE) == VT_STRUCT) {
-	    int align;
-	    switch (type_size(&sv->type, &align)) {
+	    int align, size = type_size(&sv->type, &align);
+            if (r >= TREG_XMM0 && r <= TREG_XMM7) {
+                /* vector */
+                if (size == 4)
+                    ft = VT_FLOAT;
+                else if (size == 8)
+                    ft = VT_DOUBLE;
+                else if (size != 16)
+                    tcc_error("invalid aggregate type for register load");
+            } else switch (size) {
 		case 1: ft = VT_BYTE; break;
 		case 2: ft = VT_SHORT; break;
 		case 4: ft = VT_INT; break;
@@ -440,7 +770,10 @@ void load(int r, SValue *sv)
 		    break;
 	    }
 	}
-        if ((ft & VT_BTYPE) == VT_FLOAT) {
+        if ((ft & VT_BTYPE) == VT_STRUCT) {
+            b = 0x6f0ff3; /* movdqu */
+            r = REG_VALUE(r);
+        } else if ((ft & VT_BTYPE) == VT_FLOAT) {
             b = 0x6e0f66;
             r = REG_VALUE(r); /* movd */
         } else if ((ft & VT_BTYPE) == VT_DOUBLE) {
@@ -500,6 +833,7 @@ void load(int r, SValue *sv)
                 gen_le32(fc);
             }
         } else if (v == VT_LOCAL) {
+            func_frame_escapes = 1;
             orex(1,0,r,0x8d); /* lea xxx(%ebp), r */
             gen_modrm(r, VT_LOCAL, sv->sym, fc);
         } else if (v == VT_CMP) {
@@ -531,6 +865,7 @@ void load(int r, SValue *sv)
             if ((r >= TREG_XMM0) && (r <= TREG_XMM7)) {
                 if (v == TREG_ST0) {
                     /* gen_cvt_ftof(VT_DOUBLE); */
+                    func_leaf = 0; /* scratch below %rsp */
                     o(0xf0245cdd); /* fstpl -0x10(%rsp) */
                     /* movsd -0x10(%rsp),%xmmN */
                     o(0x100ff2);
@@ -540,6 +875,8 @@ void load(int r, SValue *sv)
                     assert((v >= TREG_XMM0) && (v <= TREG_XMM7));
                     if ((ft & VT_BTYPE) == VT_FLOAT) {
                         o(0x100ff3);
+                    } else if ((ft & VT_BTYPE) == VT_STRUCT) {
+                        o(0x280f); /* movaps */
                     } else {
                         assert((ft & VT_BTYPE) == VT_DOUBLE);
                         o(0x100ff2);
@@ -549,6 +886,7 @@ void load(int r, SValue *sv)
             } else if (r == TREG_ST0) {
                 assert((v >= TREG_XMM0) && (v <= TREG_XMM7));
                 /* gen_cvt_ftof(VT_LDOUBLE); */
+                func_leaf = 0; /* scratch below %rsp */
                 /* movsd %xmmN,-0x10(%rsp) */
                 o(0x110ff2);
                 o(0x44 + REG_VALUE(r)*8); /* %xmmN */
@@ -569,9 +907,16 @@ void store(int r, SValue *v)
     int op64 = 0;
     /* store the REX prefix in this variable when PIC is enabled */
     int pic = 0;
-
 #ifdef TCC_TARGET_PE
     SValue v2;
+#endif
+
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_store(r, v))
+        return;
+#endif
+
+#ifdef TCC_TARGET_PE
     v = pe_getimport(v, &v2);
 #endif
 
@@ -611,6 +956,13 @@ void store(int r, SValue *v)
         o(pic);
         o(0xdb); /* fstpt */
         r = 7;
+    } else if (bt == VT_STRUCT && r >= TREG_XMM0) {
+        /* vector */
+        int align, size = type_size(&v->type, &align);
+        o(size == 16 ? 0xf3 : 0x66);
+        o(pic);
+        o(size == 16 ? 0x7f0f : size == 8 ? 0xd60f : 0x7e0f);
+        r = REG_VALUE(r);
     } else {
         if (bt == VT_SHORT)
             o(0x66);
@@ -643,19 +995,42 @@ void store(int r, SValue *v)
     }
 }
 
+/* room for the frame teardown if the call is turned into a jump:
+   'leave' or 'add $xx,%rsp' */
+static void gen_tail_slot(void)
+{
+    if (func_tail_call) {
+        func_tail_call = 0;
+        func_tail_slot = ind;
+        if (func_nofp)
+            o(0x801f0f), gen_le32(0); /* nopl 0(%rax) */
+        else
+            g(0x90);
+    }
+}
+
 /* 'is_jmp' is '1' if it is a jump */
 static void gcall_or_jmp(int is_jmp)
 {
     int r;
+    if (!is_jmp) {
+        func_leaf = 0;
+        /* alloca() moves %rsp under our feet */
+        if ((vtop->r & VT_SYM) && (vtop->sym->v == TOK_alloca
+                                   || vtop->sym->asm_label == TOK_alloca))
+            func_need_fp = 1;
+    }
     if ((vtop->r & (VT_VALMASK | VT_LVAL)) == VT_CONST &&
 	((vtop->r & VT_SYM) && (vtop->c.i-4) == (int)(vtop->c.i-4))) {
         /* constant symbolic case -> simple relocation */
+        gen_tail_slot();
         greloca(cur_text_section, vtop->sym, ind + 1, R_X86_64_PLT32, (int)(vtop->c.i-4));
         oad(0xe8 + is_jmp, 0); /* call/jmp im */
     } else {
         /* otherwise, indirect call */
         r = TREG_R11;
         load(r, vtop);
+        gen_tail_slot();
         o(0x41); /* REX */
         o(0xff); /* call/jmp *r */
         o(0xd0 + REG_VALUE(r) + (is_jmp << 4));
@@ -679,6 +1054,7 @@ static void gen_bounds_call(int v)
 
 static void gen_bounds_prolog(void)
 {
+    gen_need_frame();
     /* leave some room for bound checking code */
     func_bound_offset = lbounds_section->data_offset;
     func_bound_ind = ind;
@@ -1119,6 +1495,15 @@ static X86_64_Mode classify_x86_64_inner(CType *ty)
     case VT_LDOUBLE: return x86_64_mode_x87;
       
     case VT_STRUCT:
+        if (IS_VECTOR(ty->t)) {
+            /* as gcc does: vectors of one float or double go in memory
+               and vectors of up to 4 bytes in general registers */
+            CType *et = &ty->ref->next->type.ref->type;
+            int align, size = type_size(ty, &align);
+            if (is_float(et->t) && type_size(et, &align) == size)
+                return x86_64_mode_memory;
+            return size <= 4 ? x86_64_mode_integer : x86_64_mode_sse;
+        }
         f = ty->ref;
 
         mode = x86_64_mode_none;
@@ -1178,7 +1563,11 @@ static X86_64_Mode classify_x86_64_arg(CType *ty, CType *ret, int *psize, int *p
                 break;
 
             case x86_64_mode_sse:
-                if (size > 8) {
+                if (IS_VECTOR(ty->t) && size > 8) {
+                    /* passed whole in one register */
+                    *reg_count = 1;
+                    ret_t = ty->t;
+                } else if (size > 8) {
                     *reg_count = 2;
                     ret_t = VT_QFLOAT;
                 } else {
@@ -1192,7 +1581,7 @@ static X86_64_Mode classify_x86_64_arg(CType *ty, CType *ret, int *psize, int *p
     }
     
     if (ret) {
-        ret->ref = NULL;
+        ret->ref = IS_VECTOR(ret_t) ? ty->ref : NULL;
         ret->t = ret_t;
     }
     
@@ -1239,125 +1628,1084 @@ static int arg_prepare_reg(int idx) {
       return idx >= 0 && idx < REGN ? arg_regs[idx] : 0;
 }
 
-/* Generate function call. The function address is pushed first, then
-   all the parameters in call order. This functions pops all the
-   parameters and the function address. */
-void gfunc_call(int nb_args)
+#ifdef TCC_TARGET_IR
+/* gfunc_call() with arguments and a value that fit in single registers */
+static int ir_call(int nb_args, int tail)
 {
     X86_64_Mode mode;
-    CType type;
-    int size, align, r, args_size, stack_adjust, i, reg_count, k;
-    int nb_reg_args = 0;
-    int nb_sse_args = 0;
-    int sse_reg, gen_reg;
-    char *onstack = tcc_malloc((nb_args + 1) * sizeof (char));
-
-#ifdef CONFIG_TCC_BCHECK
-    if (tcc_state->do_bounds_check)
-        gbound_args(nb_args);
-#endif
+    CType *rt;
+    Sym *sym = NULL;
+    const char *name;
+    int size, align, reg_count, i, j, r, fl, d, t, fr, k, nr, ns, nstk;
+    int *vr, *w;
+    IRInsn *c;
+
+    for (i = 0; i < nb_args; ++i) {
+        t = vtop[-i].type.t & VT_BTYPE;
+        mode = classify_x86_64_arg(&vtop[-i].type, NULL, &size, &align,
+                                   &reg_count);
+        if (t == VT_STRUCT || t == VT_LDOUBLE
+            || (mode != x86_64_mode_integer && mode != x86_64_mode_sse))
+            return ir_give_up();
+    }
+    rt = &vtop[-nb_args].type.ref->type;
+    mode = classify_x86_64_arg(rt, NULL, &size, &align, &reg_count);
+    if ((rt->t & VT_BTYPE) == VT_LDOUBLE
+        || (mode != x86_64_mode_memory && (reg_count > 1 || size > 8)))
+        return ir_give_up();
+    d = -1, t = IRT_I64;
+    if (mode == x86_64_mode_sse)
+        d = TREG_XMM0, t = IRT_F64;
+    else if (mode == x86_64_mode_integer)
+        d = TREG_RAX;
+    if ((vtop[-nb_args].r & (VT_VALMASK | VT_LVAL | VT_SYM))
+        == (VT_CONST | VT_SYM) && vtop[-nb_args].c.i == 0) {
+        sym = vtop[-nb_args].sym;
+        name = get_tok_str(sym->asm_label ? sym->asm_label : sym->v, NULL);
+        /* their callers need a frame as it was */
+        if (!strcmp(name, "alloca") || strstr(name, "setjmp"))
+            return ir_give_up();
+    }
 
-    /* calculate the number of integer/float register arguments, remember
-       arguments to be passed via stack (in onstack[]), and also remember
-       if we have to align the stack pointer to 16 (onstack[i] == 2).  Needs
-       to be done in a left-to-right pass over arguments.  */
-    stack_adjust = 0;
-    for(i = nb_args - 1; i >= 0; i--) {
-        mode = classify_x86_64_arg(&vtop[-i].type, NULL, &size, &align, &reg_count);
-        if (size == 0) continue;
-        if (mode == x86_64_mode_sse && nb_sse_args + reg_count <= 8) {
-            nb_sse_args += reg_count;
-	    onstack[i] = 0;
-	} else if (mode == x86_64_mode_integer && nb_reg_args + reg_count <= REGN) {
-            nb_reg_args += reg_count;
-	    onstack[i] = 0;
-	} else if (mode == x86_64_mode_none) {
-	    onstack[i] = 0;
-	} else {
-	    if (align == 16 && (stack_adjust &= 15)) {
-		onstack[i] = 2;
-		stack_adjust = 0;
-	    } else
-	      onstack[i] = 1;
-	    stack_adjust += size;
-	}
+    /* the registers or stack slots, from left to right */
+    vr = tcc_malloc((nb_args + 1) * 2 * sizeof (int));
+    w = vr + nb_args + 1;
+    nr = ns = nstk = 0;
+    for (j = 0; j < nb_args; ++j) {
+        if (is_float(vtop[j + 1 - nb_args].type.t))
+            w[j] = ns < 8 ? TREG_XMM0 + ns++ : 32 + nstk++;
+        else
+            w[j] = nr < REGN ? arg_regs[nr++] : 32 + nstk++;
+    }
+    /* each value gets a register of its own until the call */
+    for (j = nb_args; j--; ) {
+        fl = is_float(vtop->type.t);
+        r = gv(fl ? RC_FLOAT : RC_INT);
+        vr[j] = ir_vreg(fl);
+        ir_emit(IR_MOV, fl ? IRT_F64 : IRT_I64, vr[j], r, -1);
+        vtop--;
+    }
+    fr = -1;
+    if (!sym) {
+        r = gv(RC_INT);
+        fr = ir_vreg(0);
+        ir_emit(IR_MOV, IRT_I64, fr, r, -1);
+    }
+    k = vtop->type.ref->f.func_type != FUNC_NEW ? (ns < 8 ? ns : 8) : -1;
+    vtop--;
+    save_regs(0);
+    for (j = 0, i = -1; j < nb_args; ++j) {
+        r = ir_pool_add(vr[j], w[j]);
+        if (!j)
+            i = r;
     }
+    c = ir_emit(IR_CALL, t, d, fr, -1);
+    c->sym = sym ? ir_sym(sym) : 0, c->c = k, c->cc = nb_args, c->p = i;
+    if (tail)
+        c->f = IRF_TAIL;
+    tcc_free(vr);
+    return 1;
+}
 
-    if (nb_sse_args && tcc_state->nosse)
-      tcc_error("SSE disabled but floating point arguments passed");
+static int ir_param(int where, int t, int c)
+{
+    int r = ir_vreg(IRT_FLOAT(t));
+    IRInsn *i = ir_emit(IR_STORE, t, -1, -1, r);
+    i->am = IRA_FRAME, i->c = c;
+    return ir_pool_add(r, where);
+}
 
-    /* fetch cpu flag before generating any code */
-    if ((vtop->r & VT_VALMASK) == VT_CMP)
-      gv(RC_INT);
+/* gfunc_prolog(): IR_ENTRY defines the parameters passed in registers,
+   which are stored where gfunc_prolog() would put them */
+static int ir_prolog(Sym *func_sym)
+{
+    X86_64_Mode mode, ret_mode;
+    CType *type;
+    Sym *sym;
+    int addr = PTR_SIZE * 2, param_addr = 0, size, align, reg_count;
+    int ri, si, i, k, t, fl, n = 0, p = -1;
 
-    /* for struct arguments, we need to call memcpy and the function
-       call breaks register passing arguments we are preparing.
-       So, we process arguments which will be passed by stack first. */
-    gen_reg = nb_reg_args;
-    sse_reg = nb_sse_args;
-    args_size = 0;
-    stack_adjust &= 15;
-    for (i = k = 0; i < nb_args;) {
-	mode = classify_x86_64_arg(&vtop[-i].type, NULL, &size, &align, &reg_count);
-	if (size) {
-            if (!onstack[i + k]) {
-	        ++i;
-	        continue;
-	    }
-            /* Possibly adjust stack to align SSE boundary.  We're processing
-	       args from right to left while allocating happens left to right
-	       (stack grows down), so the adjustment needs to happen _after_
-	       an argument that requires it.  */
-            if (stack_adjust) {
-	        o(0x50); /* push %rax; aka sub $8,%rsp */
-                args_size += 8;
-	        stack_adjust = 0;
+    ret_mode = classify_x86_64_arg(&func_vt, NULL, &size, &align, &reg_count);
+    if ((func_vt.t & VT_BTYPE) == VT_LDOUBLE
+        || (ret_mode != x86_64_mode_memory && (reg_count > 1 || size > 8)))
+        return ir_give_up();
+    si = 0;
+    for (sym = func_sym->type.ref->next; sym; sym = sym->next) {
+        mode = classify_x86_64_arg(&sym->type, NULL, &size, &align, &reg_count);
+        if (mode == x86_64_mode_sse && si + reg_count <= 8) {
+            if (size > reg_count * 8)
+                return ir_give_up(); /* vector in one register */
+            si += reg_count;
+        }
+    }
+
+    loc = 0;
+    func_tail_call = 0;
+    func_tail_slot = -1;
+    ir_emit(IR_ENTRY, 0, -1, -1, -1);
+    ri = si = 0;
+    if (ret_mode == x86_64_mode_memory) {
+        loc -= 8;
+        func_vc = loc;
+        p = ir_param(arg_regs[ri++], IRT_I64, loc);
+        n++;
+    }
+    for (sym = func_sym->type.ref->next; sym; sym = sym->next) {
+        type = &sym->type;
+        mode = classify_x86_64_arg(type, NULL, &size, &align, &reg_count);
+        fl = mode == x86_64_mode_sse;
+        if ((fl && si + reg_count <= 8)
+            || (mode == x86_64_mode_integer && ri + reg_count <= REGN)) {
+            /* the scalars with their own type, so that they can be
+               promoted to registers */
+            t = (type->t & VT_BTYPE) == VT_STRUCT
+                ? (fl ? IRT_F64 : IRT_I64) : ir_type(type, fl);
+            loc -= reg_count * 8;
+            param_addr = loc;
+            for (i = 0; i < reg_count; ++i) {
+                k = ir_param(fl ? TREG_XMM0 + si++ : arg_regs[ri++], t,
+                             param_addr + i * 8);
+                if (n++ == 0)
+                    p = k;
             }
-	    if (onstack[i + k] == 2)
-	        stack_adjust = 1;
+        } else if (mode != x86_64_mode_none) {
+            addr = (addr + align - 1) & -align;
+            param_addr = addr;
+            addr += size;
         }
+        sym_push(sym->v & ~SYM_FIELD, type,
+                 VT_LOCAL | VT_LVAL, param_addr);
+    }
+    ir_code[0].p = p;
+    ir_code[0].cc = n;
+    return 1;
+}
 
-	vrotb(i+1);
+/* IR_CALL destroys the caller saved registers, IR_DIV ... need %rax and
+   %rdx, shifts by a register %rcx */
+ST_FUNC unsigned ir_clobbers(IRInsn *i)
+{
+    switch (i->op) {
+    case IR_CALL:
+        return 0xffff0fc7; /* all but %rbx, %rsp, %rbp, %r12 .. %r15 */
+    case IR_DIV: case IR_UDIV: case IR_MOD: case IR_UMOD:
+    case IR_UMULH: case IR_SMULH:
+        return 1u << TREG_RAX | 1u << TREG_RDX;
+    case IR_SHL: case IR_SHR: case IR_SAR:
+        return i->f & IRF_IMM ? 0 : 1u << TREG_RCX;
+    }
+    return 0;
+}
 
-	switch (vtop->type.t & VT_BTYPE) {
-	    case VT_STRUCT:
-		/* allocate the necessary size on stack */
-		o(0x48);
-		oad(0xec81, size); /* sub $xxx, %rsp */
-		/* generate structure store */
-		r = get_reg(RC_INT);
-		orex(1, r, 0, 0x89); /* mov %rsp, r */
-		o(0xe0 + REG_VALUE(r));
-		vset(&vtop->type, r | VT_LVAL, 0);
-		vswap();
-		/* keep stack aligned for (__bound_)memmove call */
-		o(0x10ec8348); /* sub $16,%rsp */
-		o(0xf0e48348); /* and $-16,%rsp */
-		orex(0,r,0,0x50 + REG_VALUE(r)); /* push r (last %rsp) */
-		o(0x08ec8348); /* sub $8,%rsp */
-		vstore();
-		o(0x08c48348); /* add $8,%rsp */
-		o(0x5c);       /* pop %rsp */
-		break;
+/* the registers that save moves for the results and operands of 'i' */
+ST_FUNC void ir_hint(IRInsn *i, int *hint)
+{
+    int v = i->d, r = -1;
 
-	    case VT_LDOUBLE:
-                gv(RC_ST0);
-                oad(0xec8148, size); /* sub $xxx, %rsp */
-                o(0x7cdb); /* fstpt 0(%rsp) */
-                g(0x24);
-                g(0x00);
-		break;
+    switch (i->op) {
+    case IR_DIV: case IR_UDIV:
+        r = TREG_RAX;
+        break;
+    case IR_MOD: case IR_UMOD: case IR_UMULH: case IR_SMULH:
+        r = TREG_RDX;
+        break;
+    case IR_SHL: case IR_SHR: case IR_SAR:
+        if (!(i->f & IRF_IMM) && hint[i->b] < 0)
+            hint[i->b] = TREG_RCX;
+        return;
+    case IR_RET:
+        v = i->a;
+        /* fall through */
+    case IR_CALL:
+        r = IRT_FLOAT(i->t) ? TREG_XMM0 : TREG_RAX;
+        break;
+    default:
+        return;
+    }
+    if (v >= 0 && hint[v] < 0)
+        hint[v] = r;
+    if (i->op >= IR_DIV && i->op <= IR_SMULH && hint[i->a] < 0)
+        hint[i->a] = TREG_RAX;
+}
 
-	    case VT_FLOAT:
-	    case VT_DOUBLE:
-		assert(mode == x86_64_mode_sse);
-		r = gv(RC_FLOAT);
-		o(0x50); /* push $rax */
-		/* movq %xmmN, (%rsp) */
-		o(0xd60f66);
-		o(0x04 + REG_VALUE(r)*8);
-		o(0x24);
-		break;
+/* %r10, %r11, %xmm14 and %xmm15 are left to the lowering below */
+ST_DATA const signed char ir_hregs[2][16] = {
+    { TREG_RAX, TREG_RCX, TREG_RDX, TREG_RSI, TREG_RDI, TREG_R8, TREG_R9,
+      3, 12, 13, 14, 15, -1 },
+    { 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, -1 }
+};
+
+/* ------------------------------------------------------------------------- */
+/* lowering: ir_loc[] are machine registers (0 .. 15, %xmm0 .. %xmm15 as
+   16 .. 31) or %rbp offsets */
+
+#define IRL_R10 10
+#define IRL_R11 11
+#define IRL_X14 30
+#define IRL_X15 31
+#define IRL_SAVED 0xf008 /* %rbx, %r12 .. %r15 */
+#define IRL_IS_REG(l) ((unsigned)(l) < 32)
+
+/* IRLMem.am, with IRA_xxx */
+#define IRL_REG 4  /* register 'r' */
+#define IRL_GOT 5  /* GOT entry of 'sym' */
+
+/* irl_insn() flags */
+#define IRL_W 1    /* REX.W */
+#define IRL_B 2    /* %spl .. %dil as byte registers */
+#define IRL_BYTE(r) ((r) >= 4 && (r) < 8 ? IRL_B : 0)
+
+typedef struct IRLMem {
+    int am, r, c, sym;
+} IRLMem;
+
+static int irl_frame, irl_lea_frame, irl_saved, irl_save_at, irl_size;
+static int *irl_pos, *irl_fix, irl_nfix;
+static int irl_pm_d[32], irl_pm_s[32], irl_npm;
+
+static void irl_reg(IRLMem *m, int r)
+{
+    m->am = IRL_REG, m->r = r;
+}
+
+static void irl_loc(IRLMem *m, int l)
+{
+    if (IRL_IS_REG(l))
+        irl_reg(m, l);
+    else
+        m->am = IRA_FRAME, m->c = l;
+}
+
+/* prefix 'pfx', opcode 'op' (low byte first), the ModRM for 'reg' and
+   'm', then 'imm' bytes of immediate are to follow */
+static void irl_insn(int pfx, int fl, int op, int reg, IRLMem *m, int imm)
+{
+    int rex = (fl & IRL_W) << 3 | REX_BASE(reg) << 2, c = m->c, rm, mod;
+
+    if (m->am == IRL_REG || m->am == IRA_REG)
+        rex |= REX_BASE(m->r);
+    if (pfx)
+        g(pfx);
+    if (rex || (fl & IRL_B))
+        g(0x40 | rex);
+    do
+        g(op), op >>= 8;
+    while (op);
+    reg = REG_VALUE(reg) << 3;
+    switch (m->am) {
+    case IRL_REG:
+        g(0xc0 | reg | REG_VALUE(m->r));
+        break;
+    case IRA_FRAME:
+        if (c == (char)c)
+            g(0x45 | reg), g(c);
+        else
+            g(0x85 | reg), gen_le32(c);
+        break;
+    case IRA_REG:
+        rm = REG_VALUE(m->r);
+        mod = c == 0 && rm != 5 ? 0 : c == (char)c ? 0x40 : 0x80;
+        g(mod | reg | rm);
+        if (rm == 4)
+            g(0x24);
+        if (mod == 0x40)
+            g(c);
+        else if (mod == 0x80)
+            gen_le32(c);
+        break;
+    case IRA_SYM:
+        g(0x05 | reg);
+        put_elf_reloca(symtab_section, cur_text_section, ind, R_X86_64_PC32,
+                       m->sym, c - 4 - imm);
+        gen_le32(0);
+        break;
+    case IRL_GOT:
+        g(0x05 | reg);
+        put_elf_reloca(symtab_section, cur_text_section, ind,
+                       R_X86_64_REX_GOTPCRELX, m->sym, -4);
+        gen_le32(0);
+        break;
+    default: /* IRA_ABS */
+        g(0x04 | reg), g(0x25), gen_le32(c);
+        break;
+    }
+}
+
+/* opcode 'op' + register 'r' */
+static void irl_oreg(int fl, int op, int r)
+{
+    int rex = (fl & IRL_W) << 3 | REX_BASE(r);
+    if (rex || (fl & IRL_B))
+        g(0x40 | rex);
+    g(op + REG_VALUE(r));
+}
+
+/* group 1 instruction '/ext' with immediate 'c' */
+static void irl_imm(int fl, int ext, IRLMem *m, int c)
+{
+    if (c == (char)c)
+        irl_insn(0, fl, 0x83, ext, m, 1), g(c);
+    else
+        irl_insn(0, fl, 0x81, ext, m, 4), gen_le32(c);
+}
+
+/* copy all of location 's' to 'd' */
+static void irl_mov(int d, int s)
+{
+    IRLMem m;
+
+    if (d == s)
+        return;
+    if (!IRL_IS_REG(d) && !IRL_IS_REG(s))
+        irl_mov(IRL_R10, s), s = IRL_R10;
+    if (IRL_IS_REG(d)) {
+        irl_loc(&m, s);
+        if (d < 16)
+            irl_insn(0, IRL_W, 0x8b, d, &m, 0); /* mov */
+        else if (IRL_IS_REG(s))
+            irl_insn(0, 0, 0x280f, d, &m, 0); /* movaps */
+        else
+            irl_insn(0xf2, 0, 0x100f, d, &m, 0); /* movsd */
+    } else {
+        irl_loc(&m, d);
+        if (s < 16)
+            irl_insn(0, IRL_W, 0x89, s, &m, 0);
+        else
+            irl_insn(0xf2, 0, 0x110f, s, &m, 0);
+    }
+}
+
+/* a register with the value of 'v' */
+static int irl_get(int v, int scratch)
+{
+    int l = ir_loc[v];
+    if (IRL_IS_REG(l))
+        return l;
+    irl_mov(scratch, l);
+    return scratch;
+}
+
+/* the register to compute 'v' into, then irl_put() it */
+static int irl_dst(int v, int scratch)
+{
+    return v >= 0 && IRL_IS_REG(ir_loc[v]) ? ir_loc[v] : scratch;
+}
+
+static void irl_put(int v, int r)
+{
+    if (v >= 0)
+        irl_mov(ir_loc[v], r);
+}
+
+/* parallel moves, for the arguments of calls and the parameters */
+static void irl_pm_add(int d, int s)
+{
+    if (d != s)
+        irl_pm_d[irl_npm] = d, irl_pm_s[irl_npm++] = s;
+}
+
+static void irl_pmove(void)
+{
+    int k, j, n, d;
+
+    /* frame slots first, no register is written yet */
+    for (k = n = 0; k < irl_npm; ++k) {
+        if (!IRL_IS_REG(irl_pm_d[k]))
+            irl_mov(irl_pm_d[k], irl_pm_s[k]);
+        else
+            irl_pm_d[n] = irl_pm_d[k], irl_pm_s[n++] = irl_pm_s[k];
+    }
+    while (n) {
+        /* a register that no other move reads */
+        for (k = 0; k < n; ++k) {
+            for (j = 0; j < n && (j == k || irl_pm_s[j] != irl_pm_d[k]); ++j)
+                ;
+            if (j == n)
+                break;
+        }
+        if (k == n) {
+            /* a cycle: keep the value of one of them aside */
+            k = 0, d = irl_pm_d[0];
+            irl_mov(d < 16 ? IRL_R10 : IRL_X14, d);
+            for (j = 0; j < n; ++j)
+                if (irl_pm_s[j] == d)
+                    irl_pm_s[j] = d < 16 ? IRL_R10 : IRL_X14;
+        }
+        irl_mov(irl_pm_d[k], irl_pm_s[k]);
+        --n;
+        irl_pm_d[k] = irl_pm_d[n], irl_pm_s[k] = irl_pm_s[n];
+    }
+    irl_npm = 0;
+}
+
+/* jump with a rel32 to insn 't' */
+static void irl_jump(int op, int t)
+{
+    if (op != 0xe9)
+        g(0x0f);
+    g(op);
+    if ((irl_nfix & 63) == 0)
+        irl_fix = tcc_realloc(irl_fix, (irl_nfix + 64) * 2 * sizeof (int));
+    irl_fix[2 * irl_nfix] = ind;
+    irl_fix[2 * irl_nfix + 1] = t;
+    irl_nfix++;
+    gen_le32(0);
+}
+
+/* flags set before insn 'k' are used after it */
+static int irl_flags_live(int k)
+{
+    while (++k < ir_n) {
+        switch (ir_code[k].op) {
+        case IR_JCC: case IR_SETCC:
+            return 1;
+        case IR_NOP: case IR_MOV: case IR_LI: case IR_LEA: case IR_GOT:
+        case IR_LOAD: case IR_STORE: case IR_EXT:
+            break;
+        default:
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/* restore the callee saved registers and the frame of the caller */
+static void irl_leave(void)
+{
+    IRLMem m;
+    int r, c = irl_save_at;
+
+    for (r = 0; r < 16; ++r)
+        if (irl_saved >> r & 1) {
+            m.am = IRA_FRAME, m.c = c, c += 8;
+            irl_insn(0, IRL_W, 0x8b, r, &m, 0);
+        }
+    if (irl_frame)
+        g(0xc9); /* leave */
+}
+
+static void irl_entry(IRInsn *i)
+{
+    IRLMem m;
+    int r, c = irl_save_at, k, v;
+
+    if (irl_frame) {
+        g(0x55), g(0x48), g(0x89), g(0xe5); /* push %rbp; mov %rsp,%rbp */
+        irl_reg(&m, TREG_RSP);
+        if (irl_size)
+            irl_imm(IRL_W, 5, &m, irl_size); /* sub $size,%rsp */
+        for (r = 0; r < 16; ++r)
+            if (irl_saved >> r & 1) {
+                m.am = IRA_FRAME, m.c = c, c += 8;
+                irl_insn(0, IRL_W, 0x89, r, &m, 0);
+            }
+    }
+    for (k = 0; k < i->cc; ++k) {
+        v = ir_pool[2 * (i->p + k)];
+        if (v >= 0)
+            irl_pm_add(ir_loc[v], ir_pool[2 * (i->p + k) + 1]);
+    }
+    irl_pmove();
+}
+
+/* 'return f(...)': nothing but the return follows and the callee
+   cannot see our frame */
+static int irl_tail(IRInsn *i, int k)
+{
+    IRInsn *j;
+    int n = 0;
+
+    if (irl_lea_frame)
+        return 0;
+    while (++k < ir_n && n < 16) {
+        j = &ir_code[k];
+        if (j->op == IR_JMP)
+            k = j->c - 1, ++n;
+        else if (j->op != IR_NOP)
+            return j->op == IR_RET && (j->a < 0 || j->a == i->d);
+    }
+    return 0;
+}
+
+static void irl_call(IRInsn *i, int k)
+{
+    IRLMem m;
+    int j, n, v, l, w, nstk = 0, tail;
+
+    for (j = 0; j < i->cc; ++j)
+        nstk += ir_pool[2 * (i->p + j) + 1] >= 32;
+    tail = (i->f & IRF_TAIL) && !nstk && irl_tail(i, k);
+    if (nstk & 1)
+        g(0x50); /* push %rax, for the alignment */
+    for (n = nstk; n--; ) {
+        for (j = 0; ir_pool[2 * (i->p + j) + 1] != 32 + n; ++j)
+            ;
+        l = ir_loc[ir_pool[2 * (i->p + j)]];
+        if (!IRL_IS_REG(l)) {
+            irl_loc(&m, l);
+            irl_insn(0, 0, 0xff, 6, &m, 0); /* push */
+        } else if (l >= 16) {
+            irl_reg(&m, TREG_RSP);
+            irl_imm(IRL_W, 5, &m, 8);
+            m.am = IRA_REG, m.c = 0;
+            irl_insn(0xf2, 0, 0x110f, l, &m, 0); /* movsd %xmm,(%rsp) */
+        } else {
+            irl_oreg(0, 0x50, l); /* push */
+        }
+    }
+    if (i->a >= 0)
+        irl_mov(IRL_R11, ir_loc[i->a]);
+    for (j = 0; j < i->cc; ++j) {
+        v = ir_pool[2 * (i->p + j)];
+        w = ir_pool[2 * (i->p + j) + 1];
+        if (w < 32)
+            irl_pm_add(w, ir_loc[v]);
+    }
+    irl_pmove();
+    if (i->c >= 0)
+        irl_oreg(0, 0xb8, TREG_RAX), gen_le32(i->c); /* mov $n,%eax */
+    if (tail)
+        irl_leave();
+    if (i->sym) {
+        put_elf_reloca(symtab_section, cur_text_section, ind + 1,
+                       R_X86_64_PLT32, i->sym, -4);
+        g(0xe8 + tail), gen_le32(0); /* call/jmp f */
+    } else {
+        g(0x41), g(0xff), g(0xd3 + tail * 0x10); /* call/jmp *%r11 */
+    }
+    if (nstk)
+        gadd_sp((nstk + (nstk & 1)) * 8);
+    irl_put(i->d, IRT_FLOAT(i->t) ? TREG_XMM0 : TREG_RAX);
+}
+
+static const unsigned char irl_alu[] = { 0, 5, 4, 1, 6 }; /* ADD .. XOR */
+
+static void irl_binop(IRInsn *i)
+{
+    int fl = i->t == IRT_I64 ? IRL_W : 0, la = ir_loc[i->a], lb, d, ext;
+    IRLMem m;
+
+    d = irl_dst(i->d, IRL_R10);
+    ext = i->op == IR_SHL ? 4 : i->op == IR_SHR ? 5 : 7;
+    if (i->op == IR_MUL && (i->f & IRF_IMM)) {
+        irl_loc(&m, la);
+        if (i->c == (char)i->c)
+            irl_insn(0, fl, 0x6b, d, &m, 1), g(i->c);
+        else
+            irl_insn(0, fl, 0x69, d, &m, 4), gen_le32(i->c);
+    } else if (i->f & IRF_IMM) {
+        irl_mov(d, la);
+        irl_reg(&m, d);
+        if (i->op >= IR_SHL)
+            irl_insn(0, fl, 0xc1, ext, &m, 1), g(i->c);
+        else
+            irl_imm(fl, irl_alu[i->op - IR_ADD], &m, i->c);
+    } else if (i->op >= IR_SHL) {
+        irl_mov(IRL_R10, la);
+        irl_mov(TREG_RCX, ir_loc[i->b]);
+        irl_reg(&m, IRL_R10);
+        irl_insn(0, fl, 0xd3, ext, &m, 0); /* shift %r10 by %cl */
+        irl_mov(d, IRL_R10);
+    } else {
+        lb = ir_loc[i->b];
+        if (d == lb && d != la) {
+            if (i->op == IR_SUB) {
+                irl_mov(IRL_R10, la);
+                irl_reg(&m, d);
+                irl_insn(0, fl, 0x2b, IRL_R10, &m, 0);
+                irl_mov(d, IRL_R10);
+                return;
+            }
+            lb = la, la = d;
+        }
+        irl_mov(d, la);
+        irl_loc(&m, lb);
+        if (i->op == IR_MUL)
+            irl_insn(0, fl, 0xaf0f, d, &m, 0); /* imul */
+        else
+            irl_insn(0, fl, irl_alu[i->op - IR_ADD] * 8 + 3, d, &m, 0);
+    }
+    irl_put(i->d, d);
+}
+
+static void irl_cmp(IRInsn *i)
+{
+    int fl = i->t == IRT_I64 ? IRL_W : 0, la = ir_loc[i->a], lb;
+    IRLMem m;
+
+    if (i->f & IRF_IMM) {
+        irl_loc(&m, la);
+        irl_imm(fl, 7, &m, i->c);
+        return;
+    }
+    lb = ir_loc[i->b];
+    if (!IRL_IS_REG(la) && !IRL_IS_REG(lb))
+        irl_mov(IRL_R10, la), la = IRL_R10;
+    if (IRL_IS_REG(la))
+        irl_loc(&m, lb), irl_insn(0, fl, 0x3b, la, &m, 0);
+    else
+        irl_loc(&m, la), irl_insn(0, fl, 0x39, lb, &m, 0);
+}
+
+/* IR_DIV ... IR_SMULH with %rax and %rdx */
+static void irl_div(IRInsn *i)
+{
+    int fl = i->t == IRT_I64 ? IRL_W : 0, lb = ir_loc[i->b], ext;
+    IRLMem m;
+
+    if (lb == TREG_RAX || lb == TREG_RDX)
+        irl_mov(IRL_R11, lb), lb = IRL_R11;
+    irl_mov(TREG_RAX, ir_loc[i->a]);
+    switch (i->op) {
+    case IR_DIV: case IR_MOD:
+        if (fl)
+            g(0x48);
+        g(0x99); /* cltd/cqto */
+        ext = 7;
+        break;
+    case IR_UDIV: case IR_UMOD:
+        g(0x31), g(0xd2); /* xor %edx,%edx */
+        ext = 6;
+        break;
+    default:
+        ext = i->op == IR_UMULH ? 4 : 5;
+        break;
+    }
+    irl_loc(&m, lb);
+    irl_insn(0, fl, 0xf7, ext, &m, 0);
+    irl_put(i->d, i->op == IR_DIV || i->op == IR_UDIV ? TREG_RAX : TREG_RDX);
+}
+
+static void irl_setcc(IRInsn *i)
+{
+    int d = irl_dst(i->d, IRL_R10), cc = i->cc & 0xff, v, b = IRL_BYTE(d);
+    IRLMem m;
+
+    irl_reg(&m, d);
+    if (i->cc & IRC_FLOAT) {
+        /* the value if unordered, as in load() */
+        v = i->cc >> 16;
+        irl_oreg(b, 0xb0, d);
+        g(v ^ cc ^ (v == TOK_NE));
+        g(0x7a), g(3 + (d >= 4)); /* jp over the setcc */
+    }
+    irl_insn(0, b, 0x0f | cc << 8, 0, &m, 0);
+    irl_insn(0, b, 0xb60f, d, &m, 0); /* movzbl */
+    irl_put(i->d, d);
+}
+
+static void irl_ext(IRInsn *i)
+{
+    static const unsigned short op[] = { 0xbe0f, 0xb60f, 0xbf0f, 0xb70f };
+    int d = irl_dst(i->d, IRL_R10), la = ir_loc[i->a];
+    IRLMem m;
+
+    irl_loc(&m, la);
+    if (i->cc == IRT_I32)
+        irl_insn(0, IRL_W, 0x63, d, &m, 0); /* movslq */
+    else
+        irl_insn(0, (i->t == IRT_I64 ? IRL_W : 0) | IRL_BYTE(la),
+                 op[i->cc - IRT_S8], d, &m, 0);
+    irl_put(i->d, d);
+}
+
+/* the memory operand of IR_LOAD, IR_STORE and IR_LEA */
+static void irl_addr(IRLMem *m, IRInsn *i)
+{
+    m->am = i->am, m->c = i->c, m->sym = i->sym;
+    if (i->am == IRA_REG)
+        m->r = irl_get(i->a, IRL_R11);
+}
+
+static void irl_load(IRInsn *i)
+{
+    static const unsigned short op[] = {
+        0x8b, 0x8b, 0x100f, 0x100f, 0xbe0f, 0xb60f, 0xbf0f, 0xb70f
+    };
+    int d = irl_dst(i->d, IRT_FLOAT(i->t) ? IRL_X15 : IRL_R10);
+    IRLMem m;
+
+    irl_addr(&m, i);
+    irl_insn(i->t == IRT_F32 ? 0xf3 : i->t == IRT_F64 ? 0xf2 : 0,
+             i->t == IRT_I64 ? IRL_W : 0, op[i->t], d, &m, 0);
+    irl_put(i->d, d);
+}
+
+static void irl_store(IRInsn *i)
+{
+    int r = irl_get(i->b, IRT_FLOAT(i->t) ? IRL_X15 : IRL_R10);
+    IRLMem m;
+
+    irl_addr(&m, i);
+    switch (i->t) {
+    case IRT_S8: case IRT_U8:
+        irl_insn(0, IRL_BYTE(r), 0x88, r, &m, 0);
+        break;
+    case IRT_S16: case IRT_U16:
+        irl_insn(0x66, 0, 0x89, r, &m, 0);
+        break;
+    case IRT_F32: case IRT_F64:
+        irl_insn(i->t == IRT_F32 ? 0xf3 : 0xf2, 0, 0x110f, r, &m, 0);
+        break;
+    default:
+        irl_insn(0, i->t == IRT_I64 ? IRL_W : 0, 0x89, r, &m, 0);
+        break;
+    }
+}
+
+static void irl_li(IRInsn *i, int k)
+{
+    int64_t c = i->c;
+    int d = ir_loc[i->d];
+    IRLMem m;
+
+    if (!IRL_IS_REG(d) && c == (int)c) {
+        irl_loc(&m, d);
+        irl_insn(0, IRL_W, 0xc7, 0, &m, 4), gen_le32(c);
+        return;
+    }
+    d = irl_dst(i->d, IRL_R10);
+    irl_reg(&m, d);
+    if (c == 0 && !irl_flags_live(k))
+        irl_insn(0, 0, 0x31, d, &m, 0); /* xor */
+    else if ((uint64_t)c <= 0xffffffff)
+        irl_oreg(0, 0xb8, d), gen_le32(c);
+    else if (c == (int)c)
+        irl_insn(0, IRL_W, 0xc7, 0, &m, 4), gen_le32(c);
+    else
+        irl_oreg(IRL_W, 0xb8, d), gen_le64(c); /* movabs */
+    irl_put(i->d, d);
+}
+
+static void irl_fop(IRInsn *i)
+{
+    static const unsigned char op[] = { 0x58, 0x5c, 0x59, 0x5e, 0x57 };
+    int d = irl_dst(i->d, IRL_X15), la = ir_loc[i->a], lb = ir_loc[i->b];
+    int pfx = i->t == IRT_F64 ? 0xf2 : 0xf3;
+    IRLMem m;
+
+    if (d == lb && d != la) {
+        if (i->op == IR_FSUB || i->op == IR_FDIV)
+            irl_mov(IRL_X14, lb), lb = IRL_X14;
+        else
+            lb = la, la = d;
+    }
+    if (i->op == IR_FXOR) {
+        /* xorps/xorpd: 16 aligned bytes in memory */
+        pfx = i->t == IRT_F64 ? 0x66 : 0;
+        if (!IRL_IS_REG(lb))
+            irl_mov(IRL_X14, lb), lb = IRL_X14;
+    }
+    irl_mov(d, la);
+    irl_loc(&m, lb);
+    irl_insn(pfx, 0, 0x0f | op[i->op - IR_FADD] << 8, d, &m, 0);
+    irl_put(i->d, d);
+}
+
+/* IR_ITOF, IR_FTOI, IR_FTOF */
+static void irl_cvt(IRInsn *i)
+{
+    int d = irl_dst(i->d, i->op == IR_FTOI ? IRL_R10 : IRL_X15);
+    IRLMem m;
+
+    irl_loc(&m, ir_loc[i->a]);
+    if (i->op == IR_ITOF)
+        irl_insn(i->t == IRT_F64 ? 0xf2 : 0xf3, i->cc ? IRL_W : 0,
+                 0x2a0f, d, &m, 0); /* cvtsi2sd/ss */
+    else if (i->op == IR_FTOI)
+        irl_insn(i->cc == IRT_F64 ? 0xf2 : 0xf3,
+                 i->t == IRT_I64 ? IRL_W : 0, 0x2c0f, d, &m, 0); /* cvtt */
+    else
+        irl_insn(i->cc == IRT_F64 ? 0xf2 : 0xf3, 0, 0x5a0f, d, &m, 0);
+    irl_put(i->d, d);
+}
+
+static void ir_lower(void)
+{
+    IRInsn *i;
+    IRLMem m;
+    int k, v, l, n, d, cc;
+
+    irl_frame = irl_lea_frame = irl_saved = 0;
+    for (i = ir_code; i < ir_code + ir_n; ++i) {
+        if ((i->op == IR_LOAD || i->op == IR_STORE || i->op == IR_LEA)
+            && i->am == IRA_FRAME)
+            irl_frame = 1, irl_lea_frame |= i->op == IR_LEA;
+        if (i->op == IR_CALL)
+            irl_frame = 1;
+    }
+    for (n = v = 0; v < ir_nv; ++v) {
+        l = ir_loc[v];
+        if (l < 0)
+            irl_frame = 1;
+        else if (IRL_IS_REG(l) && (IRL_SAVED >> l & 1) && !(irl_saved >> l & 1))
+            irl_saved |= 1 << l, ++n;
+    }
+    if (irl_saved)
+        irl_frame = 1;
+    irl_save_at = ir_frame - 8 * n;
+    irl_size = (-irl_save_at + 15) & -16;
+
+    irl_pos = tcc_malloc((ir_n + 1) * sizeof (int));
+    irl_nfix = 0;
+    for (k = 0; k < ir_n; ++k) {
+        irl_pos[k] = ind;
+        i = &ir_code[k];
+        switch (i->op) {
+        case IR_ENTRY:
+            irl_entry(i);
+            break;
+        case IR_RET:
+            if (i->a >= 0)
+                irl_mov(IRT_FLOAT(i->t) ? TREG_XMM0 : TREG_RAX, ir_loc[i->a]);
+            irl_leave();
+            g(0xc3);
+            break;
+        case IR_CALL:
+            irl_call(i, k);
+            break;
+        case IR_JMP:
+            for (n = k + 1; n < i->c && ir_code[n].op == IR_NOP; ++n)
+                ;
+            if (n != i->c)
+                irl_jump(0xe9, i->c);
+            break;
+        case IR_JCC:
+            cc = i->cc & 0xff;
+            if (i->cc & IRC_FLOAT) {
+                /* unordered: as in gjmp_cond() */
+                v = i->cc >> 16;
+                if (cc ^ v ^ (v != TOK_NE))
+                    g(0x7a), g(6); /* jp over the jcc */
+                else
+                    irl_jump(0x8a, i->c);
+            }
+            irl_jump(cc - 0x10, i->c);
+            break;
+        case IR_MOV:
+            if (i->t == IRT_I32) {
+                d = irl_dst(i->d, IRL_R10);
+                irl_loc(&m, ir_loc[i->a]);
+                irl_insn(0, 0, 0x8b, d, &m, 0); /* zero extends */
+                irl_put(i->d, d);
+            } else {
+                irl_mov(ir_loc[i->d], ir_loc[i->a]);
+            }
+            break;
+        case IR_LI:
+            irl_li(i, k);
+            break;
+        case IR_LEA:
+            d = irl_dst(i->d, IRL_R10);
+            irl_addr(&m, i);
+            irl_insn(0, IRL_W, 0x8d, d, &m, 0);
+            irl_put(i->d, d);
+            break;
+        case IR_GOT:
+            d = irl_dst(i->d, IRL_R10);
+            m.am = IRL_GOT, m.sym = i->sym;
+            irl_insn(0, IRL_W, 0x8b, d, &m, 0);
+            irl_put(i->d, d);
+            break;
+        case IR_LOAD:
+            irl_load(i);
+            break;
+        case IR_STORE:
+            irl_store(i);
+            break;
+        case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_XOR:
+        case IR_MUL: case IR_SHL: case IR_SHR: case IR_SAR:
+            irl_binop(i);
+            break;
+        case IR_DIV: case IR_UDIV: case IR_MOD: case IR_UMOD:
+        case IR_UMULH: case IR_SMULH:
+            irl_div(i);
+            break;
+        case IR_CMP:
+            irl_cmp(i);
+            break;
+        case IR_SETCC:
+            irl_setcc(i);
+            break;
+        case IR_EXT:
+            irl_ext(i);
+            break;
+        case IR_FADD: case IR_FSUB: case IR_FMUL: case IR_FDIV: case IR_FXOR:
+            irl_fop(i);
+            break;
+        case IR_FCMP:
+            l = ir_loc[i->a];
+            if (!IRL_IS_REG(l))
+                irl_mov(IRL_X15, l), l = IRL_X15;
+            irl_loc(&m, ir_loc[i->b]);
+            irl_insn(i->t == IRT_F64 ? 0x66 : 0, 0,
+                     i->cc ? 0x2f0f : 0x2e0f, l, &m, 0); /* (u)comis */
+            break;
+        case IR_ITOF: case IR_FTOI: case IR_FTOF:
+            irl_cvt(i);
+            break;
+        }
+    }
+    irl_pos[ir_n] = ind;
+    for (k = 0; k < irl_nfix; ++k)
+        write32le(cur_text_section->data + irl_fix[2 * k],
+                  irl_pos[irl_fix[2 * k + 1]] - irl_fix[2 * k] - 4);
+    tcc_free(irl_pos), irl_pos = NULL;
+    tcc_free(irl_fix), irl_fix = NULL;
+}
+
+/* gfunc_epilog(): the IR is complete */
+static void ir_epilog(void)
+{
+    int size, align, reg_count, a = -1, t = IRT_I64;
+    X86_64_Mode mode;
+
+    mode = classify_x86_64_arg(&func_vt, NULL, &size, &align, &reg_count);
+    if (mode == x86_64_mode_sse)
+        a = TREG_XMM0, t = IRT_F64;
+    else if (mode == x86_64_mode_integer)
+        a = TREG_RAX;
+    ir_emit(IR_RET, t, -1, a, -1);
+    ir_active = 0;
+    ind = func_ind;
+    if (ir_optimize() == 0)
+        ir_lower();
+    ir_end();
+}
+#endif
+
+/* Generate function call. The function address is pushed first, then
+   all the parameters in call order. This functions pops all the
+   parameters and the function address. */
+void gfunc_call(int nb_args)
+{
+    X86_64_Mode mode;
+    CType type;
+    int size, align, r, args_size, stack_adjust, i, reg_count, k;
+    int nb_reg_args = 0;
+    int nb_sse_args = 0;
+    int sse_reg, gen_reg, tail;
+    char *onstack;
+
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_call(nb_args, 0))
+        return;
+#endif
+    onstack = tcc_malloc((nb_args + 1) * sizeof (char));
+    tail = func_tail_call;
+    func_tail_call = 0;
+#ifdef CONFIG_TCC_BCHECK
+    if (tcc_state->do_bounds_check)
+        gbound_args(nb_args);
+#endif
+
+    /* calculate the number of integer/float register arguments, remember
+       arguments to be passed via stack (in onstack[]), and also remember
+       if we have to align the stack pointer to 16 (onstack[i] == 2).  Needs
+       to be done in a left-to-right pass over arguments.  */
+    stack_adjust = 0;
+    for(i = nb_args - 1; i >= 0; i--) {
+        mode = classify_x86_64_arg(&vtop[-i].type, NULL, &size, &align, &reg_count);
+        if (size == 0) continue;
+        if (mode == x86_64_mode_sse && nb_sse_args + reg_count <= 8) {
+            nb_sse_args += reg_count;
+	    onstack[i] = 0;
+	} else if (mode == x86_64_mode_integer && nb_reg_args + reg_count <= REGN) {
+            nb_reg_args += reg_count;
+	    onstack[i] = 0;
+	} else if (mode == x86_64_mode_none) {
+	    onstack[i] = 0;
+	} else {
+	    if (align == 16 && (stack_adjust &= 15)) {
+		onstack[i] = 2;
+		stack_adjust = 0;
+	    } else
+	      onstack[i] = 1;
+	    stack_adjust += size;
+	}
+    }
+
+    if (nb_sse_args && tcc_state->nosse)
+      tcc_error("SSE disabled but floating point arguments passed");
+
+    /* fetch cpu flag before generating any code */
+    if ((vtop->r & VT_VALMASK) == VT_CMP)
+      gv(RC_INT);
+
+    /* for struct arguments, we need to call memcpy and the function
+       call breaks register passing arguments we are preparing.
+       So, we process arguments which will be passed by stack first. */
+    gen_reg = nb_reg_args;
+    sse_reg = nb_sse_args;
+    args_size = 0;
+    stack_adjust &= 15;
+    for (i = k = 0; i < nb_args;) {
+	mode = classify_x86_64_arg(&vtop[-i].type, NULL, &size, &align, &reg_count);
+	if (size) {
+            if (!onstack[i + k]) {
+	        ++i;
+	        continue;
+	    }
+            /* Possibly adjust stack to align SSE boundary.  We're processing
+	       args from right to left while allocating happens left to right
+	       (stack grows down), so the adjustment needs to happen _after_
+	       an argument that requires it.  */
+            if (stack_adjust) {
+	        o(0x50); /* push %rax; aka sub $8,%rsp */
+                args_size += 8;
+                func_sp_depth += 8;
+	        stack_adjust = 0;
+            }
+	    if (onstack[i + k] == 2)
+	        stack_adjust = 1;
+        }
+
+	vrotb(i+1);
+
+	switch (vtop->type.t & VT_BTYPE) {
+	    case VT_STRUCT:
+		/* allocate the necessary size on stack */
+		o(0x48);
+		oad(0xec81, size); /* sub $xxx, %rsp */
+		func_sp_depth += size;
+		/* %rsp is realigned dynamically below */
+		gen_need_frame();
+		/* generate structure store */
+		r = get_reg(RC_INT);
+		orex(1, r, 0, 0x89); /* mov %rsp, r */
+		o(0xe0 + REG_VALUE(r));
+		vset(&vtop->type, r | VT_LVAL, 0);
+		vswap();
+		/* keep stack aligned for (__bound_)memmove call */
+		o(0x10ec8348); /* sub $16,%rsp */
+		o(0xf0e48348); /* and $-16,%rsp */
+		orex(0,r,0,0x50 + REG_VALUE(r)); /* push r (last %rsp) */
+		o(0x08ec8348); /* sub $8,%rsp */
+		vstore();
+		o(0x08c48348); /* add $8,%rsp */
+		o(0x5c);       /* pop %rsp */
+		break;
+
+	    case VT_LDOUBLE:
+                gv(RC_ST0);
+                oad(0xec8148, size); /* sub $xxx, %rsp */
+                func_sp_depth += size;
+                o(0x7cdb); /* fstpt 0(%rsp) */
+                g(0x24);
+                g(0x00);
+		break;
+
+	    case VT_FLOAT:
+	    case VT_DOUBLE:
+		assert(mode == x86_64_mode_sse);
+		r = gv(RC_FLOAT);
+		o(0x50); /* push $rax */
+		func_sp_depth += 8;
+		/* movq %xmmN, (%rsp) */
+		o(0xd60f66);
+		o(0x04 + REG_VALUE(r)*8);
+		o(0x24);
+		break;
 
 	    default:
 		assert(mode == x86_64_mode_integer);
@@ -1365,6 +2713,7 @@ void gfunc_call(int nb_args)
 		/* XXX: implicit cast ? */
 		r = gv(RC_INT);
 		orex(0,r,0,0x50 + REG_VALUE(r)); /* push r */
+		func_sp_depth += 8;
 		break;
 	}
 	args_size += size;
@@ -1444,12 +2793,40 @@ void gfunc_call(int nb_args)
 
     if (vtop->type.ref->f.func_type != FUNC_NEW) /* implies FUNC_OLD or FUNC_ELLIPSIS */
         oad(0xb8, nb_sse_args < 8 ? nb_sse_args : 8); /* mov nb_sse_args, %eax */
+    /* a tail jump cannot pass arguments on the stack */
+    func_tail_call = tail && !args_size && !func_need_fp;
+    func_tail_slot = -1;
     gcall_or_jmp(0);
+    func_tail_end = ind;
     if (args_size)
         gadd_sp(args_size);
+    func_sp_depth -= args_size;
     vtop--;
 }
 
+ST_FUNC void gfunc_tail_call(int nb_args)
+{
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_call(nb_args, 1))
+        return;
+#endif
+    func_tail_call = 1;
+    gfunc_call(nb_args);
+}
+
+/* a 'return' statement: if nothing was emitted since a gfunc_tail_call(),
+   remember the call for gfunc_epilog() */
+ST_FUNC void gfunc_tail_return(void)
+{
+    if (func_tail_slot >= 0 && func_tail_end == ind && !nocode_wanted) {
+        if ((func_nb_tail_sites & 15) == 0)
+            func_tail_sites = tcc_realloc(func_tail_sites,
+                (func_nb_tail_sites + 16) * sizeof (int));
+        func_tail_sites[func_nb_tail_sites++] = func_tail_slot;
+    }
+    func_tail_slot = -1;
+}
+
 #define FUNC_PROLOG_SIZE 11
 
 static void push_arg_reg(int i) {
@@ -1467,12 +2844,28 @@ void gfunc_prolog(Sym *func_sym)
     Sym *sym;
     CType *type;
 
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_prolog(func_sym))
+        return;
+#endif
     sym = func_type->ref;
     addr = PTR_SIZE * 2;
     loc = 0;
     ind += FUNC_PROLOG_SIZE;
     func_sub_sp_offset = ind;
     func_ret_sub = 0;
+    func_leaf = 1;
+    func_need_fp = func_var || tcc_state->do_backtrace;
+    func_uses_fp = 0;
+    func_fixed_entry = func_sym->a.aligned || tcc_state->do_debug;
+    func_nofp = tcc_state->omit_frame_pointer && !func_need_fp
+        && !func_fixed_entry;
+    func_sp_depth = 0;
+    func_nb_local_refs = 0;
+    func_frame_escapes = 0;
+    func_tail_call = 0;
+    func_tail_slot = -1;
+    func_nb_tail_sites = 0;
     ret_mode = classify_x86_64_arg(&func_vt, NULL, &size, &align, &reg_count);
 
     if (func_var) {
@@ -1560,7 +2953,14 @@ void gfunc_prolog(Sym *func_sym)
         case x86_64_mode_sse:
 	    if (tcc_state->nosse)
 	        tcc_error("SSE disabled but floating point arguments used");
-            if (sse_param_index + reg_count <= 8) {
+            if (sse_param_index + reg_count <= 8 && size > reg_count * 8) {
+                /* vector passed whole in one register */
+                loc = (loc - 16) & -16;
+                param_addr = loc;
+                o(0x7f0ff3); /* movdqu */
+                gen_modrm(sse_param_index, VT_LOCAL, NULL, param_addr);
+                ++sse_param_index;
+            } else if (sse_param_index + reg_count <= 8) {
                 /* save arguments passed by register */
                 loc -= reg_count * 8;
                 param_addr = loc;
@@ -1614,27 +3014,103 @@ void gfunc_prolog(Sym *func_sym)
 /* generate function epilog */
 void gfunc_epilog(void)
 {
-    int v, saved_ind;
+    int v, n, i, saved_ind, frame, nofp, sub;
+    unsigned char *p;
 
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        ir_epilog();
+        return;
+    }
+#endif
 #ifdef CONFIG_TCC_BCHECK
     if (tcc_state->do_bounds_check)
         gen_bounds_epilog();
 #endif
-    o(0xc9); /* leave */
-    if (func_ret_sub == 0) {
-        o(0xc3); /* ret */
+    /* align local size to word & save local variables */
+    v = (-loc + 15) & -16;
+    nofp = func_nofp && !func_need_fp;
+    sub = 0;
+    if (func_fixed_entry) {
+        frame = 2;              /* push %rbp; mov %rsp,%rbp; sub $v,%rsp */
+    } else if (func_leaf && !func_need_fp
+               && (nofp ? -loc <= 120 : !func_uses_fp)) {
+        frame = 0, nofp = 1;    /* nothing, locals in the red zone */
+    } else if (nofp) {
+        frame = 0, sub = v + 8; /* sub $v+8,%rsp */
+    } else if (func_leaf && -loc <= 128) {
+        frame = 1;              /* push %rbp; mov %rsp,%rbp (red zone) */
     } else {
-        o(0xc2); /* ret n */
-        g(func_ret_sub);
-        g(func_ret_sub >> 8);
+        frame = 2, sub = v;
+    }
+
+    if (frame == 2) {
+        o(0xc9); /* leave */
+    } else {
+        if (frame == 1)
+            o(0x5d); /* pop %rbp */
+        if (sub)
+            gadd_sp(sub);
     }
-    /* align local size to word & save local variables */
-    v = (-loc + 15) & -16;
+    o(0xc3); /* ret */
+
+    /* rebase frame references on %rsp (%rsp = virtual %rbp + 8 - sub)
+       or restore them to plain %rbp references */
+    for (i = 0; i < func_nb_local_refs; i++) {
+        p = cur_text_section->data + func_local_refs[2 * i];
+        if (nofp)
+            *p = 0x24, add32le(p + 1, sub - 8 + func_local_refs[2 * i + 1]);
+        else
+            *p = 0x25;
+    }
+    tcc_free(func_local_refs);
+    func_local_refs = NULL;
+
+    /* turn the calls of 'return f(...)' into jumps, unless the callee
+       might get hold of our frame */
+    for (i = 0; i < func_nb_tail_sites; i++) {
+        if (func_frame_escapes || func_need_fp || func_leaf)
+            break;
+        p = cur_text_section->data + func_tail_sites[i];
+        if (!nofp) {
+            *p++ = 0xc9; /* leave */
+        } else if (sub != (char)sub) {
+            *p++ = 0x48, *p++ = 0x81, *p++ = 0xc4; /* add $xxx,%rsp */
+            write32le(p, sub), p += 4;
+        } else {
+            *p++ = 0x48, *p++ = 0x83, *p++ = 0xc4; /* add $xx,%rsp */
+            *p++ = sub;
+            *p++ = 0x0f, *p++ = 0x1f, *p++ = 0x00; /* nopl (%rax) */
+        }
+        if (*p == 0xe8)
+            *p = 0xe9; /* call -> jmp */
+        else
+            p[2] = 0xe3; /* call *%r11 -> jmp *%r11 */
+    }
+    tcc_free(func_tail_sites);
+    func_tail_sites = NULL;
+
     saved_ind = ind;
-    ind = func_sub_sp_offset - FUNC_PROLOG_SIZE;
-    o(0xe5894855);  /* push %rbp, mov %rsp, %rbp */
-    o(0xec8148);  /* sub rsp, stacksize */
-    gen_le32(v);
+    ind = func_ind;
+    if (func_fixed_entry) {
+        o(0xe5894855);  /* push %rbp, mov %rsp, %rbp */
+        o(0xec8148);  /* sub rsp, stacksize */
+        gen_le32(v);
+    } else {
+        if (frame)
+            o(0xe5894855);  /* push %rbp, mov %rsp, %rbp */
+        if (sub != (char)sub)
+            oad(0xec8148, sub);  /* sub $xxx, %rsp */
+        else if (sub)
+            o(0xec8348), g(sub); /* sub $xx, %rsp */
+        /* move the prolog up to the body and start the function there,
+           the unused bytes before it are never executed */
+        n = ind - func_ind;
+        p = cur_text_section->data;
+        memmove(p + func_sub_sp_offset - n, p + func_ind, n);
+        memset(p + func_ind, 0x90, FUNC_PROLOG_SIZE - n);
+        func_ind = func_sub_sp_offset - n;
+    }
     ind = saved_ind;
 }
 
@@ -1649,6 +3125,10 @@ ST_FUNC void gen_fill_nops(int bytes)
 /* generate a jump to a label */
 int gjmp(int t)
 {
+#ifdef TCC_TARGET_IR
+    if (ir_active)
+        return ir_jmp(ir_emit(IR_JMP, 0, -1, -1, -1), t);
+#endif
     return gjmp2(0xe9, t);
 }
 
@@ -1656,6 +3136,14 @@ int gjmp(int t)
 void gjmp_addr(int a)
 {
     int r;
+#ifdef TCC_TARGET_IR
+    IRInsn *i;
+    if (ir_active) {
+        i = ir_emit(IR_JMP, 0, -1, -1, -1);
+        i->c = a, i->f = IRF_DONE;
+        return;
+    }
+#endif
     r = a - ind - 2;
     if (r == (char)r) {
         g(0xeb);
@@ -1668,6 +3156,10 @@ void gjmp_addr(int a)
 ST_FUNC int gjmp_append(int n, int t)
 {
     void *p;
+#ifdef TCC_TARGET_IR
+    if (ir_active)
+        return ir_gjmp_append(n, t);
+#endif
     /* insert vtop->c jump list in t */
     if (n) {
         uint32_t n1 = n, n2;
@@ -1681,6 +3173,13 @@ ST_FUNC int gjmp_append(int n, int t)
 
 ST_FUNC int gjmp_cond(int op, int t)
 {
+#ifdef TCC_TARGET_IR
+        if (ir_active) {
+            IRInsn *i = ir_emit(IR_JCC, 0, -1, -1, -1);
+            i->cc = op & 0x100 ? op | vtop->cmp_r << 16 : op;
+            return ir_jmp(i, t);
+        }
+#endif
         if (op & 0x100)
 	  {
 	    /* This was a float compare.  If the parity flag is set
@@ -1705,12 +3204,164 @@ ST_FUNC int gjmp_cond(int op, int t)
         return t;
 }
 
+void vpush_const(int t, int v)
+{
+    CType ctype = { t | VT_CONSTANT, 0 };
+    vpushsym(&ctype, external_global_sym(v, &ctype));
+    vtop->r |= VT_LVAL;
+}
+
+#ifdef TCC_TARGET_IR
+/* gen_opi() */
+static int ir_opi(int op)
+{
+    int r, opc, ll, cc;
+    IRInsn *i;
+
+    switch (op) {
+    case '+': opc = IR_ADD; break;
+    case '-': opc = IR_SUB; break;
+    case '&': opc = IR_AND; break;
+    case '^': opc = IR_XOR; break;
+    case '|': opc = IR_OR; break;
+    case '*': opc = IR_MUL; break;
+    case TOK_SHL: opc = IR_SHL; break;
+    case TOK_SHR: opc = IR_SHR; break;
+    case TOK_SAR: opc = IR_SAR; break;
+    case TOK_UDIV: opc = IR_UDIV; break;
+    case TOK_UMOD: opc = IR_UMOD; break;
+    case '/': case TOK_PDIV: opc = IR_DIV; break;
+    case '%': opc = IR_MOD; break;
+    case TOK_UMULH: opc = IR_UMULH; break;
+    case TOK_SMULH: opc = IR_SMULH; break;
+    case TOK_ADDC1: case TOK_ADDC2: case TOK_SUBC1: case TOK_SUBC2:
+        return ir_give_up();
+    default: opc = IR_CMP; break;
+    }
+    ll = is64_type(vtop[-1].type.t);
+    cc = (vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST;
+    if (cc && (opc <= IR_SAR || opc == IR_CMP)
+        && (!ll || (int)vtop->c.i == vtop->c.i)) {
+        vswap();
+        r = gv(RC_INT);
+        vswap();
+        i = ir_emit(opc, ll ? IRT_I64 : IRT_I32, opc == IR_CMP ? -1 : r, r, -1);
+        i->f = IRF_IMM;
+        i->c = (int)vtop->c.i;
+        if (opc >= IR_SHL && opc <= IR_SAR)
+            i->c &= ll ? 63 : 31;
+    } else {
+        gv2(RC_INT, RC_INT);
+        r = vtop[-1].r;
+        ir_emit(opc, ll ? IRT_I64 : IRT_I32, opc == IR_CMP ? -1 : r, r, vtop->r);
+    }
+    vtop--;
+    if (opc == IR_CMP)
+        vset_VT_CMP(op);
+    return 1;
+}
+
+/* gen_opf() */
+static int ir_opf(int op)
+{
+    int opc, t, a, b, bt = vtop->type.t & VT_BTYPE;
+
+    if (bt == VT_LDOUBLE)
+        return ir_give_up();
+    t = bt == VT_FLOAT ? IRT_F32 : IRT_F64;
+    if (op == TOK_NEG) {
+        gv(RC_FLOAT);
+        vpush_const(bt, bt == VT_FLOAT ? TOK___mzerosf : TOK___mzerodf);
+        gv(RC_FLOAT);
+        ir_emit(IR_FXOR, t, vtop[-1].r, vtop[-1].r, vtop->r);
+        vtop--;
+        return 1;
+    }
+    gv2(RC_FLOAT, RC_FLOAT);
+    a = vtop[-1].r, b = vtop->r;
+    if (op >= TOK_ULT && op <= TOK_GT) {
+        opc = 0;
+        if (op != TOK_EQ && op != TOK_NE) {
+            opc = 1; /* comis: ordered compare */
+            if (op == TOK_LE || op == TOK_LT)
+                a = b, b = vtop[-1].r;
+            op = op == TOK_LE || op == TOK_GE ? 0x93 : 0x97;
+        }
+        ir_emit(IR_FCMP, t, -1, a, b)->cc = opc;
+        vtop--;
+        vset_VT_CMP(op | 0x100);
+        vtop->cmp_r = op;
+        return 1;
+    }
+    switch (op) {
+    case '-': opc = IR_FSUB; break;
+    case '*': opc = IR_FMUL; break;
+    case '/': opc = IR_FDIV; break;
+    default: opc = IR_FADD; break;
+    }
+    ir_emit(opc, t, a, a, b);
+    vtop--;
+    return 1;
+}
+
+/* gen_cvt_itof() */
+static int ir_cvt_itof(int t)
+{
+    int r, st;
+
+    if ((t & VT_BTYPE) == VT_LDOUBLE)
+        return ir_give_up();
+    r = get_reg(RC_FLOAT);
+    gv(RC_INT);
+    st = vtop->type.t;
+    ir_emit(IR_ITOF, (t & VT_BTYPE) == VT_FLOAT ? IRT_F32 : IRT_F64,
+            r, vtop->r, -1)->cc =
+        (st & (VT_BTYPE | VT_UNSIGNED)) == (VT_INT | VT_UNSIGNED)
+        || (st & VT_BTYPE) == VT_LLONG;
+    vtop->r = r;
+    return 1;
+}
+
+/* gen_cvt_ftof() */
+static int ir_cvt_ftof(int t)
+{
+    int bt = vtop->type.t & VT_BTYPE, tbt = t & VT_BTYPE, r;
+
+    if (bt == VT_LDOUBLE || tbt == VT_LDOUBLE)
+        return ir_give_up();
+    r = gv(RC_FLOAT);
+    if (bt != tbt)
+        ir_emit(IR_FTOF, tbt == VT_FLOAT ? IRT_F32 : IRT_F64, r, r, -1)->cc =
+            bt == VT_FLOAT ? IRT_F32 : IRT_F64;
+    return 1;
+}
+
+/* gen_cvt_ftoi() */
+static int ir_cvt_ftoi(int t)
+{
+    int bt = vtop->type.t & VT_BTYPE, r;
+
+    if (bt == VT_LDOUBLE)
+        return ir_give_up();
+    gv(RC_FLOAT);
+    r = get_reg(RC_INT);
+    ir_emit(IR_FTOI, t != VT_INT ? IRT_I64 : IRT_I32, r, vtop->r, -1)->cc =
+        bt == VT_FLOAT ? IRT_F32 : IRT_F64;
+    vtop->r = r;
+    return 1;
+}
+#endif
+
 /* generate an integer binary operation */
 void gen_opi(int op)
 {
     int r, fr, opc, c;
     int ll, uu, cc;
 
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_opi(op))
+        return;
+#endif
     ll = is64_type(vtop[-1].type.t);
     uu = (vtop[-1].type.t & VT_UNSIGNED) != 0;
     cc = (vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST;
@@ -1825,6 +3476,16 @@ void gen_opi(int op)
             r = TREG_RAX;
         vtop->r = r;
         break;
+    case TOK_UMULH:
+    case TOK_SMULH:
+        gv2(RC_RAX, RC_RCX);
+        fr = vtop[0].r;
+        vtop--;
+        save_reg(TREG_RDX);
+        orex(ll, fr, 0, 0xf7); /* mul/imul fr */
+        o((op == TOK_UMULH ? 0xe0 : 0xe8) + REG_VALUE(fr));
+        vtop->r = TREG_RDX;
+        break;
     default:
         opc = 7;
         goto gen_op8;
@@ -1836,13 +3497,6 @@ void gen_opl(int op)
     gen_opi(op);
 }
 
-void vpush_const(int t, int v)
-{
-    CType ctype = { t | VT_CONSTANT, 0 };
-    vpushsym(&ctype, external_global_sym(v, &ctype));
-    vtop->r |= VT_LVAL;
-}
-
 /* generate a floating point operation 'v = t1 op t2' instruction. The
    two operands are guaranteed to have the same floating point type */
 /* XXX: need to use ST1 too */
@@ -1852,6 +3506,10 @@ void gen_opf(int op)
     int bt = vtop->type.t & VT_BTYPE;
     int float_type = bt == VT_LDOUBLE ? RC_ST0 : RC_FLOAT;
 
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_opf(op))
+        return;
+#endif
     if (op == TOK_NEG) { /* unary minus */
         gv(float_type);
         if (float_type == RC_ST0) {
@@ -2065,11 +3723,70 @@ void gen_opf(int op)
     }
 }
 
+/* element-wise operation 'op' on the vectors vtop[-1] and vtop with
+   elements of type 't'.  Returns 0 if SSE2 has no instruction for it,
+   otherwise the result is left in an xmm register. */
+ST_FUNC int gen_opv(int op, int t)
+{
+    int a, b, size, align;
+
+    size = type_size(&vtop->type, &align);
+    if (size < 4 || size > 16 || tcc_state->nosse)
+        return 0;
+    t &= VT_BTYPE;
+    a = 0x66, b = 0;
+    if (t == VT_FLOAT || t == VT_DOUBLE) {
+        if (t == VT_FLOAT)
+            a = 0;
+        switch (op) {
+        case '+': b = 0x58; break; /* addps/pd */
+        case '-': b = 0x5c; break; /* subps/pd */
+        case '*': b = 0x59; break; /* mulps/pd */
+        case '/': /* not in halves, 0/0 in the upper part would trap */
+            if (size == 16)
+                b = 0x5e; /* divps/pd */
+            break;
+        }
+    } else {
+        switch (op) {
+        case '&': b = 0xdb; break; /* pand */
+        case '|': b = 0xeb; break; /* por */
+        case '^': b = 0xef; break; /* pxor */
+        case '+': /* paddb/w/d/q */
+            b = t == VT_BYTE ? 0xfc : t == VT_SHORT ? 0xfd
+              : t == VT_INT ? 0xfe : 0xd4;
+            break;
+        case '-': /* psubb/w/d/q */
+            b = t == VT_BYTE ? 0xf8 : t == VT_SHORT ? 0xf9
+              : t == VT_INT ? 0xfa : 0xfb;
+            break;
+        case '*':
+            if (t == VT_SHORT)
+                b = 0xd5; /* pmullw */
+            break;
+        }
+    }
+    if (!b)
+        return 0;
+    gv2(RC_FLOAT, RC_FLOAT);
+    if (a)
+        o(a);
+    o(0x0f | b << 8);
+    o(0xc0 + REG_VALUE(vtop[0].r) + REG_VALUE(vtop[-1].r) * 8);
+    vtop--;
+    return 1;
+}
+
 /* convert integers to fp 't' type. Must handle 'int', 'unsigned int'
    and 'long long' cases. */
 void gen_cvt_itof(int t)
 {
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_cvt_itof(t))
+        return;
+#endif
     if ((t & VT_BTYPE) == VT_LDOUBLE) {
+        func_leaf = 0; /* pushes the value */
         save_reg(TREG_ST0);
         gv(RC_INT);
         if ((vtop->type.t & VT_BTYPE) == VT_LLONG) {
@@ -2113,10 +3830,16 @@ void gen_cvt_ftof(int t)
 {
     int ft, bt, tbt;
 
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_cvt_ftof(t))
+        return;
+#endif
     ft = vtop->type.t;
     bt = ft & VT_BTYPE;
     tbt = t & VT_BTYPE;
-    
+    if (bt == VT_LDOUBLE || tbt == VT_LDOUBLE)
+        func_leaf = 0; /* scratch below %rsp */
+
     if (bt == VT_FLOAT) {
         gv(RC_FLOAT);
         if (tbt == VT_DOUBLE) {
@@ -2175,6 +3898,11 @@ void gen_cvt_ftof(int t)
 void gen_cvt_ftoi(int t)
 {
     int ft, bt, size, r;
+
+#ifdef TCC_TARGET_IR
+    if (ir_active && ir_cvt_ftoi(t))
+        return;
+#endif
     ft = vtop->type.t;
     bt = ft & VT_BTYPE;
     if (bt == VT_LDOUBLE) {
@@ -2205,6 +3933,12 @@ void gen_cvt_ftoi(int t)
 ST_FUNC void gen_cvt_sxtw(void)
 {
     int r = gv(RC_INT);
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        ir_emit(IR_EXT, IRT_I64, r, r, -1)->cc = IRT_I32;
+        return;
+    }
+#endif
     /* x86_64 specific: movslq */
     o(0x6348);
     o(0xc0 + (REG_VALUE(r) << 3) + REG_VALUE(r));
@@ -2218,6 +3952,13 @@ ST_FUNC void gen_cvt_csti(int t)
     sz = !(t & VT_UNSIGNED);
     xl = (t & VT_BTYPE) == VT_SHORT;
     ll = (vtop->type.t & VT_BTYPE) == VT_LLONG;
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        ir_emit(IR_EXT, ll ? IRT_I64 : IRT_I32, r, r, -1)->cc =
+            xl ? (sz ? IRT_S16 : IRT_U16) : (sz ? IRT_S8 : IRT_U8);
+        return;
+    }
+#endif
     orex(ll, r, 0, 0xc0b60f /* mov[sz] %a[xl], %eax */
         | (sz << 3 | xl) << 8
         | (REG_VALUE(r) << 3 | REG_VALUE(r)) << 16
@@ -2236,18 +3977,24 @@ ST_FUNC void gen_increment_tcov (SValue *sv)
 /* computed goto support */
 ST_FUNC void ggoto(void)
 {
+#ifdef TCC_TARGET_IR
+    if (ir_active)
+        ir_failed = 1;
+#endif
     gcall_or_jmp(1);
     vtop--;
 }
 
 /* Save the stack pointer onto the stack and return the location of its address */
 ST_FUNC void gen_vla_sp_save(int addr) {
+    gen_need_frame();
     /* mov %rsp,addr(%rbp)*/
     gen_modrm64(0x89, TREG_RSP, VT_LOCAL, NULL, addr);
 }
 
 /* Restore the SP from a location on the stack */
 ST_FUNC void gen_vla_sp_restore(int addr) {
+    gen_need_frame();
     gen_modrm64(0x8b, TREG_RSP, VT_LOCAL, NULL, addr);
 }
 
@@ -2263,6 +4010,8 @@ ST_FUNC void gen_vla_result(int addr) {
 ST_FUNC void gen_vla_alloc(CType *type, int align) {
     int use_call = 0;
 
+    gen_need_frame();
+
 #if defined(CONFIG_TCC_BCHECK)
     use_call = tcc_state->do_bounds_check;
 #endif
@@ -2292,9 +4041,165 @@ ST_FUNC void gen_vla_alloc(CType *type, int align) {
  * Assmuing the top part of the stack looks like below,
  *  src dest src
  */
+/* 'b' with %r as reg operand and c(%base) as memory operand,
+   c < 128 */
+static void gen_modrm_base(int ll, int b, int r, int base, int c)
+{
+    orex(ll, base, r, b);
+    g((c ? 0x40 : 0) | REG_VALUE(r) << 3 | REG_VALUE(base));
+    if (c)
+        g(c);
+}
+
+/* size of the next chunk for an inline copy/set of 'size' bytes at
+   offset 'i'. The last chunk may overlap the one before it. */
+static int small_chunk(int size, int i, int sse, int *pi)
+{
+    int n = sse && size >= 16 ? 16 : size >= 8 ? 8
+        : size >= 4 ? 4 : size >= 2 ? 2 : 1;
+    if (i + n > size)
+        i = size - n;
+    *pi = i;
+    return n;
+}
+
+#ifdef TCC_TARGET_IR
+/* gen_struct_copy() ('copy') and gen_memset() up to SMALL_COPY_MAX */
+static void ir_small_mem(int size, int copy)
+{
+    static const unsigned char irt[9] = {
+        0, IRT_U8, IRT_U16, 0, IRT_I32, 0, 0, 0, IRT_I64
+    };
+    int d, s, r, i, j, n;
+    IRInsn *p;
+
+    gv2(RC_INT, RC_INT);
+    d = vtop[-1].r, s = r = vtop->r;
+    for (i = 0; i < size; i = j + n) {
+        n = small_chunk(size, i, 0, &j);
+        if (copy) {
+            r = ir_vreg(0);
+            p = ir_emit(IR_LOAD, irt[n], r, s, -1);
+            p->am = IRA_REG, p->c = j;
+        }
+        p = ir_emit(IR_STORE, irt[n], -1, d, r);
+        p->am = IRA_REG, p->c = j;
+    }
+    vpop();
+    vpop();
+}
+#endif
+
+/* store chunk 'n' of %r (gpr) or %x (xmm) to c(%base) */
+static void gen_small_store(int n, int r, int x, int base, int c)
+{
+    if (n == 16)
+        gen_modrm_base(0, 0x110f, x, base, c); /* movups %x,c(%base) */
+    else if (n == 1)
+        gen_modrm_base(0, 0x88, r, base, c); /* movb */
+    else {
+        if (n == 2)
+            o(0x66);
+        gen_modrm_base(n == 8, 0x89, r, base, c); /* mov */
+    }
+}
+
+/* copy 'size' bytes (<= SMALL_COPY_MAX) with unrolled moves */
+static void gen_small_copy(int size)
+{
+    int d, s, r, x, i, j, n, sse;
+
+    gv2(RC_INT, RC_INT);
+    d = vtop[-1].r, s = vtop[0].r;
+    r = get_reg(RC_INT);
+    sse = !tcc_state->nosse && size >= 16;
+    x = sse ? get_reg(RC_FLOAT) : 0;
+    for (i = 0; i < size; i = j + n) {
+        n = small_chunk(size, i, sse, &j);
+        if (n == 16)
+            gen_modrm_base(0, 0x100f, x, s, j); /* movups j(%s),%x */
+        else if (n == 1)
+            gen_modrm_base(0, 0xb60f, r, s, j); /* movzbl */
+        else {
+            if (n == 2)
+                o(0x66);
+            gen_modrm_base(n == 8, 0x8b, r, s, j); /* mov */
+        }
+        gen_small_store(n, r, x, d, j);
+    }
+    vpop();
+    vpop();
+}
+
+/* vtop[-1]: dest address, vtop: byte value replicated to 64 bits.
+   Store it to 'size' bytes at dest (size <= SMALL_COPY_MAX). */
+ST_FUNC void gen_memset(int size)
+{
+    int d, r, x, i, j, n, sse, zero;
+
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        ir_small_mem(size, 0);
+        return;
+    }
+#endif
+    zero = (vtop->r & (VT_VALMASK | VT_LVAL | VT_SYM)) == VT_CONST
+        && vtop->c.i == 0;
+    sse = !tcc_state->nosse && size >= 16;
+    if (sse && zero) {
+        vswap();
+        d = gv(RC_INT);
+        vswap();
+        r = 0;
+    } else {
+        gv2(RC_INT, RC_INT);
+        d = vtop[-1].r, r = vtop[0].r;
+    }
+    x = 0;
+    if (sse) {
+        x = get_reg(RC_FLOAT);
+        if (zero) {
+            o(0x66);
+            orex(0, x, x, 0xef0f); /* pxor %x,%x */
+            o(0xc0 | REG_VALUE(x) << 3 | REG_VALUE(x));
+        } else {
+            o(0x66);
+            orex(1, r, x, 0x6e0f); /* movq %r,%x */
+            o(0xc0 | REG_VALUE(x) << 3 | REG_VALUE(r));
+            o(0x66);
+            orex(0, x, x, 0x6c0f); /* punpcklqdq %x,%x */
+            o(0xc0 | REG_VALUE(x) << 3 | REG_VALUE(x));
+        }
+    }
+    for (i = 0; i < size; i = j + n) {
+        n = small_chunk(size, i, sse, &j);
+        gen_small_store(n, r, x, d, j);
+    }
+    vpop();
+    vpop();
+}
+
 ST_FUNC void gen_struct_copy(int size)
 {
     int n = size / PTR_SIZE;
+#ifdef TCC_TARGET_IR
+    if (ir_active) {
+        if (size <= SMALL_COPY_MAX) {
+            ir_small_mem(size, 1);
+        } else {
+            /* no %rsi/%rdi for 'rep movsq' in the IR */
+            vpush_helper_func(TOK_memmove);
+            vrott(3);
+            vpushi(size);
+            gfunc_call(3);
+        }
+        return;
+    }
+#endif
+    if (size <= SMALL_COPY_MAX) {
+        gen_small_copy(size);
+        return;
+    }
 #ifdef TCC_TARGET_PE
     o(0x5756); /* push rsi, rdi */
 #endif
@@ -2321,6 +4226,260 @@ ST_FUNC void gen_struct_copy(int size)
     vpop();
 }
 
+/* 'size' bytes form of instruction 'op' (the opcode of the byte form,
+   op + 1 being the wider one) with register 'r' and memory at '(b)' */
+static void gen_atomic_insn(int op, int size, int r, int b)
+{
+    if (size == 2)
+        g(0x66);
+    orex(size == 8, b, r, 0);
+    if (op > 0xff)
+        g(op >> 8);
+    g(op + (size != 1));
+    g(REG_VALUE(r) << 3 | REG_VALUE(b));
+}
+
+/* register to register operation 'op' (89 mov, 01 add, 21 and ...) */
+static void gen_atomic_opr(int op, int ll, int r, int d)
+{
+    orex(ll, d, r, op);
+    o(0xc0 + REG_VALUE(d) + REG_VALUE(r) * 8);
+}
+
+/* inline expansion of __atomic_xxx().  The value stack holds the
+   pointer to the atomic object and the other arguments of the builtin
+   without the memory orders.  Returns the register with the result.
+   Locked instructions are full barriers, so 'memorder' only matters
+   for stores. */
+ST_FUNC int gen_atomic(int atok, int size, int memorder)
+{
+    int ll = size == 8, r = TREG_RCX, op = 0, t;
+
+    switch (atok) {
+    case TOK___atomic_load:
+        r = gv(RC_INT);
+        gen_atomic_insn(0x8a, size, r, r); /* mov (r),r */
+        vpop();
+        break;
+    case TOK___atomic_compare_exchange:
+        /* rax: expected value, r11: its address, rcx: desired */
+        vswap();
+        gv(RC_RAX);
+        vrott(3);
+        gv2(RC_RDX, RC_RCX);
+        vrotb(3); /* again if a bounds check call spilled it */
+        gv(RC_RAX);
+        vrott(3);
+        gen_atomic_opr(0x89, 1, TREG_RAX, TREG_R11);
+        gen_atomic_insn(0x8a, size, TREG_RAX, TREG_R11);
+        g(0xf0);
+        gen_atomic_insn(0x0fb0, size, TREG_RCX, TREG_RDX); /* lock cmpxchg */
+        g(0x74); /* je, else store the current value */
+        g(3 + (size == 2));
+        gen_atomic_insn(0x88, size, TREG_RAX, TREG_R11);
+        o(0xc0940f); /* sete %al */
+        o(0xc0b60f); /* movzbl %al,%eax */
+        vtop -= 3;
+        return TREG_RAX;
+    default:
+        gv2(RC_RDX, RC_RCX);
+        vtop -= 2;
+        switch (atok) {
+        case TOK___atomic_store:
+            if (memorder == 5)
+                gen_atomic_insn(0x86, size, r, TREG_RDX); /* xchg */
+            else
+                gen_atomic_insn(0x88, size, r, TREG_RDX); /* mov */
+            return VT_CONST;
+        case TOK___atomic_exchange:
+            gen_atomic_insn(0x86, size, r, TREG_RDX);
+            break;
+        case TOK___atomic_fetch_sub:
+        case TOK___atomic_sub_fetch:
+            orex(ll, r, 0, 0xf7); /* neg */
+            o(0xd8 + REG_VALUE(r));
+            /* fall through */
+        case TOK___atomic_fetch_add:
+        case TOK___atomic_add_fetch:
+            t = atok == TOK___atomic_add_fetch || atok == TOK___atomic_sub_fetch;
+            get_reg(RC_RAX);
+            if (t)
+                gen_atomic_opr(0x89, ll, r, TREG_RAX);
+            g(0xf0);
+            gen_atomic_insn(0x0fc0, size, r, TREG_RDX); /* lock xadd */
+            if (t)
+                gen_atomic_opr(0x01, ll, TREG_RAX, r);
+            break;
+        default:
+            /* cmpxchg loop for the other operations */
+            switch (atok) {
+            case TOK___atomic_fetch_or:
+            case TOK___atomic_or_fetch:
+                op = 0x09;
+                break;
+            case TOK___atomic_fetch_xor:
+            case TOK___atomic_xor_fetch:
+                op = 0x31;
+                break;
+            default:
+                op = 0x21;
+                break;
+            }
+            get_reg(RC_RAX);
+            gen_atomic_insn(0x8a, size, TREG_RAX, TREG_RDX);
+            t = ind;
+            gen_atomic_opr(0x89, ll, TREG_RAX, TREG_R11);
+            gen_atomic_opr(op, ll, r, TREG_R11);
+            if (atok == TOK___atomic_fetch_nand
+                || atok == TOK___atomic_nand_fetch) {
+                orex(ll, TREG_R11, 0, 0xf7); /* not */
+                o(0xd0 + REG_VALUE(TREG_R11));
+            }
+            g(0xf0);
+            gen_atomic_insn(0x0fb0, size, TREG_R11, TREG_RDX);
+            g(0x75); /* jne */
+            g(t - ind - 1);
+            if (atok >= TOK___atomic_add_fetch)
+                gen_atomic_opr(0x89, ll, TREG_R11, r);
+            else
+                r = TREG_RAX;
+            break;
+        }
+        break;
+    }
+    if (size < 4) {
+        o(0xb60f + ((size == 2) << 8)); /* movz[bw]l r,r */
+        g(0xc0 + REG_VALUE(r) * 9);
+    }
+    return r;
+}
+
+/* 'op' r2,r where 'op' is a two byte opcode (0f xx), optionally
+   preceded by 'pfx' */
+static void gen_bitop_rr(int pfx, int op, int ll, int r, int r2)
+{
+    if (pfx)
+        g(pfx);
+    orex(ll, r2, r, op);
+    o(0xc0 + REG_VALUE(r) * 8 + REG_VALUE(r2));
+}
+
+/* 'op' $imm,r with 'op' c1 or 83 and 'ext' the /digit */
+static void gen_bitop_ri(int op, int ext, int ll, int r, int imm)
+{
+    orex(ll, r, 0, op);
+    o(0xc0 + ext * 8 + REG_VALUE(r));
+    g(imm);
+}
+
+/* inline expansion of __builtin_'op'() with 'op' the int form or
+   TOK_builtin_bswap16, the operand of 'size' bytes being on vtop.
+   Returns the register with the result. */
+ST_FUNC int gen_bitop(int op, int size)
+{
+    int ll = size == 8, bits = size * 8, r, t = 0;
+
+    r = gv(RC_INT);
+    if (op == TOK_builtin_ffs || op == TOK_builtin_clrsb)
+        t = get_reg(RC_INT);
+    vpop();
+    switch (op) {
+    case TOK_builtin_bswap16:
+        orex(ll, r, 0, 0x0f); /* bswap */
+        o(0xc8 + REG_VALUE(r));
+        if (size == 2)
+            gen_bitop_ri(0xc1, 5, 0, r, 16); /* shr $16 */
+        break;
+    case TOK_builtin_popcount:
+    case TOK_builtin_parity:
+        gen_bitop_rr(0xf3, 0xb80f, ll, r, r); /* popcnt */
+        if (op == TOK_builtin_parity)
+            gen_bitop_ri(0x83, 4, 0, r, 1); /* and $1 */
+        break;
+    case TOK_builtin_ctz:
+        /* tzcnt is bsf with a prefix that older cpus ignore */
+        gen_bitop_rr(tcc_state->mbmi ? 0xf3 : 0, 0xbc0f, ll, r, r);
+        break;
+    case TOK_builtin_ffs:
+        gen_bitop_rr(0, 0xbc0f, ll, r, r); /* bsf */
+        orex(0, t, 0, 0xb8 + REG_VALUE(t)); /* mov $-1,t */
+        gen_le32(-1);
+        gen_bitop_rr(0, 0x440f, 0, r, t); /* cmovz t,r */
+        gen_bitop_ri(0x83, 0, 0, r, 1); /* add $1 */
+        break;
+    case TOK_builtin_clrsb:
+        /* 'bits' - 1 - bsr((x ^ x >> 'bits' - 1) << 1 | 1) */
+        gen_atomic_opr(0x89, ll, r, t); /* mov r,t */
+        gen_bitop_ri(0xc1, 7, ll, t, bits - 1); /* sar */
+        gen_atomic_opr(0x31, ll, t, r); /* xor t,r */
+        gen_bitop_ri(0xc1, 4, ll, r, 1); /* shl $1 */
+        gen_bitop_ri(0x83, 1, ll, r, 1); /* or $1 */
+        goto bsr;
+    default: /* clz */
+        if (tcc_state->mlzcnt) {
+            gen_bitop_rr(0xf3, 0xbd0f, ll, r, r); /* lzcnt */
+            break;
+        }
+    bsr:
+        gen_bitop_rr(0, 0xbd0f, ll, r, r); /* bsr */
+        gen_bitop_ri(0x83, 6, 0, r, bits - 1); /* xor */
+        break;
+    }
+    return r;
+}
+
+/* prefetch the address on vtop into the cache levels for 'locality'
+   (0: prefetchnta ... 3: prefetcht0) */
+ST_FUNC void gen_prefetch(int locality)
+{
+    int r = gv(RC_INT);
+    orex(0, r, 0, 0x180f);
+    gen_modrm((4 - locality) & 3, r, NULL, 0);
+    vpop();
+}
+
+#ifdef TCC_TARGET_TLS
+/* replace the thread-local variable on vtop by its address in a
+   register.  The TLS_GD sequence is the one the linker relaxes. */
+ST_FUNC void gen_tls_addr(int model)
+{
+    Sym *sym = vtop->sym;
+    int r;
+
+    if (model == TLS_GD) {
+        save_regs(0);
+        func_leaf = 0;
+        o(0x3d8d4866); /* data16 lea x@tlsgd(%rip),%rdi */
+        greloca(cur_text_section, sym, ind, R_X86_64_TLSGD, -4);
+        gen_le32(0);
+        o(0xe8486666); /* data16 data16 rex64 call __tls_get_addr@plt */
+        greloca(cur_text_section, external_helper_sym(TOK___tls_get_addr),
+                ind, R_X86_64_PLT32, -4);
+        gen_le32(0);
+        r = TREG_RAX;
+    } else {
+        r = get_reg(RC_INT);
+        if (model == TLS_IE) {
+            orex(1, 0, r, 0x8b); /* mov x@gottpoff(%rip),%r */
+            o(0x05 + REG_VALUE(r) * 8);
+            greloca(cur_text_section, sym, ind, R_X86_64_GOTTPOFF, -4);
+            gen_le32(0);
+        }
+        g(0x64); /* mov/add %fs:0,%r */
+        orex(1, 0, r, model == TLS_IE ? 0x03 : 0x8b);
+        o(0x2504 + REG_VALUE(r) * 8);
+        gen_le32(0);
+        if (model == TLS_LE) {
+            orex(1, r, 0, 0x81); /* add $x@tpoff,%r */
+            o(0xc0 + REG_VALUE(r));
+            greloca(cur_text_section, sym, ind, R_X86_64_TPOFF32, 0);
+            gen_le32(0);
+        }
+    }
+    vtop->r = r;
+}
+#endif
+
 /* end of x86-64 code generator */
 /*************************************************************/
 #endif /* ! TARGET_DEFS_ONLY */
@@ -12,6 +12,17 @@
 
 #define R_NUM       R_X86_64_NUM
 
+#if !defined TCC_TARGET_PE && !defined TCC_TARGET_MACHO
+/* dynamic relocations of TLS GOT entries */
+#define R_TPOFF     R_X86_64_TPOFF64
+#define R_DTPMOD    R_X86_64_DTPMOD64
+#define R_DTPOFF    R_X86_64_DTPOFF64
+/* TLS accesses of executables are relaxed to initial or local exec */
+#define TLS_RELAX
+/* GOT accesses to symbols which bind locally are relaxed to direct ones */
+#define GOT_RELAX
+#endif
+
 #define ELF_START_ADDR 0x400000
 #define ELF_PAGE_SIZE  0x200000
 
@@ -84,7 +95,16 @@ int gotplt_entry_type (int reloc_type)
             return AUTO_GOTPLT_ENTRY;
 
         case R_X86_64_GOTTPOFF:
-            return BUILD_GOT_ONLY;
+            return TLS_IE_ENTRY;
+        case R_X86_64_TLSGD:
+            return TLS_GD_ENTRY;
+        case R_X86_64_TLSLD:
+            return TLS_LD_ENTRY;
+        case R_X86_64_DTPOFF32:
+        case R_X86_64_TPOFF32:
+        case R_X86_64_DTPOFF64:
+        case R_X86_64_TPOFF64:
+            return NO_GOTPLT_ENTRY;
 
         case R_X86_64_GOT32:
         case R_X86_64_GOT64:
@@ -93,12 +113,6 @@ int gotplt_entry_type (int reloc_type)
         case R_X86_64_GOTOFF64:
         case R_X86_64_GOTPCREL:
         case R_X86_64_GOTPCRELX:
-        case R_X86_64_TLSGD:
-        case R_X86_64_TLSLD:
-        case R_X86_64_DTPOFF32:
-        case R_X86_64_TPOFF32:
-        case R_X86_64_DTPOFF64:
-        case R_X86_64_TPOFF64:
         case R_X86_64_REX_GOTPCRELX:
         case R_X86_64_PLT32:
         case R_X86_64_PLTOFF64:
@@ -183,11 +197,66 @@ ST_FUNC void relocate_plt(TCCState *s1)
         }
     }
 }
+
+#ifdef GOT_RELAX
+/* Rewrite the instruction of the GOTPCRELX relocation 'rel' of section
+   's' to use the address of its symbol instead of its GOT entry:
+       mov foo@GOTPCREL(%rip),%r  ->  lea foo(%rip),%r
+       call *foo@GOTPCREL(%rip)   ->  addr32 call foo
+       jmp *foo@GOTPCREL(%rip)    ->  jmp foo; nop
+   and turn the relocation into a R_X86_64_PC32.  Returns 0 for other
+   instructions. */
+ST_FUNC int relax_got_reloc(TCCState *s1, Section *s, ElfW_Rel *rel)
+{
+    int type = ELFW(R_TYPE)(rel->r_info);
+    addr_t offset = rel->r_offset;
+    unsigned char *p = s->data + offset;
+
+    if (offset < 2 || offset + 4 > s->data_offset || s->sh_type == SHT_NOBITS)
+        return 0;
+    if (p[-2] == 0x8b && (p[-1] & 0xc7) == 0x05) {
+        if (type == R_X86_64_REX_GOTPCRELX
+            && (offset < 3 || (p[-3] & 0xf0) != 0x40))
+            return 0;
+        p[-2] = 0x8d;
+    } else if (type == R_X86_64_GOTPCRELX && p[-2] == 0xff && p[-1] == 0x15) {
+        p[-2] = 0x67, p[-1] = 0xe8;
+    } else if (type == R_X86_64_GOTPCRELX && p[-2] == 0xff && p[-1] == 0x25) {
+        unsigned disp = read32le(p);
+        p[-2] = 0xe9, write32le(p - 1, disp), p[3] = 0x90;
+        rel->r_offset = --offset;
+    } else {
+        return 0;
+    }
+    rel->r_info = ELFW(R_INFO)(ELFW(R_SYM)(rel->r_info), R_X86_64_PC32);
+    return 1;
+}
+#endif
 #endif
 #endif
 
+#ifdef R_TPOFF
+/* offset of 'val' from the thread pointer, which points to the end of
+   the TLS block of the executable */
+static addr_t tls_tpoff(TCCState *s1, addr_t val)
+{
+    addr_t size, start = get_tls_block(s1, &size, NULL);
+    return val - start - size;
+}
+
+/* offset of 'val' in the TLS block of its module */
+static addr_t tls_dtpoff(TCCState *s1, addr_t val)
+{
+    addr_t size;
+    return val - get_tls_block(s1, &size, NULL);
+}
+#endif
+
 void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr, addr_t addr, addr_t val)
 {
+#ifdef R_TPOFF
+    ElfW(Sym) *sym;
+#endif
     int sym_index, esym_index;
 
     sym_index = ELFW(R_SYM)(rel->r_info);
@@ -296,9 +365,6 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr, addr_t
         case R_X86_64_GOTPC64:
             add64le(ptr, s1->got->sh_addr - addr + rel->r_addend);
             break;
-        case R_X86_64_GOTTPOFF:
-            add32le(ptr, val - s1->got->sh_addr);
-            break;
         case R_X86_64_GOT32:
             /* we load the got offset */
             add32le(ptr, get_sym_attr(s1, sym_index, 0)->got_offset);
@@ -310,8 +376,32 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr, addr_t
         case R_X86_64_GOTOFF64:
             add64le(ptr, val - s1->got->sh_addr);
             break;
+#ifdef R_TPOFF
+        case R_X86_64_GOTTPOFF:
+            sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
+            if ((s1->output_type & TCC_OUTPUT_EXE)
+                && sym->st_shndx != SHN_UNDEF) {
+                /* initial-exec to local-exec:
+                   mov/add x@gottpoff(%rip),%r -> mov/add $x@tpoff,%r */
+                if ((ptr[-3] & 0xfb) == 0x48
+                    && (ptr[-2] == 0x8b || ptr[-2] == 0x03)
+                    && (ptr[-1] & 0xc7) == 0x05) {
+                    ptr[-3] = 0x48 | ((ptr[-3] >> 2) & 1);
+                    ptr[-2] = ptr[-2] == 0x8b ? 0xc7 : 0x81;
+                    ptr[-1] = 0xc0 | ((ptr[-1] >> 3) & 7);
+                    write32le(ptr, tls_tpoff(s1, sym->st_value));
+                }
+                else
+                    tcc_error_noabort("unexpected R_X86_64_GOTTPOFF pattern");
+                break;
+            }
+            add32le(ptr, tls_got_entry(s1, TLS_IE_ENTRY, sym_index,
+                                       tls_tpoff(s1, sym->st_value))
+                         + rel->r_addend - addr);
+            break;
         case R_X86_64_TLSGD:
-            {
+            sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
+            if (s1->output_type & TCC_OUTPUT_EXE) {
                 static const unsigned char expect[] = {
                     /* .byte 0x66; lea 0(%rip),%rdi */
                     0x66, 0x48, 0x8d, 0x3d, 0x00, 0x00, 0x00, 0x00,
@@ -320,27 +410,32 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr, addr_t
                 static const unsigned char replace[] = {
                     /* mov %fs:0,%rax */
                     0x64, 0x48, 0x8b, 0x04, 0x25, 0x00, 0x00, 0x00, 0x00,
-                    /* lea -4(%rax),%rax */
+                    /* lea 0(%rax),%rax */
                     0x48, 0x8d, 0x80, 0x00, 0x00, 0x00, 0x00 };
 
                 if (memcmp (ptr-4, expect, sizeof(expect)) == 0) {
-                    ElfW(Sym) *sym;
-                    Section *sec;
-                    int32_t x;
-
                     memcpy(ptr-4, replace, sizeof(replace));
                     rel[1].r_info = ELFW(R_INFO)(0, R_X86_64_NONE);
-                    sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
-                    sec = s1->sections[sym->st_shndx];
-                    x = sym->st_value - sec->sh_addr - sec->data_offset;
-                    add32le(ptr + 8, x);
+                    if (sym->st_shndx != SHN_UNDEF) {
+                        /* general-dynamic to local-exec */
+                        write32le(ptr + 8, tls_tpoff(s1, sym->st_value));
+                    } else {
+                        /* to initial-exec: add x@gottpoff(%rip),%rax */
+                        ptr[6] = 0x03, ptr[7] = 0x05;
+                        write32le(ptr + 8, tls_got_entry(s1, TLS_GD_ENTRY,
+                            sym_index, 0) - (addr + 12));
+                    }
                 }
                 else
                     tcc_error_noabort("unexpected R_X86_64_TLSGD pattern");
+                break;
             }
+            add32le(ptr, tls_got_entry(s1, TLS_GD_ENTRY, sym_index,
+                                       tls_dtpoff(s1, sym->st_value))
+                         + rel->r_addend - addr);
             break;
         case R_X86_64_TLSLD:
-            {
+            if (s1->output_type & TCC_OUTPUT_EXE) {
                 static const unsigned char expect[] = {
                     /* lea 0(%rip),%rdi */
                     0x48, 0x8d, 0x3d, 0x00, 0x00, 0x00, 0x00,
@@ -357,34 +452,27 @@ void relocate(TCCState *s1, ElfW_Rel *rel, int type, unsigned char *ptr, addr_t
                 }
                 else
                     tcc_error_noabort("unexpected R_X86_64_TLSLD pattern");
+                break;
             }
+            add32le(ptr, tls_got_entry(s1, TLS_LD_ENTRY, sym_index, 0)
+                         + rel->r_addend - addr);
             break;
         case R_X86_64_DTPOFF32:
-        case R_X86_64_TPOFF32:
-            {
-                ElfW(Sym) *sym;
-                Section *sec;
-                int32_t x;
-
-                sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
-                sec = s1->sections[sym->st_shndx];
-                x = val - sec->sh_addr - sec->data_offset;
-                add32le(ptr, x);
+            /* local-dynamic is relaxed to local-exec in executables */
+            if (!(s1->output_type & TCC_OUTPUT_EXE)) {
+                add32le(ptr, tls_dtpoff(s1, val));
+                break;
             }
+        case R_X86_64_TPOFF32:
+            add32le(ptr, tls_tpoff(s1, val));
             break;
         case R_X86_64_DTPOFF64:
+            add64le(ptr, tls_dtpoff(s1, val));
+            break;
         case R_X86_64_TPOFF64:
-            {
-                ElfW(Sym) *sym;
-                Section *sec;
-                int32_t x;
-
-                sym = &((ElfW(Sym) *)symtab_section->data)[sym_index];
-                sec = s1->sections[sym->st_shndx];
-                x = val - sec->sh_addr - sec->data_offset;
-                add64le(ptr, x);
-            }
+            add64le(ptr, tls_tpoff(s1, val));
             break;
+#endif
         case R_X86_64_NONE:
             break;
         case R_X86_64_RELATIVE: